@@ -0,0 +1,407 @@
+#include "AsyncFileIo.h"
+
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define MMP_HAS_IO_URING 1
+#endif
+#endif
+
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+constexpr uint32_t kIoRingEntries = 64;
+
+class AsyncFileIo::Request
+{
+public:
+    using ptr = std::shared_ptr<Request>;
+public:
+    bool         write = false;
+    int          fd = -1;
+    uint8_t*     data = nullptr;
+    size_t       bytes = 0;
+    uint64_t     offset = 0;
+    size_t       doneBytes = 0;
+    struct iovec iov = {};
+    Callback     done;
+};
+
+#ifdef MMP_HAS_IO_URING
+
+/**
+ * @brief 不依赖 liburing, 直接使用系统调用
+ * @note  user_data 为 new 出的 Request::ptr, 0 表示退出
+ */
+class AsyncFileIo::Ring
+{
+public:
+    static std::unique_ptr<Ring> Create(AsyncFileIo* io);
+    ~Ring();
+public:
+    void Submit(Request::ptr request);
+private:
+    Ring() = default;
+    void Enqueue(uint8_t opcode, int fd, const struct iovec* iov, uint64_t offset, uint64_t userData);
+    void ReapLoop();
+private:
+    AsyncFileIo*         _io = nullptr;
+    int                  _fd = -1;
+    void*                _sq = MAP_FAILED;
+    size_t               _sqSize = 0;
+    void*                _cq = MAP_FAILED;
+    size_t               _cqSize = 0;
+    struct io_uring_sqe* _sqes = (struct io_uring_sqe*)MAP_FAILED;
+    size_t               _sqesSize = 0;
+    uint32_t*            _sqTail = nullptr;
+    uint32_t             _sqMask = 0;
+    uint32_t*            _sqArray = nullptr;
+    uint32_t*            _cqHead = nullptr;
+    uint32_t*            _cqTail = nullptr;
+    uint32_t             _cqMask = 0;
+    struct io_uring_cqe* _cqes = nullptr;
+    uint32_t             _entries = 0;
+private:
+    std::mutex              _mtx;
+    std::condition_variable _cond;
+    uint32_t                _inflightNum = 0;
+    std::thread             _reaper;
+};
+
+std::unique_ptr<AsyncFileIo::Ring> AsyncFileIo::Ring::Create(AsyncFileIo* io)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, kIoRingEntries, &params);
+    if (fd < 0)
+    {
+        UTILITY_LOG_INFO << "io_uring unavailable (" << strerror(errno) << "), fallback to thread";
+        return nullptr;
+    }
+    std::unique_ptr<Ring> ring(new Ring());
+    ring->_io = io;
+    ring->_fd = fd;
+    ring->_entries = params.sq_entries;
+    ring->_sqSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->_sqSize = ring->_cqSize = std::max(ring->_sqSize, ring->_cqSize);
+    }
+    ring->_sq = mmap(nullptr, ring->_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->_sq == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->_cq = ring->_sq;
+    }
+    else
+    {
+        ring->_cq = mmap(nullptr, ring->_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->_cq == MAP_FAILED)
+        {
+            return nullptr;
+        }
+    }
+    ring->_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->_sqes = (struct io_uring_sqe*)mmap(nullptr, ring->_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->_sqes == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    uint8_t* sq = (uint8_t*)ring->_sq;
+    uint8_t* cq = (uint8_t*)ring->_cq;
+    ring->_sqTail = (uint32_t*)(sq + params.sq_off.tail);
+    ring->_sqMask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+    ring->_sqArray = (uint32_t*)(sq + params.sq_off.array);
+    ring->_cqHead = (uint32_t*)(cq + params.cq_off.head);
+    ring->_cqTail = (uint32_t*)(cq + params.cq_off.tail);
+    ring->_cqMask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+    ring->_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    Ring* raw = ring.get();
+    ring->_reaper = std::thread([raw]()
+    {
+        raw->ReapLoop();
+    });
+    return ring;
+}
+
+AsyncFileIo::Ring::~Ring()
+{
+    if (_reaper.joinable())
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cond.wait(lock, [this]()
+            {
+                return _inflightNum == 0;
+            });
+        }
+        // Hint : 以 user_data 为 0 的 NOP 通知收割线程退出
+        Enqueue(IORING_OP_NOP, -1, nullptr, 0, 0);
+        _reaper.join();
+    }
+    if (_sqes != MAP_FAILED)
+    {
+        munmap(_sqes, _sqesSize);
+    }
+    if (_cq != MAP_FAILED && _cq != _sq)
+    {
+        munmap(_cq, _cqSize);
+    }
+    if (_sq != MAP_FAILED)
+    {
+        munmap(_sq, _sqSize);
+    }
+    if (_fd >= 0)
+    {
+        close(_fd);
+    }
+}
+
+void AsyncFileIo::Ring::Submit(Request::ptr request)
+{
+    request->iov.iov_base = request->data;
+    request->iov.iov_len = request->bytes;
+    Enqueue(request->write ? IORING_OP_WRITEV : IORING_OP_READV, request->fd, &request->iov,
+            request->offset, (uint64_t)(uintptr_t)new Request::ptr(request));
+}
+
+void AsyncFileIo::Ring::Enqueue(uint8_t opcode, int fd, const struct iovec* iov, uint64_t offset, uint64_t userData)
+{
+    std::unique_lock<std::mutex> lock(_mtx);
+    // Hint : CQ 容量为 SQ 的两倍, 在途请求不超过 SQ 容量即不会溢出
+    _cond.wait(lock, [this]()
+    {
+        return _inflightNum < _entries;
+    });
+    uint32_t tail = *_sqTail;
+    uint32_t index = tail & _sqMask;
+    struct io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = iov ? 1 : 0;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    _sqArray[index] = index;
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+    _inflightNum++;
+    syscall(__NR_io_uring_enter, _fd, 1, 0, 0, nullptr, 0);
+}
+
+void AsyncFileIo::Ring::ReapLoop()
+{
+    bool running = true;
+    while (running)
+    {
+        if (syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+        {
+            UTILITY_LOG_ERROR << "io_uring_enter fail, error is: " << strerror(errno);
+            break;
+        }
+        uint32_t head = *_cqHead;
+        uint32_t tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe* cqe = &_cqes[head & _cqMask];
+            uint64_t userData = cqe->user_data;
+            int64_t result = cqe->res;
+            __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _inflightNum--;
+                _cond.notify_all();
+            }
+            if (userData == 0)
+            {
+                running = false;
+                continue;
+            }
+            Request::ptr* holder = (Request::ptr*)(uintptr_t)userData;
+            Request::ptr request = *holder;
+            delete holder;
+            _io->Complete(request, result);
+        }
+    }
+}
+
+#else
+
+class AsyncFileIo::Ring
+{
+public:
+    static std::unique_ptr<Ring> Create(AsyncFileIo* /* io */) { return nullptr; }
+    void Submit(Request::ptr /* request */) {}
+};
+
+#endif /* MMP_HAS_IO_URING */
+
+AsyncFileIo* AsyncFileIo::Instance()
+{
+    static AsyncFileIo gInstance;
+    return &gInstance;
+}
+
+AsyncFileIo::AsyncFileIo(uint32_t threadNum)
+{
+    _running = true;
+    _readNum = 0;
+    _writeNum = 0;
+    _readBytes = 0;
+    _writeBytes = 0;
+    _failNum = 0;
+    _ring = Ring::Create(this);
+    if (_ring)
+    {
+        return;
+    }
+    threadNum = threadNum == 0 ? 1 : threadNum;
+    for (uint32_t i=0; i<threadNum; i++)
+    {
+        _threads.emplace_back([this]()
+        {
+            ThreadLoop();
+        });
+    }
+}
+
+AsyncFileIo::~AsyncFileIo()
+{
+    _ring.reset();
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _running = false;
+        _cond.notify_all();
+    }
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+void AsyncFileIo::Read(int fd, void* data, size_t bytes, uint64_t offset, const Callback& done)
+{
+    Request::ptr request = std::make_shared<Request>();
+    request->fd = fd;
+    request->data = (uint8_t*)data;
+    request->bytes = bytes;
+    request->offset = offset;
+    request->done = done;
+    _readNum++;
+    Submit(request);
+}
+
+void AsyncFileIo::Write(int fd, const void* data, size_t bytes, uint64_t offset, const Callback& done)
+{
+    Request::ptr request = std::make_shared<Request>();
+    request->write = true;
+    request->fd = fd;
+    request->data = (uint8_t*)data;
+    request->bytes = bytes;
+    request->offset = offset;
+    request->done = done;
+    _writeNum++;
+    Submit(request);
+}
+
+std::string AsyncFileIo::Backend()
+{
+    return _ring ? "io_uring" : "thread";
+}
+
+void AsyncFileIo::Submit(Request::ptr request)
+{
+    if (_ring)
+    {
+        _ring->Submit(request);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mtx);
+    _requests.push_back(request);
+    _cond.notify_one();
+}
+
+void AsyncFileIo::Complete(Request::ptr request, int64_t result)
+{
+    if (result < 0)
+    {
+        _failNum++;
+        request->done(result);
+        return;
+    }
+    request->doneBytes += (size_t)result;
+    if (!request->write)
+    {
+        _readBytes += (uint64_t)result;
+        request->done((int64_t)request->doneBytes);
+        return;
+    }
+    _writeBytes += (uint64_t)result;
+    // Hint : 短写很少见 (如磁盘将满), 直接在 I/O 线程上补齐, 避免收割线程等待 ring 空位
+    while (result > 0 && request->doneBytes < request->bytes)
+    {
+        result = pwrite(request->fd, request->data + request->doneBytes, request->bytes - request->doneBytes,
+                        (off_t)(request->offset + request->doneBytes));
+        if (result > 0)
+        {
+            request->doneBytes += (size_t)result;
+            _writeBytes += (uint64_t)result;
+        }
+    }
+    if (result < 0)
+    {
+        _failNum++;
+        request->done(-errno);
+        return;
+    }
+    request->done((int64_t)request->doneBytes);
+}
+
+void AsyncFileIo::ThreadLoop()
+{
+    while (true)
+    {
+        Request::ptr request;
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cond.wait(lock, [this]()
+            {
+                return !_requests.empty() || !_running;
+            });
+            if (_requests.empty())
+            {
+                break;
+            }
+            request = _requests.front();
+            _requests.pop_front();
+        }
+        ssize_t result = request->write ? pwrite(request->fd, request->data, request->bytes, (off_t)request->offset)
+                                        : pread(request->fd, request->data, request->bytes, (off_t)request->offset);
+        Complete(request, result < 0 ? -errno : (int64_t)result);
+    }
+}
+
+std::string AsyncFileIo::Report()
+{
+    std::stringstream ss;
+    ss << "AsyncFileIo backend : " << Backend() << ", read : " << _readNum << " (" << _readBytes / 1024 << " KB)"
+       << ", write : " << _writeNum << " (" << _writeBytes / 1024 << " KB), fail : " << _failNum;
+    return ss.str();
+}
+
+} // namespace Mmp
@@ -0,0 +1,80 @@
+//
+// AsyncFileIo.h
+//
+// Library: Common
+// Package: Utility
+// Module:  AsyncFileIo
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace Mmp
+{
+
+/**
+ * @brief  文件异步读写, 少量 I/O 线程服务所有码流的读取与写入
+ * @note   1 - 优先使用 io_uring (单个 ring + 一个收割线程), 内核不支持时回退为线程池 pread/pwrite;
+ *             常规文件总是 "可读可写", epoll 对其没有意义, 故不使用 epoll
+ *         2 - 完成回调在 I/O 线程上执行, 应尽快返回; 需要继续处理时投递到 WorkStealingExecutor
+ *         3 - 写入的短写由内部补齐, 回调的 result 为总字节数或 -errno; 读取的短读 (文件尾) 原样返回
+ *         4 - 线程安全
+ */
+class AsyncFileIo
+{
+public:
+    using ptr = std::shared_ptr<AsyncFileIo>;
+    using Callback = std::function<void(int64_t result)>;
+public:
+    /**
+     * @brief 进程共享的实例
+     */
+    static AsyncFileIo* Instance();
+public:
+    /**
+     * @param[in] threadNum : 回退为线程池时的线程数
+     */
+    explicit AsyncFileIo(uint32_t threadNum = 2);
+    ~AsyncFileIo();
+public:
+    void Read(int fd, void* data, size_t bytes, uint64_t offset, const Callback& done);
+    void Write(int fd, const void* data, size_t bytes, uint64_t offset, const Callback& done);
+    /**
+     * @brief "io_uring" 或 "thread"
+     */
+    std::string Backend();
+    std::string Report();
+private:
+    class Request;
+    class Ring;
+private:
+    void Submit(std::shared_ptr<Request> request);
+    void Complete(std::shared_ptr<Request> request, int64_t result);
+    void ThreadLoop();
+private:
+    std::unique_ptr<Ring>                 _ring;
+private: /* thread backend */
+    std::mutex                            _mtx;
+    std::condition_variable               _cond;
+    std::deque<std::shared_ptr<Request>>  _requests;
+    std::vector<std::thread>              _threads;
+    bool                                  _running;
+private: /* statistics */
+    std::atomic<uint64_t>                 _readNum;
+    std::atomic<uint64_t>                 _writeNum;
+    std::atomic<uint64_t>                 _readBytes;
+    std::atomic<uint64_t>                 _writeBytes;
+    std::atomic<uint64_t>                 _failNum;
+};
+
+} // namespace Mmp
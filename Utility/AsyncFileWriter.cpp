@@ -0,0 +1,164 @@
+#include "AsyncFileWriter.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+
+#include "FrameClock.h"
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief 与完成回调共享, 回调可能晚于 AsyncFileWriter 的析构执行
+ */
+class AsyncFileWriter::State
+{
+public:
+    std::mutex                        mtx;
+    std::condition_variable           cond;
+    uint32_t                          inflightNum = 0;
+    std::vector<std::vector<uint8_t>> freeBuffers;
+    bool                              failed = false;
+public: /* statistics */
+    uint64_t                          bufferNum = 0;
+    uint64_t                          waitNum = 0;
+    uint64_t                          waitNs = 0;
+};
+
+AsyncFileWriter::AsyncFileWriter(const std::string& path, AsyncFileIo* io, size_t bufferSize, uint32_t maxInflight)
+{
+    _path = path;
+    _io = io;
+    _bufferSize = bufferSize == 0 ? 1 : bufferSize;
+    _maxInflight = maxInflight == 0 ? 1 : maxInflight;
+    _offset = 0;
+    _state = std::make_shared<State>();
+    _fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0)
+    {
+        UTILITY_LOG_ERROR << "Open " << path << " fail, error is: " << strerror(errno);
+    }
+    _buffer.reserve(_bufferSize);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    Close();
+}
+
+bool AsyncFileWriter::IsOpen()
+{
+    return _fd >= 0;
+}
+
+void AsyncFileWriter::Write(const void* data, size_t bytes)
+{
+    if (_fd < 0)
+    {
+        return;
+    }
+    const uint8_t* cur = (const uint8_t*)data;
+    while (bytes > 0)
+    {
+        size_t copyBytes = std::min(bytes, _bufferSize - _buffer.size());
+        _buffer.insert(_buffer.end(), cur, cur + copyBytes);
+        cur += copyBytes;
+        bytes -= copyBytes;
+        if (_buffer.size() == _bufferSize)
+        {
+            SubmitBuffer();
+        }
+    }
+}
+
+void AsyncFileWriter::SubmitBuffer()
+{
+    if (_buffer.empty())
+    {
+        return;
+    }
+    std::shared_ptr<State> state = _state;
+    std::shared_ptr<std::vector<uint8_t>> buffer = std::make_shared<std::vector<uint8_t>>();
+    buffer->swap(_buffer);
+    {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        if (state->inflightNum >= _maxInflight)
+        {
+            // Hint : 磁盘跟不上时在此反压, 在途内存不超过 maxInflight 个缓冲区
+            uint64_t beginNs = FrameClock::NowNs();
+            state->cond.wait(lock, [this, state]()
+            {
+                return state->inflightNum < _maxInflight;
+            });
+            state->waitNum++;
+            state->waitNs += FrameClock::NowNs() - beginNs;
+        }
+        state->inflightNum++;
+        state->bufferNum++;
+        if (!state->freeBuffers.empty())
+        {
+            _buffer.swap(state->freeBuffers.back());
+            state->freeBuffers.pop_back();
+        }
+    }
+    _buffer.clear();
+    _buffer.reserve(_bufferSize);
+    size_t bytes = buffer->size();
+    std::string path = _path;
+    _io->Write(_fd, buffer->data(), bytes, _offset, [state, buffer, bytes, path](int64_t result)
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        if (result != (int64_t)bytes)
+        {
+            UTILITY_LOG_ERROR << "Write " << path << " fail, result is: " << result << ", expect: " << bytes;
+            state->failed = true;
+        }
+        state->freeBuffers.push_back(std::move(*buffer));
+        state->inflightNum--;
+        state->cond.notify_all();
+    });
+    _offset += bytes;
+}
+
+bool AsyncFileWriter::Flush()
+{
+    if (_fd < 0)
+    {
+        return false;
+    }
+    SubmitBuffer();
+    std::unique_lock<std::mutex> lock(_state->mtx);
+    _state->cond.wait(lock, [this]()
+    {
+        return _state->inflightNum == 0;
+    });
+    return !_state->failed;
+}
+
+bool AsyncFileWriter::Close()
+{
+    if (_fd < 0)
+    {
+        return false;
+    }
+    bool ok = Flush();
+    close(_fd);
+    _fd = -1;
+    return ok;
+}
+
+std::string AsyncFileWriter::Report()
+{
+    std::lock_guard<std::mutex> lock(_state->mtx);
+    std::stringstream ss;
+    ss << "AsyncFileWriter " << _path << " bytes : " << _offset + _buffer.size() << ", buffers : " << _state->bufferNum
+       << ", wait : " << _state->waitNum << " (" << _state->waitNs / 1000000 << " ms)" << (_state->failed ? ", failed" : "");
+    return ss.str();
+}
+
+} // namespace Mmp
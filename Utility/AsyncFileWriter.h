@@ -0,0 +1,63 @@
+//
+// AsyncFileWriter.h
+//
+// Library: Common
+// Package: Utility
+// Module:  AsyncFileWriter
+//
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+#include "AsyncFileIo.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief  顺序写文件, 数据先拷贝到缓冲区, 满后交给 AsyncFileIo 写入 (write-behind)
+ * @note   1 - Write 通常只有一次内存拷贝, 不等待磁盘; 在途缓冲区达到 maxInflight 时才等待, 以限制内存
+ *         2 - 每个缓冲区按文件偏移写入, 完成顺序不影响文件内容
+ *         3 - 非线程安全, 同一时间仅一个写入者; Close (或析构) 等待所有写入完成
+ *         4 - Write 可能因反压而等待, 在 Pipeline 中应作为 blocking 节点 (见 AddSink)
+ */
+class AsyncFileWriter
+{
+public:
+    using ptr = std::shared_ptr<AsyncFileWriter>;
+public:
+    explicit AsyncFileWriter(const std::string& path, AsyncFileIo* io = AsyncFileIo::Instance(),
+                             size_t bufferSize = 1024 * 1024, uint32_t maxInflight = 4);
+    ~AsyncFileWriter();
+public:
+    bool IsOpen();
+    void Write(const void* data, size_t bytes);
+    /**
+     * @brief 提交缓冲区中的数据并等待所有写入完成
+     * @return 此前的写入是否全部成功
+     */
+    bool Flush();
+    bool Close();
+    std::string Report();
+private:
+    void SubmitBuffer();
+private:
+    class State;
+private:
+    std::string            _path;
+    AsyncFileIo*           _io;
+    int                    _fd;
+    size_t                 _bufferSize;
+    uint32_t               _maxInflight;
+    std::vector<uint8_t>   _buffer;
+    uint64_t               _offset;
+    std::shared_ptr<State> _state;
+};
+
+} // namespace Mmp
@@ -0,0 +1,167 @@
+#include "BitrateController.h"
+
+#include <sstream>
+#include <algorithm>
+
+namespace Mmp
+{
+
+namespace
+{
+
+constexpr uint32_t kBacklogUsage = 50;      // 输出队列占用过半视为写入跟不上
+constexpr uint32_t kRecoverWindows = 3;
+constexpr uint64_t kDecreasePercent = 70;
+constexpr uint64_t kIncreasePercent = 10;   // 每次上调上限的 10%
+constexpr uint64_t kTargetMarginPercent = 90;
+
+} // namespace
+
+BitrateController::BitrateController(uint64_t bps, uint32_t fpsNum, uint32_t fpsDen)
+{
+    _fpsNum = fpsNum == 0 ? 30 : fpsNum;
+    _fpsDen = fpsDen == 0 ? 1 : fpsDen;
+    _bps = bps;
+    _minBps = bps / 4;
+    _maxBps = bps;
+    _targetBps = 0;
+    _started = false;
+    _windowFrames = 0;
+    _windowPackets = 0;
+    _windowBytes = 0;
+    _windowMaxUsage = 0;
+    _calmWindows = 0;
+    _holdWindows = 0;
+    _totalBytes = 0;
+    _lastOutputBps = 0;
+    _decreaseNum = 0;
+    _increaseNum = 0;
+}
+
+void BitrateController::SetFrameRate(uint32_t fpsNum, uint32_t fpsDen)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _fpsNum = fpsNum == 0 ? 30 : fpsNum;
+    _fpsDen = fpsDen == 0 ? 1 : fpsDen;
+}
+
+void BitrateController::SetRange(uint64_t minBps, uint64_t maxBps)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _minBps = std::min(minBps, maxBps);
+    _maxBps = maxBps;
+}
+
+void BitrateController::SetTargetBandwidth(uint64_t bps)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _targetBps = bps;
+}
+
+void BitrateController::OnPacket(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _windowPackets++;
+    _windowBytes += bytes;
+    _totalBytes += bytes;
+}
+
+uint64_t BitrateController::Ceiling()
+{
+    uint64_t ceiling = _targetBps != 0 ? std::min(_maxBps, _targetBps) : _maxBps;
+    return std::max(ceiling, _minBps);
+}
+
+bool BitrateController::Update(uint32_t queueUsage, BitrateDecision& decision)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    uint64_t ceiling = Ceiling();
+    uint64_t bps = _bps;
+    std::stringstream cause;
+    if (!_started)
+    {
+        _started = true;
+        if (_bps > ceiling)
+        {
+            bps = ceiling;
+            cause << "initial bitrate above target bandwidth " << _targetBps;
+        }
+    }
+    else
+    {
+        _windowFrames++;
+        _windowMaxUsage = std::max(_windowMaxUsage, queueUsage);
+        if (_windowFrames * _fpsDen < _fpsNum)
+        {
+            return false;
+        }
+        // Hint : 送入的帧数包含尚在编码器中与被跳过的帧, 码率按实际输出的包数换算
+        uint64_t outputBps = _windowPackets == 0 ? 0 : _windowBytes * 8 * _fpsNum / (_windowPackets * _fpsDen);
+        uint32_t usage = _windowMaxUsage;
+        _lastOutputBps = outputBps;
+        _windowFrames = 0;
+        _windowPackets = 0;
+        _windowBytes = 0;
+        _windowMaxUsage = 0;
+        if (_holdWindows != 0)
+        {
+            _holdWindows--;
+            return false;
+        }
+        if (usage >= kBacklogUsage)
+        {
+            bps = _bps * kDecreasePercent / 100;
+            cause << "writer queue " << usage << "% full";
+            _calmWindows = 0;
+        }
+        else if (_targetBps != 0 && outputBps > _targetBps)
+        {
+            bps = _bps * _targetBps / outputBps * kTargetMarginPercent / 100;
+            cause << "output " << outputBps << " bps over target bandwidth " << _targetBps;
+            _calmWindows = 0;
+        }
+        else if (_bps < ceiling && ++_calmWindows >= kRecoverWindows)
+        {
+            bps = _bps + ceiling * kIncreasePercent / 100;
+            cause << "no congestion in " << _calmWindows << " windows";
+        }
+    }
+    bps = std::min(std::max(bps, _minBps), ceiling);
+    if (bps == _bps)
+    {
+        return false;
+    }
+    decision.oldBps = _bps;
+    decision.bps = bps;
+    decision.cause = cause.str();
+    if (bps < _bps)
+    {
+        _decreaseNum++;
+        _holdWindows = 1;
+    }
+    else
+    {
+        _increaseNum++;
+    }
+    _calmWindows = 0;
+    _bps = bps;
+    return true;
+}
+
+uint64_t BitrateController::Bps()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _bps;
+}
+
+std::string BitrateController::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::stringstream ss;
+    ss << "BitrateController bps : " << _bps << " [" << _minBps << ", " << Ceiling() << "], last output : " << _lastOutputBps
+       << " bps, decrease : " << _decreaseNum << ", increase : " << _increaseNum
+       << ", bytes : " << _totalBytes;
+    return ss.str();
+}
+
+} // namespace Mmp
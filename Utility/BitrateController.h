@@ -0,0 +1,102 @@
+//
+// BitrateController.h
+//
+// Library: Common
+// Package: Utility
+// Module:  BitrateController
+//
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+namespace Mmp
+{
+
+/**
+ * @brief 一次码率调整
+ */
+class BitrateDecision
+{
+public:
+    uint64_t    oldBps = 0;
+    uint64_t    bps = 0;
+    std::string cause;
+};
+
+/**
+ * @brief  编码码率的运行时调节
+ * @note   1 - 按媒体时间评估: 每送入 1 秒 (按帧率换算的帧数) 的帧评估一次, 与编码速度无关;
+ *             输出码率按窗口内输出的包数换算 (每包一帧), 不受在途帧与跳过编码的帧 (如静止画面) 影响
+ *         2 - 拥塞信号 : 编码输出到写入 (上传) 之间的队列占用过半, 或输出码率超过目标带宽;
+ *             拥塞时乘性下调, 连续若干个窗口无拥塞后加性上调, 直至上限 min(maxBps, 目标带宽)
+ *         3 - 不插入 IDR, 新码率由编码器的码控在当前 GOP 内收敛; MMP-Core 的编码器没有强制 IDR 的接口,
+ *             需要在下调时立即从新的 GOP 开始, 应先在 MMP-Core 中透传 MPP_ENC_SET_IDR_FRAME
+ *         4 - 下调后保持一个窗口不再评估, 等待在途的数据排空
+ *         5 - OnPacket 线程安全; Update 仅由送编码的线程调用
+ */
+class BitrateController
+{
+public:
+    using ptr = std::shared_ptr<BitrateController>;
+public:
+    /**
+     * @param[in] bps    : 初始码率, 同时作为默认的上限
+     * @param[in] fpsNum : 帧率分子, 用于将帧数换算为媒体时间
+     */
+    BitrateController(uint64_t bps, uint32_t fpsNum, uint32_t fpsDen = 1);
+public:
+    /**
+     * @brief 帧率在开始编码后才能确定时 (如转码) 重新设置
+     */
+    void SetFrameRate(uint32_t fpsNum, uint32_t fpsDen = 1);
+    /**
+     * @brief 调节范围, 默认为 [bps / 4, bps]
+     */
+    void SetRange(uint64_t minBps, uint64_t maxBps);
+    /**
+     * @brief 目标带宽 (bit/s), 0 (默认) 表示不限制
+     */
+    void SetTargetBandwidth(uint64_t bps);
+    /**
+     * @brief 编码器每输出一个包调用一次
+     */
+    void OnPacket(uint64_t bytes);
+    /**
+     * @brief      每送入一帧前调用一次
+     * @param[in]  queueUsage : 编码输出队列的额度占用百分比, 见 PipelineEdge::Usage
+     * @param[out] decision
+     * @return     需要调整码率时返回 true
+     */
+    bool Update(uint32_t queueUsage, BitrateDecision& decision);
+    uint64_t Bps();
+    std::string Report();
+private:
+    uint64_t Ceiling();
+private:
+    std::mutex _mtx;
+    uint32_t   _fpsNum;
+    uint32_t   _fpsDen;
+    uint64_t   _bps;
+    uint64_t   _minBps;
+    uint64_t   _maxBps;
+    uint64_t   _targetBps;
+    bool       _started;
+private: /* window */
+    uint64_t   _windowFrames;
+    uint64_t   _windowPackets; // 窗口内编码器输出的包数
+    uint64_t   _windowBytes;
+    uint32_t   _windowMaxUsage;
+    uint32_t   _calmWindows;  // 连续无拥塞的窗口数
+    uint32_t   _holdWindows;  // 下调后暂停评估的窗口数
+private: /* statistics */
+    uint64_t   _totalBytes;
+    uint64_t   _lastOutputBps;
+    uint64_t   _decreaseNum;
+    uint64_t   _increaseNum;
+};
+
+} // namespace Mmp
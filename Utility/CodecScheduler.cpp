@@ -0,0 +1,236 @@
+#include "CodecScheduler.h"
+
+#include <sstream>
+
+namespace Mmp
+{
+
+constexpr double kEwmaAlpha = 0.2;
+
+CodecScheduler::CodecScheduler(uint32_t instanceNum, uint32_t queueLimit, double imbalanceThreshold)
+{
+    _instances.resize(instanceNum == 0 ? 1 : instanceNum);
+    _queueLimit = queueLimit;
+    _queuedNum = 0;
+    _runningNum = 0;
+    _imbalanceThreshold = imbalanceThreshold < 1.0 ? 1.0 : imbalanceThreshold;
+    _closed = false;
+    _migrationNum = 0;
+    _splitNum = 0;
+}
+
+double CodecScheduler::NsPerCost(const Instance& instance)
+{
+    if (instance.nsPerCost != 0)
+    {
+        return instance.nsPerCost;
+    }
+    // Hint : 尚无样本的实例沿用其他实例的均值, 都没有样本时各实例等价
+    double sum = 0;
+    uint32_t num = 0;
+    for (const auto& other : _instances)
+    {
+        if (other.nsPerCost != 0)
+        {
+            sum += other.nsPerCost;
+            num++;
+        }
+    }
+    return num ? sum / num : 1.0;
+}
+
+double CodecScheduler::Load(const Instance& instance)
+{
+    return (double)(instance.queuedCost + instance.runningCost) * NsPerCost(instance);
+}
+
+bool CodecScheduler::IsIdle(const Instance& instance)
+{
+    return instance.queue.empty() && instance.runningCost == 0;
+}
+
+void CodecScheduler::Rebalance()
+{
+    // Hint : 每个排队中的任务至多迁移一次, 避免实例耗时差异较大时来回迁移
+    for (uint32_t round=0; round<_queuedNum; round++)
+    {
+        size_t maxIndex = _instances.size(), minIndex = 0;
+        for (size_t i=0; i<_instances.size(); i++)
+        {
+            if (!_instances[i].queue.empty() && (maxIndex == _instances.size() || Load(_instances[i]) > Load(_instances[maxIndex])))
+            {
+                maxIndex = i;
+            }
+            if (Load(_instances[i]) < Load(_instances[minIndex]))
+            {
+                minIndex = i;
+            }
+        }
+        if (maxIndex == _instances.size() || maxIndex == minIndex)
+        {
+            break;
+        }
+        Instance& from = _instances[maxIndex];
+        Instance& to = _instances[minIndex];
+        Task task = from.queue.back();
+        double fromLoad = Load(from);
+        double toLoad = Load(to);
+        // Hint : 仅在负载比超过阈值, 且迁移后不会使目标实例成为新的瓶颈时迁移
+        if (fromLoad <= _imbalanceThreshold * toLoad || toLoad + task.cost * NsPerCost(to) >= fromLoad)
+        {
+            break;
+        }
+        from.queue.pop_back();
+        from.queuedCost -= task.cost;
+        to.queue.push_back(task);
+        to.queuedCost += task.cost;
+        _migrationNum++;
+    }
+}
+
+uint32_t CodecScheduler::Submit(uint64_t id, uint64_t cost)
+{
+    std::unique_lock<std::mutex> lock(_mtx);
+    if (_queueLimit != 0)
+    {
+        _cond.wait(lock, [this]()
+        {
+            return _queuedNum < _queueLimit;
+        });
+    }
+    size_t target = 0;
+    double targetFinish = 0;
+    for (size_t i=0; i<_instances.size(); i++)
+    {
+        double finish = Load(_instances[i]) + cost * NsPerCost(_instances[i]);
+        if (i == 0 || finish < targetFinish)
+        {
+            target = i;
+            targetFinish = finish;
+        }
+    }
+    _instances[target].queue.push_back(Task{id, cost});
+    _instances[target].queuedCost += cost;
+    _queuedNum++;
+    _cond.notify_all();
+    return (uint32_t)target;
+}
+
+bool CodecScheduler::Take(uint32_t instance, uint64_t& id, uint64_t& cost)
+{
+    std::unique_lock<std::mutex> lock(_mtx);
+    if (instance >= _instances.size())
+    {
+        return false;
+    }
+    Instance& self = _instances[instance];
+    _cond.wait(lock, [this, &self]()
+    {
+        if (self.queue.empty())
+        {
+            Rebalance();
+        }
+        return !self.queue.empty() || (_closed && _queuedNum == 0 && _runningNum == 0);
+    });
+    if (self.queue.empty())
+    {
+        return false;
+    }
+    Task task = self.queue.front();
+    self.queue.pop_front();
+    self.queuedCost -= task.cost;
+    self.runningCost += task.cost;
+    _queuedNum--;
+    _runningNum++;
+    id = task.id;
+    cost = task.cost;
+    _cond.notify_all();
+    return true;
+}
+
+void CodecScheduler::Complete(uint32_t instance, uint64_t cost, uint64_t serviceNs)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (instance >= _instances.size())
+    {
+        return;
+    }
+    Instance& self = _instances[instance];
+    self.runningCost -= cost <= self.runningCost ? cost : self.runningCost;
+    _runningNum -= _runningNum ? 1 : 0;
+    if (cost != 0 && serviceNs != 0)
+    {
+        double sample = (double)serviceNs / cost;
+        self.nsPerCost = self.nsPerCost == 0 ? sample : (1 - kEwmaAlpha) * self.nsPerCost + kEwmaAlpha * sample;
+    }
+    self.taskNum++;
+    self.totalCost += cost;
+    self.busyNs += serviceNs;
+    Rebalance();
+    _cond.notify_all();
+}
+
+uint32_t CodecScheduler::IdleNum()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    uint32_t idleNum = 0;
+    for (const auto& instance : _instances)
+    {
+        idleNum += IsIdle(instance) ? 1 : 0;
+    }
+    return idleNum;
+}
+
+bool CodecScheduler::Split(uint32_t instance, uint64_t id, uint64_t splitCost)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (instance >= _instances.size())
+    {
+        return false;
+    }
+    Instance& self = _instances[instance];
+    size_t target = _instances.size();
+    for (size_t i=0; i<_instances.size(); i++)
+    {
+        if (i != instance && IsIdle(_instances[i]))
+        {
+            target = i;
+            break;
+        }
+    }
+    // Hint : 仅交给空闲实例, 交给忙碌的实例只会排队等待, 不能与本实例并行
+    if (target == _instances.size() || splitCost == 0)
+    {
+        return false;
+    }
+    self.runningCost -= splitCost <= self.runningCost ? splitCost : self.runningCost;
+    _instances[target].queue.push_back(Task{id, splitCost});
+    _instances[target].queuedCost += splitCost;
+    _queuedNum++;
+    _splitNum++;
+    _cond.notify_all();
+    return true;
+}
+
+void CodecScheduler::Close()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _closed = true;
+    _cond.notify_all();
+}
+
+std::string CodecScheduler::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::stringstream ss;
+    ss << "CodecScheduler migration : " << _migrationNum << ", split : " << _splitNum;
+    for (size_t i=0; i<_instances.size(); i++)
+    {
+        const Instance& instance = _instances[i];
+        ss << ", [" << i << "] task : " << instance.taskNum << ", cost : " << instance.totalCost
+           << ", service : " << (uint64_t)(instance.nsPerCost / 1000) << " us/cost";
+    }
+    return ss.str();
+}
+
+} // namespace Mmp
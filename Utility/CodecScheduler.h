@@ -0,0 +1,116 @@
+//
+// CodecScheduler.h
+//
+// Library: Common
+// Package: Utility
+// Module:  CodecScheduler
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+namespace Mmp
+{
+
+/**
+ * @brief  编解码器实例间的最小负载调度
+ * @note   1 - 任务为可独立解码的码流单元 (以 IDR 开始的分段或整个文件), cost 为其工作量 (如帧数)
+ *         2 - 每个实例的负载 = (排队 + 处理中的 cost) * 该实例每单位 cost 的处理耗时 (EWMA)
+ *         3 - 新任务分配给预计完成最早的实例
+ *         4 - 负载比超过 imbalanceThreshold 时, 将排队中的任务迁移到负载最低的实例;
+ *             排队中的任务尚未送入编解码器且以 IDR 开始, 迁移无需额外处理
+ *         5 - 有空闲实例时, 处理中的任务可在 IDR 边界拆分, 通过 Split 将拆分出的部分交给空闲实例并行处理;
+ *             由调用方保证各部分输出的顺序
+ *         6 - Close 后仍有处理中的任务时, 空闲实例继续等待拆分出的任务
+ *         7 - 线程安全
+ *         8 - 用于 test_transcode 的分段并行与批量模式; test_compositor 不适用: 每个解码器对应一路连续的实时输入,
+ *             每个编码器对应一档输出并持有其码控状态, 没有可在实例间迁移或拆分的独立任务
+ */
+class CodecScheduler
+{
+public:
+    using ptr = std::shared_ptr<CodecScheduler>;
+public:
+    /**
+     * @param[in] instanceNum        : 编解码器实例数
+     * @param[in] queueLimit         : 所有实例排队任务数上限, 达到上限时 Submit 阻塞; 0 表示不限制
+     * @param[in] imbalanceThreshold : 触发迁移的负载比
+     */
+    explicit CodecScheduler(uint32_t instanceNum, uint32_t queueLimit = 0, double imbalanceThreshold = 1.5);
+public:
+    /**
+     * @brief  提交任务
+     * @return 分配到的实例
+     */
+    uint32_t Submit(uint64_t id, uint64_t cost);
+    /**
+     * @brief  实例取下一个任务, 无任务时阻塞
+     * @return Close 后且无任务时返回 false
+     */
+    bool Take(uint32_t instance, uint64_t& id, uint64_t& cost);
+    /**
+     * @brief 实例完成 Take 得到的任务
+     * @param[in] serviceNs : 实际处理耗时
+     */
+    void Complete(uint32_t instance, uint64_t cost, uint64_t serviceNs);
+    /**
+     * @brief 空闲实例 (无排队及处理中的任务) 数, 用于拆分前的快速判断
+     */
+    uint32_t IdleNum();
+    /**
+     * @brief  将处理中的任务拆分出的部分交给空闲实例
+     * @param[in] id        : 拆分出的部分的任务 id
+     * @param[in] splitCost : 拆分出的部分的工作量 (估算)
+     * @return 存在空闲实例时, 拆分出的部分作为新任务加入其队列并返回 true
+     * @note   返回 true 后, 本实例 Complete 的 cost 为 Take 得到的 cost 减去 splitCost
+     */
+    bool Split(uint32_t instance, uint64_t id, uint64_t splitCost);
+    /**
+     * @brief 不再提交任务
+     */
+    void Close();
+    std::string Report();
+private:
+    struct Task
+    {
+        uint64_t id;
+        uint64_t cost;
+    };
+    struct Instance
+    {
+        std::deque<Task> queue;
+        uint64_t         queuedCost = 0;
+        uint64_t         runningCost = 0;
+        double           nsPerCost = 0;   // EWMA, 0 表示尚无样本
+    public: /* statistics */
+        uint64_t         taskNum = 0;
+        uint64_t         totalCost = 0;
+        uint64_t         busyNs = 0;
+    };
+private:
+    double NsPerCost(const Instance& instance);
+    double Load(const Instance& instance);
+    bool IsIdle(const Instance& instance);
+    void Rebalance();
+private:
+    std::mutex _mtx;
+    std::condition_variable _cond;
+    std::vector<Instance> _instances;
+    uint32_t _queueLimit;
+    uint32_t _queuedNum;
+    uint32_t _runningNum;
+    double   _imbalanceThreshold;
+    bool     _closed;
+private: /* statistics */
+    uint64_t _migrationNum;
+    uint64_t _splitNum;
+};
+
+} // namespace Mmp
@@ -0,0 +1,251 @@
+//
+// CodecWarmPool.h
+//
+// Library: Common
+// Package: Utility
+// Module:  CodecWarmPool
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace Mmp
+{
+
+constexpr uint32_t kCodecWarmLeaseTimeoutMs = 2000; // Lease 等待后台预热实例的最长时间
+
+/**
+ * @brief  预先 Init/Start 的编解码器实例池
+ * @note   1 - Codec 为 Codec::AbstractDecoder 或 Codec::AbstractEncoder
+ *         2 - 每个 pool 对应一种编解码器配置 (类型、码率等), 由 creator 决定; 不同配置使用不同的 pool
+ *         3 - 创建、Init/Start 以及归还后的重置 (Stop/Uninit/Init/Start) 均在后台线程完成,
+ *             池为空但后台仍有实例在预热时, Lease 等待该实例 (最长 kCodecWarmLeaseTimeoutMs),
+ *             超时或无待预热实例时才在调用线程上冷启动
+ *         4 - creator 返回 nullptr 时视为不支持, 不再预热, WaitWarm 返回 false
+ *         5 - 线程安全
+ */
+template <typename Codec>
+class CodecWarmPool
+{
+public:
+    using ptr = std::shared_ptr<CodecWarmPool<Codec>>;
+    using CodecPtr = std::shared_ptr<Codec>;
+    /**
+     * @brief 创建实例并设置参数, 无需调用 Init
+     */
+    using Creator = std::function<CodecPtr()>;
+public:
+    /**
+     * @param[in] capacity : 保持预热的实例数
+     */
+    CodecWarmPool(const Creator& creator, uint32_t capacity)
+    {
+        _creator = creator;
+        _capacity = capacity;
+        _running = true;
+        _creating = 0;
+        _createFail = false;
+        _warmNum = 0;
+        _coldNum = 0;
+        _resetNum = 0;
+        _thread = std::thread([this]()
+        {
+            WorkerLoop();
+        });
+    }
+    ~CodecWarmPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _running = false;
+            _cond.notify_all();
+        }
+        _thread.join();
+        // Hint : 尚未重置的归还实例同样需要释放, 否则泄漏 MPP 上下文
+        for (auto& codec : _returned)
+        {
+            codec->Stop();
+            codec->Uninit();
+        }
+        for (auto& codec : _idle)
+        {
+            codec->Stop();
+            codec->Uninit();
+        }
+    }
+public:
+    /**
+     * @brief      租用一个已 Start 的实例
+     * @param[out] warm : 是否命中预热实例
+     * @return     创建失败时返回 nullptr
+     */
+    CodecPtr Lease(bool* warm = nullptr)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            // Hint : 后台正在 (或即将) 预热时等待该实例, 避免同时冷启动第二个实例
+            _cond.wait_for(lock, std::chrono::milliseconds(kCodecWarmLeaseTimeoutMs), [this]()
+            {
+                return !_idle.empty() || (_creating == 0 && _idle.size() >= _capacity) || !_running;
+            });
+            if (!_idle.empty())
+            {
+                CodecPtr codec = _idle.front();
+                _idle.pop_front();
+                _warmNum++;
+                _cond.notify_all();
+                if (warm)
+                {
+                    *warm = true;
+                }
+                return codec;
+            }
+            _coldNum++;
+            _cond.notify_all();
+        }
+        if (warm)
+        {
+            *warm = false;
+        }
+        return Create();
+    }
+    /**
+     * @brief 归还实例, 后台重置后重新进入池中 (池已满时释放)
+     */
+    void Return(CodecPtr codec)
+    {
+        if (!codec)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_mtx);
+        _returned.push_back(codec);
+        _cond.notify_all();
+    }
+    /**
+     * @brief 调整保持预热的实例数, 多出的空闲实例在后台释放
+     */
+    void SetCapacity(uint32_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _capacity = capacity;
+        while (_idle.size() > _capacity)
+        {
+            _returned.push_back(_idle.back());
+            _idle.pop_back();
+        }
+        _cond.notify_all();
+    }
+    /**
+     * @brief  等待池中预热实例数达到 capacity
+     * @return creator 创建失败 (不支持的编解码器) 时返回 false
+     */
+    bool WaitWarm()
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        _cond.wait(lock, [this]()
+        {
+            return _idle.size() >= _capacity || !_running;
+        });
+        return !_createFail;
+    }
+    std::string Report()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        std::stringstream ss;
+        ss << "CodecWarmPool capacity : " << _capacity << ", warm lease : " << _warmNum << ", cold lease : " << _coldNum << ", reset : " << _resetNum;
+        return ss.str();
+    }
+private:
+    CodecPtr Create()
+    {
+        CodecPtr codec = _creator();
+        if (!codec)
+        {
+            return nullptr;
+        }
+        codec->Init();
+        codec->Start();
+        return codec;
+    }
+    void WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        while (_running)
+        {
+            if (!_returned.empty())
+            {
+                CodecPtr codec = _returned.front();
+                _returned.pop_front();
+                bool keep = _idle.size() + _creating < _capacity;
+                _creating += keep ? 1 : 0;
+                lock.unlock();
+                codec->Stop();
+                codec->Uninit();
+                if (keep)
+                {
+                    codec->Init();
+                    codec->Start();
+                }
+                lock.lock();
+                if (keep)
+                {
+                    _creating--;
+                    _idle.push_back(codec);
+                    _resetNum++;
+                    _cond.notify_all();
+                }
+            }
+            else if (_idle.size() + _creating < _capacity)
+            {
+                _creating++;
+                lock.unlock();
+                CodecPtr codec = Create();
+                lock.lock();
+                _creating--;
+                if (!codec)
+                {
+                    // Hint : 不支持的编解码器, 不再尝试预热
+                    _capacity = (uint32_t)_idle.size();
+                    _createFail = true;
+                }
+                else
+                {
+                    _idle.push_back(codec);
+                }
+                _cond.notify_all();
+            }
+            else
+            {
+                _cond.wait(lock);
+            }
+        }
+    }
+private:
+    Creator                 _creator;
+    uint32_t                _capacity;
+    std::mutex              _mtx;
+    std::condition_variable _cond;
+    std::thread             _thread;
+    bool                    _running;
+    uint32_t                _creating;
+    bool                    _createFail;
+    std::deque<CodecPtr>    _idle;
+    std::deque<CodecPtr>    _returned;
+private: /* statistics */
+    uint64_t                _warmNum;
+    uint64_t                _coldNum;
+    uint64_t                _resetNum;
+};
+
+} // namespace Mmp
@@ -0,0 +1,92 @@
+#include "DamageTracker.h"
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+namespace Mmp
+{
+
+DamageTracker::DamageTracker(uint32_t width, uint32_t height, uint32_t itemNum)
+{
+    _width = width;
+    _height = height;
+    _itemRects.resize(itemNum, DamageRect{0, 0, width, height});
+    _dirty.resize(itemNum, false);
+    _drawNum = 0;
+    _skipNum = 0;
+    _damagedPixels = 0;
+}
+
+void DamageTracker::SetItemRect(uint32_t item, float x, float y, float width, float height)
+{
+    if (item >= _itemRects.size())
+    {
+        return;
+    }
+    // Hint : NV12 色度平面为 2x2 下采样, 区域向外扩展到偶数像素
+    uint32_t left = (uint32_t)std::floor(x * _width) & ~1u;
+    uint32_t top = (uint32_t)std::floor(y * _height) & ~1u;
+    uint32_t right = std::min(((uint32_t)std::ceil((x + width) * _width) + 1) & ~1u, _width);
+    uint32_t bottom = std::min(((uint32_t)std::ceil((y + height) * _height) + 1) & ~1u, _height);
+    _itemRects[item] = DamageRect{left, top, right > left ? right - left : 0, bottom > top ? bottom - top : 0};
+}
+
+void DamageTracker::MarkDirty(uint32_t item)
+{
+    if (item < _dirty.size())
+    {
+        _dirty[item] = true;
+    }
+}
+
+bool DamageTracker::IsDirty(uint32_t item)
+{
+    return item < _dirty.size() && _dirty[item];
+}
+
+bool DamageTracker::HasDamage()
+{
+    return std::find(_dirty.begin(), _dirty.end(), true) != _dirty.end();
+}
+
+std::vector<DamageRect> DamageTracker::Regions()
+{
+    std::vector<DamageRect> regions;
+    for (size_t i=0; i<_dirty.size(); i++)
+    {
+        if (_dirty[i])
+        {
+            regions.push_back(_itemRects[i]);
+        }
+    }
+    return regions;
+}
+
+void DamageTracker::Commit(bool drawn)
+{
+    if (drawn)
+    {
+        _drawNum++;
+        for (const auto& rect : Regions())
+        {
+            _damagedPixels += (uint64_t)rect.width * rect.height;
+        }
+    }
+    else
+    {
+        _skipNum++;
+    }
+    std::fill(_dirty.begin(), _dirty.end(), false);
+}
+
+std::string DamageTracker::Report()
+{
+    std::stringstream ss;
+    uint64_t totalPixels = (_drawNum + _skipNum) * _width * _height;
+    ss << "DamageTracker draw : " << _drawNum << ", skip : " << _skipNum;
+    ss << ", damaged area : " << (totalPixels ? _damagedPixels * 100 / totalPixels : 0) << "%";
+    return ss.str();
+}
+
+} // namespace Mmp
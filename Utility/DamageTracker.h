@@ -0,0 +1,72 @@
+//
+// DamageTracker.h
+//
+// Library: Common
+// Package: Utility
+// Module:  DamageTracker
+//
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+namespace Mmp
+{
+
+/**
+ * @brief 像素坐标下的矩形区域
+ */
+struct DamageRect
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+/**
+ * @brief  合成画面的脏区域跟踪 (SceneRenderStrategy::Keep)
+ * @note   1 - 记录自上次合成以来收到新图像的 item, 未变化的 item 无需重新绘制
+ *         2 - 没有任何脏区域时整帧跳过合成, 直接复用上一帧输出; 有脏区域时场景合成器整帧重绘,
+ *             区域仅用于统计重绘的像素数, 不做局部重绘
+ *         3 - 区域按 NV12 对齐到偶数像素; 非线程安全
+ */
+class DamageTracker
+{
+public:
+    using ptr = std::shared_ptr<DamageTracker>;
+public:
+    DamageTracker(uint32_t width, uint32_t height, uint32_t itemNum);
+public:
+    /**
+     * @brief 设置 item 的区域, 参数为归一化坐标 (与 SceneItemParam 一致)
+     */
+    void SetItemRect(uint32_t item, float x, float y, float width, float height);
+    void MarkDirty(uint32_t item);
+    bool IsDirty(uint32_t item);
+    bool HasDamage();
+    /**
+     * @brief 各脏 item 的区域
+     */
+    std::vector<DamageRect> Regions();
+    /**
+     * @brief 一次合成 (或跳过) 完成后调用, 清空脏标记并更新统计
+     * @param[in] drawn : 本次是否实际执行了合成
+     */
+    void Commit(bool drawn);
+    std::string Report();
+private:
+    uint32_t _width;
+    uint32_t _height;
+    std::vector<DamageRect> _itemRects;
+    std::vector<bool> _dirty;
+private: /* statistics */
+    uint64_t _drawNum;
+    uint64_t _skipNum;
+    uint64_t _damagedPixels;
+};
+
+} // namespace Mmp
@@ -0,0 +1,113 @@
+#include "DmaBufFence.h"
+
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
+
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+DmaBufFence::ptr DmaBufFence::Export(int dmaBufFd)
+{
+    if (dmaBufFd < 0)
+    {
+        return nullptr;
+    }
+#ifdef DMA_BUF_IOCTL_EXPORT_SYNC_FILE
+    {
+        struct dma_buf_export_sync_file exportSyncFile = {};
+        // Hint : 读方需要等待的是写栅栏, 故以 DMA_BUF_SYNC_READ 导出
+        exportSyncFile.flags = DMA_BUF_SYNC_READ;
+        exportSyncFile.fd = -1;
+        if (ioctl(dmaBufFd, DMA_BUF_IOCTL_EXPORT_SYNC_FILE, &exportSyncFile) == 0)
+        {
+            return std::shared_ptr<DmaBufFence>(new DmaBufFence(exportSyncFile.fd, true));
+        }
+        else
+        {
+            static bool kWarnOnce = true;
+            if (kWarnOnce)
+            {
+                UTILITY_LOG_WARN << "DMA_BUF_IOCTL_EXPORT_SYNC_FILE fail, error is: " << errno << ", fallback to poll dma buf";
+                kWarnOnce = false;
+            }
+        }
+    }
+#endif /* DMA_BUF_IOCTL_EXPORT_SYNC_FILE */
+    int fd = dup(dmaBufFd);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    return std::shared_ptr<DmaBufFence>(new DmaBufFence(fd, false));
+}
+
+DmaBufFence::DmaBufFence(int fd, bool isSyncFile)
+{
+    _fd = fd;
+    _isSyncFile = isSyncFile;
+}
+
+DmaBufFence::~DmaBufFence()
+{
+    if (_fd >= 0)
+    {
+        close(_fd);
+    }
+}
+
+bool DmaBufFence::Wait(int32_t timeoutMs)
+{
+    struct pollfd pfd = {};
+    pfd.fd = _fd;
+    pfd.events = POLLIN;
+    int ret = 0;
+    do
+    {
+        ret = poll(&pfd, 1, timeoutMs);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+    if (ret < 0)
+    {
+        UTILITY_LOG_WARN << "Poll fence fail, error is: " << errno;
+        return true;
+    }
+    return ret > 0;
+}
+
+bool DmaBufFence::IsSignaled()
+{
+    return Wait(0);
+}
+
+bool DmaBufFence::IsSyncFile()
+{
+    return _isSyncFile;
+}
+
+DmaBufCpuAccess::DmaBufCpuAccess(int dmaBufFd, bool write)
+{
+    _fd = dmaBufFd;
+    _flags = write ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ;
+    if (_fd >= 0)
+    {
+        struct dma_buf_sync sync = {};
+        sync.flags = DMA_BUF_SYNC_START | _flags;
+        ioctl(_fd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+}
+
+DmaBufCpuAccess::~DmaBufCpuAccess()
+{
+    if (_fd >= 0)
+    {
+        struct dma_buf_sync sync = {};
+        sync.flags = DMA_BUF_SYNC_END | _flags;
+        ioctl(_fd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+}
+
+} // namespace Mmp
@@ -0,0 +1,70 @@
+//
+// DmaBufFence.h
+//
+// Library: Common
+// Package: Utility
+// Module:  DmaBufFence
+//
+
+#pragma once
+
+#include <memory>
+#include <cstdint>
+
+namespace Mmp
+{
+
+/**
+ * @brief  DMA-BUF 上 GPU 写操作的完成栅栏
+ * @note   1 - 通过 DMA_BUF_IOCTL_EXPORT_SYNC_FILE 从 DMA-BUF 的隐式栅栏导出 sync_file,
+ *             导出时刻之前提交的 GPU 渲染完成后栅栏 signal, 与之后提交的渲染无关
+ *             (提交指已 glFlush 到驱动, 仍缓存在 GL 命令队列中的渲染不在栅栏内, 导出前须先 glFlush)
+ *         2 - 内核不支持导出时退化为 poll DMA-BUF 本身 (等待其当前所有写操作)
+ *         3 - 仅在真正访问 buffer 时 Wait, 使得 GPU 渲染下一帧与 VENC 读取当前帧可以并行
+ */
+class DmaBufFence
+{
+public:
+    using ptr = std::shared_ptr<DmaBufFence>;
+public:
+    /**
+     * @brief      导出 dmaBufFd 当前的写栅栏
+     * @return     失败时返回 nullptr, 调用方应视为已 signal
+     */
+    static DmaBufFence::ptr Export(int dmaBufFd);
+public:
+    ~DmaBufFence();
+public:
+    /**
+     * @brief      等待栅栏 signal
+     * @param[in]  timeoutMs : 超时时间, 小于 0 表示一直等待
+     * @return     是否 signal
+     */
+    bool Wait(int32_t timeoutMs = -1);
+    bool IsSignaled();
+    /**
+     * @brief 是否为 sync_file (否则为 DMA-BUF 自身)
+     */
+    bool IsSyncFile();
+private:
+    DmaBufFence(int fd, bool isSyncFile);
+private:
+    int  _fd;
+    bool _isSyncFile;
+};
+
+/**
+ * @brief  CPU 访问 DMA-BUF 的同步区间 (DMA_BUF_IOCTL_SYNC)
+ * @note   构造时 SYNC_START (会等待隐式栅栏并处理 cache 一致性), 析构时 SYNC_END
+ */
+class DmaBufCpuAccess
+{
+public:
+    DmaBufCpuAccess(int dmaBufFd, bool write = false);
+    ~DmaBufCpuAccess();
+private:
+    int      _fd;
+    uint64_t _flags;
+};
+
+} // namespace Mmp
@@ -0,0 +1,235 @@
+#include "FrameAnalyzer.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+
+#include "FrameClock.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MMP_FRAME_ANALYZER_NEON 1
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define MMP_FRAME_ANALYZER_AVX2 1
+#endif
+
+namespace Mmp
+{
+
+namespace
+{
+
+constexpr uint32_t kHistogramColumnStep = 8;
+
+using SadCopyFunc = uint64_t (*)(const uint8_t* cur, const uint8_t* ref, uint8_t* dst, size_t size);
+
+/**
+ * @brief 计算 cur 与 ref 的 SAD, 同时将 cur 拷贝到 dst
+ */
+uint64_t SadCopyScalar(const uint8_t* cur, const uint8_t* ref, uint8_t* dst, size_t size)
+{
+    uint64_t sad = 0;
+    for (size_t i=0; i<size; i++)
+    {
+        sad += (uint64_t)std::abs((int)cur[i] - (int)ref[i]);
+        dst[i] = cur[i];
+    }
+    return sad;
+}
+
+#if defined(MMP_FRAME_ANALYZER_NEON)
+uint64_t SadCopyNeon(const uint8_t* cur, const uint8_t* ref, uint8_t* dst, size_t size)
+{
+    // Hint : 每次迭代每个 u32 通道最多累加 4 * 255, 单行不会溢出
+    uint32x4_t acc = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        uint8x16_t a = vld1q_u8(cur + i);
+        uint8x16_t b = vld1q_u8(ref + i);
+        acc = vpadalq_u16(acc, vpaddlq_u8(vabdq_u8(a, b)));
+        vst1q_u8(dst + i, a);
+    }
+    uint64x2_t sum = vpaddlq_u32(acc);
+    uint64_t sad = vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+    return sad + SadCopyScalar(cur + i, ref + i, dst + i, size - i);
+}
+#endif /* MMP_FRAME_ANALYZER_NEON */
+
+#if defined(MMP_FRAME_ANALYZER_AVX2)
+__attribute__((target("avx2"))) uint64_t SadCopyAvx2(const uint8_t* cur, const uint8_t* ref, uint8_t* dst, size_t size)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(cur + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(ref + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(a, b));
+        _mm256_storeu_si256((__m256i*)(dst + i), a);
+    }
+    uint64_t sad = (uint64_t)_mm256_extract_epi64(acc, 0) + (uint64_t)_mm256_extract_epi64(acc, 1)
+                 + (uint64_t)_mm256_extract_epi64(acc, 2) + (uint64_t)_mm256_extract_epi64(acc, 3);
+    return sad + SadCopyScalar(cur + i, ref + i, dst + i, size - i);
+}
+#endif /* MMP_FRAME_ANALYZER_AVX2 */
+
+/**
+ * @brief 按 CPU 能力选择实现, 只在首次调用时检测
+ */
+SadCopyFunc SelectSadCopy(std::string& backend)
+{
+#if defined(MMP_FRAME_ANALYZER_NEON)
+    backend = "neon";
+    return SadCopyNeon;
+#elif defined(MMP_FRAME_ANALYZER_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        backend = "avx2";
+        return SadCopyAvx2;
+    }
+#endif
+    backend = "scalar";
+    return SadCopyScalar;
+}
+
+std::string gBackend;
+SadCopyFunc gSadCopy = SelectSadCopy(gBackend);
+
+} // namespace
+
+FrameAnalyzer::FrameAnalyzer(uint32_t width, uint32_t height, uint32_t minSceneCutInterval, uint32_t rowStep)
+{
+    _width = width;
+    _height = height;
+    _rowStep = rowStep == 0 ? 1 : rowStep;
+    _minSceneCutInterval = minSceneCutInterval;
+    _sceneCutHistogramDiff = 0.4;
+    _sceneCutSad = 12;
+    _staticSad = 0.5;
+    _reference.resize((size_t)width * ((height + _rowStep - 1) / _rowStep));
+    _candidate.resize(_reference.size());
+    _histogram.fill(0);
+    _candidateHistogram.fill(0);
+    _hasReference = false;
+    _hasCandidate = false;
+    _frameIndex = 0;
+    _lastSceneCutIndex = 0;
+    _analyzedNum = 0;
+    _sceneCutNum = 0;
+    _staticNum = 0;
+    _totalCostNs = 0;
+    _maxCostNs = 0;
+}
+
+void FrameAnalyzer::SetThresholds(double sceneCutHistogramDiff, double sceneCutSad, double staticSad)
+{
+    _sceneCutHistogramDiff = sceneCutHistogramDiff;
+    _sceneCutSad = sceneCutSad;
+    _staticSad = staticSad;
+}
+
+FrameAnalysis FrameAnalyzer::Analyze(const uint8_t* luma, uint32_t stride)
+{
+    FrameAnalysis analysis;
+    uint64_t beginNs = FrameClock::NowNs();
+    // Hint : 4 份直方图交替累加, 避免相邻像素落在同一区间时的写后读依赖
+    uint32_t subHistograms[4][kHistogramBinNum] = {};
+    uint64_t sad = 0;
+    uint64_t histogramSampleNum = 0;
+    const uint8_t* ref = _reference.data();
+    uint8_t* dst = _candidate.data();
+    for (uint32_t y=0; y<_height; y+=_rowStep)
+    {
+        const uint8_t* row = luma + (size_t)y * stride;
+        uint32_t x = 0;
+        for (; x + 3 * kHistogramColumnStep < _width; x += 4 * kHistogramColumnStep)
+        {
+            subHistograms[0][row[x] * kHistogramBinNum / 256]++;
+            subHistograms[1][row[x + kHistogramColumnStep] * kHistogramBinNum / 256]++;
+            subHistograms[2][row[x + 2 * kHistogramColumnStep] * kHistogramBinNum / 256]++;
+            subHistograms[3][row[x + 3 * kHistogramColumnStep] * kHistogramBinNum / 256]++;
+        }
+        for (; x < _width; x += kHistogramColumnStep)
+        {
+            subHistograms[0][row[x] * kHistogramBinNum / 256]++;
+        }
+        histogramSampleNum += (_width + kHistogramColumnStep - 1) / kHistogramColumnStep;
+        sad += gSadCopy(row, ref, dst, _width);
+        ref += _width;
+        dst += _width;
+    }
+    std::array<uint32_t, kHistogramBinNum> histogram;
+    for (uint32_t i=0; i<kHistogramBinNum; i++)
+    {
+        histogram[i] = subHistograms[0][i] + subHistograms[1][i] + subHistograms[2][i] + subHistograms[3][i];
+    }
+    if (_hasReference)
+    {
+        uint64_t sampleNum = (uint64_t)_width * ((_height + _rowStep - 1) / _rowStep);
+        uint64_t histogramDiff = 0;
+        for (uint32_t i=0; i<kHistogramBinNum; i++)
+        {
+            histogramDiff += (uint64_t)std::abs((int64_t)histogram[i] - (int64_t)_histogram[i]);
+        }
+        analysis.sad = sampleNum ? (double)sad / sampleNum : 0;
+        analysis.histogramDiff = histogramSampleNum ? (double)histogramDiff / (2 * histogramSampleNum) : 0;
+        // Hint : 直方图相近但 SAD 很大 (如构图不同而亮度分布相近的两个场景) 同样视为切换
+        bool changed = analysis.sad >= _sceneCutSad && (analysis.histogramDiff >= _sceneCutHistogramDiff || analysis.sad >= 3 * _sceneCutSad);
+        analysis.sceneCut = changed && _frameIndex - _lastSceneCutIndex >= _minSceneCutInterval;
+        analysis.isStatic = analysis.sad < _staticSad;
+    }
+    else
+    {
+        analysis.sceneCut = true;
+    }
+    if (analysis.sceneCut)
+    {
+        _lastSceneCutIndex = _frameIndex;
+        _sceneCutNum++;
+    }
+    _staticNum += analysis.isStatic ? 1 : 0;
+    _candidateHistogram = histogram;
+    _hasCandidate = true;
+    _frameIndex++;
+    _analyzedNum++;
+    analysis.costNs = FrameClock::NowNs() - beginNs;
+    _totalCostNs += analysis.costNs;
+    _maxCostNs = std::max(_maxCostNs, analysis.costNs);
+    return analysis;
+}
+
+void FrameAnalyzer::Skip()
+{
+    _frameIndex++;
+    _staticNum++;
+}
+
+void FrameAnalyzer::Commit()
+{
+    if (!_hasCandidate)
+    {
+        return;
+    }
+    _reference.swap(_candidate);
+    _histogram = _candidateHistogram;
+    _hasReference = true;
+    _hasCandidate = false;
+}
+
+std::string FrameAnalyzer::Report()
+{
+    std::stringstream ss;
+    ss << "FrameAnalyzer (" << Backend() << ") " << _width << "x" << _height << " frames : " << _frameIndex
+       << ", analyzed : " << _analyzedNum << ", scene cut : " << _sceneCutNum << ", static : " << _staticNum
+       << ", avg cost : " << (_analyzedNum ? _totalCostNs / _analyzedNum / 1000 : 0) << " us, max cost : " << _maxCostNs / 1000 << " us";
+    return ss.str();
+}
+
+std::string FrameAnalyzer::Backend()
+{
+    return gBackend;
+}
+
+} // namespace Mmp
@@ -0,0 +1,128 @@
+#include "FrameBufferRing.h"
+
+#include <chrono>
+#include <sstream>
+
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+FrameBufferRing::FrameBufferRing(uint32_t depth)
+{
+    _depth = depth == 0 ? 1 : depth;
+    _publishNum = 0;
+    _stallNum = 0;
+    _stallTimeUs = 0;
+    _timeoutNum = 0;
+    _overwriteNum = 0;
+    _maxInFlight = 0;
+}
+
+bool FrameBufferRing::NextTargetBusy()
+{
+    if (_publishOrder.size() < _depth)
+    {
+        return false;
+    }
+    uintptr_t next = _publishOrder.front();
+    return _holdCount.count(next) && _holdCount[next] != 0;
+}
+
+bool FrameBufferRing::WaitWritable(int32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_mtx);
+    if (!NextTargetBusy())
+    {
+        return true;
+    }
+    _stallNum++;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    bool writable = _cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]()
+    {
+        return !NextTargetBusy();
+    });
+    _stallTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    if (!writable)
+    {
+        _timeoutNum++;
+    }
+    return writable;
+}
+
+Codec::StreamFrame::ptr FrameBufferRing::Publish(AbstractAllocateMethod::ptr allocateMethod, const PixelsInfo& info)
+{
+    uintptr_t key = (uintptr_t)allocateMethod.get();
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _publishNum++;
+        if (_holdCount[key] != 0)
+        {
+            // Hint : 合成器渲染到了仍被持有的 framebuffer, 说明 ring 深度不足或轮转顺序与预期不符
+            _overwriteNum++;
+        }
+        _holdCount[key]++;
+        _publishOrder.push_back(key);
+        while (_publishOrder.size() > _depth)
+        {
+            _publishOrder.pop_front();
+        }
+        uint32_t inFlight = 0;
+        for (const auto& hold : _holdCount)
+        {
+            inFlight += hold.second != 0 ? 1 : 0;
+        }
+        if (inFlight > _maxInFlight)
+        {
+            _maxInFlight = inFlight;
+        }
+    }
+    std::weak_ptr<FrameBufferRing> weakRing = shared_from_this();
+    return std::shared_ptr<Codec::StreamFrame>(new Codec::StreamFrame(info, allocateMethod), [weakRing, key](Codec::StreamFrame* frame)
+    {
+        delete frame;
+        FrameBufferRing::ptr ring = weakRing.lock();
+        if (ring)
+        {
+            ring->Release(key);
+        }
+    });
+}
+
+void FrameBufferRing::Release(uintptr_t key)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_holdCount.count(key) && _holdCount[key] != 0)
+    {
+        _holdCount[key]--;
+    }
+    _cond.notify_all();
+}
+
+uint32_t FrameBufferRing::Depth()
+{
+    return _depth;
+}
+
+uint32_t FrameBufferRing::InFlight()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    uint32_t inFlight = 0;
+    for (const auto& hold : _holdCount)
+    {
+        inFlight += hold.second != 0 ? 1 : 0;
+    }
+    return inFlight;
+}
+
+std::string FrameBufferRing::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::stringstream ss;
+    ss << "FrameBufferRing depth : " << _depth << ", publish : " << _publishNum << ", max in flight : " << _maxInFlight;
+    ss << ", stall : " << _stallNum << " (" << _stallTimeUs / 1000 << " ms)" << ", timeout : " << _timeoutNum;
+    ss << ", overwrite : " << _overwriteNum;
+    return ss.str();
+}
+
+} // namespace Mmp
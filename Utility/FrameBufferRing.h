@@ -0,0 +1,75 @@
+//
+// FrameBufferRing.h
+//
+// Library: Common
+// Package: Utility
+// Module:  FrameBufferRing
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "Common/PixelsInfo.h"
+#include "Codec/StreamFrame.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief  合成输出 buffer 环的所有权跟踪
+ * @note   1 - 合成器按顺序在 depth 个 framebuffer 之间轮转渲染, 故下一次渲染的目标
+ *             即为 depth 次发布之前的 framebuffer
+ *         2 - Publish 返回的 StreamFrame 由编码、显示等消费者共享, 引用计数归零时自动 release
+ *         3 - 目标 framebuffer 仍被持有时 WaitWritable 阻塞, 而不是覆盖正在被 VENC 读取的数据
+ *         4 - 线程安全
+ */
+class FrameBufferRing : public std::enable_shared_from_this<FrameBufferRing>
+{
+public:
+    using ptr = std::shared_ptr<FrameBufferRing>;
+public:
+    explicit FrameBufferRing(uint32_t depth);
+public:
+    /**
+     * @brief  等待下一个渲染目标可写
+     * @return 超时时返回 false, 调用方应跳过本次渲染
+     */
+    bool WaitWritable(int32_t timeoutMs);
+    /**
+     * @brief      发布渲染完成的 framebuffer
+     * @param[in]  allocateMethod : framebuffer 的内存
+     * @return     带所有权的 StreamFrame, 所有持有者释放后归还到 ring
+     */
+    Codec::StreamFrame::ptr Publish(AbstractAllocateMethod::ptr allocateMethod, const PixelsInfo& info);
+    uint32_t Depth();
+    /**
+     * @brief 当前被消费者持有的 framebuffer 数
+     */
+    uint32_t InFlight();
+    std::string Report();
+private:
+    void Release(uintptr_t key);
+    bool NextTargetBusy();
+private:
+    std::mutex _mtx;
+    std::condition_variable _cond;
+    uint32_t _depth;
+    std::deque<uintptr_t> _publishOrder; // 最近 depth 次发布的 framebuffer
+    std::unordered_map<uintptr_t, uint32_t> _holdCount;
+private: /* statistics */
+    uint64_t _publishNum;
+    uint64_t _stallNum;
+    uint64_t _stallTimeUs;
+    uint64_t _timeoutNum;
+    uint64_t _overwriteNum;
+    uint32_t _maxInFlight;
+};
+
+} // namespace Mmp
@@ -0,0 +1,163 @@
+#include "FrameClock.h"
+
+#include <cerrno>
+#include <ctime>
+#include <cassert>
+#include <sstream>
+
+namespace Mmp
+{
+
+constexpr uint64_t kNsPerSecond = 1000000000ull;
+// 追赶模式下最多落后 1s, 超出后视为时间线已失效, 直接对齐到下一个 deadline
+constexpr uint64_t kMaxCatchUpNs = kNsPerSecond;
+// 抖动直方图各区间上界, 单位 us, 最后一个区间无上界
+constexpr uint64_t kJitterBucketUs[FrameClock::kJitterBucketNum - 1] = {50, 100, 250, 500, 1000, 2000, 5000, 10000};
+
+FrameClock::FrameClock(uint32_t fpsNum, uint32_t fpsDen, Policy policy)
+{
+    assert(fpsNum != 0 && fpsDen != 0);
+    _fpsNum = fpsNum == 0 ? 30 : fpsNum;
+    _fpsDen = fpsDen == 0 ? 1 : fpsDen;
+    _policy = policy;
+    _started = false;
+    _startNs = 0;
+    _index = 0;
+    _jitterHistogram.fill(0);
+    _maxJitterNs = 0;
+    _totalJitterNs = 0;
+    _waitCount = 0;
+    _lateCount = 0;
+    _skipCount = 0;
+}
+
+uint64_t FrameClock::NowNs()
+{
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * kNsPerSecond + (uint64_t)ts.tv_nsec;
+}
+
+void FrameClock::SleepUntilNs(uint64_t deadlineNs)
+{
+    struct timespec ts = {};
+    ts.tv_sec = deadlineNs / kNsPerSecond;
+    ts.tv_nsec = deadlineNs % kNsPerSecond;
+    // Hint : 被信号打断时 clock_nanosleep 返回 EINTR, 绝对时间可直接重试
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+}
+
+void FrameClock::Reset()
+{
+    _started = true;
+    _startNs = NowNs();
+    _index = 0;
+    _jitterHistogram.fill(0);
+    _maxJitterNs = 0;
+    _totalJitterNs = 0;
+    _waitCount = 0;
+    _lateCount = 0;
+    _skipCount = 0;
+}
+
+uint64_t FrameClock::DeadlineNs(uint64_t index)
+{
+    // Hint : 按帧序号整体计算而非逐帧累加, 30000/1001 这类帧率也不会产生漂移;
+    //        先按 _fpsNum 帧 (整 _fpsDen 秒) 拆分, 避免 index * _fpsDen * 1e9 溢出 uint64
+    return _startNs + (index / _fpsNum) * _fpsDen * kNsPerSecond + (index % _fpsNum) * _fpsDen * kNsPerSecond / _fpsNum;
+}
+
+uint64_t FrameClock::FrameIntervalNs()
+{
+    return (uint64_t)_fpsDen * kNsPerSecond / _fpsNum;
+}
+
+uint64_t FrameClock::FrameIndex()
+{
+    return _index;
+}
+
+uint64_t FrameClock::Wait()
+{
+    if (!_started)
+    {
+        Reset();
+        return 0;
+    }
+    uint64_t skipped = 0;
+    _index++;
+    uint64_t deadline = DeadlineNs(_index);
+    uint64_t now = NowNs();
+    if (now > deadline)
+    {
+        _lateCount++;
+        if (_policy == Policy::SKIP || now - deadline > kMaxCatchUpNs)
+        {
+            // 对齐到下一个尚未到达的 deadline
+            uint64_t periodNs = _fpsDen * kNsPerSecond; // _fpsNum 帧的时长
+            uint64_t elapsedNs = now - _startNs;
+            uint64_t nextIndex = elapsedNs / periodNs * _fpsNum + elapsedNs % periodNs * _fpsNum / periodNs + 1;
+            skipped = nextIndex - _index;
+            _skipCount += skipped;
+            _index = nextIndex;
+            deadline = DeadlineNs(_index);
+        }
+        else
+        {
+            // Hint : 追赶模式下不休眠, 由调用方连续处理直至追上时间线
+            return 0;
+        }
+    }
+    SleepUntilNs(deadline);
+    now = NowNs();
+    RecordJitter(now > deadline ? now - deadline : 0);
+    return skipped;
+}
+
+void FrameClock::RecordJitter(uint64_t jitterNs)
+{
+    uint64_t jitterUs = jitterNs / 1000;
+    uint32_t bucket = 0;
+    for (; bucket < kJitterBucketNum - 1; bucket++)
+    {
+        if (jitterUs < kJitterBucketUs[bucket])
+        {
+            break;
+        }
+    }
+    _jitterHistogram[bucket]++;
+    _waitCount++;
+    _totalJitterNs += jitterNs;
+    if (jitterNs > _maxJitterNs)
+    {
+        _maxJitterNs = jitterNs;
+    }
+}
+
+std::string FrameClock::Report()
+{
+    std::stringstream ss;
+    ss << "FrameClock(" << _fpsNum << "/" << _fpsDen << " fps, " << (_policy == Policy::SKIP ? "skip" : "catch up") << ")";
+    ss << " frames : " << _index << ", late : " << _lateCount << ", skipped : " << _skipCount;
+    ss << ", avg jitter : " << (_waitCount ? _totalJitterNs / _waitCount / 1000 : 0) << " us";
+    ss << ", max jitter : " << _maxJitterNs / 1000 << " us";
+    ss << std::endl << "-- jitter histogram :";
+    uint64_t lower = 0;
+    for (uint32_t i=0; i<kJitterBucketNum; i++)
+    {
+        ss << std::endl << "  ";
+        if (i < kJitterBucketNum - 1)
+        {
+            ss << "[" << lower << ", " << kJitterBucketUs[i] << ") us : ";
+            lower = kJitterBucketUs[i];
+        }
+        else
+        {
+            ss << "[" << lower << ", +inf) us : ";
+        }
+        ss << _jitterHistogram[i];
+    }
+    return ss.str();
+}
+
+} // namespace Mmp
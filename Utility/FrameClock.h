@@ -0,0 +1,101 @@
+//
+// FrameClock.h
+//
+// Library: Common
+// Package: Utility
+// Module:  FrameClock
+//
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+namespace Mmp
+{
+
+/**
+ * @brief  帧时钟, 基于绝对 deadline 的帧率控制
+ * @note   1 - 第 N 帧的 deadline 为 start + N * den / num 秒, 由整数运算得到, 不会累计误差
+ *         2 - 使用 clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME) 休眠, 不受处理耗时影响
+ *         3 - 非线程安全, 每条需要控速的线程持有一个实例
+ */
+class FrameClock
+{
+public:
+    using ptr = std::shared_ptr<FrameClock>;
+public:
+    /**
+     * @brief 落后于 deadline 时的处理策略
+     */
+    enum class Policy
+    {
+        CATCH_UP,   // 不休眠连续处理, 直至追上时间线
+        SKIP,       // 丢弃已错过的 deadline, 对齐到下一个未来的 deadline
+    };
+public:
+    /**
+     * @param[in] fpsNum : 帧率分子
+     * @param[in] fpsDen : 帧率分母, 例如 30000/1001
+     * @param[in] policy : 落后时的处理策略
+     */
+    explicit FrameClock(uint32_t fpsNum, uint32_t fpsDen = 1, Policy policy = Policy::SKIP);
+public:
+    /**
+     * @brief 以当前时刻作为第 0 帧的 deadline, 并清空统计
+     */
+    void Reset();
+    /**
+     * @brief  阻塞至下一帧的 deadline
+     * @return 本次被跳过的帧数 (仅 Policy::SKIP 时可能非 0)
+     * @note   首次调用时若未 Reset, 自动以当前时刻为起点
+     */
+    uint64_t Wait();
+    /**
+     * @brief 当前帧序号
+     */
+    uint64_t FrameIndex();
+    /**
+     * @brief 两帧之间的理论间隔, 单位 ns
+     */
+    uint64_t FrameIntervalNs();
+    /**
+     * @brief 唤醒抖动直方图以及丢帧、迟到等统计
+     */
+    std::string Report();
+public:
+    /**
+     * @brief 当前 CLOCK_MONOTONIC 时间, 单位 ns
+     */
+    static uint64_t NowNs();
+    /**
+     * @brief 以绝对时间休眠至 deadlineNs (CLOCK_MONOTONIC)
+     */
+    static void SleepUntilNs(uint64_t deadlineNs);
+public:
+    /**
+     * @brief 抖动直方图区间数, 区间上界见 FrameClock.cpp
+     */
+    static constexpr uint32_t kJitterBucketNum = 9;
+private:
+    uint64_t DeadlineNs(uint64_t index);
+    void RecordJitter(uint64_t jitterNs);
+private:
+    uint32_t _fpsNum;
+    uint32_t _fpsDen;
+    Policy   _policy;
+    bool     _started;
+    uint64_t _startNs;
+    uint64_t _index;
+private: /* statistics */
+    std::array<uint64_t, kJitterBucketNum> _jitterHistogram;
+    uint64_t _maxJitterNs;
+    uint64_t _totalJitterNs;
+    uint64_t _waitCount;
+    uint64_t _lateCount;
+    uint64_t _skipCount;
+};
+
+} // namespace Mmp
@@ -0,0 +1,117 @@
+#include "FramePool.h"
+
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <sstream>
+#include <condition_variable>
+
+#include "Common/DmaHeapAllocateMethod.h"
+
+#include "FrameClock.h"
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief 与输出帧的释放回调共享, 回调可能晚于 FramePool 的析构执行
+ */
+class FramePool::State
+{
+public:
+    std::mutex                           mtx;
+    std::condition_variable              cond;
+    PixelsInfo                           info;
+    bool                                 useDmaHeap = false;
+    std::vector<Codec::StreamFrame::ptr> buffers;
+    std::vector<bool>                    busy;
+    std::vector<uint64_t>                generations;
+    uint32_t                             next = 0;
+public: /* statistics */
+    uint64_t                             acquireNum = 0;
+    uint64_t                             waitNum = 0;
+    uint64_t                             waitNs = 0;
+    uint64_t                             growNum = 0;
+public:
+    void AddBuffer()
+    {
+        AbstractAllocateMethod::ptr alloc;
+        if (useDmaHeap)
+        {
+            alloc = std::make_shared<DmaHeapAllocateMethod>();
+        }
+        buffers.push_back(std::make_shared<Codec::StreamFrame>(info, alloc));
+        busy.push_back(false);
+        generations.push_back(0);
+    }
+};
+
+FramePool::FramePool(const PixelsInfo& info, uint32_t bufferNum, bool useDmaHeap)
+{
+    _state = std::make_shared<State>();
+    _state->info = info;
+    _state->useDmaHeap = useDmaHeap;
+    for (uint32_t i=0; i<(bufferNum == 0 ? 1 : bufferNum); i++)
+    {
+        _state->AddBuffer();
+    }
+}
+
+Codec::StreamFrame::ptr FramePool::Acquire(int32_t timeoutMs)
+{
+    std::shared_ptr<State> state = _state;
+    uint32_t slot = 0;
+    uint64_t generation = 0;
+    Codec::StreamFrame::ptr buffer;
+    {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        slot = state->next;
+        state->next = (state->next + 1) % state->buffers.size();
+        state->acquireNum++;
+        if (state->busy[slot])
+        {
+            uint64_t beginNs = FrameClock::NowNs();
+            state->waitNum++;
+            if (!state->cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [state, slot]() { return !state->busy[slot]; }))
+            {
+                // Hint : buffer 被长期持有 (如编码器保留了最后一帧), 新分配一个而不是覆盖或卡住输入
+                slot = (uint32_t)state->buffers.size();
+                state->AddBuffer();
+                state->growNum++;
+                UTILITY_LOG_WARN << "Frame pool buffer is still in use, grow to " << state->buffers.size() << " buffers";
+            }
+            state->waitNs += FrameClock::NowNs() - beginNs;
+        }
+        state->busy[slot] = true;
+        generation = ++state->generations[slot];
+        buffer = state->buffers[slot];
+    }
+    return Codec::StreamFrame::ptr(buffer.get(), [state, buffer, slot, generation](Codec::StreamFrame*)
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        if (state->generations[slot] != generation)
+        {
+            return;
+        }
+        state->busy[slot] = false;
+        state->cond.notify_all();
+    });
+}
+
+uint32_t FramePool::Size()
+{
+    std::lock_guard<std::mutex> lock(_state->mtx);
+    return (uint32_t)_state->buffers.size();
+}
+
+std::string FramePool::Report()
+{
+    std::lock_guard<std::mutex> lock(_state->mtx);
+    std::stringstream ss;
+    ss << "FramePool buffers : " << _state->buffers.size() << ", acquire : " << _state->acquireNum
+       << ", wait : " << _state->waitNum << " (" << _state->waitNs / 1000000 << " ms), grow : " << _state->growNum;
+    return ss.str();
+}
+
+} // namespace Mmp
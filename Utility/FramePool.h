@@ -0,0 +1,52 @@
+//
+// FramePool.h
+//
+// Library: Common
+// Package: Utility
+// Module:  FramePool
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "Common/PixelsInfo.h"
+#include "Codec/StreamFrame.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief  固定数量输入帧 buffer 的轮转池
+ * @note   1 - Acquire 按顺序返回下一个 buffer, 其仍被编码器等持有时等待归还, 不会覆盖正在被 VENC 读取的数据;
+ *             等待超时 (buffer 被长期持有, 如编码器保留了最后一帧) 时新分配一个 buffer 加入池中, 计入 Report
+ *         2 - 返回的 StreamFrame 引用计数归零时归还 buffer, 可在任意线程释放, 可晚于 FramePool 析构;
+ *             每次 Acquire 递增该 buffer 的代数, 归还时代数不一致 (已被再次借出) 的释放被忽略
+ *         3 - Acquire 仅由一个线程调用
+ */
+class FramePool
+{
+public:
+    using ptr = std::shared_ptr<FramePool>;
+public:
+    /**
+     * @param[in] bufferNum  : buffer 数, 应大于下游 (队列 + 编码器在途) 可持有的帧数
+     * @param[in] useDmaHeap : 是否使用 DMA-HEAP 分配
+     */
+    FramePool(const PixelsInfo& info, uint32_t bufferNum, bool useDmaHeap = false);
+public:
+    /**
+     * @brief 获取下一个可写的 buffer
+     */
+    Codec::StreamFrame::ptr Acquire(int32_t timeoutMs);
+    uint32_t Size();
+    std::string Report();
+private:
+    class State;
+private:
+    std::shared_ptr<State> _state;
+};
+
+} // namespace Mmp
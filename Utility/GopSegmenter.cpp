@@ -0,0 +1,84 @@
+#include "GopSegmenter.h"
+
+namespace Mmp
+{
+
+GopSegmenter::GopSegmenter(H26xCodec codec, uint32_t minFrameNum)
+{
+    _codec = codec;
+    _minFrameNum = minFrameNum;
+    _segmentNum = 0;
+}
+
+void GopSegmenter::Append(NormalPack::ptr pack)
+{
+    if (!_cur)
+    {
+        _cur = std::make_shared<GopSegment>();
+        _cur->index = _segmentNum++;
+        _cur->frameNum = 0;
+        _cur->size = 0;
+    }
+    _cur->packs.push_back(pack);
+    _cur->size += pack->GetSize();
+}
+
+GopSegment::ptr GopSegmenter::Push(NormalPack::ptr pack)
+{
+    const uint8_t* data = (const uint8_t*)pack->GetData(0);
+    size_t size = pack->GetSize();
+    if (!H26xNal::IsVcl(_codec, data, size))
+    {
+        if (H26xNal::IsParameterSet(_codec, data, size))
+        {
+            _parameterSets[H26xNal::Type(_codec, data, size)] = pack;
+        }
+        _pending.push_back(pack);
+        return nullptr;
+    }
+    GopSegment::ptr segment;
+    bool isFirstSlice = H26xNal::IsFirstSliceOfPicture(_codec, data, size);
+    if (isFirstSlice && H26xNal::IsIdr(_codec, data, size) && _cur && _cur->frameNum >= _minFrameNum && _cur->frameNum != 0)
+    {
+        segment = _cur;
+        _cur = nullptr;
+        // Hint : 新分段必须以参数集开头, 码流中仅在开头出现一次参数集时从缓存中补齐
+        bool hasParameterSet = false;
+        for (const auto& pending : _pending)
+        {
+            hasParameterSet = hasParameterSet || H26xNal::IsParameterSet(_codec, (const uint8_t*)pending->GetData(0), pending->GetSize());
+        }
+        if (!hasParameterSet)
+        {
+            for (const auto& parameterSet : _parameterSets)
+            {
+                Append(parameterSet.second);
+            }
+        }
+    }
+    for (const auto& pending : _pending)
+    {
+        Append(pending);
+    }
+    _pending.clear();
+    Append(pack);
+    if (isFirstSlice)
+    {
+        _cur->frameNum++;
+    }
+    return segment;
+}
+
+GopSegment::ptr GopSegmenter::Flush()
+{
+    for (const auto& pack : _pending)
+    {
+        Append(pack);
+    }
+    _pending.clear();
+    GopSegment::ptr segment = _cur;
+    _cur = nullptr;
+    return segment;
+}
+
+} // namespace Mmp
@@ -0,0 +1,72 @@
+//
+// GopSegmenter.h
+//
+// Library: Common
+// Package: Utility
+// Module:  GopSegmenter
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Common/NormalPack.h"
+
+#include "H26xBitstream.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief 以 IDR 开始、可独立解码的一段码流
+ */
+class GopSegment
+{
+public:
+    using ptr = std::shared_ptr<GopSegment>;
+public:
+    uint32_t                     index;    // 在原码流中的序号
+    uint32_t                     frameNum; // access unit 数
+    uint64_t                     size;     // 字节数
+    std::vector<NormalPack::ptr> packs;
+};
+
+/**
+ * @brief  按 IDR 边界切分 Annex-B 码流
+ * @note   1 - IDR 之前的非 VCL NAL (SPS、PPS、SEI 等) 归属于 IDR 所在的分段
+ *         2 - 分段开头缺少参数集时补上最近一次出现的参数集, 保证每段可独立解码
+ *         3 - 不足 minFrameNum 帧时不切分, 避免 GOP 过短时编解码器初始化开销占比过高
+ *         4 - 第一个 IDR 之前的帧无法独立解码, 与第一个分段合并 (由解码器自行丢弃)
+ *         5 - 非线程安全
+ */
+class GopSegmenter
+{
+public:
+    using ptr = std::shared_ptr<GopSegmenter>;
+public:
+    explicit GopSegmenter(H26xCodec codec, uint32_t minFrameNum = 0);
+public:
+    /**
+     * @brief  送入下一个 NAL 单元
+     * @return 上一个分段完整时返回该分段, 否则返回 nullptr
+     */
+    GopSegment::ptr Push(NormalPack::ptr pack);
+    /**
+     * @brief 码流结束, 返回最后一个分段
+     */
+    GopSegment::ptr Flush();
+private:
+    void Append(NormalPack::ptr pack);
+private:
+    H26xCodec _codec;
+    uint32_t _minFrameNum;
+    uint32_t _segmentNum;
+    GopSegment::ptr _cur;
+    std::vector<NormalPack::ptr> _pending; // 尚未确定归属的非 VCL NAL
+    std::map<uint8_t, NormalPack::ptr> _parameterSets; // NAL 类型 -> 最近一次出现的参数集
+};
+
+} // namespace Mmp
@@ -0,0 +1,464 @@
+#include "H26xBitstream.h"
+
+#include <map>
+
+namespace Mmp
+{
+
+namespace
+{
+
+constexpr uint8_t kH264NalSliceNonIdr = 1;
+constexpr uint8_t kH264NalSliceIdr    = 5;
+constexpr uint8_t kH264NalSps         = 7;
+constexpr uint8_t kH264NalPps         = 8;
+
+constexpr uint8_t kH265NalSubLayerMax = 14; // RSV_VCL_N14
+constexpr uint8_t kH265NalVclMax      = 31;
+constexpr uint8_t kH265NalIdrWRadl    = 19;
+constexpr uint8_t kH265NalIdrNLp      = 20;
+constexpr uint8_t kH265NalVps         = 32;
+constexpr uint8_t kH265NalSps         = 33;
+constexpr uint8_t kH265NalPps         = 34;
+
+bool ParseH264FrameRate(H26xBitReader& br, uint32_t& fpsNum, uint32_t& fpsDen)
+{
+    uint32_t profileIdc = br.U(8);
+    br.Skip(8); // constraint_set_flags + reserved_zero_2bits
+    br.Skip(8); // level_idc
+    br.UE();    // seq_parameter_set_id
+    if (profileIdc == 100 || profileIdc == 110 || profileIdc == 122 || profileIdc == 244 || profileIdc == 44 ||
+        profileIdc == 83  || profileIdc == 86  || profileIdc == 118 || profileIdc == 128 || profileIdc == 138 ||
+        profileIdc == 139 || profileIdc == 134 || profileIdc == 135
+    )
+    {
+        uint32_t chromaFormatIdc = br.UE();
+        if (chromaFormatIdc == 3)
+        {
+            br.Skip(1); // separate_colour_plane_flag
+        }
+        br.UE();    // bit_depth_luma_minus8
+        br.UE();    // bit_depth_chroma_minus8
+        br.Skip(1); // qpprime_y_zero_transform_bypass_flag
+        if (br.U(1)) // seq_scaling_matrix_present_flag
+        {
+            uint32_t listNum = chromaFormatIdc != 3 ? 8 : 12;
+            for (uint32_t i=0; i<listNum; i++)
+            {
+                if (!br.U(1)) // seq_scaling_list_present_flag
+                {
+                    continue;
+                }
+                uint32_t sizeOfScalingList = i < 6 ? 16 : 64;
+                int32_t lastScale = 8;
+                int32_t nextScale = 8;
+                for (uint32_t j=0; j<sizeOfScalingList && nextScale != 0; j++)
+                {
+                    int32_t deltaScale = br.SE();
+                    nextScale = (lastScale + deltaScale + 256) % 256;
+                    lastScale = nextScale == 0 ? lastScale : nextScale;
+                }
+            }
+        }
+    }
+    br.UE(); // log2_max_frame_num_minus4
+    uint32_t picOrderCntType = br.UE();
+    if (picOrderCntType == 0)
+    {
+        br.UE(); // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if (picOrderCntType == 1)
+    {
+        br.Skip(1); // delta_pic_order_always_zero_flag
+        br.SE();    // offset_for_non_ref_pic
+        br.SE();    // offset_for_top_to_bottom_field
+        uint32_t numRefFramesInPicOrderCntCycle = br.UE();
+        for (uint32_t i=0; i<numRefFramesInPicOrderCntCycle && !br.Overflow(); i++)
+        {
+            br.SE(); // offset_for_ref_frame
+        }
+    }
+    br.UE();    // max_num_ref_frames
+    br.Skip(1); // gaps_in_frame_num_value_allowed_flag
+    br.UE();    // pic_width_in_mbs_minus1
+    br.UE();    // pic_height_in_map_units_minus1
+    if (!br.U(1)) // frame_mbs_only_flag
+    {
+        br.Skip(1); // mb_adaptive_frame_field_flag
+    }
+    br.Skip(1); // direct_8x8_inference_flag
+    if (br.U(1)) // frame_cropping_flag
+    {
+        br.UE();
+        br.UE();
+        br.UE();
+        br.UE();
+    }
+    if (!br.U(1)) // vui_parameters_present_flag
+    {
+        return false;
+    }
+    if (br.U(1)) // aspect_ratio_info_present_flag
+    {
+        if (br.U(8) == 255) // Extended_SAR
+        {
+            br.Skip(16); // sar_width
+            br.Skip(16); // sar_height
+        }
+    }
+    if (br.U(1)) // overscan_info_present_flag
+    {
+        br.Skip(1); // overscan_appropriate_flag
+    }
+    if (br.U(1)) // video_signal_type_present_flag
+    {
+        br.Skip(4); // video_format + video_full_range_flag
+        if (br.U(1)) // colour_description_present_flag
+        {
+            br.Skip(24);
+        }
+    }
+    if (br.U(1)) // chroma_loc_info_present_flag
+    {
+        br.UE();
+        br.UE();
+    }
+    if (!br.U(1)) // timing_info_present_flag
+    {
+        return false;
+    }
+    uint32_t numUnitsInTick = br.U(32);
+    uint32_t timeScale = br.U(32);
+    if (br.Overflow() || numUnitsInTick == 0 || timeScale == 0)
+    {
+        return false;
+    }
+    // Hint : H.264 中一帧对应两个 tick (field)
+    fpsNum = timeScale;
+    fpsDen = numUnitsInTick * 2;
+    return true;
+}
+
+void SkipH265ProfileTierLevel(H26xBitReader& br, uint32_t maxSubLayersMinus1)
+{
+    br.Skip(88); // general profile
+    br.Skip(8);  // general_level_idc
+    std::vector<bool> subLayerProfilePresent(maxSubLayersMinus1);
+    std::vector<bool> subLayerLevelPresent(maxSubLayersMinus1);
+    for (uint32_t i=0; i<maxSubLayersMinus1; i++)
+    {
+        subLayerProfilePresent[i] = br.U(1);
+        subLayerLevelPresent[i] = br.U(1);
+    }
+    if (maxSubLayersMinus1 > 0)
+    {
+        for (uint32_t i=maxSubLayersMinus1; i<8; i++)
+        {
+            br.Skip(2); // reserved_zero_2bits
+        }
+    }
+    for (uint32_t i=0; i<maxSubLayersMinus1; i++)
+    {
+        if (subLayerProfilePresent[i])
+        {
+            br.Skip(88);
+        }
+        if (subLayerLevelPresent[i])
+        {
+            br.Skip(8);
+        }
+    }
+}
+
+bool ParseH265FrameRate(H26xBitReader& br, uint32_t& fpsNum, uint32_t& fpsDen)
+{
+    br.Skip(4); // vps_video_parameter_set_id
+    br.Skip(2); // vps_base_layer_internal_flag + vps_base_layer_available_flag
+    br.Skip(6); // vps_max_layers_minus1
+    uint32_t maxSubLayersMinus1 = br.U(3);
+    br.Skip(1);  // vps_temporal_id_nesting_flag
+    br.Skip(16); // vps_reserved_0xffff_16bits
+    SkipH265ProfileTierLevel(br, maxSubLayersMinus1);
+    bool subLayerOrderingInfoPresent = br.U(1);
+    for (uint32_t i=(subLayerOrderingInfoPresent ? 0 : maxSubLayersMinus1); i<=maxSubLayersMinus1; i++)
+    {
+        br.UE(); // vps_max_dec_pic_buffering_minus1
+        br.UE(); // vps_max_num_reorder_pics
+        br.UE(); // vps_max_latency_increase_plus1
+    }
+    uint32_t maxLayerId = br.U(6);
+    uint32_t numLayerSetsMinus1 = br.UE();
+    for (uint32_t i=1; i<=numLayerSetsMinus1 && !br.Overflow(); i++)
+    {
+        br.Skip(maxLayerId + 1); // layer_id_included_flag
+    }
+    if (!br.U(1)) // vps_timing_info_present_flag
+    {
+        return false;
+    }
+    uint32_t numUnitsInTick = br.U(32);
+    uint32_t timeScale = br.U(32);
+    if (br.Overflow() || numUnitsInTick == 0 || timeScale == 0)
+    {
+        return false;
+    }
+    fpsNum = timeScale;
+    fpsDen = numUnitsInTick;
+    return true;
+}
+
+} // namespace
+
+bool H26xCodecFromName(const std::string& codecType, H26xCodec& codec)
+{
+    static std::map<std::string, H26xCodec> kLookup =
+    {
+        {"h264", H26xCodec::H264},
+        {"hevc", H26xCodec::H265}
+    };
+    if (kLookup.count(codecType))
+    {
+        codec = kLookup[codecType];
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+H26xBitReader::H26xBitReader(const uint8_t* data, size_t size)
+{
+    _rbsp.reserve(size);
+    uint32_t zeroNum = 0;
+    for (size_t i=0; i<size; i++)
+    {
+        if (zeroNum >= 2 && data[i] == 0x03)
+        {
+            zeroNum = 0;
+            continue;
+        }
+        zeroNum = data[i] == 0 ? zeroNum + 1 : 0;
+        _rbsp.push_back(data[i]);
+    }
+    _bitOffset = 0;
+    _overflow = false;
+}
+
+uint32_t H26xBitReader::U(uint32_t bits)
+{
+    uint32_t value = 0;
+    for (uint32_t i=0; i<bits; i++)
+    {
+        if (_bitOffset >= _rbsp.size() * 8)
+        {
+            _overflow = true;
+            return 0;
+        }
+        uint8_t bit = (_rbsp[_bitOffset / 8] >> (7 - _bitOffset % 8)) & 0x01;
+        value = (value << 1) | bit;
+        _bitOffset++;
+    }
+    return value;
+}
+
+uint32_t H26xBitReader::UE()
+{
+    uint32_t leadingZeroBits = 0;
+    while (!_overflow && U(1) == 0)
+    {
+        leadingZeroBits++;
+        if (leadingZeroBits > 31)
+        {
+            _overflow = true;
+            return 0;
+        }
+    }
+    if (_overflow)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)1 << leadingZeroBits) - 1 + U(leadingZeroBits));
+}
+
+int32_t H26xBitReader::SE()
+{
+    uint32_t codeNum = UE();
+    return (codeNum & 0x01) ? (int32_t)((codeNum + 1) / 2) : -(int32_t)(codeNum / 2);
+}
+
+void H26xBitReader::Skip(uint32_t bits)
+{
+    _bitOffset += bits;
+    if (_bitOffset > _rbsp.size() * 8)
+    {
+        _overflow = true;
+    }
+}
+
+bool H26xBitReader::Overflow()
+{
+    return _overflow;
+}
+
+size_t H26xNal::HeaderOffset(const uint8_t* data, size_t size)
+{
+    if (size >= 4 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1)
+    {
+        return 4;
+    }
+    else if (size >= 3 && data[0] == 0 && data[1] == 0 && data[2] == 1)
+    {
+        return 3;
+    }
+    else
+    {
+        return size;
+    }
+}
+
+std::vector<std::pair<size_t, size_t>> H26xNal::Split(const uint8_t* data, size_t size)
+{
+    std::vector<size_t> begins;
+    for (size_t i=0; i+2<size; i++)
+    {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+        {
+            // Hint : 4 字节起始码的首个 0 归属于当前 NAL
+            begins.push_back(i > 0 && data[i - 1] == 0 ? i - 1 : i);
+            i += 2;
+        }
+    }
+    std::vector<std::pair<size_t, size_t>> nals;
+    for (size_t i=0; i<begins.size(); i++)
+    {
+        size_t end = i + 1 < begins.size() ? begins[i + 1] : size;
+        nals.push_back({begins[i], end - begins[i]});
+    }
+    return nals;
+}
+
+uint8_t H26xNal::Type(H26xCodec codec, const uint8_t* data, size_t size)
+{
+    size_t offset = HeaderOffset(data, size);
+    if (offset >= size)
+    {
+        return 0xFF;
+    }
+    return codec == H26xCodec::H264 ? (data[offset] & 0x1F) : ((data[offset] >> 1) & 0x3F);
+}
+
+bool H26xNal::IsVcl(H26xCodec codec, const uint8_t* data, size_t size)
+{
+    uint8_t type = Type(codec, data, size);
+    if (codec == H26xCodec::H264)
+    {
+        return type >= kH264NalSliceNonIdr && type <= kH264NalSliceIdr;
+    }
+    else
+    {
+        return type <= kH265NalVclMax;
+    }
+}
+
+bool H26xNal::IsFirstSliceOfPicture(H26xCodec codec, const uint8_t* data, size_t size)
+{
+    if (!IsVcl(codec, data, size))
+    {
+        return false;
+    }
+    size_t offset = HeaderOffset(data, size);
+    // Hint : H.264 的 first_mb_in_slice 为 0 时其 ue(v) 编码恰好为 1 bit 的 '1';
+    //        H.265 的 first_slice_segment_in_pic_flag 为 slice header 的第一个 bit
+    size_t headerSize = codec == H26xCodec::H264 ? 1 : 2;
+    if (offset + headerSize >= size)
+    {
+        return false;
+    }
+    return (data[offset + headerSize] & 0x80) != 0;
+}
+
+bool H26xNal::IsIdr(H26xCodec codec, const uint8_t* data, size_t size)
+{
+    uint8_t type = Type(codec, data, size);
+    if (codec == H26xCodec::H264)
+    {
+        return type == kH264NalSliceIdr;
+    }
+    else
+    {
+        return type == kH265NalIdrWRadl || type == kH265NalIdrNLp;
+    }
+}
+
+bool H26xNal::IsNonReference(H26xCodec codec, const uint8_t* data, size_t size, uint8_t maxTemporalId)
+{
+    if (!IsVcl(codec, data, size))
+    {
+        return false;
+    }
+    size_t offset = HeaderOffset(data, size);
+    if (codec == H26xCodec::H264)
+    {
+        return ((data[offset] >> 5) & 0x03) == 0; // nal_ref_idc
+    }
+    if (offset + 2 > size || maxTemporalId == kH265TemporalIdUnknown)
+    {
+        return false;
+    }
+    uint8_t type = Type(codec, data, size);
+    uint8_t temporalId = (data[offset + 1] & 0x07) - 1; // nuh_temporal_id_plus1
+    return type <= kH265NalSubLayerMax && type % 2 == 0 && temporalId == maxTemporalId;
+}
+
+bool H26xNal::ParseMaxTemporalId(H26xCodec codec, const uint8_t* data, size_t size, uint8_t& maxTemporalId)
+{
+    size_t offset = HeaderOffset(data, size);
+    if (codec != H26xCodec::H265 || Type(codec, data, size) != kH265NalSps || offset + 3 > size)
+    {
+        return false;
+    }
+    H26xBitReader br(data + offset + 2, size - offset - 2);
+    br.Skip(4); // sps_video_parameter_set_id
+    maxTemporalId = (uint8_t)br.U(3); // sps_max_sub_layers_minus1
+    return !br.Overflow();
+}
+
+bool H26xNal::IsParameterSet(H26xCodec codec, const uint8_t* data, size_t size)
+{
+    uint8_t type = Type(codec, data, size);
+    if (codec == H26xCodec::H264)
+    {
+        return type == kH264NalSps || type == kH264NalPps;
+    }
+    else
+    {
+        return type == kH265NalVps || type == kH265NalSps || type == kH265NalPps;
+    }
+}
+
+bool H26xNal::ParseFrameRate(H26xCodec codec, const uint8_t* data, size_t size, uint32_t& fpsNum, uint32_t& fpsDen)
+{
+    uint8_t type = Type(codec, data, size);
+    size_t offset = HeaderOffset(data, size);
+    if (offset + 2 > size)
+    {
+        return false;
+    }
+    if (codec == H26xCodec::H264 && type == kH264NalSps)
+    {
+        H26xBitReader br(data + offset + 1, size - offset - 1);
+        return ParseH264FrameRate(br, fpsNum, fpsDen);
+    }
+    else if (codec == H26xCodec::H265 && type == kH265NalVps)
+    {
+        H26xBitReader br(data + offset + 2, size - offset - 2);
+        return ParseH265FrameRate(br, fpsNum, fpsDen);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+} // namespace Mmp
@@ -0,0 +1,112 @@
+//
+// H26xBitstream.h
+//
+// Library: Common
+// Package: Utility
+// Module:  H26xBitstream
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace Mmp
+{
+
+constexpr uint8_t kH265TemporalIdUnknown = 0xFF;
+
+enum class H26xCodec
+{
+    H264,
+    H265,
+};
+
+/**
+ * @brief      根据 -codec 参数 (h264, hevc) 获取码流类型
+ * @param[in]  codecType
+ * @param[out] codec
+ */
+bool H26xCodecFromName(const std::string& codecType, H26xCodec& codec);
+
+/**
+ * @brief  去除防竞争字节 (0x000003) 后的 RBSP 按位读取器
+ */
+class H26xBitReader
+{
+public:
+    H26xBitReader(const uint8_t* data, size_t size);
+public:
+    uint32_t U(uint32_t bits);
+    uint32_t UE();
+    int32_t  SE();
+    void     Skip(uint32_t bits);
+    bool     Overflow();
+private:
+    std::vector<uint8_t> _rbsp;
+    size_t _bitOffset;
+    bool   _overflow;
+};
+
+/**
+ * @brief  Annex-B NAL 单元的简易解析
+ * @note   data 均包含起始码 (00 00 01 或 00 00 00 01)
+ */
+class H26xNal
+{
+public:
+    /**
+     * @brief 跳过起始码, 返回 NAL header 的偏移; 非法时返回 size
+     */
+    static size_t HeaderOffset(const uint8_t* data, size_t size);
+    /**
+     * @brief NAL 类型, 非法时返回 0xFF
+     */
+    static uint8_t Type(H26xCodec codec, const uint8_t* data, size_t size);
+    /**
+     * @brief 是否为视频编码层 (slice) NAL
+     */
+    static bool IsVcl(H26xCodec codec, const uint8_t* data, size_t size);
+    /**
+     * @brief 是否为一帧图像的第一个 slice, 即新的 access unit 的开始
+     */
+    static bool IsFirstSliceOfPicture(H26xCodec codec, const uint8_t* data, size_t size);
+    /**
+     * @brief 是否为 IDR slice
+     */
+    static bool IsIdr(H26xCodec codec, const uint8_t* data, size_t size);
+    /**
+     * @brief     是否为不被参考的 slice, 丢弃后不影响其他帧的解码
+     * @param[in] maxTemporalId : H.265 SPS 的 sps_max_sub_layers_minus1 (见 ParseMaxTemporalId), 未知时为 kH265TemporalIdUnknown
+     * @note      H.264 为 nal_ref_idc 等于 0, 忽略 maxTemporalId;
+     *            H.265 的 sub-layer non-reference 图像 (TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N) 只是不被同一时域层参考,
+     *            仍可能被更高时域层参考, 只有位于最高时域层 (TemporalId 等于 maxTemporalId) 时才可丢弃; maxTemporalId 未知时返回 false
+     */
+    static bool IsNonReference(H26xCodec codec, const uint8_t* data, size_t size, uint8_t maxTemporalId);
+    /**
+     * @brief      从 H.265 SPS 中解析最高时域层 (sps_max_sub_layers_minus1)
+     * @return     非 H.265 SPS 时返回 false
+     */
+    static bool ParseMaxTemporalId(H26xCodec codec, const uint8_t* data, size_t size, uint8_t& maxTemporalId);
+    /**
+     * @brief 是否为参数集 (H.264 SPS/PPS, H.265 VPS/SPS/PPS)
+     */
+    static bool IsParameterSet(H26xCodec codec, const uint8_t* data, size_t size);
+    /**
+     * @brief      从 SPS (H.264) 或 VPS (H.265) 中解析 VUI timing 信息
+     * @param[out] fpsNum : 帧率分子
+     * @param[out] fpsDen : 帧率分母
+     * @return     码流中不包含 timing 信息时返回 false
+     */
+    static bool ParseFrameRate(H26xCodec codec, const uint8_t* data, size_t size, uint32_t& fpsNum, uint32_t& fpsDen);
+    /**
+     * @brief  按起始码将一段码流 (如编码器输出的一个 access unit) 切分为 NAL 单元
+     * @return 各 NAL 单元 (含起始码) 的 {偏移, 大小}
+     */
+    static std::vector<std::pair<size_t, size_t>> Split(const uint8_t* data, size_t size);
+};
+
+} // namespace Mmp
@@ -0,0 +1,242 @@
+#include "LatencyProbe.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+#include "FrameClock.h"
+
+namespace Mmp
+{
+
+namespace
+{
+
+constexpr uint8_t  kStampMarker = 0xA5;
+constexpr uint32_t kStampBytes = LatencyStamp::kBitNum / 8;
+constexpr uint8_t  kStampBlack = 16;
+constexpr uint8_t  kStampWhite = 235;
+constexpr uint32_t kSampleSize = LatencyStamp::kBlockSize / 2; // 每块中心参与判决的区域
+
+uint8_t Crc8(const uint8_t* data, size_t size)
+{
+    uint8_t crc = 0;
+    for (size_t i=0; i<size; i++)
+    {
+        crc ^= data[i];
+        for (uint32_t bit=0; bit<8; bit++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief 条码的布局, 左上角 (x = 0) 起每行 bitsPerRow 个块, 与画面宽度及解码输出的对齐无关
+ */
+bool StampLayout(uint32_t width, uint32_t height, uint32_t& bitsPerRow, uint32_t& rows, uint32_t& left)
+{
+    bitsPerRow = std::min(LatencyStamp::kBitNum, width / LatencyStamp::kBlockSize);
+    if (bitsPerRow == 0)
+    {
+        return false;
+    }
+    rows = (LatencyStamp::kBitNum + bitsPerRow - 1) / bitsPerRow;
+    left = 0;
+    return rows * LatencyStamp::kBlockSize <= height;
+}
+
+} // namespace
+
+bool LatencyStamp::Write(uint8_t* nv12, uint32_t stride, uint32_t width, uint32_t height, uint32_t sequence, uint32_t timestampUs)
+{
+    uint32_t bitsPerRow = 0, rows = 0, left = 0;
+    if (!StampLayout(width, height, bitsPerRow, rows, left))
+    {
+        return false;
+    }
+    uint8_t payload[kStampBytes] =
+    {
+        kStampMarker,
+        (uint8_t)(sequence >> 24), (uint8_t)(sequence >> 16), (uint8_t)(sequence >> 8), (uint8_t)sequence,
+        (uint8_t)(timestampUs >> 24), (uint8_t)(timestampUs >> 16), (uint8_t)(timestampUs >> 8), (uint8_t)timestampUs,
+        0
+    };
+    payload[kStampBytes - 1] = Crc8(payload, kStampBytes - 1);
+    uint8_t* chroma = nv12 + (size_t)stride * height;
+    for (uint32_t y=0; y<rows*kBlockSize; y++)
+    {
+        uint8_t* dst = nv12 + (size_t)y * stride + left;
+        for (uint32_t block=0; block<bitsPerRow; block++)
+        {
+            uint32_t bit = y / kBlockSize * bitsPerRow + block;
+            bool on = bit < kBitNum && ((payload[bit / 8] >> (7 - bit % 8)) & 1);
+            memset(dst + block * kBlockSize, on ? kStampWhite : kStampBlack, kBlockSize);
+        }
+        if (y % 2 == 0)
+        {
+            memset(chroma + (size_t)(y / 2) * stride + left, 128, bitsPerRow * kBlockSize);
+        }
+    }
+    return true;
+}
+
+bool LatencyStamp::Read(const uint8_t* luma, uint32_t stride, uint32_t width, uint32_t height, uint32_t& sequence, uint32_t& timestampUs)
+{
+    uint32_t bitsPerRow = 0, rows = 0, left = 0;
+    if (!StampLayout(width, height, bitsPerRow, rows, left))
+    {
+        return false;
+    }
+    uint8_t payload[kStampBytes] = {0};
+    for (uint32_t bit=0; bit<kBitNum; bit++)
+    {
+        uint32_t top = bit / bitsPerRow * kBlockSize + (kBlockSize - kSampleSize) / 2;
+        uint32_t x = left + bit % bitsPerRow * kBlockSize + (kBlockSize - kSampleSize) / 2;
+        uint32_t sum = 0;
+        for (uint32_t y=top; y<top+kSampleSize; y++)
+        {
+            const uint8_t* src = luma + (size_t)y * stride + x;
+            for (uint32_t i=0; i<kSampleSize; i++)
+            {
+                sum += src[i];
+            }
+        }
+        if (sum * 2 > (uint32_t)(kStampBlack + kStampWhite) * kSampleSize * kSampleSize)
+        {
+            payload[bit / 8] |= (uint8_t)(1 << (7 - bit % 8));
+        }
+    }
+    if (payload[0] != kStampMarker || Crc8(payload, kStampBytes - 1) != payload[kStampBytes - 1])
+    {
+        return false;
+    }
+    sequence = ((uint32_t)payload[1] << 24) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 8) | payload[4];
+    timestampUs = ((uint32_t)payload[5] << 24) | ((uint32_t)payload[6] << 16) | ((uint32_t)payload[7] << 8) | payload[8];
+    return true;
+}
+
+uint32_t LatencyStamp::NowUs()
+{
+    return (uint32_t)(FrameClock::NowNs() / 1000);
+}
+
+LatencyProbe::LatencyProbe()
+{
+    _maxSequence = 0;
+    _received = false;
+    _receivedNum = 0;
+    _duplicateNum = 0;
+    _reorderNum = 0;
+    _unreadableNum = 0;
+}
+
+bool LatencyProbe::Stamp(uint8_t* nv12, uint32_t stride, uint32_t width, uint32_t height, uint32_t timestampUs)
+{
+    uint32_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        sequence = (uint32_t)_latencyUs.size();
+    }
+    if (!LatencyStamp::Write(nv12, stride, width, height, sequence, timestampUs))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mtx);
+    _latencyUs.push_back(-1);
+    return true;
+}
+
+void LatencyProbe::Check(const uint8_t* luma, uint32_t stride, uint32_t width, uint32_t height)
+{
+    uint32_t sequence = 0, timestampUs = 0;
+    bool readable = LatencyStamp::Read(luma, stride, width, height, sequence, timestampUs);
+    uint32_t nowUs = LatencyStamp::NowUs();
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!readable || sequence >= _latencyUs.size())
+    {
+        _unreadableNum++;
+        return;
+    }
+    if (_latencyUs[sequence] >= 0)
+    {
+        _duplicateNum++;
+        return;
+    }
+    // Hint : 32 bit 时间戳回绕时无符号差值仍然正确
+    _latencyUs[sequence] = (int64_t)(uint32_t)(nowUs - timestampUs);
+    _receivedNum++;
+    if (_received && sequence < _maxSequence)
+    {
+        _reorderNum++;
+    }
+    _maxSequence = _received ? std::max(_maxSequence, sequence) : sequence;
+    _received = true;
+}
+
+uint64_t LatencyProbe::LostNum()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _latencyUs.size() - _receivedNum;
+}
+
+std::string LatencyProbe::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::vector<int64_t> samples;
+    int64_t totalUs = 0;
+    for (int64_t latencyUs : _latencyUs)
+    {
+        if (latencyUs >= 0)
+        {
+            samples.push_back(latencyUs);
+            totalUs += latencyUs;
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    uint64_t lostNum = _latencyUs.size() - _receivedNum;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "LatencyProbe stamped : " << _latencyUs.size() << ", received : " << _receivedNum
+       << ", lost : " << lostNum << " (" << (_latencyUs.empty() ? 0.0 : lostNum * 100.0 / _latencyUs.size()) << "%)"
+       << ", duplicate : " << _duplicateNum << ", reordered : " << _reorderNum << ", unreadable : " << _unreadableNum;
+    if (!samples.empty())
+    {
+        auto percentile = [&samples](double p) -> double
+        {
+            return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))] / 1000.0;
+        };
+        ss << ", latency (ms) min : " << samples.front() / 1000.0 << ", avg : " << totalUs / 1000.0 / samples.size()
+           << ", p50 : " << percentile(0.5) << ", p95 : " << percentile(0.95) << ", p99 : " << percentile(0.99)
+           << ", max : " << samples.back() / 1000.0;
+    }
+    return ss.str();
+}
+
+bool LatencyProbe::Export(const std::string& path)
+{
+    std::ofstream ofs(path);
+    if (!ofs.is_open())
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mtx);
+    ofs << "sequence,latency_us,status" << std::endl;
+    for (size_t sequence=0; sequence<_latencyUs.size(); sequence++)
+    {
+        if (_latencyUs[sequence] >= 0)
+        {
+            ofs << sequence << "," << _latencyUs[sequence] << ",ok" << std::endl;
+        }
+        else
+        {
+            ofs << sequence << ",,lost" << std::endl;
+        }
+    }
+    return true;
+}
+
+} // namespace Mmp
@@ -0,0 +1,97 @@
+//
+// LatencyProbe.h
+//
+// Library: Common
+// Package: Utility
+// Module:  LatencyProbe
+//
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Mmp
+{
+
+/**
+ * @brief  嵌入 NV12 亮度平面的条码, 携带序号与时间戳
+ * @note   1 - 共 80 bit : 标记 0xA5 (8 bit), 序号 (32 bit), 时间戳 (32 bit, 微秒, 回绕), CRC-8
+ *         2 - 每 bit 为 16x16 的黑 (16) 或白 (235) 块, 与宏块对齐, 低码率编码后仍可识别;
+ *             自画面左上角 (x = 0) 起, 宽度不足时换行 (会覆盖测试图案的帧号); 读取时取每块中心 8x8 的均值
+ *         3 - 位于最左上方的若干块, 不受解码输出宽高对齐 (如 1080 -> 1088) 的影响, 但读取时须传入解码帧实际的行字节数
+ */
+class LatencyStamp
+{
+public:
+    static constexpr uint32_t kBlockSize = 16;
+    static constexpr uint32_t kBitNum = 80;
+public:
+    /**
+     * @brief     写入条码, 同时将条码区域的色度置为 128
+     * @param[in] nv12   : Y 平面之后紧接 UV 平面
+     * @param[in] stride : Y 平面与 UV 平面的行字节数
+     * @return    画面过小无法容纳条码时返回 false
+     */
+    static bool Write(uint8_t* nv12, uint32_t stride, uint32_t width, uint32_t height, uint32_t sequence, uint32_t timestampUs);
+    /**
+     * @brief  读取条码
+     * @return 不存在条码或校验失败时返回 false
+     */
+    static bool Read(const uint8_t* luma, uint32_t stride, uint32_t width, uint32_t height, uint32_t& sequence, uint32_t& timestampUs);
+    /**
+     * @brief 条码使用的时钟, 即 FrameClock 的微秒数的低 32 bit
+     */
+    static uint32_t NowUs();
+};
+
+/**
+ * @brief  端到端 (合成或生成 -> 编码 -> 解码) 延迟与丢帧的统计
+ * @note   1 - Stamp 在帧送编码前写入条码, Check 在解码编码输出后读取条码, 两者之差即为该帧的延迟
+ *         2 - 同一序号再次读到时计为重复 (如按帧率补齐的重复帧), 只统计第一次的延迟;
+ *             序号小于已读到的最大序号时计为乱序; 结束时未读到的序号计为丢失 (含过载保护的丢帧)
+ *         3 - 时间戳为 32 bit 微秒, 单帧延迟超过约 71 分钟时无法区分
+ *         4 - Stamp 仅由送编码的一个线程调用, 其余接口线程安全
+ */
+class LatencyProbe
+{
+public:
+    using ptr = std::shared_ptr<LatencyProbe>;
+public:
+    LatencyProbe();
+public:
+    /**
+     * @brief     写入条码, 序号依次递增
+     * @param[in] timestampUs : 帧产生的时刻 (如合成时刻), 默认为当前时间
+     * @return    画面过小无法容纳条码时返回 false, 不占用序号
+     */
+    bool Stamp(uint8_t* nv12, uint32_t stride, uint32_t width, uint32_t height, uint32_t timestampUs = LatencyStamp::NowUs());
+    /**
+     * @brief 读取解码后的一帧并统计
+     */
+    void Check(const uint8_t* luma, uint32_t stride, uint32_t width, uint32_t height);
+    /**
+     * @brief 已写入条码但尚未读到的帧数
+     */
+    uint64_t LostNum();
+    std::string Report();
+    /**
+     * @brief 逐帧导出为 CSV (sequence,latency_us,status), status 为 ok 或 lost
+     */
+    bool Export(const std::string& path);
+private:
+    std::mutex           _mtx;
+    std::vector<int64_t> _latencyUs; // 按序号, 尚未读到时为 -1
+    uint32_t             _maxSequence;
+    bool                 _received;
+private: /* statistics */
+    uint64_t             _receivedNum;
+    uint64_t             _duplicateNum;
+    uint64_t             _reorderNum;
+    uint64_t             _unreadableNum;
+};
+
+} // namespace Mmp
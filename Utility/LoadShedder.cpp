@@ -0,0 +1,160 @@
+#include "LoadShedder.h"
+
+#include <sstream>
+#include <algorithm>
+
+#include "TimedPack.h"
+
+namespace Mmp
+{
+
+DecodeLoadShedder::DecodeLoadShedder(H26xCodec codec, uint32_t depthHigh, uint32_t depthLow)
+{
+    _codec = codec;
+    _depthHigh = depthHigh;
+    _depthLow = depthLow == UINT32_MAX ? depthHigh / 2 : std::min(depthLow, depthHigh);
+    _shedding = false;
+    _dropping = false;
+    _maxTemporalId = kH265TemporalIdUnknown;
+    _passNum = 0;
+    _dropNum = 0;
+    _episodeNum = 0;
+    _maxDepth = 0;
+}
+
+bool DecodeLoadShedder::Drop(const uint8_t* data, size_t size, uint32_t depth)
+{
+    uint8_t maxTemporalId = 0;
+    if (H26xNal::ParseMaxTemporalId(_codec, data, size, maxTemporalId))
+    {
+        // Hint : 存在多个 SPS 时取最高的时域层, 只会少丢而不会误丢
+        _maxTemporalId = _maxTemporalId == kH265TemporalIdUnknown ? maxTemporalId : std::max(_maxTemporalId, maxTemporalId);
+    }
+    if (!H26xNal::IsVcl(_codec, data, size))
+    {
+        return false;
+    }
+    if (!H26xNal::IsFirstSliceOfPicture(_codec, data, size))
+    {
+        return _dropping;
+    }
+    if (depth > _maxDepth)
+    {
+        _maxDepth = depth;
+    }
+    if (_shedding && depth <= _depthLow)
+    {
+        _shedding = false;
+    }
+    else if (!_shedding && _depthHigh != 0 && depth >= _depthHigh)
+    {
+        _shedding = true;
+        _episodeNum++;
+    }
+    _dropping = _shedding && H26xNal::IsNonReference(_codec, data, size, _maxTemporalId);
+    _dropping ? _dropNum++ : _passNum++;
+    return _dropping;
+}
+
+uint64_t DecodeLoadShedder::DropNum()
+{
+    return _dropNum;
+}
+
+std::string DecodeLoadShedder::Report()
+{
+    std::stringstream ss;
+    ss << "DecodeLoadShedder pass : " << _passNum << ", drop : " << _dropNum << ", episode : " << _episodeNum
+       << ", max depth : " << _maxDepth << " (high : " << _depthHigh << ", low : " << _depthLow << ")";
+    return ss.str();
+}
+
+EncodeLoadShedder::EncodeLoadShedder(uint32_t depthHigh)
+{
+    _depthHigh = depthHigh;
+    _fpsNum = 0;
+    _fpsDen = 1;
+    _maxDuplicate = 0;
+    _started = false;
+    _firstPts = 0;
+    _lastPts = 0;
+    _slotNum = 0;
+    _passNum = 0;
+    _rateDropNum = 0;
+    _overloadDropNum = 0;
+    _duplicateNum = 0;
+    _resyncNum = 0;
+}
+
+void EncodeLoadShedder::SetOutputFrameRate(uint32_t fpsNum, uint32_t fpsDen, uint32_t maxDuplicate)
+{
+    _fpsNum = fpsNum;
+    _fpsDen = fpsDen == 0 ? 1 : fpsDen;
+    _maxDuplicate = maxDuplicate;
+    _started = false;
+}
+
+uint32_t EncodeLoadShedder::Frames(int64_t pts, uint32_t depth)
+{
+    uint32_t frameNum = 1;
+    if (_fpsNum != 0 && pts != kPtsNone)
+    {
+        if (!_started || pts < _lastPts)
+        {
+            _resyncNum += _started ? 1 : 0;
+            _started = true;
+            _firstPts = pts;
+            _slotNum = 0;
+        }
+        _lastPts = pts;
+        // Hint : 时间不晚于 pts 的输出位置 (四舍五入到最近的位置) 均由本帧填充
+        uint64_t halfSlots = (uint64_t)(pts - _firstPts) * _fpsNum * 2 / (_fpsDen * 1000000ull);
+        uint64_t targetSlotNum = (halfSlots + 1) / 2 + 1;
+        if (targetSlotNum <= _slotNum)
+        {
+            _rateDropNum++;
+            return 0;
+        }
+        uint64_t slotNum = targetSlotNum - _slotNum;
+        _slotNum = targetSlotNum;
+        if (slotNum > 1ull + _maxDuplicate)
+        {
+            // Hint : 输入中断过久, 不补帧, 从当前位置继续
+            _resyncNum++;
+            slotNum = 1;
+        }
+        frameNum = (uint32_t)slotNum;
+    }
+    if (_depthHigh != 0)
+    {
+        if (depth >= _depthHigh)
+        {
+            _overloadDropNum++;
+            return 0;
+        }
+        // Hint : 重复送入不应使编码队列超过 depthHigh
+        frameNum = std::min(frameNum, _depthHigh - depth);
+    }
+    _passNum++;
+    _duplicateNum += frameNum - 1;
+    return frameNum;
+}
+
+uint64_t EncodeLoadShedder::DropNum()
+{
+    return _rateDropNum + _overloadDropNum;
+}
+
+std::string EncodeLoadShedder::Report()
+{
+    std::stringstream ss;
+    ss << "EncodeLoadShedder pass : " << _passNum << ", rate drop : " << _rateDropNum << ", overload drop : " << _overloadDropNum
+       << ", duplicate : " << _duplicateNum << ", resync : " << _resyncNum;
+    if (_fpsNum != 0)
+    {
+        ss << ", target fps : " << _fpsNum << "/" << _fpsDen;
+    }
+    return ss.str();
+}
+
+} // namespace Mmp
@@ -0,0 +1,113 @@
+//
+// LoadShedder.h
+//
+// Library: Common
+// Package: Utility
+// Module:  LoadShedder
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "H26xBitstream.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief  解码前的过载保护, 解码队列过深时丢弃非参考帧
+ * @note   1 - 按 access unit 决策: 在一帧的首个 slice 处判断, 同一帧的其余 slice 沿用该结果;
+ *             参数集、SEI 等非 VCL NAL 总是保留
+ *         2 - 深度达到 depthHigh 时开始丢弃, 回落到 depthLow 以下才停止, 避免在阈值附近反复切换
+ *         3 - 只丢弃非参考帧 (见 H26xNal::IsNonReference), 不影响其余帧的解码;
+ *             码流全为参考帧时无帧可丢, 由上游的反压限制延迟; H.265 在读到 SPS 之前不丢弃
+ *         4 - 须在 PtsReorderQueue::Push 之前调用, 被丢弃的帧不应记录时间戳
+ *         5 - Drop 非线程安全, 仅由读取线程调用; Report 可在任意线程调用
+ */
+class DecodeLoadShedder
+{
+public:
+    using ptr = std::shared_ptr<DecodeLoadShedder>;
+public:
+    /**
+     * @param[in] depthHigh : 解码队列深度 (帧) 达到此值时开始丢弃, 0 表示不丢弃
+     * @param[in] depthLow  : 丢弃后深度回落到此值时停止, 默认为 depthHigh 的一半
+     */
+    DecodeLoadShedder(H26xCodec codec, uint32_t depthHigh, uint32_t depthLow = UINT32_MAX);
+public:
+    /**
+     * @brief     判断 NAL 是否在解码前丢弃
+     * @param[in] depth : 当前解码队列深度 (帧), 包括解码器内部已送入未取出的帧
+     */
+    bool Drop(const uint8_t* data, size_t size, uint32_t depth);
+    uint64_t DropNum();
+    std::string Report();
+private:
+    H26xCodec _codec;
+    uint32_t  _depthHigh;
+    uint32_t  _depthLow;
+    bool      _shedding;
+    bool      _dropping;   // 当前 access unit 是否被丢弃
+    uint8_t   _maxTemporalId; // 已读到的 SPS 中最高的时域层
+private: /* statistics */
+    std::atomic<uint64_t> _passNum;
+    std::atomic<uint64_t> _dropNum;
+    std::atomic<uint64_t> _episodeNum; // 进入丢弃状态的次数
+    std::atomic<uint32_t> _maxDepth;
+};
+
+/**
+ * @brief  编码前的过载保护, 按目标帧率丢弃或重复, 编码队列过深时丢弃
+ * @note   1 - 输出时间线为 firstPts + k * den / num 秒, 每个输入帧填充其时间戳之前尚未填充的输出位置:
+ *             输入快于目标帧率时丢弃 (rate drop), 慢于目标帧率时重复送入 (duplicate)
+ *         2 - 编码队列深度达到 depthHigh 时丢弃 (overload drop), 被丢弃的帧仍占用输出位置,
+ *             恢复后不会为追赶而重复送入, 延迟不会累积
+ *         3 - 单帧最多重复 maxDuplicate 次, 输入中断更久时重新对齐时间线; 时间戳回退时同样重新对齐
+ *         4 - Frames 非线程安全, 仅由送编码的线程调用; Report 可在任意线程调用
+ */
+class EncodeLoadShedder
+{
+public:
+    using ptr = std::shared_ptr<EncodeLoadShedder>;
+public:
+    /**
+     * @param[in] depthHigh : 编码队列深度 (帧) 达到此值时丢弃, 0 表示不丢弃
+     */
+    explicit EncodeLoadShedder(uint32_t depthHigh);
+public:
+    /**
+     * @brief 设置目标输出帧率, fpsNum 为 0 (默认) 时不按帧率丢弃与重复
+     */
+    void SetOutputFrameRate(uint32_t fpsNum, uint32_t fpsDen = 1, uint32_t maxDuplicate = 2);
+    /**
+     * @brief     决定一帧送编码的次数
+     * @param[in] pts   : 输入帧时间戳, 单位 us; 为 kPtsNone 时不按帧率处理
+     * @param[in] depth : 当前编码队列深度 (帧), 包括编码器内部已送入未取出的帧
+     * @return    0 表示丢弃, 1 表示正常送入, 大于 1 时重复送入同一帧
+     */
+    uint32_t Frames(int64_t pts, uint32_t depth);
+    uint64_t DropNum();
+    std::string Report();
+private:
+    uint32_t _depthHigh;
+    uint32_t _fpsNum;
+    uint32_t _fpsDen;
+    uint32_t _maxDuplicate;
+    bool     _started;
+    int64_t  _firstPts;
+    int64_t  _lastPts;
+    uint64_t _slotNum;  // 已填充的输出位置数
+private: /* statistics */
+    std::atomic<uint64_t> _passNum;
+    std::atomic<uint64_t> _rateDropNum;
+    std::atomic<uint64_t> _overloadDropNum;
+    std::atomic<uint64_t> _duplicateNum;
+    std::atomic<uint64_t> _resyncNum;
+};
+
+} // namespace Mmp
@@ -0,0 +1,332 @@
+#include "MockCodec.h"
+
+#include <mutex>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include <Poco/Instantiator.h>
+
+#include "Common/NormalPack.h"
+#include "Common/DmaHeapAllocateMethod.h"
+#include "Codec/StreamFrame.h"
+#include "Codec/CodecFactory.h"
+
+#include "DmaBufFence.h"
+
+namespace Mmp
+{
+
+namespace
+{
+
+constexpr uint8_t kMockMagic[4] = {'M', 'O', 'C', 'K'};
+constexpr uint8_t kMockSliceHeader = 0x80;  // first_mb_in_slice = 0 (H.264), first_slice_segment_in_pic_flag = 1 (H.265)
+constexpr uint8_t kMockTrailingBits = 0x80; // rbsp_stop_one_bit, 避免 NAL 以 0x00 结尾
+constexpr size_t  kMockPayloadHeaderSize = sizeof(kMockMagic) + 8;
+
+class MockH264Encoder : public MockEncoder
+{
+public:
+    MockH264Encoder() : MockEncoder(H26xCodec::H264) {}
+};
+
+class MockH265Encoder : public MockEncoder
+{
+public:
+    MockH265Encoder() : MockEncoder(H26xCodec::H265) {}
+};
+
+class MockH264Decoder : public MockDecoder
+{
+public:
+    MockH264Decoder() : MockDecoder(H26xCodec::H264) {}
+};
+
+class MockH265Decoder : public MockDecoder
+{
+public:
+    MockH265Decoder() : MockDecoder(H26xCodec::H265) {}
+};
+
+void PutUint32(std::vector<uint8_t>& rbsp, uint32_t value)
+{
+    rbsp.push_back((uint8_t)(value >> 24));
+    rbsp.push_back((uint8_t)(value >> 16));
+    rbsp.push_back((uint8_t)(value >> 8));
+    rbsp.push_back((uint8_t)value);
+}
+
+uint32_t GetUint32(const uint8_t* data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+/**
+ * @brief 插入防竞争字节, 使 NAL 内不出现起始码
+ */
+void AppendEscaped(std::vector<uint8_t>& nal, const std::vector<uint8_t>& rbsp)
+{
+    uint32_t zeroNum = 0;
+    for (uint8_t byte : rbsp)
+    {
+        if (zeroNum >= 2 && byte <= 0x03)
+        {
+            nal.push_back(0x03);
+            zeroNum = 0;
+        }
+        nal.push_back(byte);
+        zeroNum = byte == 0x00 ? zeroNum + 1 : 0;
+    }
+}
+
+std::vector<uint8_t> Unescape(const uint8_t* data, size_t size)
+{
+    std::vector<uint8_t> rbsp;
+    rbsp.reserve(size);
+    uint32_t zeroNum = 0;
+    for (size_t i=0; i<size; i++)
+    {
+        if (zeroNum >= 2 && data[i] == 0x03)
+        {
+            zeroNum = 0;
+            continue;
+        }
+        rbsp.push_back(data[i]);
+        zeroNum = data[i] == 0x00 ? zeroNum + 1 : 0;
+    }
+    return rbsp;
+}
+
+} // namespace
+
+void RegisterMockCodecs()
+{
+    static std::once_flag once;
+    std::call_once(once, []()
+    {
+        Codec::EncoderFactory::DefaultFactory().RegisterEncoderClass("MockH264Encoder", new Poco::Instantiator<MockH264Encoder, Codec::AbstractEncoder>);
+        Codec::EncoderFactory::DefaultFactory().RegisterEncoderClass("MockH265Encoder", new Poco::Instantiator<MockH265Encoder, Codec::AbstractEncoder>);
+        Codec::DecoderFactory::DefaultFactory().RegisterDecoderClass("MockH264Decoder", new Poco::Instantiator<MockH264Decoder, Codec::AbstractDecoder>);
+        Codec::DecoderFactory::DefaultFactory().RegisterDecoderClass("MockH265Decoder", new Poco::Instantiator<MockH265Decoder, Codec::AbstractDecoder>);
+    });
+}
+
+std::string MockCodecClassName(const std::string& className)
+{
+    if (className.compare(0, 2, "RK") == 0)
+    {
+        return "Mock" + className.substr(2);
+    }
+    return className;
+}
+
+/************************************************ MockEncoder ************************************************/
+
+MockEncoder::MockEncoder(H26xCodec codec)
+{
+    _codec = codec;
+    _description = codec == H26xCodec::H264 ? "MockH264Encoder" : "MockH265Encoder";
+}
+
+void MockEncoder::SetParameter(Any /* parameter */, const std::string& /* property */)
+{
+}
+
+Any MockEncoder::GetParamter(const std::string& /* property */)
+{
+    return Any();
+}
+
+bool MockEncoder::Init()
+{
+    return true;
+}
+
+void MockEncoder::Uninit()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _packs.clear();
+}
+
+bool MockEncoder::Start()
+{
+    return true;
+}
+
+void MockEncoder::Stop()
+{
+}
+
+bool MockEncoder::Push(AbstractFrame::ptr frame)
+{
+    Codec::StreamFrame::ptr streamFrame = std::dynamic_pointer_cast<Codec::StreamFrame>(frame);
+    if (!streamFrame || streamFrame->info.format != PixelFormat::NV12)
+    {
+        return false;
+    }
+    uint32_t width = (uint32_t)streamFrame->info.width;
+    uint32_t height = (uint32_t)streamFrame->info.height;
+    size_t imageSize = std::min<size_t>((size_t)width * height * 3 / 2, streamFrame->GetSize());
+    std::vector<uint8_t> rbsp;
+    rbsp.reserve(kMockPayloadHeaderSize + imageSize + 1);
+    rbsp.push_back(kMockSliceHeader);
+    rbsp.insert(rbsp.end(), kMockMagic, kMockMagic + sizeof(kMockMagic));
+    PutUint32(rbsp, width);
+    PutUint32(rbsp, height);
+    {
+        DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(streamFrame->GetAllocateMethod());
+        DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1);
+        const uint8_t* image = (const uint8_t*)streamFrame->GetData(0);
+        rbsp.insert(rbsp.end(), image, image + imageSize);
+    }
+    rbsp.push_back(kMockTrailingBits);
+    std::vector<uint8_t> nal = {0x00, 0x00, 0x00, 0x01};
+    if (_codec == H26xCodec::H264)
+    {
+        nal.push_back(0x65); // nal_ref_idc = 3, IDR slice
+    }
+    else
+    {
+        nal.push_back(0x26); // IDR_W_RADL
+        nal.push_back(0x01); // TemporalId = 0
+    }
+    AppendEscaped(nal, rbsp);
+    NormalPack::ptr pack = std::make_shared<NormalPack>(nal.size());
+    memcpy(pack->GetData(0), nal.data(), nal.size());
+    std::lock_guard<std::mutex> lock(_mtx);
+    _packs.push_back(pack);
+    return true;
+}
+
+bool MockEncoder::Pop(AbstractPack::ptr& pack)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_packs.empty())
+    {
+        return false;
+    }
+    pack = _packs.front();
+    _packs.pop_front();
+    return true;
+}
+
+bool MockEncoder::CanPush()
+{
+    return true;
+}
+
+bool MockEncoder::CanPop()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return !_packs.empty();
+}
+
+const std::string& MockEncoder::Description()
+{
+    return _description;
+}
+
+/************************************************ MockDecoder ************************************************/
+
+MockDecoder::MockDecoder(H26xCodec codec)
+{
+    _codec = codec;
+    _description = codec == H26xCodec::H264 ? "MockH264Decoder" : "MockH265Decoder";
+    _eos = false;
+}
+
+void MockDecoder::SetParameter(Any /* parameter */, const std::string& /* property */)
+{
+}
+
+Any MockDecoder::GetParamter(const std::string& /* property */)
+{
+    return Any();
+}
+
+bool MockDecoder::Init()
+{
+    return true;
+}
+
+void MockDecoder::Uninit()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _frames.clear();
+    _eos = false;
+}
+
+bool MockDecoder::Start()
+{
+    return true;
+}
+
+void MockDecoder::Stop()
+{
+}
+
+bool MockDecoder::Push(AbstractPack::ptr pack)
+{
+    if (!pack)
+    {
+        return false;
+    }
+    if (pack->GetSize() == 0)
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _eos = true;
+        return true;
+    }
+    const uint8_t* data = (const uint8_t*)pack->GetData(0);
+    size_t size = pack->GetSize();
+    if (!H26xNal::IsIdr(_codec, data, size))
+    {
+        return true;
+    }
+    size_t offset = H26xNal::HeaderOffset(data, size) + (_codec == H26xCodec::H264 ? 1 : 2);
+    std::vector<uint8_t> rbsp = Unescape(data + offset, size - offset);
+    if (rbsp.size() < 1 + kMockPayloadHeaderSize + 1 || rbsp[0] != kMockSliceHeader || memcmp(rbsp.data() + 1, kMockMagic, sizeof(kMockMagic)) != 0)
+    {
+        return true;
+    }
+    uint32_t width = GetUint32(rbsp.data() + 1 + sizeof(kMockMagic));
+    uint32_t height = GetUint32(rbsp.data() + 1 + sizeof(kMockMagic) + 4);
+    Codec::StreamFrame::ptr frame = std::make_shared<Codec::StreamFrame>(PixelsInfo((int32_t)width, (int32_t)height, 8, PixelFormat::NV12));
+    size_t imageSize = std::min<size_t>(rbsp.size() - 1 - kMockPayloadHeaderSize - 1, frame->GetSize());
+    memcpy(frame->GetData(0), rbsp.data() + 1 + kMockPayloadHeaderSize, imageSize);
+    std::lock_guard<std::mutex> lock(_mtx);
+    _frames.push_back(frame);
+    _eos = false;
+    return true;
+}
+
+bool MockDecoder::Pop(AbstractFrame::ptr& frame)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_frames.empty() || (!_eos && _frames.size() <= kMockDecoderDelay))
+    {
+        return false;
+    }
+    frame = _frames.front();
+    _frames.pop_front();
+    return true;
+}
+
+bool MockDecoder::CanPush()
+{
+    return true;
+}
+
+bool MockDecoder::CanPop()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return !_frames.empty() && (_eos || _frames.size() > kMockDecoderDelay);
+}
+
+const std::string& MockDecoder::Description()
+{
+    return _description;
+}
+
+} // namespace Mmp
@@ -0,0 +1,95 @@
+//
+// MockCodec.h
+//
+// Library: Common
+// Package: Utility
+// Module:  MockCodec
+//
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "Codec/AbstractDecoder.h"
+#include "Codec/AbstractEncoder.h"
+
+#include "H26xBitstream.h"
+
+namespace Mmp
+{
+
+constexpr uint32_t kMockDecoderDelay = 2; // 模拟 DPB, 未收到 EOS 时保留的帧数
+
+/**
+ * @brief  注册软件 mock 编解码器: MockH264Encoder, MockH265Encoder, MockH264Decoder, MockH265Decoder
+ * @note   不依赖硬件, 用于在 CI 中检查流水线的帧数守恒 (如 EOS 时是否丢失尾部帧); 可重复调用
+ */
+void RegisterMockCodecs();
+
+/**
+ * @brief 将硬件编解码器的类名映射为对应的 mock 类名, 如 RKH264Decoder -> MockH264Decoder
+ */
+std::string MockCodecClassName(const std::string& className);
+
+/**
+ * @brief  mock 编码器, 每帧 NV12 原样封装为一个 IDR slice NAL (含防竞争字节)
+ * @note   1 - 每帧立即输出一个包, 与硬件编码器一致 (见 AddEncoderNode)
+ *         2 - 输入帧按 info 的宽高读取, 行字节数等于宽
+ */
+class MockEncoder : public Codec::AbstractEncoder
+{
+public:
+    explicit MockEncoder(H26xCodec codec);
+public:
+    void SetParameter(Any parameter, const std::string& property) override;
+    Any GetParamter(const std::string& property) override;
+    bool Init() override;
+    void Uninit() override;
+    bool Start() override;
+    void Stop() override;
+    bool Push(AbstractFrame::ptr frame) override;
+    bool Pop(AbstractPack::ptr& pack) override;
+    bool CanPush() override;
+    bool CanPop() override;
+    const std::string& Description() override;
+private:
+    H26xCodec                     _codec;
+    std::string                   _description;
+    std::mutex                    _mtx;
+    std::deque<AbstractPack::ptr> _packs;
+};
+
+/**
+ * @brief  mock 解码器, 还原 MockEncoder 的输出
+ * @note   1 - 保留最多 kMockDecoderDelay 帧, 收到空包 (EOS, 见 CodecEosPack) 后全部输出
+ *         2 - 非 mock 码流的 NAL (如参数集) 被忽略
+ */
+class MockDecoder : public Codec::AbstractDecoder
+{
+public:
+    explicit MockDecoder(H26xCodec codec);
+public:
+    void SetParameter(Any parameter, const std::string& property) override;
+    Any GetParamter(const std::string& property) override;
+    bool Init() override;
+    void Uninit() override;
+    bool Start() override;
+    void Stop() override;
+    bool Push(AbstractPack::ptr pack) override;
+    bool Pop(AbstractFrame::ptr& frame) override;
+    bool CanPush() override;
+    bool CanPop() override;
+    const std::string& Description() override;
+private:
+    H26xCodec                      _codec;
+    std::string                    _description;
+    std::mutex                     _mtx;
+    std::deque<AbstractFrame::ptr> _frames;
+    bool                           _eos;
+};
+
+} // namespace Mmp
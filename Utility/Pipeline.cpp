@@ -0,0 +1,339 @@
+#include "Pipeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "ThreadPlacement.h"
+
+namespace Mmp
+{
+
+constexpr uint32_t kStepBudget = 16;      // 单次调度最多执行的 step 数, 之后让出 worker
+constexpr uint64_t kPollIntervalUs = 200;     // 首次 POLL 的间隔, 连续 POLL 时按倍数退避
+constexpr uint64_t kMaxPollIntervalUs = 3200;
+
+namespace
+{
+
+enum NodeState
+{
+    kNodeCreated = 0,
+    kNodeParked,
+    kNodeScheduled,
+    kNodeRunning,
+    kNodeRunningNotified, // 运行中被唤醒, 挂起前需再执行一次
+    kNodeDone
+};
+
+} // namespace
+
+class Pipeline::Node
+{
+public:
+    using ptr = std::shared_ptr<Node>;
+public:
+    std::string                        stage;
+    Task                               run;      // 独占线程的节点
+    Step                               step;     // step 节点
+    bool                               blocking = false;
+    std::vector<PipelineEdgeBase::ptr> inputs;
+    std::vector<PipelineEdgeBase::ptr> outputs;
+    std::atomic<int>                   state = {kNodeCreated};
+    std::promise<void>                 done;
+    uint64_t                           pollIntervalUs = kPollIntervalUs;
+public: /* placement, stage 配置了 ThreadPlacement 时 step 在独占的线程上执行 */
+    bool                               placed = false;
+    std::mutex                         mtx;
+    std::condition_variable            cond;
+    bool                               scheduled = false;
+    uint64_t                           scheduledNs = 0;
+public: /* statistics */
+    uint64_t                           stepNum = 0;
+    uint64_t                           scheduleNum = 0;
+    uint64_t                           elapsedNs = 0;
+};
+
+class Pipeline::Completion
+{
+public:
+    std::atomic<uint32_t> remainNum = {0};
+    std::promise<void>    done;
+};
+
+Pipeline::Pipeline(const std::string& name, WorkStealingExecutor* executor)
+{
+    _name = name;
+    _executor = executor;
+    _completion = std::make_shared<Completion>();
+    _done = _completion->done.get_future().share();
+    _startNs = 0;
+}
+
+Pipeline::~Pipeline()
+{
+    Stop();
+    Wait();
+    // Hint : 唤醒回调持有节点, 边可能比 Pipeline 存活更久
+    for (auto& edge : _edges)
+    {
+        edge->ClearWakers();
+    }
+}
+
+std::shared_future<void> Pipeline::AddNode(const std::string& stage, const Task& run, const std::vector<PipelineEdgeBase::ptr>& inputs, const std::vector<PipelineEdgeBase::ptr>& outputs)
+{
+    Node::ptr node = std::make_shared<Node>();
+    node->stage = stage;
+    node->run = run;
+    node->inputs = inputs;
+    node->outputs = outputs;
+    _nodes.push_back(node);
+    return node->done.get_future().share();
+}
+
+std::shared_future<void> Pipeline::AddStepNode(const std::string& stage, const Step& step, const std::vector<PipelineEdgeBase::ptr>& inputs, const std::vector<PipelineEdgeBase::ptr>& outputs, bool blocking)
+{
+    Node::ptr node = std::make_shared<Node>();
+    node->stage = stage;
+    node->step = step;
+    node->blocking = blocking;
+    node->inputs = inputs;
+    node->outputs = outputs;
+    std::weak_ptr<Node> weakNode = node;
+    PipelineEdgeBase::Waker waker = [this, weakNode]()
+    {
+        Node::ptr node = weakNode.lock();
+        if (!node)
+        {
+            return;
+        }
+        int state = node->state;
+        while (true)
+        {
+            if (state == kNodeParked)
+            {
+                if (node->state.compare_exchange_weak(state, kNodeScheduled))
+                {
+                    Schedule(node, 0);
+                    return;
+                }
+            }
+            else if (state == kNodeRunning)
+            {
+                if (node->state.compare_exchange_weak(state, kNodeRunningNotified))
+                {
+                    return;
+                }
+            }
+            else
+            {
+                return;
+            }
+        }
+    };
+    for (auto& input : inputs)
+    {
+        input->AddConsumerWaker(waker);
+    }
+    for (auto& output : outputs)
+    {
+        output->AddProducerWaker(waker);
+    }
+    _nodes.push_back(node);
+    return node->done.get_future().share();
+}
+
+void Pipeline::Start()
+{
+    _startNs = FrameClock::NowNs();
+    _completion->remainNum = (uint32_t)_nodes.size();
+    if (_nodes.empty())
+    {
+        _completion->done.set_value();
+        return;
+    }
+    for (auto& node : _nodes)
+    {
+        if (node->step)
+        {
+            node->placed = ThreadPlacement::Instance()->HasPolicy(node->stage);
+            if (node->placed)
+            {
+                _threads.emplace_back([this, node]()
+                {
+                    RunPlaced(node);
+                });
+            }
+            node->state = kNodeScheduled;
+            Schedule(node, 0);
+            continue;
+        }
+        _threads.emplace_back([this, node]()
+        {
+            ThreadPlacement::Instance()->Apply(node->stage);
+            node->run();
+            Finish(node);
+        });
+    }
+}
+
+void Pipeline::Schedule(Node::ptr node, uint64_t delayUs)
+{
+    node->scheduleNum++;
+    if (node->placed)
+    {
+        std::lock_guard<std::mutex> lock(node->mtx);
+        node->scheduled = true;
+        node->scheduledNs = FrameClock::NowNs() + delayUs * 1000;
+        node->cond.notify_one();
+        return;
+    }
+    _executor->SubmitAfter(delayUs, [this, node]()
+    {
+        RunStep(node);
+    }, node->blocking);
+}
+
+void Pipeline::RunPlaced(Node::ptr node)
+{
+    ThreadPlacement::Instance()->Apply(node->stage);
+    while (node->state != kNodeDone)
+    {
+        {
+            std::unique_lock<std::mutex> lock(node->mtx);
+            node->cond.wait(lock, [node]()
+            {
+                return node->scheduled;
+            });
+            uint64_t nowNs = FrameClock::NowNs();
+            if (node->scheduledNs > nowNs)
+            {
+                node->cond.wait_for(lock, std::chrono::nanoseconds(node->scheduledNs - nowNs));
+                continue;
+            }
+            node->scheduled = false;
+        }
+        RunStep(node);
+    }
+}
+
+void Pipeline::RunStep(Node::ptr node)
+{
+    node->state = kNodeRunning;
+    for (uint32_t i=0; i<kStepBudget; i++)
+    {
+        node->stepNum++;
+        PipelineStep result = node->step();
+        if (result != PipelineStep::POLL)
+        {
+            node->pollIntervalUs = kPollIntervalUs;
+        }
+        switch (result)
+        {
+            case PipelineStep::PROGRESS:
+            {
+                break;
+            }
+            case PipelineStep::IDLE:
+            {
+                int expected = kNodeRunning;
+                if (node->state.compare_exchange_strong(expected, kNodeParked))
+                {
+                    return;
+                }
+                // Hint : 执行期间边已有变化, 再执行一次而不是挂起, 避免丢失唤醒
+                node->state = kNodeRunning;
+                break;
+            }
+            case PipelineStep::POLL:
+            {
+                // Hint : 编解码器长时间没有输出时 (如等待输入) 逐步放慢轮询, 有进展后恢复
+                node->state = kNodeScheduled;
+                Schedule(node, node->pollIntervalUs);
+                node->pollIntervalUs = std::min(node->pollIntervalUs * 2, kMaxPollIntervalUs);
+                return;
+            }
+            case PipelineStep::DONE:
+            {
+                Finish(node);
+                return;
+            }
+        }
+    }
+    node->state = kNodeScheduled;
+    Schedule(node, 0);
+}
+
+void Pipeline::Finish(Node::ptr node)
+{
+    node->state = kNodeDone;
+    for (auto& input : node->inputs)
+    {
+        input->Abort();
+    }
+    for (auto& output : node->outputs)
+    {
+        output->Close();
+    }
+    node->elapsedNs = FrameClock::NowNs() - _startNs;
+    node->done.set_value();
+    // Hint : 最后一个节点结束后 Pipeline 可能随即析构, 之后只访问局部持有的 completion
+    std::shared_ptr<Completion> completion = _completion;
+    if (--completion->remainNum == 0)
+    {
+        completion->done.set_value();
+    }
+}
+
+void Pipeline::Wait()
+{
+    if (_startNs == 0)
+    {
+        return;
+    }
+    _done.wait();
+    for (auto& thread : _threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+    _threads.clear();
+}
+
+void Pipeline::Stop()
+{
+    for (auto& edge : _edges)
+    {
+        edge->Abort();
+    }
+}
+
+std::shared_future<void> Pipeline::Done()
+{
+    return _done;
+}
+
+std::string Pipeline::Report()
+{
+    std::stringstream ss;
+    ss << "Pipeline " << _name << " nodes : " << _nodes.size() << ", edges : " << _edges.size();
+    for (auto& node : _nodes)
+    {
+        ss << std::endl << "-- node " << node->stage << (node->step ? (node->placed ? " (placed)" : (node->blocking ? " (blocking)" : "")) : " (thread)");
+        ss << " done at : " << node->elapsedNs / 1000000 << " ms";
+        if (node->step)
+        {
+            ss << ", steps : " << node->stepNum << ", schedules : " << node->scheduleNum;
+        }
+    }
+    for (auto& edge : _edges)
+    {
+        ss << std::endl << "-- " << edge->Report();
+    }
+    return ss.str();
+}
+
+} // namespace Mmp
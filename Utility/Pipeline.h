@@ -0,0 +1,543 @@
+//
+// Pipeline.h
+//
+// Library: Common
+// Package: Utility
+// Module:  Pipeline
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <sstream>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "FrameClock.h"
+#include "WorkStealingExecutor.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief 边已满时 Push 的处理方式
+ */
+enum class PipelineEdgePolicy
+{
+    BLOCK,       // 阻塞生产者 (反压)
+    DROP_OLDEST  // 丢弃最旧的数据, 用于只关心最新画面的消费者, 例如显示
+};
+
+/**
+ * @brief step 节点单次执行的结果
+ */
+enum class PipelineStep
+{
+    PROGRESS, // 处理了数据, 继续执行
+    IDLE,     // 输入为空或输出已满, 挂起直到相邻的边有变化
+    POLL,     // 等待边以外的事件 (如编解码器输出), 稍后重试
+    DONE      // 节点结束
+};
+
+/**
+ * @brief 数据占用的字节数, 用于边的字节额度; 默认不计字节
+ * @note  可在 Mmp 命名空间内为具体类型重载 (通过 ADL 查找), 例如 PipelineCodec.h 中的帧与包
+ */
+template <typename T>
+uint64_t PipelineItemBytes(const T& /* item */)
+{
+    return 0;
+}
+
+/**
+ * @brief 流水线的边 (类型无关部分), 供 Pipeline 统一传播 EOS 与退出
+ */
+class PipelineEdgeBase
+{
+public:
+    using ptr = std::shared_ptr<PipelineEdgeBase>;
+    using Waker = std::function<void()>;
+public:
+    virtual ~PipelineEdgeBase() = default;
+public:
+    /**
+     * @brief 注册消费者/生产者的唤醒回调, 供挂起的 step 节点使用; 仅在 Pipeline::Start 之前调用
+     */
+    void AddConsumerWaker(const Waker& waker)
+    {
+        _consumerWakers.push_back(waker);
+    }
+    void AddProducerWaker(const Waker& waker)
+    {
+        _producerWakers.push_back(waker);
+    }
+    void ClearWakers()
+    {
+        _consumerWakers.clear();
+        _producerWakers.clear();
+    }
+public:
+    /**
+     * @brief 生产者结束 (EOS), 消费者取完剩余数据后 Pop 返回 false
+     */
+    virtual void Close() = 0;
+    /**
+     * @brief 消费者退出, 丢弃剩余数据并唤醒阻塞的生产者
+     */
+    virtual void Abort() = 0;
+    virtual std::string Report() = 0;
+protected:
+    void WakeConsumers()
+    {
+        for (auto& waker : _consumerWakers)
+        {
+            waker();
+        }
+    }
+    void WakeProducers()
+    {
+        for (auto& waker : _producerWakers)
+        {
+            waker();
+        }
+    }
+private:
+    std::vector<Waker> _consumerWakers;
+    std::vector<Waker> _producerWakers;
+};
+
+/**
+ * @brief  节点之间的有界队列, 按帧数与字节数两种额度 (credit) 限制在途数据
+ * @note   1 - 单生产者或多生产者、单消费者均可, 线程安全
+ *         2 - 生产者写入时占用额度, 消费者取出时归还; 任一额度用尽即视为满:
+ *             BLOCK 策略下 Push 阻塞 (反压沿边逐级传递到 source), DROP_OLDEST 策略下丢弃最旧的数据 (降级)
+ *         3 - 空队列总能写入一个数据, 单个数据超过字节额度时不会死锁
+ */
+template <typename T>
+class PipelineEdge : public PipelineEdgeBase
+{
+public:
+    using ptr = std::shared_ptr<PipelineEdge<T>>;
+public:
+    /**
+     * @param[in] capacity : 帧数额度
+     * @param[in] maxBytes : 字节额度, 0 表示不限制
+     */
+    PipelineEdge(const std::string& name, uint32_t capacity, PipelineEdgePolicy policy = PipelineEdgePolicy::BLOCK, uint64_t maxBytes = 0)
+    {
+        _name = name;
+        _capacity = capacity == 0 ? 1 : capacity;
+        _maxBytes = maxBytes;
+        _bytes = 0;
+        _policy = policy;
+        _closed = false;
+        _aborted = false;
+        _pushNum = 0;
+        _dropNum = 0;
+        _blockNum = 0;
+        _blockNs = 0;
+        _fullNum = 0;
+        _maxDepth = 0;
+        _peakBytes = 0;
+    }
+public:
+    /**
+     * @return 消费者已退出或边已关闭时返回 false, 生产者应停止生产
+     */
+    bool Push(const T& item)
+    {
+        uint64_t bytes = PipelineItemBytes(item);
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (_policy == PipelineEdgePolicy::BLOCK && !HasCredit(bytes) && !_aborted && !_closed)
+            {
+                _blockNum++;
+                uint64_t beginNs = FrameClock::NowNs();
+                _cond.wait(lock, [this, bytes]()
+                {
+                    return HasCredit(bytes) || _aborted || _closed;
+                });
+                _blockNs += FrameClock::NowNs() - beginNs;
+            }
+            if (!Append(item, bytes))
+            {
+                return false;
+            }
+        }
+        WakeConsumers();
+        return true;
+    }
+    /**
+     * @brief  非阻塞写入
+     * @return 边已满或已失效时返回 false, 通过 IsAborted 区分
+     */
+    bool TryPush(const T& item)
+    {
+        uint64_t bytes = PipelineItemBytes(item);
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (_policy == PipelineEdgePolicy::BLOCK && !HasCredit(bytes))
+            {
+                _fullNum++;
+                return false;
+            }
+            if (!Append(item, bytes))
+            {
+                return false;
+            }
+        }
+        WakeConsumers();
+        return true;
+    }
+    /**
+     * @return EOS (已关闭且取空) 或已退出时返回 false
+     */
+    bool Pop(T& item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cond.wait(lock, [this]()
+            {
+                return !_items.empty() || _closed || _aborted;
+            });
+            if (!TakeFront(item))
+            {
+                return false;
+            }
+        }
+        WakeProducers();
+        return true;
+    }
+    /**
+     * @brief  非阻塞读取
+     * @return 暂无数据时返回 false, 通过 IsEos 区分是否已结束
+     */
+    bool TryPop(T& item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (!TakeFront(item))
+            {
+                return false;
+            }
+        }
+        WakeProducers();
+        return true;
+    }
+    bool IsEos()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return _aborted || (_closed && _items.empty());
+    }
+    bool IsAborted()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return _aborted;
+    }
+    uint32_t Size()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return (uint32_t)_items.size();
+    }
+    /**
+     * @brief 额度的占用百分比, 取帧数与字节数中较高者
+     */
+    uint32_t Usage()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        uint64_t usage = _items.size() * 100 / _capacity;
+        if (_maxBytes != 0)
+        {
+            usage = std::max(usage, _bytes * 100 / _maxBytes);
+        }
+        return (uint32_t)std::min<uint64_t>(usage, 100);
+    }
+    void Close() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _closed = true;
+            _cond.notify_all();
+        }
+        WakeConsumers();
+    }
+    void Abort() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _aborted = true;
+            _items.clear();
+            _bytes = 0;
+            _cond.notify_all();
+        }
+        WakeConsumers();
+        WakeProducers();
+    }
+    std::string Report() override
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        std::stringstream ss;
+        ss << "Edge " << _name << " capacity : " << _capacity << ", push : " << _pushNum << ", max depth : " << _maxDepth;
+        if (_maxBytes != 0 || _peakBytes != 0)
+        {
+            ss << ", peak bytes : " << _peakBytes << (_maxBytes != 0 ? "/" + std::to_string(_maxBytes) : std::string());
+        }
+        ss << ", block : " << _blockNum << " (" << _blockNs / 1000000 << " ms)" << ", full : " << _fullNum << ", drop : " << _dropNum;
+        return ss.str();
+    }
+private:
+    bool HasCredit(uint64_t bytes)
+    {
+        if (_items.size() >= _capacity)
+        {
+            return false;
+        }
+        return _maxBytes == 0 || _items.empty() || _bytes + bytes <= _maxBytes;
+    }
+    bool Append(const T& item, uint64_t bytes)
+    {
+        if (_aborted || _closed)
+        {
+            return false;
+        }
+        while (!HasCredit(bytes))
+        {
+            _bytes -= PipelineItemBytes(_items.front());
+            _items.pop_front();
+            _dropNum++;
+        }
+        _items.push_back(item);
+        _bytes += bytes;
+        _pushNum++;
+        if (_items.size() > _maxDepth)
+        {
+            _maxDepth = (uint32_t)_items.size();
+        }
+        if (_bytes > _peakBytes)
+        {
+            _peakBytes = _bytes;
+        }
+        _cond.notify_all();
+        return true;
+    }
+    bool TakeFront(T& item)
+    {
+        if (_items.empty() || _aborted)
+        {
+            return false;
+        }
+        item = _items.front();
+        _items.pop_front();
+        _bytes -= PipelineItemBytes(item);
+        _cond.notify_all();
+        return true;
+    }
+private:
+    std::string             _name;
+    uint32_t                _capacity;
+    uint64_t                _maxBytes;
+    uint64_t                _bytes;
+    PipelineEdgePolicy      _policy;
+    std::mutex              _mtx;
+    std::condition_variable _cond;
+    std::deque<T>           _items;
+    bool                    _closed;
+    bool                    _aborted;
+private: /* statistics */
+    uint64_t                _pushNum;
+    uint64_t                _dropNum;
+    uint64_t                _blockNum;
+    uint64_t                _blockNs;
+    uint64_t                _fullNum; // TryPush 因边满失败的次数
+    uint32_t                _maxDepth;
+    uint64_t                _peakBytes;
+};
+
+/**
+ * @brief  由节点和有界边组成的数据流图
+ * @note   1 - 节点结束时其输出边自动 Close (EOS 向下游传播),
+ *             输入边自动 Abort (提前退出时向上游传播, 解除生产者的阻塞)
+ *         2 - step 节点 (AddStepNode, 以及 AddSource / AddTransform / AddSink) 每次只处理少量数据,
+ *             在 WorkStealingExecutor 上调度, 输入为空或输出已满时挂起, 由相邻的边唤醒;
+ *             blocking 节点 (如编解码器 Push) 在执行器的阻塞线程池上运行; 返回 POLL 时延迟重新调度,
+ *             连续 POLL 时间隔按倍数增长 (200 us - 3.2 ms), 有进展后恢复
+ *         3 - AddNode 添加的节点独占一个线程, 用于需要长时间持有线程的阶段 (如 GL 合成、显示),
+ *             启动时按 stage 应用 ThreadPlacement; step 节点的 stage 在 ThreadPlacement 中有配置时
+ *             (如 encoder_pop), 该节点同样独占一个按 stage 放置的线程, 调度方式不变
+ *         4 - 图在 Start 之前构建完成, 之后不可再添加节点或边
+ *         5 - 添加节点时返回该节点结束的 future, Done 返回所有节点结束的 future, 无需轮询等待
+ */
+class Pipeline
+{
+public:
+    using ptr = std::shared_ptr<Pipeline>;
+    using Task = std::function<void()>;
+    using Step = std::function<PipelineStep()>;
+public:
+    explicit Pipeline(const std::string& name, WorkStealingExecutor* executor = WorkStealingExecutor::Instance());
+    ~Pipeline();
+public:
+    /**
+     * @param[in] capacity : 帧数额度
+     * @param[in] maxBytes : 字节额度, 0 表示不限制
+     */
+    template <typename T>
+    typename PipelineEdge<T>::ptr CreateEdge(const std::string& name, uint32_t capacity, PipelineEdgePolicy policy = PipelineEdgePolicy::BLOCK, uint64_t maxBytes = 0)
+    {
+        typename PipelineEdge<T>::ptr edge = std::make_shared<PipelineEdge<T>>(name, capacity, policy, maxBytes);
+        _edges.push_back(edge);
+        return edge;
+    }
+    /**
+     * @brief     添加独占线程的节点
+     * @param[in] stage : 阶段名, 同时作为 ThreadPlacement 的 stage
+     * @param[in] run : 节点主体, 自行 (阻塞地) 读写边
+     * @return    节点结束 (run 返回且输出边已关闭) 的 future
+     */
+    std::shared_future<void> AddNode(const std::string& stage, const Task& run, const std::vector<PipelineEdgeBase::ptr>& inputs, const std::vector<PipelineEdgeBase::ptr>& outputs);
+    /**
+     * @brief     添加 step 节点
+     * @param[in] step : 非阻塞地读写边 (TryPop / TryPush), 返回本次执行的结果
+     * @param[in] blocking : step 内有阻塞调用时为 true, 在阻塞线程池上运行
+     */
+    std::shared_future<void> AddStepNode(const std::string& stage, const Step& step, const std::vector<PipelineEdgeBase::ptr>& inputs, const std::vector<PipelineEdgeBase::ptr>& outputs, bool blocking = false);
+    /**
+     * @param[in] produce : bool(Out&), 返回 false 表示数据源结束
+     */
+    template <typename Out, typename Produce>
+    std::shared_future<void> AddSource(const std::string& stage, std::shared_ptr<PipelineEdge<Out>> out, Produce produce, bool blocking = false)
+    {
+        std::shared_ptr<Pending<Out>> pending = std::make_shared<Pending<Out>>();
+        return AddStepNode(stage, [out, produce, pending]() mutable -> PipelineStep
+        {
+            if (!pending->valid)
+            {
+                if (!produce(pending->item))
+                {
+                    return PipelineStep::DONE;
+                }
+                pending->valid = true;
+            }
+            return pending->Flush(out);
+        }, {}, {out}, blocking);
+    }
+    /**
+     * @param[in] transform : bool(const In&, Out&), 返回 false 时丢弃该数据
+     */
+    template <typename In, typename Out, typename Transform>
+    std::shared_future<void> AddTransform(const std::string& stage, std::shared_ptr<PipelineEdge<In>> in, std::shared_ptr<PipelineEdge<Out>> out, Transform transform, bool blocking = false)
+    {
+        std::shared_ptr<Pending<Out>> pending = std::make_shared<Pending<Out>>();
+        return AddStepNode(stage, [in, out, transform, pending]() mutable -> PipelineStep
+        {
+            if (!pending->valid)
+            {
+                In item;
+                if (!in->TryPop(item))
+                {
+                    return in->IsEos() ? PipelineStep::DONE : PipelineStep::IDLE;
+                }
+                if (!transform(item, pending->item))
+                {
+                    return PipelineStep::PROGRESS;
+                }
+                pending->valid = true;
+            }
+            return pending->Flush(out);
+        }, {in}, {out}, blocking);
+    }
+    /**
+     * @param[in] consume : void(const In&)
+     */
+    template <typename In, typename Consume>
+    std::shared_future<void> AddSink(const std::string& stage, std::shared_ptr<PipelineEdge<In>> in, Consume consume, bool blocking = false)
+    {
+        return AddSink(stage, in, consume, []() {}, blocking);
+    }
+    /**
+     * @param[in] consume : void(const In&)
+     * @param[in] flush : void(), 输入结束 (EOS 或被中止) 后调用一次, 用于落盘等收尾工作, 之后节点结束
+     */
+    template <typename In, typename Consume, typename Flush>
+    std::shared_future<void> AddSink(const std::string& stage, std::shared_ptr<PipelineEdge<In>> in, Consume consume, Flush flush, bool blocking)
+    {
+        return AddStepNode(stage, [in, consume, flush]() mutable -> PipelineStep
+        {
+            In item;
+            if (!in->TryPop(item))
+            {
+                if (!in->IsEos())
+                {
+                    return PipelineStep::IDLE;
+                }
+                flush();
+                return PipelineStep::DONE;
+            }
+            consume(item);
+            return PipelineStep::PROGRESS;
+        }, {in}, {}, blocking);
+    }
+public:
+    void Start();
+    /**
+     * @brief 等待所有节点结束 (所有 source 到达 EOS 且数据流出 sink, 或被 Stop)
+     */
+    void Wait();
+    /**
+     * @brief 所有节点结束的 future
+     */
+    std::shared_future<void> Done();
+    /**
+     * @brief 中止所有边, 阻塞在边上的节点随即退出; 仍需调用 Wait
+     */
+    void Stop();
+    std::string Report();
+public:
+    /**
+     * @brief 尚未写入输出边的一个数据, 供 step 节点在输出已满时暂存
+     */
+    template <typename T>
+    class Pending
+    {
+    public:
+        T    item = T();
+        bool valid = false;
+    public:
+        PipelineStep Flush(const std::shared_ptr<PipelineEdge<T>>& out)
+        {
+            if (out->TryPush(item))
+            {
+                item = T();
+                valid = false;
+                return PipelineStep::PROGRESS;
+            }
+            return out->IsAborted() ? PipelineStep::DONE : PipelineStep::IDLE;
+        }
+    };
+private:
+    class Node;
+    class Completion;
+    void RunStep(std::shared_ptr<Node> node);
+    void RunPlaced(std::shared_ptr<Node> node);
+    void Schedule(std::shared_ptr<Node> node, uint64_t delayUs);
+    void Finish(std::shared_ptr<Node> node);
+private:
+    std::string                        _name;
+    WorkStealingExecutor*              _executor;
+    std::vector<std::shared_ptr<Node>> _nodes;
+    std::vector<PipelineEdgeBase::ptr> _edges;
+    std::vector<std::thread>           _threads;
+    std::shared_ptr<Completion>        _completion;
+    std::shared_future<void>           _done;
+    uint64_t                           _startNs;
+};
+
+} // namespace Mmp
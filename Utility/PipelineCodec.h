@@ -0,0 +1,453 @@
+//
+// PipelineCodec.h
+//
+// Library: Common
+// Package: Utility
+// Module:  PipelineCodec
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <sstream>
+#include <cstdint>
+#include <type_traits>
+
+#include "Common/NormalPack.h"
+#include "Common/AbstractPack.h"
+#include "Common/AbstractFrame.h"
+#include "Common/DmaHeapAllocateMethod.h"
+#include "Codec/StreamFrame.h"
+#include "Codec/CodecFactory.h"
+
+#include "Pipeline.h"
+#include "FrameClock.h"
+#include "H26xBitstream.h"
+#include "UtilityCommon.h"
+#include "DmaBufFence.h"
+#include "LatencyProbe.h"
+#include "BitrateController.h"
+
+namespace Mmp
+{
+
+constexpr uint32_t kCodecNodeDrainIdleMs = 500; // 输入结束后超过该时间没有输出即视为已排空
+constexpr uint32_t kDecoderNodeMaxInflight = 16; // H.264 DPB 最多 16 帧
+constexpr uint32_t kEncoderNodeMaxInflight = 4;
+constexpr uint32_t kCodecNodeCreditTimeoutMs = 50;
+constexpr uint32_t kCodecNodeMaxOverdraftRatio = 2; // 透支后的 maxInflight 不超过配置额度的倍数
+constexpr uint32_t kNalEdgeCapacity = 16;
+constexpr uint32_t kPackEdgeCapacity = 16;
+constexpr uint64_t kNalEdgeBytes = 4 * 1024 * 1024; // 突发的大 I 帧按字节限制在途码流
+constexpr uint64_t kPackEdgeBytes = 4 * 1024 * 1024;
+constexpr uint32_t kLatencyProbePackCapacity = 64;
+constexpr uint32_t kLatencyProbeFrameCapacity = 2;
+
+/**
+ * @brief 帧与包按数据大小计入边的字节额度
+ */
+template <typename T>
+typename std::enable_if<std::is_base_of<AbstractFrame, T>::value, uint64_t>::type PipelineItemBytes(const std::shared_ptr<T>& item)
+{
+    return item ? (uint64_t)item->GetSize() : 0;
+}
+
+/**
+ * @brief  NV12 帧的行字节数
+ * @note   StreamFrame 不携带行字节数, 由 buffer 大小反推; 硬件解码输出的宽高可能按 16 对齐 (如 1080 -> 1088),
+ *         依次按原高度与按 16 对齐的高度尝试, 取能整除且不小于宽的值, 均不成立时返回宽
+ */
+inline uint32_t FrameLumaStride(const Codec::StreamFrame::ptr& frame)
+{
+    uint32_t width = (uint32_t)frame->info.width;
+    uint32_t height = (uint32_t)frame->info.height;
+    size_t size = frame->GetSize();
+    for (uint32_t alignedHeight : {height, (height + 15) & ~15u})
+    {
+        size_t rows = (size_t)alignedHeight * 3 / 2;
+        if (rows != 0 && size % rows == 0 && size / rows >= width)
+        {
+            return (uint32_t)(size / rows);
+        }
+    }
+    return width;
+}
+
+/**
+ * @brief 编解码节点的计数, 节点结束后读取
+ */
+class CodecNodeStats
+{
+public:
+    using ptr = std::shared_ptr<CodecNodeStats>;
+public:
+    std::atomic<uint32_t> pushedNum = {0}; // 送入的帧数 (解码为 access unit 数)
+    std::atomic<uint32_t> poppedNum = {0}; // 取出的帧数或包数
+    std::atomic<bool>     pushing = {true};
+    std::atomic<bool>     idleDrained = {false}; // 排空以空闲宽限期结束, 而非取完 pushedNum 个输出
+public: /* credit */
+    std::atomic<uint32_t> baseInflight = {0}; // 配置的在途额度
+    std::atomic<uint32_t> maxInflight = {0};  // 编解码器内部最多的在途帧数, 透支时上调, 额度归还后回落
+    std::atomic<bool>     outputBlocked = {false}; // pop 侧因输出边已满而等待
+    std::atomic<uint32_t> creditWaitNum = {0};
+    std::atomic<uint32_t> overdraftNum = {0};
+public:
+    /**
+     * @brief 已送入未取出的数量; 编码器可能单独输出参数集包, 取出数多于送入数时视为 0
+     */
+    uint32_t Inflight()
+    {
+        uint32_t poppedNum = this->poppedNum;
+        uint32_t pushedNum = this->pushedNum;
+        return pushedNum > poppedNum ? pushedNum - poppedNum : 0;
+    }
+    std::string Report()
+    {
+        std::stringstream ss;
+        ss << "pushed : " << pushedNum << ", popped : " << poppedNum << ", max inflight : " << maxInflight << "/" << baseInflight
+           << ", credit wait : " << creditWaitNum << ", overdraft : " << overdraftNum << ", drain : " << (idleDrained ? "idle" : "count");
+        return ss.str();
+    }
+};
+
+/**
+ * @brief 编解码器的在途额度
+ * @note  1 - 编解码器内部的帧 (已送入未取出) 达到 maxInflight 时等待 pop 归还额度, 限制 DMA-BUF 的占用
+ *        2 - 部分码流需要送入更多数据才会有输出 (如重排序深度超过额度), pop 侧未被下游阻塞、
+ *            等待超过 kCodecNodeCreditTimeoutMs 仍无输出时透支一帧并上调 maxInflight, 避免死锁
+ *        3 - maxInflight 最多上调到 baseInflight * kCodecNodeMaxOverdraftRatio, 之后只等待 pop, 不再透支;
+ *            在途帧数回落到 baseInflight 以下时 maxInflight 逐帧回落, 单次突发不会永久放大 DMA-BUF 的占用
+ */
+class CodecNodeCredit
+{
+public:
+    explicit CodecNodeCredit(CodecNodeStats::ptr stats)
+    {
+        _stats = stats;
+        _waitBeginNs = 0;
+        _waitPoppedNum = 0;
+    }
+    /**
+     * @brief  push 前调用
+     * @return 可以送入时返回 true, 否则返回 false, 由调用方 POLL
+     */
+    bool Acquire()
+    {
+        uint32_t poppedNum = _stats->poppedNum;
+        uint32_t inflightNum = _stats->Inflight();
+        if (inflightNum < _stats->baseInflight && _stats->maxInflight > _stats->baseInflight)
+        {
+            _stats->maxInflight--;
+        }
+        if (inflightNum < _stats->maxInflight)
+        {
+            _waitBeginNs = 0;
+            return true;
+        }
+        uint64_t nowNs = FrameClock::NowNs();
+        if (_waitBeginNs == 0 || poppedNum != _waitPoppedNum || _stats->outputBlocked)
+        {
+            _stats->creditWaitNum += _waitBeginNs == 0 ? 1 : 0;
+            _waitBeginNs = nowNs;
+            _waitPoppedNum = poppedNum;
+            return false;
+        }
+        if (nowNs - _waitBeginNs < kCodecNodeCreditTimeoutMs * 1000000ull || _stats->maxInflight >= _stats->baseInflight * kCodecNodeMaxOverdraftRatio)
+        {
+            return false;
+        }
+        _stats->overdraftNum++;
+        _stats->maxInflight++;
+        _waitBeginNs = 0;
+        return true;
+    }
+private:
+    CodecNodeStats::ptr _stats;
+    uint64_t            _waitBeginNs;
+    uint32_t            _waitPoppedNum;
+};
+
+/**
+ * @brief 解码器的 EOS 包 (空包), 送入后解码器输出其内部保留的所有帧
+ * @note  MMP-Core 的解码器接口没有单独的 flush/EOS 方法, 空包作为 EOS 目前只有 MockDecoder 按此实现,
+ *        RK 解码器是否据此输出 DPB 中的帧未在硬件上验证; 不输出时由 CodecPopStep 的空闲宽限期结束排空
+ */
+inline NormalPack::ptr CodecEosPack()
+{
+    return std::make_shared<NormalPack>(0);
+}
+
+/**
+ * @brief     编解码器 pop 节点的 step, 上游结束后排空编解码器的输出
+ * @param[in] countDone : 取完 pushedNum 个输出时立即结束, 仅用于输出数不会多于输入数的解码器
+ * @note      1 - 暂无输出时返回 POLL, 由执行器定时重试, 不占用线程
+ *            2 - MMP-Core 的编解码器不提供输出结束的信号, 上游结束后超过 drainIdleMs 没有任何输出即结束;
+ *                解码器的输出少于输入是正常的 (起始 CRA 后的 RASL、损坏的 access unit、两场合成一帧),
+ *                此时仅记录 idleDrained 并打印数量, 不视为丢失
+ */
+template <typename Output, typename PopFn>
+Pipeline::Step CodecPopStep(const std::string& name, CodecNodeStats::ptr stats, std::shared_ptr<PipelineEdge<Output>> out, PopFn pop,
+                            uint32_t drainIdleMs, bool countDone)
+{
+    std::shared_ptr<Pipeline::Pending<Output>> pending = std::make_shared<Pipeline::Pending<Output>>();
+    std::shared_ptr<uint64_t> lastOutputNs = std::make_shared<uint64_t>(0);
+    return [name, stats, out, pop, drainIdleMs, countDone, pending, lastOutputNs]() mutable -> PipelineStep
+    {
+        if (pending->valid)
+        {
+            PipelineStep step = pending->Flush(out);
+            stats->outputBlocked = step == PipelineStep::IDLE;
+            *lastOutputNs = FrameClock::NowNs();
+            return step;
+        }
+        bool draining = !stats->pushing;
+        if (draining && countDone && stats->poppedNum >= stats->pushedNum)
+        {
+            return PipelineStep::DONE;
+        }
+        if (pop(pending->item))
+        {
+            stats->poppedNum++;
+            *lastOutputNs = FrameClock::NowNs();
+            pending->valid = true;
+            PipelineStep step = pending->Flush(out);
+            stats->outputBlocked = step == PipelineStep::IDLE;
+            return step;
+        }
+        if (!draining)
+        {
+            *lastOutputNs = 0;
+            return PipelineStep::POLL;
+        }
+        // Hint : 宽限期从上游结束或最后一次输出开始计, 输入期间的空闲不计入
+        uint64_t nowNs = FrameClock::NowNs();
+        if (*lastOutputNs == 0)
+        {
+            *lastOutputNs = nowNs;
+        }
+        if (nowNs - *lastOutputNs > drainIdleMs * 1000000ull)
+        {
+            stats->idleDrained = true;
+            if (stats->poppedNum < stats->pushedNum)
+            {
+                UTILITY_LOG_INFO << name << " drained after " << drainIdleMs << " ms idle, outputs : " << stats->poppedNum << ", inputs : " << stats->pushedNum;
+            }
+            return PipelineStep::DONE;
+        }
+        return PipelineStep::POLL;
+    };
+}
+
+/**
+ * @brief  添加解码节点 (decoder_push, decoder_pop)
+ * @note   1 - decoder 需已 Init/Start, pipeline 结束后由调用方 Stop/Uninit
+ *         2 - Push 可能等待解码器空闲的输入 buffer, 在阻塞线程池上执行; Pop 为轮询
+ *         3 - 每个 access unit 占用一个在途额度 (见 CodecNodeCredit), 由 decoder_pop 取出帧后归还
+ *         4 - 输入结束时送入 CodecEosPack, 解码器随后输出 DPB 中保留的帧; decoder_pop 取完 pushedNum 帧,
+ *             或 drainIdleMs 内没有新的输出时结束 (见 CodecPopStep)
+ */
+inline CodecNodeStats::ptr AddDecoderNode(Pipeline& pipeline, Codec::AbstractDecoder::ptr decoder, H26xCodec codec,
+                                          PipelineEdge<NormalPack::ptr>::ptr in, PipelineEdge<AbstractFrame::ptr>::ptr out,
+                                          uint32_t maxInflight = kDecoderNodeMaxInflight, uint32_t drainIdleMs = kCodecNodeDrainIdleMs)
+{
+    CodecNodeStats::ptr stats = std::make_shared<CodecNodeStats>();
+    stats->baseInflight = maxInflight == 0 ? 1 : maxInflight;
+    stats->maxInflight = (uint32_t)stats->baseInflight;
+    std::shared_ptr<CodecNodeCredit> credit = std::make_shared<CodecNodeCredit>(stats);
+    std::shared_ptr<NormalPack::ptr> pending = std::make_shared<NormalPack::ptr>();
+    pipeline.AddStepNode("decoder_push", [decoder, codec, in, stats, credit, pending]() -> PipelineStep
+    {
+        NormalPack::ptr pack = *pending;
+        if (!pack && !in->TryPop(pack))
+        {
+            if (in->IsEos())
+            {
+                if (!in->IsAborted())
+                {
+                    decoder->Push(CodecEosPack());
+                }
+                stats->pushing = false;
+                return PipelineStep::DONE;
+            }
+            return PipelineStep::IDLE;
+        }
+        // Hint : 额度按 access unit 计, 只在新一帧的首个 slice 处检查, 不拆分同一帧的 NAL
+        if (H26xNal::IsFirstSliceOfPicture(codec, (const uint8_t*)pack->GetData(0), pack->GetSize()))
+        {
+            if (!credit->Acquire())
+            {
+                *pending = pack;
+                return PipelineStep::POLL;
+            }
+            stats->pushedNum++;
+        }
+        *pending = nullptr;
+        decoder->Push(pack);
+        return PipelineStep::PROGRESS;
+    }, {in}, {}, true);
+    // Hint : 下游提前退出时 Abort 输入边, 解除 decoder_push 及上游的阻塞
+    pipeline.AddStepNode("decoder_pop", CodecPopStep<AbstractFrame::ptr>("decoder_pop", stats, out, [decoder](AbstractFrame::ptr& frame) -> bool
+    {
+        return decoder->Pop(frame);
+    }, drainIdleMs, true), {in}, {out});
+    return stats;
+}
+
+/**
+ * @brief     添加编码节点 (encoder_push, encoder_pop)
+ * @param[in] prepare : AbstractFrame::ptr(const In&), 送编码前在 encoder_push 中调用, 返回 nullptr 时跳过
+ * @note      1 - encoder 需已 Init/Start, pipeline 结束后由调用方 Stop/Uninit; 假定编码器不跨帧保留输入, 结束时不送入 EOS,
+ *                该假定只有 MockEncoder 保证, 未在 RK 编码器上验证
+ *            2 - 编码器可能将参数集 (SPS/PPS/SEI) 作为单独的包输出, 包数不一定等于帧数,
+ *                encoder_pop 在输入结束且 drainIdleMs 内没有新的输出时结束, 不按包数判断
+ *            3 - 每帧占用一个在途额度 (见 CodecNodeCredit), 额度用尽时不从输入边取数据, 反压传递到上游
+ */
+template <typename In, typename Prepare>
+CodecNodeStats::ptr AddEncoderNode(Pipeline& pipeline, Codec::AbstractEncoder::ptr encoder,
+                                   std::shared_ptr<PipelineEdge<In>> in, PipelineEdge<AbstractPack::ptr>::ptr out,
+                                   Prepare prepare, uint32_t maxInflight = kEncoderNodeMaxInflight, uint32_t drainIdleMs = kCodecNodeDrainIdleMs)
+{
+    CodecNodeStats::ptr stats = std::make_shared<CodecNodeStats>();
+    stats->baseInflight = maxInflight == 0 ? 1 : maxInflight;
+    stats->maxInflight = (uint32_t)stats->baseInflight;
+    std::shared_ptr<CodecNodeCredit> credit = std::make_shared<CodecNodeCredit>(stats);
+    pipeline.AddStepNode("encoder_push", [encoder, in, stats, credit, prepare]() mutable -> PipelineStep
+    {
+        if (in->Size() != 0 && !credit->Acquire())
+        {
+            return PipelineStep::POLL;
+        }
+        In item;
+        if (!in->TryPop(item))
+        {
+            if (in->IsEos())
+            {
+                stats->pushing = false;
+                return PipelineStep::DONE;
+            }
+            return PipelineStep::IDLE;
+        }
+        AbstractFrame::ptr frame = prepare(item);
+        if (frame)
+        {
+            stats->pushedNum++;
+            encoder->Push(frame);
+        }
+        return PipelineStep::PROGRESS;
+    }, {in}, {}, true);
+    pipeline.AddStepNode("encoder_pop", CodecPopStep<AbstractPack::ptr>("encoder_pop", stats, out, [encoder](AbstractPack::ptr& pack) -> bool
+    {
+        return encoder->Pop(pack);
+    }, drainIdleMs, false), {in}, {out});
+    return stats;
+}
+
+/**
+ * @brief     送编码前执行一次码率控制, 需要调整时通过 SetParameter 下发并打印原因
+ * @param[in] packs : 编码输出边, 其额度占用反映写入 (上传) 是否跟得上
+ * @note      在 AddEncoderNode 的 prepare 中调用, SetParameter 与 Push 位于同一线程, 不会并发
+ */
+inline void ApplyBitrateControl(const std::string& name, Codec::AbstractEncoder::ptr encoder, BitrateController::ptr controller,
+                                PipelineEdge<AbstractPack::ptr>::ptr packs)
+{
+    BitrateDecision decision;
+    if (!controller->Update(packs->Usage(), decision))
+    {
+        return;
+    }
+    encoder->SetParameter(decision.bps, Codec::kBps);
+    UTILITY_LOG_INFO << name << " bitrate " << decision.oldBps << " -> " << decision.bps << ", cause : " << decision.cause;
+}
+
+/**
+ * @brief     添加延迟探测节点 (latency_tee, decoder_push, decoder_pop, latency_probe)
+ * @param[in] packs : 编码输出边
+ * @param[in] out   : packs 原样转发到 out, 供写文件等原有的消费者使用
+ * @param[in] probe : 送编码前已通过 LatencyProbe::Stamp 写入条码
+ * @note      1 - latency_tee 将每个编码包按 NAL 切分并复制一份送入 decoder, 解码后由 latency_probe 读取条码,
+ *                延迟即从写入条码到解码输出的时间, 含编码、写入队列与解码
+ *            2 - decoder 需已 Init/Start, pipeline 结束后由调用方 Stop/Uninit; 与编码器类型无关, 硬件与软件编解码器均可
+ *            3 - 读取时使用解码帧实际的行字节数 (见 FrameLumaStride)
+ */
+inline CodecNodeStats::ptr AddLatencyProbeNode(Pipeline& pipeline, const std::string& name, Codec::AbstractDecoder::ptr decoder, H26xCodec codec,
+                                               PipelineEdge<AbstractPack::ptr>::ptr packs, PipelineEdge<AbstractPack::ptr>::ptr out, LatencyProbe::ptr probe)
+{
+    PipelineEdge<NormalPack::ptr>::ptr probePacks = pipeline.CreateEdge<NormalPack::ptr>("probe_pack_" + name, kLatencyProbePackCapacity);
+    PipelineEdge<AbstractFrame::ptr>::ptr probeFrames = pipeline.CreateEdge<AbstractFrame::ptr>("probe_frame_" + name, kLatencyProbeFrameCapacity);
+    class TeeState
+    {
+    public:
+        AbstractPack::ptr pack;
+        bool forwarded = false;
+        std::vector<NormalPack::ptr> nals;
+        size_t nalIndex = 0;
+    };
+    std::shared_ptr<TeeState> state = std::make_shared<TeeState>();
+    pipeline.AddStepNode("latency_tee", [packs, out, probePacks, state]() -> PipelineStep
+    {
+        if (!state->pack)
+        {
+            if (!packs->TryPop(state->pack))
+            {
+                return packs->IsEos() ? PipelineStep::DONE : PipelineStep::IDLE;
+            }
+            state->forwarded = false;
+            state->nals.clear();
+            state->nalIndex = 0;
+            const uint8_t* data = (const uint8_t*)state->pack->GetData(0);
+            for (const auto& nal : H26xNal::Split(data, state->pack->GetSize()))
+            {
+                NormalPack::ptr copy = std::make_shared<NormalPack>(nal.second);
+                memcpy(copy->GetData(0), data + nal.first, nal.second);
+                state->nals.push_back(copy);
+            }
+        }
+        if (!state->forwarded)
+        {
+            if (!out->TryPush(state->pack) && !out->IsAborted())
+            {
+                return PipelineStep::IDLE;
+            }
+            state->forwarded = true;
+        }
+        while (state->nalIndex < state->nals.size() && probePacks->TryPush(state->nals[state->nalIndex]))
+        {
+            state->nalIndex++;
+        }
+        if (state->nalIndex < state->nals.size() && !probePacks->IsAborted())
+        {
+            return PipelineStep::IDLE;
+        }
+        state->pack = nullptr;
+        return PipelineStep::PROGRESS;
+    }, {packs}, {out, probePacks});
+    CodecNodeStats::ptr stats = AddDecoderNode(pipeline, decoder, codec, probePacks, probeFrames);
+    pipeline.AddSink("latency_probe", probeFrames, [probe](const AbstractFrame::ptr& frame)
+    {
+        Codec::StreamFrame::ptr streamFrame = std::dynamic_pointer_cast<Codec::StreamFrame>(frame);
+        if (!streamFrame)
+        {
+            return;
+        }
+        DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(streamFrame->GetAllocateMethod());
+        DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1);
+        probe->Check((const uint8_t*)streamFrame->GetData(0), FrameLumaStride(streamFrame), streamFrame->info.width, streamFrame->info.height);
+    });
+    return stats;
+}
+
+inline CodecNodeStats::ptr AddEncoderNode(Pipeline& pipeline, Codec::AbstractEncoder::ptr encoder,
+                                          PipelineEdge<AbstractFrame::ptr>::ptr in, PipelineEdge<AbstractPack::ptr>::ptr out,
+                                          uint32_t maxInflight = kEncoderNodeMaxInflight, uint32_t drainIdleMs = kCodecNodeDrainIdleMs)
+{
+    return AddEncoderNode<AbstractFrame::ptr>(pipeline, encoder, in, out, [](const AbstractFrame::ptr& frame) -> AbstractFrame::ptr
+    {
+        return frame;
+    }, maxInflight, drainIdleMs);
+}
+
+} // namespace Mmp
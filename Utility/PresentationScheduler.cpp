@@ -0,0 +1,122 @@
+#include "PresentationScheduler.h"
+
+#include <sstream>
+
+#include "FrameClock.h"
+
+namespace Mmp
+{
+
+PtsReorderQueue::PtsReorderQueue()
+{
+}
+
+void PtsReorderQueue::Push(NormalPack::ptr pack)
+{
+    TimedPack::ptr timedPack = std::dynamic_pointer_cast<TimedPack>(pack);
+    if (!timedPack || !timedPack->isFirstSlice || timedPack->ptsUs == kPtsNone)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mtx);
+    _pts.insert(timedPack->ptsUs);
+}
+
+int64_t PtsReorderQueue::Pop()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_pts.empty())
+    {
+        return kPtsNone;
+    }
+    int64_t pts = *_pts.begin();
+    _pts.erase(_pts.begin());
+    return pts;
+}
+
+size_t PtsReorderQueue::Size()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _pts.size();
+}
+
+std::string PtsReorderQueue::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::stringstream ss;
+    ss << "PtsReorderQueue pending : " << _pts.size();
+    return ss.str();
+}
+
+PresentationScheduler::PresentationScheduler(int64_t lateToleranceUs, int64_t resyncUs)
+{
+    _lateToleranceUs = lateToleranceUs;
+    _resyncUs = resyncUs;
+    _started = false;
+    _anchorNs = 0;
+    _frameNum = 0;
+    _lateNum = 0;
+    _resyncNum = 0;
+    _maxLatenessUs = 0;
+}
+
+bool PresentationScheduler::Wait(int64_t pts)
+{
+    int64_t deadlineNs = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        int64_t nowNs = (int64_t)FrameClock::NowNs();
+        _frameNum++;
+        if (pts == kPtsNone)
+        {
+            // Hint : 没有时间戳的帧立即呈现
+            return true;
+        }
+        if (!_started)
+        {
+            _anchorNs = nowNs - pts * 1000;
+            _started = true;
+        }
+        deadlineNs = _anchorNs + pts * 1000;
+        int64_t latenessUs = (nowNs - deadlineNs) / 1000;
+        if (latenessUs > _maxLatenessUs)
+        {
+            _maxLatenessUs = latenessUs;
+        }
+        if (latenessUs > _resyncUs)
+        {
+            _anchorNs = nowNs - pts * 1000;
+            _resyncNum++;
+            _lateNum++;
+            return false;
+        }
+        else if (latenessUs > _lateToleranceUs)
+        {
+            _lateNum++;
+            return false;
+        }
+    }
+    FrameClock::SleepUntilNs((uint64_t)deadlineNs);
+    return true;
+}
+
+int64_t PresentationScheduler::MediaTime()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_started)
+    {
+        return kPtsNone;
+    }
+    return ((int64_t)FrameClock::NowNs() - _anchorNs) / 1000;
+}
+
+std::string PresentationScheduler::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::stringstream ss;
+    ss << "PresentationScheduler frames : " << _frameNum << ", late : " << _lateNum << ", resync : " << _resyncNum;
+    ss << ", max lateness : " << _maxLatenessUs << " us";
+    return ss.str();
+}
+
+} // namespace Mmp
@@ -0,0 +1,92 @@
+//
+// PresentationScheduler.h
+//
+// Library: Common
+// Package: Utility
+// Module:  PresentationScheduler
+//
+
+#pragma once
+
+#include <set>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "TimedPack.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief  时间戳重排序队列
+ * @note   1 - 送入解码器的 access unit 的时间戳集合与解码器输出的帧一一对应, 解码器按显示顺序输出,
+ *             故解码器每输出一帧, 取当前最小的待输出时间戳即为该帧的 PTS (B 帧同样适用, 时间戳可以是变帧率的)
+ *         2 - 不依赖解码器透传时间戳; 解码器丢弃 access unit (如起始 CRA 后的 RASL、损坏的帧) 时,
+ *             被丢弃的时间戳留在队列中, 其后输出的帧依次取到偏早的时间戳, 直到码流结束
+ *         3 - 线程安全, Push 与 Pop 通常位于不同线程
+ */
+class PtsReorderQueue
+{
+public:
+    using ptr = std::shared_ptr<PtsReorderQueue>;
+public:
+    PtsReorderQueue();
+public:
+    /**
+     * @brief 送入解码器的 NAL, 仅记录一帧的第一个 slice
+     */
+    void Push(NormalPack::ptr pack);
+    /**
+     * @brief 解码器每输出一帧调用一次, 无待输出时间戳时返回 kPtsNone
+     */
+    int64_t Pop();
+    size_t Size();
+    std::string Report();
+private:
+    std::mutex             _mtx;
+    std::multiset<int64_t> _pts; // 待输出的时间戳
+};
+
+/**
+ * @brief  基于主时钟 (CLOCK_MONOTONIC) 的呈现调度器
+ * @note   1 - 第一次 Wait 时将主时钟与时间戳对齐, 此后每帧在 anchor + pts 时刻呈现
+ *         2 - 迟到超过 resyncUs 时重新对齐, 避免长时间追赶
+ *         3 - 线程安全, 显示与编码可共享同一主时钟
+ */
+class PresentationScheduler
+{
+public:
+    using ptr = std::shared_ptr<PresentationScheduler>;
+public:
+    /**
+     * @param[in] lateToleranceUs : 可容忍的迟到时间, 超出时 Wait 返回 false
+     * @param[in] resyncUs        : 迟到超过此值时重新对齐主时钟
+     */
+    explicit PresentationScheduler(int64_t lateToleranceUs = 20000, int64_t resyncUs = 500000);
+public:
+    /**
+     * @brief  阻塞至 pts 对应的呈现时刻
+     * @return 是否按时 (迟到不超过 lateToleranceUs)
+     */
+    bool Wait(int64_t pts);
+    /**
+     * @brief 主时钟对应的媒体时间, 未开始时返回 kPtsNone
+     */
+    int64_t MediaTime();
+    std::string Report();
+private:
+    std::mutex _mtx;
+    int64_t    _lateToleranceUs;
+    int64_t    _resyncUs;
+    bool       _started;
+    int64_t    _anchorNs;  // pts 为 0 时对应的主时钟时间
+private: /* statistics */
+    uint64_t   _frameNum;
+    uint64_t   _lateNum;
+    uint64_t   _resyncNum;
+    int64_t    _maxLatenessUs;
+};
+
+} // namespace Mmp
@@ -0,0 +1,315 @@
+#include "RawVideoReader.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Common/DmaHeapAllocateMethod.h"
+
+#include "DmaBufFence.h"
+#include "FrameClock.h"
+#include "UtilityCommon.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Mmp
+{
+
+namespace
+{
+
+constexpr int32_t kPoolTimeoutMs = 1000;
+
+/**
+ * @brief 将 I420 的 U、V 平面交织为 NV12 的 UV 平面
+ */
+void InterleaveUV(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t size)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= size; i += 16)
+    {
+        uint8x16x2_t pair;
+        pair.val[0] = vld1q_u8(u + i);
+        pair.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + 2 * i, pair);
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(u + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(v + i));
+        _mm_storeu_si128((__m128i*)(uv + 2 * i), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i*)(uv + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+void AdviseWillNeed(const uint8_t* data, uint64_t offset, uint64_t bytes)
+{
+    static const uint64_t kPageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t begin = offset / kPageSize * kPageSize;
+    madvise((void*)(data + begin), bytes + (offset - begin), MADV_WILLNEED);
+}
+
+} // namespace
+
+bool RawVideoFormatFromName(const std::string& name, RawVideoFormat& format)
+{
+    if (name == "nv12")
+    {
+        format = RawVideoFormat::NV12;
+    }
+    else if (name == "i420" || name == "yuv420p")
+    {
+        format = RawVideoFormat::I420;
+    }
+    else if (name == "y4m")
+    {
+        format = RawVideoFormat::Y4M;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+RawVideoReader::RawVideoReader(const std::string& path, RawVideoFormat format, uint32_t width, uint32_t height,
+                               uint32_t bufferNum, bool useDmaHeap, uint32_t prefetchFrames)
+{
+    _path = path;
+    _format = format;
+    _width = width;
+    _height = height;
+    _fpsNum = 0;
+    _fpsDen = 0;
+    _prefetchFrames = prefetchFrames;
+    _data = nullptr;
+    _size = 0;
+    _frameIndex = 0;
+    _readNum = 0;
+    _copyNs = 0;
+    _fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0)
+    {
+        UTILITY_LOG_ERROR << "Open " << path << " fail, error is: " << strerror(errno);
+        return;
+    }
+    struct stat st = {};
+    if (fstat(_fd, &st) != 0 || st.st_size == 0)
+    {
+        UTILITY_LOG_ERROR << "Stat " << path << " fail or empty file";
+        return;
+    }
+    _size = (uint64_t)st.st_size;
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        UTILITY_LOG_ERROR << "Mmap " << path << " fail, error is: " << strerror(errno);
+        _size = 0;
+        return;
+    }
+    _data = (const uint8_t*)data;
+    madvise(data, _size, MADV_SEQUENTIAL);
+    if (_format == RawVideoFormat::Y4M && !ParseY4mHeader())
+    {
+        _frameOffsets.clear();
+        return;
+    }
+    if (_width == 0 || _height == 0 || _width % 2 != 0 || _height % 2 != 0)
+    {
+        UTILITY_LOG_ERROR << "Invalid raw video size " << _width << "x" << _height << ", width and height must be even";
+        _frameOffsets.clear();
+        return;
+    }
+    uint64_t frameSize = (uint64_t)_width * _height * 3 / 2;
+    if (_format != RawVideoFormat::Y4M)
+    {
+        for (uint64_t offset = 0; offset + frameSize <= _size; offset += frameSize)
+        {
+            _frameOffsets.push_back(offset);
+        }
+    }
+    if (_prefetchFrames != 0 && !_frameOffsets.empty())
+    {
+        AdviseWillNeed(_data, _frameOffsets[0], frameSize * std::min<uint64_t>(_prefetchFrames, _frameOffsets.size()));
+    }
+    _pool = std::make_shared<FramePool>(PixelsInfo(_width, _height, 8, PixelFormat::NV12), bufferNum, useDmaHeap);
+}
+
+RawVideoReader::~RawVideoReader()
+{
+    if (_data)
+    {
+        munmap((void*)_data, _size);
+    }
+    if (_fd >= 0)
+    {
+        close(_fd);
+    }
+}
+
+bool RawVideoReader::ParseY4mHeader()
+{
+    // 例如 : YUV4MPEG2 W1920 H1080 F30000:1001 Ip A1:1 C420jpeg\n
+    const char* kMagic = "YUV4MPEG2 ";
+    const uint8_t* end = (const uint8_t*)memchr(_data, '\n', (size_t)std::min<uint64_t>(_size, 4096));
+    if (_size < strlen(kMagic) || memcmp(_data, kMagic, strlen(kMagic)) != 0 || !end)
+    {
+        UTILITY_LOG_ERROR << _path << " is not a y4m file";
+        return false;
+    }
+    std::stringstream ss(std::string((const char*)_data + strlen(kMagic), (const char*)end));
+    std::string token;
+    while (ss >> token)
+    {
+        switch (token[0])
+        {
+            case 'W': _width = std::stoi(token.substr(1)); break;
+            case 'H': _height = std::stoi(token.substr(1)); break;
+            case 'F':
+            {
+                size_t pos = token.find(':');
+                if (pos != std::string::npos)
+                {
+                    _fpsNum = std::stoi(token.substr(1, pos - 1));
+                    _fpsDen = std::stoi(token.substr(pos + 1));
+                }
+                break;
+            }
+            case 'C':
+            {
+                // Hint : 420jpeg, 420paldv, 420mpeg2 仅色度采样位置不同, 数据布局与 I420 相同;
+                //        高位深以 420p 加位数表示 (如 420p10), 注意与 420paldv 区分
+                std::string colorSpace = token.substr(1);
+                bool highBitDepth = colorSpace.size() > 4 && colorSpace.compare(0, 4, "420p") == 0 && isdigit((unsigned char)colorSpace[4]);
+                if (colorSpace.compare(0, 3, "420") != 0 || highBitDepth)
+                {
+                    UTILITY_LOG_ERROR << "Unsupported y4m color space " << colorSpace << ", only 8 bit 4:2:0 is supported";
+                    return false;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    uint64_t frameSize = (uint64_t)_width * _height * 3 / 2;
+    uint64_t offset = (uint64_t)(end - _data) + 1;
+    while (offset + 5 < _size && memcmp(_data + offset, "FRAME", 5) == 0)
+    {
+        const uint8_t* frameEnd = (const uint8_t*)memchr(_data + offset, '\n', (size_t)std::min<uint64_t>(_size - offset, 1024));
+        if (!frameEnd || (uint64_t)(frameEnd - _data) + 1 + frameSize > _size)
+        {
+            break;
+        }
+        offset = (uint64_t)(frameEnd - _data) + 1;
+        _frameOffsets.push_back(offset);
+        offset += frameSize;
+    }
+    return true;
+}
+
+bool RawVideoReader::IsOpen()
+{
+    return !_frameOffsets.empty();
+}
+
+void RawVideoReader::CopyFrame(const uint8_t* src, uint8_t* dst)
+{
+    uint64_t lumaSize = (uint64_t)_width * _height;
+    if (_format == RawVideoFormat::NV12)
+    {
+        memcpy(dst, src, lumaSize * 3 / 2);
+    }
+    else
+    {
+        memcpy(dst, src, lumaSize);
+        InterleaveUV(src + lumaSize, src + lumaSize + lumaSize / 4, dst + lumaSize, lumaSize / 4);
+    }
+}
+
+Codec::StreamFrame::ptr RawVideoReader::Read()
+{
+    if (_frameIndex >= _frameOffsets.size())
+    {
+        return nullptr;
+    }
+    // Hint : 使用轮转池中的下一个 buffer, 编码器仍持有时等待其归还
+    Codec::StreamFrame::ptr frame = _pool->Acquire(kPoolTimeoutMs);
+    if (_prefetchFrames != 0 && _frameIndex + _prefetchFrames < _frameOffsets.size())
+    {
+        AdviseWillNeed(_data, _frameOffsets[_frameIndex + _prefetchFrames], (uint64_t)_width * _height * 3 / 2);
+    }
+    {
+        uint64_t beginNs = FrameClock::NowNs();
+        DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(frame->GetAllocateMethod());
+        DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1, true);
+        CopyFrame(_data + _frameOffsets[_frameIndex], (uint8_t*)frame->GetData(0));
+        _copyNs += FrameClock::NowNs() - beginNs;
+    }
+    _frameIndex++;
+    _readNum++;
+    return frame;
+}
+
+void RawVideoReader::Rewind()
+{
+    _frameIndex = 0;
+}
+
+uint32_t RawVideoReader::Width()
+{
+    return _width;
+}
+
+uint32_t RawVideoReader::Height()
+{
+    return _height;
+}
+
+uint64_t RawVideoReader::FrameNum()
+{
+    return _frameOffsets.size();
+}
+
+bool RawVideoReader::GetFrameRate(uint32_t& fpsNum, uint32_t& fpsDen)
+{
+    if (_fpsNum == 0 || _fpsDen == 0)
+    {
+        return false;
+    }
+    fpsNum = _fpsNum;
+    fpsDen = _fpsDen;
+    return true;
+}
+
+std::string RawVideoReader::Report()
+{
+    std::stringstream ss;
+    ss << "RawVideoReader " << _path << " " << _width << "x" << _height << " frames : " << _readNum << " / " << _frameOffsets.size()
+       << ", copy : " << (_readNum ? _copyNs / _readNum / 1000 : 0) << " us/frame";
+    if (_pool)
+    {
+        ss << ", " << _pool->Report();
+    }
+    return ss.str();
+}
+
+} // namespace Mmp
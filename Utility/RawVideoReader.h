@@ -0,0 +1,98 @@
+//
+// RawVideoReader.h
+//
+// Library: Common
+// Package: Utility
+// Module:  RawVideoReader
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Codec/StreamFrame.h"
+
+#include "FramePool.h"
+
+namespace Mmp
+{
+
+enum class RawVideoFormat
+{
+    NV12,
+    I420,
+    Y4M,   // 仅支持 4:2:0 8 bit
+};
+
+/**
+ * @brief      根据 -input_format 参数 (nv12, i420, y4m) 获取文件格式
+ * @param[in]  name
+ * @param[out] format
+ */
+bool RawVideoFormatFromName(const std::string& name, RawVideoFormat& format);
+
+/**
+ * @brief  原始视频 (NV12 / I420 / Y4M) 文件的读取, 输出 NV12 帧
+ * @note   1 - 文件整体 mmap, 按帧偏移直接拷贝到输出 buffer, 不经过 read 的内核拷贝;
+ *             prefetchFrames 不为 0 时对后续若干帧 madvise(MADV_WILLNEED), 由内核提前读入 page cache
+ *         2 - 输出帧来自 bufferNum 个 buffer 的轮转池 (见 FramePool), 下一个 buffer 仍被编码器等持有时 Read 等待其归还
+ *         3 - I420 在拷贝时将 U、V 交织为 NV12
+ *         4 - Read 非线程安全, 仅由一个线程调用; 输出帧可在任意线程释放
+ */
+class RawVideoReader
+{
+public:
+    using ptr = std::shared_ptr<RawVideoReader>;
+public:
+    /**
+     * @param[in] width, height : 原始 NV12 / I420 的宽高, Y4M 以文件头为准
+     * @param[in] bufferNum     : 轮转池的 buffer 数, 应大于下游 (队列 + 编码器在途) 可持有的帧数
+     * @param[in] useDmaHeap    : 输出 buffer 是否使用 DMA-HEAP 分配
+     */
+    RawVideoReader(const std::string& path, RawVideoFormat format, uint32_t width, uint32_t height,
+                   uint32_t bufferNum = 8, bool useDmaHeap = false, uint32_t prefetchFrames = 4);
+    ~RawVideoReader();
+public:
+    bool IsOpen();
+    /**
+     * @brief 读取下一帧, 文件结束时返回 nullptr
+     */
+    Codec::StreamFrame::ptr Read();
+    /**
+     * @brief 回到第一帧, 用于循环输入
+     */
+    void Rewind();
+    uint32_t Width();
+    uint32_t Height();
+    uint64_t FrameNum();
+    /**
+     * @brief Y4M 文件头中的帧率, 原始 YUV 或未指定时返回 false
+     */
+    bool GetFrameRate(uint32_t& fpsNum, uint32_t& fpsDen);
+    std::string Report();
+private:
+    bool ParseY4mHeader();
+    void CopyFrame(const uint8_t* src, uint8_t* dst);
+private:
+    std::string           _path;
+    RawVideoFormat        _format;
+    uint32_t              _width;
+    uint32_t              _height;
+    uint32_t              _fpsNum;
+    uint32_t              _fpsDen;
+    uint32_t              _prefetchFrames;
+    int                   _fd;
+    const uint8_t*        _data;
+    uint64_t              _size;
+    std::vector<uint64_t> _frameOffsets;
+    uint64_t              _frameIndex;
+    FramePool::ptr        _pool;
+private: /* statistics */
+    uint64_t              _readNum;
+    uint64_t              _copyNs;
+};
+
+} // namespace Mmp
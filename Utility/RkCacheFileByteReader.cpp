@@ -0,0 +1,373 @@
+#include "RkCacheFileByteReader.h"
+
+#include <vector>
+#include <fstream>
+#include <cerrno>
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "Common/ImmutableVectorAllocateMethod.h"
+
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+constexpr uint32_t kBufSize = 1024 * 1024;
+constexpr uint32_t kPipeKeepBytes = 4; // 管道无法回读, 保留上一块的末尾供 GetNalUint 回退起始码
+
+NormalPack::ptr RkCacheFileByteReader::GetNalUint()
+{
+    std::vector<uint8_t> bufs;
+    bufs.reserve(1024 * 1024);
+    uint32_t next_24_bits = 0;
+    bool isFirst = true;
+    bool reachEnd = false;
+    while (!(next_24_bits == 0x000001 && !isFirst))
+    {
+        if (next_24_bits == 0x000001)
+        {
+            isFirst = false;
+            bufs.push_back(0);
+            bufs.push_back(0);
+            bufs.push_back(0);
+            bufs.push_back(1);
+        }
+        uint8_t byte = 0;
+        if (Read(&byte, 1) != 1 && eof())
+        {
+            // Hint : 最后一个 NAL 以文件结尾而非下一个起始码结束, 不能丢弃
+            if (isFirst || bufs.size() <= 4)
+            {
+                return nullptr;
+            }
+            reachEnd = true;
+            break;
+        }
+        if (!isFirst)
+        {
+            bufs.push_back(byte);
+        }
+        next_24_bits = (next_24_bits << 8) | byte;
+        next_24_bits = next_24_bits & 0xFFFFFF;
+    }
+    if (!reachEnd)
+    {
+        Seek(Tell() - 3);
+    }
+    if (!reachEnd && bufs.size() >= 3)
+    {
+        bufs.resize(bufs.size() - 3);
+        if (!bufs.empty() && bufs[bufs.size()-1] == 0)
+        {
+            bufs.pop_back();
+        }
+    }
+    std::shared_ptr<ImmutableVectorAllocateMethod<uint8_t>> alloc = std::make_shared<ImmutableVectorAllocateMethod<uint8_t>>();
+    alloc->container.swap(bufs);
+    TimedPack::ptr pack = std::make_shared<TimedPack>(alloc->container.size(), alloc);
+    Stamp(pack);
+    return pack;
+}
+
+class RkCacheFileByteReader::Prefetching
+{
+public:
+    std::mutex              mtx;
+    std::condition_variable cond;
+    std::vector<uint8_t>    buf;
+    uint64_t                offset = 0;
+    int64_t                 result = 0;
+    bool                    done = false;
+};
+
+RkCacheFileByteReader::RkCacheFileByteReader(const std::string& path, H26xCodec codec, AsyncFileIo* io)
+{
+    _codec = codec;
+    _fpsNum = 30;
+    _fpsDen = 1;
+    _fpsFromStream = false;
+    _accessUnitNum = 0;
+    _io = io;
+    _fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0)
+    {
+        assert(false);
+        exit(255);
+    }
+    struct stat st;
+    _seekable = fstat(_fd, &st) == 0 && S_ISREG(st.st_mode);
+    _eof = false;
+    _buf.resize(kBufSize);
+    _offset = 0;
+    _cur = 0;
+    _len = 0;
+    Load(0);
+}
+
+RkCacheFileByteReader::~RkCacheFileByteReader()
+{
+    if (_prefetching)
+    {
+        // Hint : 预读的目标缓冲区属于 Prefetching, 此处仅需等待其不再引用 fd
+        std::unique_lock<std::mutex> lock(_prefetching->mtx);
+        _prefetching->cond.wait(lock, [this]()
+        {
+            return _prefetching->done;
+        });
+    }
+    close(_fd);
+}
+
+void RkCacheFileByteReader::Load(uint64_t offset)
+{
+    std::shared_ptr<Prefetching> prefetching = _prefetching;
+    _prefetching = nullptr;
+    if (prefetching)
+    {
+        std::unique_lock<std::mutex> lock(prefetching->mtx);
+        prefetching->cond.wait(lock, [prefetching]()
+        {
+            return prefetching->done;
+        });
+    }
+    if (!_seekable)
+    {
+        LoadSequential(offset);
+        return;
+    }
+    if (prefetching && prefetching->offset == offset && prefetching->result >= 0)
+    {
+        _buf.swap(prefetching->buf);
+        _len = (uint32_t)prefetching->result;
+    }
+    else
+    {
+        ssize_t len = pread(_fd, _buf.data(), kBufSize, (off_t)offset);
+        _len = len > 0 ? (uint32_t)len : 0;
+    }
+    _offset = offset;
+    _cur = 0;
+    _eof = _len < kBufSize;
+    if (!_eof)
+    {
+        Prefetch(_offset + _len);
+    }
+}
+
+void RkCacheFileByteReader::LoadSequential(uint64_t offset)
+{
+    uint64_t end = _offset + _len;
+    if (offset < end - std::min<uint64_t>(_len, kPipeKeepBytes) || offset > end)
+    {
+        UTILITY_LOG_WARN << "Seek on pipe is not supported, offset is: " << offset << ", read offset is: " << end;
+        _offset = end;
+        _cur = 0;
+        _len = 0;
+        _eof = true;
+        return;
+    }
+    // Hint : 管道的 read 可能只返回部分数据, 读满或读到文件尾 (返回 0) 为止
+    uint32_t keepBytes = (uint32_t)(end - offset);
+    memmove(_buf.data(), _buf.data() + _len - keepBytes, keepBytes);
+    _offset = offset;
+    _cur = 0;
+    _len = keepBytes;
+    _eof = false;
+    while (_len < kBufSize)
+    {
+        ssize_t len = read(_fd, _buf.data() + _len, kBufSize - _len);
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (len <= 0)
+        {
+            _eof = true;
+            break;
+        }
+        _len += (uint32_t)len;
+    }
+}
+
+void RkCacheFileByteReader::Prefetch(uint64_t offset)
+{
+    std::shared_ptr<Prefetching> prefetching = std::make_shared<Prefetching>();
+    prefetching->buf.resize(kBufSize);
+    prefetching->offset = offset;
+    _io->Read(_fd, prefetching->buf.data(), kBufSize, offset, [prefetching](int64_t result)
+    {
+        std::lock_guard<std::mutex> lock(prefetching->mtx);
+        prefetching->result = result;
+        prefetching->done = true;
+        prefetching->cond.notify_all();
+    });
+    _prefetching = prefetching;
+}
+
+size_t RkCacheFileByteReader::Read(void* data, size_t bytes)
+{
+    uint8_t* dst = (uint8_t*)data;
+    size_t readBytes = 0;
+    while (readBytes < bytes)
+    {
+        if (_cur == _len)
+        {
+            if (_eof)
+            {
+                break;
+            }
+            Load(_offset + _len);
+            continue;
+        }
+        size_t copyBytes = std::min(bytes - readBytes, (size_t)(_len - _cur));
+        memcpy(dst + readBytes, _buf.data() + _cur, copyBytes);
+        _cur += copyBytes;
+        readBytes += copyBytes;
+    }
+    return readBytes;
+}
+
+bool RkCacheFileByteReader::Seek(size_t offset)
+{
+    if (offset >= _offset && offset <= _offset + _len)
+    {
+        _cur = (uint32_t)(offset - _offset);
+        return true;
+    }
+    Load(offset);
+    return _len != 0 || !_eof;
+}
+
+size_t RkCacheFileByteReader::Tell()
+{
+    return _offset + _cur;
+}
+
+bool RkCacheFileByteReader::eof()
+{
+    return _eof && _cur == _len;
+}
+
+void RkCacheFileByteReader::SetFrameRate(uint32_t fpsNum, uint32_t fpsDen)
+{
+    if (_fpsFromStream || fpsNum == 0 || fpsDen == 0)
+    {
+        return;
+    }
+    _fpsNum = fpsNum;
+    _fpsDen = fpsDen;
+}
+
+bool RkCacheFileByteReader::GetFrameRate(uint32_t& fpsNum, uint32_t& fpsDen)
+{
+    fpsNum = _fpsNum;
+    fpsDen = _fpsDen;
+    return _fpsFromStream;
+}
+
+void RkCacheFileByteReader::Stamp(TimedPack::ptr pack)
+{
+    const uint8_t* data = (const uint8_t*)pack->GetData(0);
+    size_t size = pack->GetSize();
+    uint32_t fpsNum = 0, fpsDen = 0;
+    if (!_fpsFromStream && H26xNal::ParseFrameRate(_codec, data, size, fpsNum, fpsDen))
+    {
+        UTILITY_LOG_INFO << "Frame rate from bitstream is: " << fpsNum << "/" << fpsDen;
+        _fpsNum = fpsNum;
+        _fpsDen = fpsDen;
+        _fpsFromStream = true;
+    }
+    //
+    // Hint : 非 VCL NAL (SPS、PPS、SEI 等) 归属于其后的 access unit,
+    //        时间戳按解码顺序递增, 显示顺序由 PtsReorderQueue 恢复
+    //
+    pack->isFirstSlice = H26xNal::IsFirstSliceOfPicture(_codec, data, size);
+    if (!pack->isFirstSlice)
+    {
+        return;
+    }
+    int64_t frameDurationUs = (int64_t)(_fpsDen * 1000000ull / _fpsNum);
+    if (_accessUnitNum < _timestampsUs.size())
+    {
+        pack->ptsUs = _timestampsUs[_accessUnitNum];
+        pack->durationUs = _durationsUs[_accessUnitNum];
+    }
+    else if (!_timestampsUs.empty())
+    {
+        pack->ptsUs = _timestampsUs.back() + (int64_t)(_accessUnitNum - _timestampsUs.size() + 1) * frameDurationUs;
+        pack->durationUs = frameDurationUs;
+    }
+    else
+    {
+        pack->ptsUs = (int64_t)(_accessUnitNum * _fpsDen * 1000000ull / _fpsNum);
+        pack->durationUs = frameDurationUs;
+    }
+    _accessUnitNum++;
+}
+
+bool RkCacheFileByteReader::LoadTimestamps(const std::string& path)
+{
+    std::ifstream ifs(path);
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+    std::vector<int64_t> timestampsUs;
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#')
+        {
+            continue;
+        }
+        char* end = nullptr;
+        double seconds = strtod(line.c_str() + begin, &end);
+        if (end == line.c_str() + begin)
+        {
+            UTILITY_LOG_WARN << "Invalid timestamp: " << line;
+            return false;
+        }
+        timestampsUs.push_back((int64_t)(seconds * 1000000 + (seconds < 0 ? -0.5 : 0.5)));
+    }
+    if (timestampsUs.empty())
+    {
+        return false;
+    }
+    int64_t baseUs = *std::min_element(timestampsUs.begin(), timestampsUs.end());
+    for (auto& timestampUs : timestampsUs)
+    {
+        timestampUs -= baseUs;
+    }
+    // Hint : 时长按显示顺序计算, B 帧的解码顺序与显示顺序不同
+    std::vector<size_t> order(timestampsUs.size());
+    for (size_t i=0; i<order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&timestampsUs](size_t a, size_t b)
+    {
+        return timestampsUs[a] < timestampsUs[b];
+    });
+    std::vector<int64_t> durationsUs(timestampsUs.size(), (int64_t)(_fpsDen * 1000000ull / _fpsNum));
+    for (size_t i=0; i+1<order.size(); i++)
+    {
+        durationsUs[order[i]] = timestampsUs[order[i+1]] - timestampsUs[order[i]];
+    }
+    if (order.size() >= 2)
+    {
+        durationsUs[order.back()] = durationsUs[order[order.size() - 2]];
+    }
+    _timestampsUs.swap(timestampsUs);
+    _durationsUs.swap(durationsUs);
+    UTILITY_LOG_INFO << "Load " << _timestampsUs.size() << " timestamps from " << path;
+    return true;
+}
+
+} // namespace Mmp
@@ -0,0 +1,95 @@
+//
+// RkCacheFileByteReader.h
+//
+// Library: Common
+// Package: Utility
+// Module:  RkCacheFileByteReader
+//
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+#include "H26xBitstream.h"
+#include "TimedPack.h"
+#include "AsyncFileIo.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief  Annex-B 码流文件读取器, 按 NAL 单元切分并附带时间戳
+ * @note   1 - 时间戳优先取自 LoadTimestamps 加载的逐帧时间戳 (变帧率), 其次为码流 VUI timing (H.264 SPS / H.265 VPS),
+ *             最后为 SetFrameRate 设置的帧率; 只有一帧的第一个 slice 带有时间戳
+ *         2 - 解析当前缓冲区时通过 AsyncFileIo 预读下一块, GetNalUint 仅在磁盘慢于解析时等待;
+ *             仍可能等待, 在 Pipeline 中应作为 blocking 节点 (见 AddSource)
+ *         3 - 以短读判断文件尾, 不依赖文件大小, 可读取管道 (如 mkfifo 或 /dev/stdin); 管道不可 pread, 此时顺序读取且不预读
+ * @todo   好像挺烧 CPU, 用 `mmap` 并且优化 NAL UINT 的查找方式可能好一些
+ */
+class RkCacheFileByteReader
+{
+public:
+    using ptr = std::shared_ptr<RkCacheFileByteReader>;
+public:
+    explicit RkCacheFileByteReader(const std::string& path, H26xCodec codec = H26xCodec::H264, AsyncFileIo* io = AsyncFileIo::Instance());
+    ~RkCacheFileByteReader();
+public:
+    /**
+     * @brief 获取下一个 NAL 单元, 实际类型为 TimedPack
+     */
+    NormalPack::ptr GetNalUint();
+    /**
+     * @brief 码流不包含 timing 信息时使用的帧率, default 30
+     */
+    void SetFrameRate(uint32_t fpsNum, uint32_t fpsDen = 1);
+    /**
+     * @brief      当前使用的帧率
+     * @return     帧率是否来自码流
+     */
+    bool GetFrameRate(uint32_t& fpsNum, uint32_t& fpsDen);
+    /**
+     * @brief     加载逐帧的时间戳, 用于变帧率的码流
+     * @param[in] path : 每行一个 access unit 的 pts, 单位秒, 按解码顺序, # 开头为注释;
+     *                   可由 ffprobe -select_streams v -show_entries packet=pts_time -of csv=p=0 [input] 得到
+     * @note      以最小的时间戳为 0; 超出文件记录的 access unit 按帧率从最后一个时间戳继续递增
+     */
+    bool LoadTimestamps(const std::string& path);
+public:
+    size_t Read(void* data, size_t bytes);
+    bool Seek(size_t offset);
+    size_t Tell();
+    bool eof();
+private:
+    void Stamp(TimedPack::ptr pack);
+    void Load(uint64_t offset);
+    void LoadSequential(uint64_t offset);
+    void Prefetch(uint64_t offset);
+private:
+    class Prefetching;
+private:
+    int                          _fd;
+    bool                         _seekable;
+    bool                         _eof;      // 最近一次读取为短读, 当前缓冲区之后没有数据
+    AsyncFileIo*                 _io;
+    std::shared_ptr<Prefetching> _prefetching;
+private:
+    std::vector<uint8_t> _buf;
+    uint64_t             _offset;
+    uint32_t             _cur;
+    uint32_t             _len;
+private: /* timestamp */
+    H26xCodec _codec;
+    uint32_t  _fpsNum;
+    uint32_t  _fpsDen;
+    bool      _fpsFromStream;
+    uint64_t  _accessUnitNum;
+    std::vector<int64_t> _timestampsUs; // 按解码顺序
+    std::vector<int64_t> _durationsUs;  // 按显示顺序到下一帧的间隔, 与 _timestampsUs 一一对应
+};
+
+} // namespace Mmp
@@ -0,0 +1,154 @@
+#include "StartupProfiler.h"
+
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unistd.h>
+
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+constexpr uint64_t kNsPerSecond = 1000000000ull;
+constexpr uint64_t kNsPerMs = 1000000ull;
+// /proc/[pid]/stat 中 starttime 为第 22 个字段
+constexpr uint32_t kStatStartTimeField = 22;
+
+StartupProfiler* StartupProfiler::Instance()
+{
+    static StartupProfiler gInstance;
+    return &gInstance;
+}
+
+uint64_t StartupProfiler::BootTimeNs()
+{
+    struct timespec ts = {};
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * kNsPerSecond + (uint64_t)ts.tv_nsec;
+}
+
+StartupProfiler::StartupProfiler()
+{
+    _processStartNs = BootTimeNs();
+    // Hint : starttime 以系统启动为起点, 单位为 clock tick, 与 CLOCK_BOOTTIME 同源
+    std::ifstream ifs("/proc/self/stat");
+    std::string stat;
+    if (std::getline(ifs, stat))
+    {
+        // 第 2 个字段 (comm) 可能包含空格, 从最后一个 ')' 之后开始计数
+        size_t pos = stat.rfind(')');
+        if (pos != std::string::npos)
+        {
+            std::stringstream ss(stat.substr(pos + 1));
+            std::string field;
+            uint32_t index = 2;
+            while (ss >> field && ++index < kStatStartTimeField);
+            long ticks = sysconf(_SC_CLK_TCK);
+            if (index == kStatStartTimeField && ticks > 0)
+            {
+                uint64_t startNs = std::stoull(field) * kNsPerSecond / (uint64_t)ticks;
+                if (startNs <= _processStartNs)
+                {
+                    _processStartNs = startNs;
+                }
+            }
+        }
+    }
+}
+
+void StartupProfiler::Mark(const std::string& phase)
+{
+    uint64_t offsetNs = BootTimeNs() - _processStartNs;
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (const auto& mark : _marks)
+    {
+        if (mark.first == phase)
+        {
+            return;
+        }
+    }
+    _marks.push_back({phase, offsetNs});
+}
+
+uint64_t StartupProfiler::ElapsedMs()
+{
+    return (BootTimeNs() - _processStartNs) / kNsPerMs;
+}
+
+void StartupProfiler::SetDeadline(const std::string& phase, uint64_t deadlineMs)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (deadlineMs == 0)
+    {
+        _deadlines.erase(phase);
+    }
+    else
+    {
+        _deadlines[phase] = deadlineMs;
+    }
+}
+
+bool StartupProfiler::Check()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    bool pass = true;
+    for (const auto& deadline : _deadlines)
+    {
+        bool reached = false;
+        for (const auto& mark : _marks)
+        {
+            if (mark.first == deadline.first)
+            {
+                reached = true;
+                if (mark.second / kNsPerMs > deadline.second)
+                {
+                    UTILITY_LOG_ERROR << "Startup phase \"" << deadline.first << "\" takes " << mark.second / kNsPerMs << " ms, deadline is: " << deadline.second << " ms";
+                    pass = false;
+                }
+            }
+        }
+        if (!reached)
+        {
+            UTILITY_LOG_ERROR << "Startup phase \"" << deadline.first << "\" is not reached, deadline is: " << deadline.second << " ms";
+            pass = false;
+        }
+    }
+    return pass;
+}
+
+std::string StartupProfiler::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::stringstream ss;
+    ss << "Startup phases (ms since process start):";
+    uint64_t lastNs = 0;
+    for (const auto& mark : _marks)
+    {
+        ss << std::endl << "-- " << std::setw(8) << std::fixed << std::setprecision(1) << mark.second / 1e6
+           << " (+" << std::setprecision(1) << (mark.second - lastNs) / 1e6 << ") " << mark.first;
+        lastNs = mark.second;
+    }
+    return ss.str();
+}
+
+bool StartupProfiler::Export(const std::string& path)
+{
+    std::ofstream ofs(path);
+    if (!ofs.is_open())
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mtx);
+    ofs << "phase,offset_ms,delta_ms" << std::endl;
+    uint64_t lastNs = 0;
+    for (const auto& mark : _marks)
+    {
+        ofs << mark.first << "," << std::fixed << std::setprecision(3) << mark.second / 1e6 << "," << (mark.second - lastNs) / 1e6 << std::endl;
+        lastNs = mark.second;
+    }
+    return true;
+}
+
+} // namespace Mmp
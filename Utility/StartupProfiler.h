@@ -0,0 +1,70 @@
+//
+// StartupProfiler.h
+//
+// Library: Common
+// Package: Utility
+// Module:  StartupProfiler
+//
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Mmp
+{
+
+/**
+ * @brief 首帧阶段名, -first_frame_deadline 作用于该阶段
+ */
+constexpr const char* kStartupFirstFrame = "first frame";
+
+/**
+ * @brief  启动阶段耗时统计
+ * @note   1 - 各阶段的时刻均相对于进程启动 (/proc/self/stat starttime, 精度为一个 jiffy),
+ *             包含动态库加载、静态初始化等 main 之前的耗时
+ *         2 - 同名阶段只记录第一次
+ *         3 - 可为阶段设置 deadline, 用于在测试中发现启动耗时的回退
+ *         4 - 线程安全
+ */
+class StartupProfiler
+{
+public:
+    static StartupProfiler* Instance();
+public:
+    /**
+     * @brief 记录阶段完成的时刻
+     */
+    void Mark(const std::string& phase);
+    /**
+     * @brief 自进程启动以来经过的时间
+     */
+    uint64_t ElapsedMs();
+    /**
+     * @brief 设置阶段的 deadline (相对进程启动), 0 表示取消
+     */
+    void SetDeadline(const std::string& phase, uint64_t deadlineMs);
+    /**
+     * @brief  检查所有 deadline
+     * @return 存在超时或未到达的阶段时返回 false
+     */
+    bool Check();
+    std::string Report();
+    /**
+     * @brief 导出为 CSV : phase,offset_ms,delta_ms
+     */
+    bool Export(const std::string& path);
+private:
+    StartupProfiler();
+    static uint64_t BootTimeNs();
+private:
+    std::mutex _mtx;
+    uint64_t   _processStartNs;
+    std::vector<std::pair<std::string, uint64_t>> _marks; // 阶段 -> 相对进程启动的时刻 (ns)
+    std::map<std::string, uint64_t> _deadlines;
+};
+
+} // namespace Mmp
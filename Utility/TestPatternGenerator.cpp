@@ -0,0 +1,418 @@
+#include "TestPatternGenerator.h"
+
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "FrameClock.h"
+#include "WorkStealingExecutor.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MMP_TEST_PATTERN_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MMP_TEST_PATTERN_SSE2 1
+#endif
+
+namespace Mmp
+{
+
+namespace
+{
+
+constexpr uint32_t kBandRows = 64;
+constexpr uint32_t kBarNum = 8;
+constexpr uint32_t kBarSpeed = 8;       // 像素每帧, 须为偶数
+constexpr uint32_t kZonePlateSpeed = 2048; // 相位每帧, 65536 为一个周期
+
+// 75% 彩条 (BT.709, limited range) : 白, 黄, 青, 绿, 品红, 红, 蓝, 黑
+constexpr uint8_t kBarY[kBarNum] = {180, 168, 145, 133,  63,  51,  28,  16};
+constexpr uint8_t kBarU[kBarNum] = {128,  44, 147,  63, 193, 109, 212, 128};
+constexpr uint8_t kBarV[kBarNum] = {128, 136,  44,  52, 204, 212, 120, 128};
+
+// 3x5 点阵数字, 按行优先从最高位开始
+constexpr uint16_t kDigitGlyph[10] =
+{
+    0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF
+};
+
+uint32_t SplitMix32(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)(value ^ (value >> 31)) | 1;
+}
+
+/**
+ * @brief 波带片 : 相位 p = column[x] + rowPhase, 输出三角波 (p < 32768 ? p : 65535 - p) >> 7
+ */
+void ZonePlateRowScalar(const uint16_t* column, uint16_t rowPhase, uint8_t* dst, size_t size)
+{
+    for (size_t x=0; x<size; x++)
+    {
+        uint16_t phase = (uint16_t)(column[x] + rowPhase);
+        uint16_t mask = (phase & 0x8000) ? 0xFFFF : 0;
+        dst[x] = (uint8_t)((phase ^ mask) >> 7);
+    }
+}
+
+#if !defined(MMP_TEST_PATTERN_NEON) && !defined(MMP_TEST_PATTERN_SSE2)
+/**
+ * @brief 噪声 : 4 路 xorshift32, 每次迭代输出 16 字节
+ */
+void NoiseRowScalar(uint64_t seed, uint8_t* dst, size_t size)
+{
+    uint32_t state[4] = {SplitMix32(seed * 4), SplitMix32(seed * 4 + 1), SplitMix32(seed * 4 + 2), SplitMix32(seed * 4 + 3)};
+    for (size_t x=0; x<size; x+=16)
+    {
+        for (uint32_t i=0; i<4; i++)
+        {
+            state[i] ^= state[i] << 13;
+            state[i] ^= state[i] >> 17;
+            state[i] ^= state[i] << 5;
+        }
+        memcpy(dst + x, state, std::min<size_t>(16, size - x));
+    }
+}
+#endif /* !MMP_TEST_PATTERN_NEON && !MMP_TEST_PATTERN_SSE2 */
+
+#if defined(MMP_TEST_PATTERN_NEON)
+void ZonePlateRow(const uint16_t* column, uint16_t rowPhase, uint8_t* dst, size_t size)
+{
+    uint16x8_t row = vdupq_n_u16(rowPhase);
+    size_t x = 0;
+    for (; x + 16 <= size; x += 16)
+    {
+        uint16x8_t p0 = vaddq_u16(vld1q_u16(column + x), row);
+        uint16x8_t p1 = vaddq_u16(vld1q_u16(column + x + 8), row);
+        p0 = veorq_u16(p0, vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(p0), 15)));
+        p1 = veorq_u16(p1, vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(p1), 15)));
+        vst1q_u8(dst + x, vcombine_u8(vshrn_n_u16(p0, 7), vshrn_n_u16(p1, 7)));
+    }
+    ZonePlateRowScalar(column + x, rowPhase, dst + x, size - x);
+}
+
+void NoiseRow(uint64_t seed, uint8_t* dst, size_t size)
+{
+    uint32_t init[4] = {SplitMix32(seed * 4), SplitMix32(seed * 4 + 1), SplitMix32(seed * 4 + 2), SplitMix32(seed * 4 + 3)};
+    uint32x4_t state = vld1q_u32(init);
+    size_t x = 0;
+    for (; x + 16 <= size; x += 16)
+    {
+        state = veorq_u32(state, vshlq_n_u32(state, 13));
+        state = veorq_u32(state, vshrq_n_u32(state, 17));
+        state = veorq_u32(state, vshlq_n_u32(state, 5));
+        vst1q_u8(dst + x, vreinterpretq_u8_u32(state));
+    }
+    if (x < size)
+    {
+        uint32_t tail[4];
+        state = veorq_u32(state, vshlq_n_u32(state, 13));
+        state = veorq_u32(state, vshrq_n_u32(state, 17));
+        state = veorq_u32(state, vshlq_n_u32(state, 5));
+        vst1q_u32(tail, state);
+        memcpy(dst + x, tail, size - x);
+    }
+}
+#elif defined(MMP_TEST_PATTERN_SSE2)
+void ZonePlateRow(const uint16_t* column, uint16_t rowPhase, uint8_t* dst, size_t size)
+{
+    __m128i row = _mm_set1_epi16((int16_t)rowPhase);
+    size_t x = 0;
+    for (; x + 16 <= size; x += 16)
+    {
+        __m128i p0 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(column + x)), row);
+        __m128i p1 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(column + x + 8)), row);
+        p0 = _mm_srli_epi16(_mm_xor_si128(p0, _mm_srai_epi16(p0, 15)), 7);
+        p1 = _mm_srli_epi16(_mm_xor_si128(p1, _mm_srai_epi16(p1, 15)), 7);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(p0, p1));
+    }
+    ZonePlateRowScalar(column + x, rowPhase, dst + x, size - x);
+}
+
+void NoiseRow(uint64_t seed, uint8_t* dst, size_t size)
+{
+    __m128i state = _mm_set_epi32((int32_t)SplitMix32(seed * 4 + 3), (int32_t)SplitMix32(seed * 4 + 2),
+                                  (int32_t)SplitMix32(seed * 4 + 1), (int32_t)SplitMix32(seed * 4));
+    size_t x = 0;
+    for (; x + 16 <= size; x += 16)
+    {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        _mm_storeu_si128((__m128i*)(dst + x), state);
+    }
+    if (x < size)
+    {
+        uint8_t tail[16];
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        _mm_storeu_si128((__m128i*)tail, state);
+        memcpy(dst + x, tail, size - x);
+    }
+}
+#else
+void ZonePlateRow(const uint16_t* column, uint16_t rowPhase, uint8_t* dst, size_t size)
+{
+    ZonePlateRowScalar(column, rowPhase, dst, size);
+}
+
+void NoiseRow(uint64_t seed, uint8_t* dst, size_t size)
+{
+    NoiseRowScalar(seed, dst, size);
+}
+#endif
+
+/**
+ * @brief 一帧的分段任务, 由调用线程与执行器上的任务共同认领
+ * @note  迟到的任务只访问 next, 不会在 Generate 返回后访问帧数据
+ */
+class PatternJob
+{
+public:
+    std::atomic<uint32_t>      next{0};
+    std::atomic<uint32_t>      done{0};
+    uint32_t                   bandNum = 0;
+    std::function<void(uint32_t /* band */)> run;
+    std::mutex                 mtx;
+    std::condition_variable    cond;
+public:
+    void Work()
+    {
+        for (uint32_t band = next.fetch_add(1); band < bandNum; band = next.fetch_add(1))
+        {
+            run(band);
+            if (done.fetch_add(1) + 1 == bandNum)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                cond.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace
+
+bool TestPatternFromName(const std::string& name, TestPattern& pattern)
+{
+    if (name == "bars")
+    {
+        pattern = TestPattern::BARS;
+    }
+    else if (name == "zoneplate")
+    {
+        pattern = TestPattern::ZONE_PLATE;
+    }
+    else if (name == "noise")
+    {
+        pattern = TestPattern::NOISE;
+    }
+    else if (name == "mix")
+    {
+        pattern = TestPattern::MIX;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+TestPatternGenerator::TestPatternGenerator(uint32_t width, uint32_t height, TestPattern pattern, uint32_t threadNum)
+{
+    _width = width;
+    _height = height;
+    _pattern = pattern;
+    _threadNum = threadNum == 0 ? 1 : threadNum;
+    _frameNum = 0;
+    _totalCostNs = 0;
+    _maxCostNs = 0;
+    _barLuma.resize(2 * (size_t)width);
+    _barChroma.resize(2 * (size_t)width);
+    for (uint32_t x=0; x<2*width; x++)
+    {
+        _barLuma[x] = kBarY[(x % width) * kBarNum / width];
+        uint32_t bar = ((x & ~1u) % width) * kBarNum / width;
+        _barChroma[x] = (x & 1) ? kBarV[bar] : kBarU[bar];
+    }
+    // Hint : 相位 (x - w / 2)^2 * 32768 / w, 边缘处相邻像素相差半个周期, 即达到奈奎斯特频率
+    _zoneColumn.resize(width);
+    for (uint32_t x=0; x<width; x++)
+    {
+        int64_t dx = (int64_t)x - width / 2;
+        _zoneColumn[x] = (uint16_t)((uint64_t)(dx * dx) * 32768 / width);
+    }
+}
+
+TestPattern TestPatternGenerator::RowPattern(uint32_t y)
+{
+    if (_pattern != TestPattern::MIX)
+    {
+        return _pattern;
+    }
+    else if (y < _height / 3)
+    {
+        return TestPattern::BARS;
+    }
+    else if (y < _height * 2 / 3)
+    {
+        return TestPattern::ZONE_PLATE;
+    }
+    else
+    {
+        return TestPattern::NOISE;
+    }
+}
+
+void TestPatternGenerator::GenerateRows(uint64_t frameIndex, uint8_t* nv12, uint32_t stride, uint32_t beginRow, uint32_t endRow)
+{
+    uint8_t* chroma = nv12 + (size_t)stride * _height;
+    for (uint32_t y=beginRow; y<endRow; y++)
+    {
+        uint8_t* dst = nv12 + (size_t)y * stride;
+        switch (RowPattern(y))
+        {
+            case TestPattern::BARS:
+            {
+                uint32_t shift = (uint32_t)((frameIndex * kBarSpeed + y) % _width) & ~1u;
+                memcpy(dst, _barLuma.data() + shift, _width);
+                break;
+            }
+            case TestPattern::ZONE_PLATE:
+            {
+                int64_t dy = (int64_t)y - _height / 2;
+                uint16_t rowPhase = (uint16_t)((uint64_t)(dy * dy) * 32768 / _width + frameIndex * kZonePlateSpeed);
+                ZonePlateRow(_zoneColumn.data(), rowPhase, dst, _width);
+                break;
+            }
+            default:
+            {
+                NoiseRow(frameIndex * (2 * _height) + y, dst, _width);
+                break;
+            }
+        }
+    }
+    for (uint32_t cy=beginRow/2; cy<endRow/2; cy++)
+    {
+        uint8_t* dst = chroma + (size_t)cy * stride;
+        switch (RowPattern(cy * 2))
+        {
+            case TestPattern::BARS:
+            {
+                uint32_t shift = (uint32_t)((frameIndex * kBarSpeed + cy * 2) % _width) & ~1u;
+                memcpy(dst, _barChroma.data() + shift, _width);
+                break;
+            }
+            case TestPattern::ZONE_PLATE:
+            {
+                memset(dst, 128, _width);
+                break;
+            }
+            default:
+            {
+                NoiseRow(frameIndex * (2 * _height) + _height + cy, dst, _width);
+                break;
+            }
+        }
+    }
+}
+
+void TestPatternGenerator::DrawCounter(uint64_t frameIndex, uint8_t* nv12, uint32_t stride)
+{
+    std::string digits = std::to_string(frameIndex);
+    uint32_t scale = std::max<uint32_t>(2, _height / 120) & ~1u;
+    uint32_t boxWidth = ((uint32_t)digits.size() * 4 + 1) * scale;
+    uint32_t boxHeight = 7 * scale;
+    if (scale + boxWidth > _width || scale + boxHeight > _height)
+    {
+        return;
+    }
+    uint8_t* chroma = nv12 + (size_t)stride * _height;
+    for (uint32_t y=0; y<boxHeight; y++)
+    {
+        uint8_t* dst = nv12 + (size_t)(scale + y) * stride + scale;
+        uint32_t glyphRow = y / scale - 1; // 上下各留一格边框
+        for (uint32_t x=0; x<boxWidth; x++)
+        {
+            uint32_t cell = x / scale;
+            bool on = false;
+            if (y >= scale && glyphRow < 5 && cell % 4 != 0)
+            {
+                uint32_t glyphColumn = cell % 4 - 1;
+                on = (kDigitGlyph[digits[cell / 4] - '0'] >> (14 - glyphRow * 3 - glyphColumn)) & 1;
+            }
+            dst[x] = on ? 235 : 16;
+        }
+        if (y % 2 == 0)
+        {
+            memset(chroma + (size_t)(scale + y) / 2 * stride + scale, 128, boxWidth);
+        }
+    }
+}
+
+void TestPatternGenerator::Generate(uint64_t frameIndex, uint8_t* nv12, uint32_t stride)
+{
+    uint64_t beginNs = FrameClock::NowNs();
+    uint32_t bandNum = (_height + kBandRows - 1) / kBandRows;
+    if (_threadNum == 1 || bandNum == 1)
+    {
+        GenerateRows(frameIndex, nv12, stride, 0, _height);
+    }
+    else
+    {
+        std::shared_ptr<PatternJob> job = std::make_shared<PatternJob>();
+        job->bandNum = bandNum;
+        job->run = [this, frameIndex, nv12, stride](uint32_t band)
+        {
+            GenerateRows(frameIndex, nv12, stride, band * kBandRows, std::min(_height, (band + 1) * kBandRows));
+        };
+        for (uint32_t i=1; i<_threadNum; i++)
+        {
+            WorkStealingExecutor::Instance()->Submit([job]()
+            {
+                job->Work();
+            });
+        }
+        job->Work();
+        std::unique_lock<std::mutex> lock(job->mtx);
+        job->cond.wait(lock, [job]()
+        {
+            return job->done.load() == job->bandNum;
+        });
+    }
+    DrawCounter(frameIndex, nv12, stride);
+    uint64_t costNs = FrameClock::NowNs() - beginNs;
+    _frameNum++;
+    _totalCostNs += costNs;
+    _maxCostNs = std::max(_maxCostNs, costNs);
+}
+
+std::string TestPatternGenerator::Report()
+{
+    static const char* kPatternName[] = {"bars", "zoneplate", "noise", "mix"};
+    std::stringstream ss;
+    ss << "TestPatternGenerator (" << Backend() << ") " << _width << "x" << _height << " " << kPatternName[(int)_pattern]
+       << " threads : " << _threadNum << ", frames : " << _frameNum
+       << ", avg cost : " << (_frameNum ? _totalCostNs / _frameNum / 1000 : 0) << " us, max cost : " << _maxCostNs / 1000 << " us";
+    return ss.str();
+}
+
+std::string TestPatternGenerator::Backend()
+{
+#if defined(MMP_TEST_PATTERN_NEON)
+    return "neon";
+#elif defined(MMP_TEST_PATTERN_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace Mmp
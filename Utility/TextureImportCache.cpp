@@ -0,0 +1,169 @@
+#include "TextureImportCache.h"
+
+#include <sstream>
+#include <sys/stat.h>
+
+#include "Common/NormalPicture.h"
+#include "Common/DmaHeapAllocateMethod.h"
+#include "GPU/PG/Utility/CommonUtility.h"
+
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+TextureImportCache::TextureImportCache(GLDrawContex::ptr draw, uint32_t capacity, uint32_t flags)
+{
+    _draw = draw;
+    _capacity = capacity == 0 ? 1 : capacity;
+    _flags = flags;
+    _hitNum = 0;
+    _missNum = 0;
+    _evictNum = 0;
+    _staleNum = 0;
+}
+
+bool TextureImportCache::GetIdentity(AbstractAllocateMethod::ptr allocateMethod, uint64_t& key, uint64_t& generation, bool& trackLifetime)
+{
+    if (!allocateMethod)
+    {
+        return false;
+    }
+    DmaHeapAllocateMethod::ptr dmaAlloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(allocateMethod);
+    if (dmaAlloc)
+    {
+        struct stat st = {};
+        if (dmaAlloc->GetFd() >= 0 && fstat(dmaAlloc->GetFd(), &st) == 0)
+        {
+            // Hint : inode 可跨 AllocateMethod 实例标识同一块 buffer; inode 号可能被复用, 以创建时间 (anon inode 的 ctime) 区分
+            key = (uint64_t)st.st_ino;
+            generation = (uint64_t)st.st_ctim.tv_sec * 1000000000ull + (uint64_t)st.st_ctim.tv_nsec;
+            trackLifetime = false;
+            return true;
+        }
+    }
+    // Hint : 最高位用于与 inode 区分
+    key = (uint64_t)(uintptr_t)allocateMethod.get() | (1ull << 63);
+    generation = 0;
+    trackLifetime = true;
+    return true;
+}
+
+Texture::ptr TextureImportCache::Acquire(AbstractFrame::ptr frame, const PixelsInfo& info)
+{
+    EvictReleased();
+    uint64_t key = 0;
+    uint64_t generation = 0;
+    bool trackLifetime = false;
+    bool cacheable = frame && GetIdentity(frame->GetAllocateMethod(), key, generation, trackLifetime);
+    if (cacheable && _lookup.count(key))
+    {
+        EntryList::iterator it = _lookup[key];
+        if (it->generation != generation)
+        {
+            _staleNum++;
+            Evict(it);
+        }
+        else if (it->info.width == info.width && it->info.height == info.height && it->info.format == info.format)
+        {
+            _hitNum++;
+            AbstractAllocateMethod::ptr allocateMethod = frame->GetAllocateMethod();
+            if (!it->trackLifetime && it->allocateMethod.lock() == allocateMethod)
+            {
+                // Hint : 解码器对同一块 buffer 复用 AllocateMethod 实例, 此后按其生命周期淘汰
+                it->trackLifetime = true;
+            }
+            it->allocateMethod = allocateMethod;
+            _lru.splice(_lru.begin(), _lru, it);
+            return it->texture;
+        }
+        else
+        {
+            Evict(it);
+        }
+    }
+    _missNum++;
+    std::vector<Texture::ptr> textures = Gpu::Create2DTextures(_draw, info, "", _flags);
+    if (textures.empty() || !frame)
+    {
+        return nullptr;
+    }
+    Texture::ptr texture = textures[0];
+    {
+        AbstractPicture::ptr picFrame = std::make_shared<NormalPicture>(info, frame->GetAllocateMethod());
+        Gpu::Update2DTextures(_draw, {texture}, picFrame);
+    }
+    if (!cacheable)
+    {
+        return texture;
+    }
+    Entry entry;
+    entry.key = key;
+    entry.generation = generation;
+    entry.info = info;
+    entry.texture = texture;
+    entry.trackLifetime = trackLifetime;
+    entry.allocateMethod = frame->GetAllocateMethod();
+    _lru.push_front(entry);
+    _lookup[key] = _lru.begin();
+    while (_lru.size() > _capacity)
+    {
+        Evict(std::prev(_lru.end()));
+    }
+    return texture;
+}
+
+void TextureImportCache::EvictReleased()
+{
+    for (EntryList::iterator it = _lru.begin(); it != _lru.end();)
+    {
+        if (it->trackLifetime && it->allocateMethod.expired())
+        {
+            EntryList::iterator cur = it++;
+            Evict(cur);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void TextureImportCache::Evict(EntryList::iterator it)
+{
+    _lookup.erase(it->key);
+    _lru.erase(it);
+    _evictNum++;
+}
+
+void TextureImportCache::Clear()
+{
+    _evictNum += _lru.size();
+    _lookup.clear();
+    _lru.clear();
+}
+
+size_t TextureImportCache::Size()
+{
+    return _lru.size();
+}
+
+uint64_t TextureImportCache::HitNum()
+{
+    return _hitNum;
+}
+
+uint64_t TextureImportCache::EvictNum()
+{
+    return _evictNum;
+}
+
+std::string TextureImportCache::Report()
+{
+    std::stringstream ss;
+    ss << "TextureImportCache size : " << _lru.size() << "/" << _capacity;
+    ss << ", hit : " << _hitNum << ", miss : " << _missNum << ", evict : " << _evictNum << ", stale : " << _staleNum;
+    return ss.str();
+}
+
+} // namespace Mmp
@@ -0,0 +1,91 @@
+//
+// TextureImportCache.h
+//
+// Library: Common
+// Package: Utility
+// Module:  TextureImportCache
+//
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+#include "Common/PixelsInfo.h"
+#include "Common/AbstractFrame.h"
+#include "GPU/GL/GLDrawContex.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief  外部纹理 (EGLImage) 导入缓存, 以 DMA-BUF 为键的 LRU
+ * @note   1 - 解码器在少量固定的 DMA-BUF 之间轮转, 同一块 DMA-BUF 只需导入一次,
+ *             导入后的纹理直接引用 DMA-BUF 的内容, 后续帧无需重新导入
+ *         2 - DMA-BUF 的身份由 (inode, 创建时间) 确定 (fstat), 旧内核上 inode 号释放后可能被新的 buffer 复用,
+ *             创建时间不同即视为另一块 buffer, 重新导入; 无法获取 fd 时退化为 AllocateMethod 的地址
+ *         3 - AllocateMethod 释放即视为解码器释放了该 buffer (如 Stop 或分辨率变化时重新分配), 对应纹理被淘汰;
+ *             DMA-BUF 仅在命中时确认解码器复用同一 AllocateMethod 实例后才按其生命周期淘汰,
+ *             每帧重新包装 fd 的解码器仍由 LRU 淘汰
+ *         4 - 仅适用于 TEXTURE_EXTERNAL 导入方式; 非线程安全, 需在合成线程中使用
+ */
+class TextureImportCache
+{
+public:
+    using ptr = std::shared_ptr<TextureImportCache>;
+public:
+    /**
+     * @param[in] draw     : 绘制上下文
+     * @param[in] capacity : 最多缓存的纹理数, 应不小于所有解码器输出 buffer 数量之和
+     * @param[in] flags    : 创建纹理时使用的 GlTextureFlags
+     */
+    TextureImportCache(GLDrawContex::ptr draw, uint32_t capacity, uint32_t flags);
+public:
+    /**
+     * @brief  获取 frame 对应的纹理, 未命中时创建并导入
+     * @return 导入失败时返回 nullptr
+     */
+    Texture::ptr Acquire(AbstractFrame::ptr frame, const PixelsInfo& info);
+    /**
+     * @brief 淘汰所有纹理, 解码器 Stop 或分辨率变化时调用
+     */
+    void Clear();
+    /**
+     * @brief 当前缓存的纹理数, 已释放的 buffer 在下一次 Acquire 时淘汰
+     */
+    size_t Size();
+    uint64_t HitNum();
+    uint64_t EvictNum();
+    std::string Report();
+private:
+    struct Entry
+    {
+        uint64_t                                  key;
+        uint64_t                                  generation; // DMA-BUF 的创建时间 (ns)
+        PixelsInfo                                info;
+        Texture::ptr                              texture;
+        bool                                      trackLifetime;
+        std::weak_ptr<AbstractAllocateMethod>     allocateMethod;
+    };
+    using EntryList = std::list<Entry>;
+private:
+    static bool GetIdentity(AbstractAllocateMethod::ptr allocateMethod, uint64_t& key, uint64_t& generation, bool& trackLifetime);
+    void EvictReleased();
+    void Evict(EntryList::iterator it);
+private:
+    GLDrawContex::ptr _draw;
+    uint32_t          _capacity;
+    uint32_t          _flags;
+    EntryList         _lru; // front 为最近使用
+    std::unordered_map<uint64_t, EntryList::iterator> _lookup;
+private: /* statistics */
+    uint64_t          _hitNum;
+    uint64_t          _missNum;
+    uint64_t          _evictNum;
+    uint64_t          _staleNum; // inode 被新的 buffer 复用
+};
+
+} // namespace Mmp
@@ -0,0 +1,281 @@
+#include "ThreadPlacement.h"
+
+#include <cerrno>
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <pthread.h>
+#include <algorithm>
+
+#include "UtilityCommon.h"
+
+namespace Mmp
+{
+
+namespace
+{
+
+std::string Trim(const std::string& str)
+{
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+/**
+ * @brief 各 CPU 的算力, 优先取 cpu_capacity, 其次为最高频率
+ */
+std::vector<uint64_t> CpuCapacities()
+{
+    long cpuNum = sysconf(_SC_NPROCESSORS_CONF);
+    std::vector<uint64_t> capacities;
+    for (long i=0; i<cpuNum; i++)
+    {
+        uint64_t capacity = 0;
+        std::string prefix = "/sys/devices/system/cpu/cpu" + std::to_string(i);
+        std::ifstream ifs(prefix + "/cpu_capacity");
+        if (!(ifs >> capacity))
+        {
+            std::ifstream freq(prefix + "/cpufreq/cpuinfo_max_freq");
+            if (!(freq >> capacity))
+            {
+                capacity = 0;
+            }
+        }
+        capacities.push_back(capacity);
+    }
+    return capacities;
+}
+
+} // namespace
+
+ThreadPlacement* ThreadPlacement::Instance()
+{
+    static ThreadPlacement gInstance;
+    return &gInstance;
+}
+
+std::vector<uint32_t> ThreadPlacement::BigCores()
+{
+    std::vector<uint64_t> capacities = CpuCapacities();
+    uint64_t maxCapacity = capacities.empty() ? 0 : *std::max_element(capacities.begin(), capacities.end());
+    std::vector<uint32_t> cpus;
+    for (size_t i=0; i<capacities.size(); i++)
+    {
+        if (capacities[i] == maxCapacity)
+        {
+            cpus.push_back((uint32_t)i);
+        }
+    }
+    return cpus;
+}
+
+std::vector<uint32_t> ThreadPlacement::LittleCores()
+{
+    std::vector<uint64_t> capacities = CpuCapacities();
+    uint64_t minCapacity = capacities.empty() ? 0 : *std::min_element(capacities.begin(), capacities.end());
+    std::vector<uint32_t> cpus;
+    for (size_t i=0; i<capacities.size(); i++)
+    {
+        if (capacities[i] == minCapacity)
+        {
+            cpus.push_back((uint32_t)i);
+        }
+    }
+    return cpus;
+}
+
+bool ThreadPlacement::ParseCpus(const std::string& cpus, std::vector<uint32_t>& result)
+{
+    result.clear();
+    if (cpus == "big")
+    {
+        result = BigCores();
+        return !result.empty();
+    }
+    else if (cpus == "little")
+    {
+        result = LittleCores();
+        return !result.empty();
+    }
+    std::stringstream ss(cpus);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        range = Trim(range);
+        size_t pos = range.find('-');
+        try
+        {
+            uint32_t first = (uint32_t)std::stoul(range.substr(0, pos));
+            uint32_t last = pos == std::string::npos ? first : (uint32_t)std::stoul(range.substr(pos + 1));
+            for (uint32_t cpu=first; cpu<=last && cpu<CPU_SETSIZE; cpu++)
+            {
+                result.push_back(cpu);
+            }
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+    return !result.empty();
+}
+
+std::string ThreadPlacement::CpusToString(const std::vector<uint32_t>& cpus)
+{
+    std::stringstream ss;
+    for (size_t i=0; i<cpus.size(); i++)
+    {
+        ss << (i == 0 ? "" : ",") << cpus[i];
+    }
+    return ss.str();
+}
+
+bool ThreadPlacement::SetPolicy(const std::string& stage, const std::string& spec)
+{
+    Policy policy;
+    size_t pos = spec.find(':');
+    if (!ParseCpus(Trim(spec.substr(0, pos)), policy.cpus))
+    {
+        UTILITY_LOG_ERROR << "Invalid cpus for stage " << stage << ", spec is: " << spec;
+        return false;
+    }
+    if (pos != std::string::npos)
+    {
+        try
+        {
+            policy.priority = std::stoi(Trim(spec.substr(pos + 1)));
+        }
+        catch (...)
+        {
+            policy.priority = -1;
+        }
+        if (policy.priority < sched_get_priority_min(SCHED_FIFO) || policy.priority > sched_get_priority_max(SCHED_FIFO))
+        {
+            UTILITY_LOG_ERROR << "Invalid SCHED_FIFO priority for stage " << stage << ", spec is: " << spec;
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> lock(_mtx);
+    _policies[stage] = policy;
+    return true;
+}
+
+bool ThreadPlacement::Load(const std::string& path)
+{
+    std::ifstream ifs(path);
+    if (!ifs.is_open())
+    {
+        UTILITY_LOG_ERROR << "Open thread placement config fail, path is: " << path;
+        return false;
+    }
+    std::string line;
+    bool success = true;
+    while (std::getline(ifs, line))
+    {
+        line = Trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        size_t pos = line.find('=');
+        if (pos == std::string::npos)
+        {
+            UTILITY_LOG_ERROR << "Invalid thread placement line: " << line;
+            success = false;
+            continue;
+        }
+        success = SetPolicy(Trim(line.substr(0, pos)), Trim(line.substr(pos + 1))) && success;
+    }
+    return success;
+}
+
+bool ThreadPlacement::Apply(const std::string& stage)
+{
+    Policy policy;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!_policies.count(stage))
+        {
+            return true;
+        }
+        policy = _policies[stage];
+    }
+    bool success = true;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (auto cpu : policy.cpus)
+    {
+        CPU_SET(cpu, &mask);
+    }
+    if (sched_setaffinity(0, sizeof(mask), &mask) != 0)
+    {
+        UTILITY_LOG_WARN << "sched_setaffinity fail, stage is: " << stage << ", error is: " << errno;
+        success = false;
+    }
+    if (policy.priority > 0)
+    {
+        struct sched_param param = {};
+        param.sched_priority = policy.priority;
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0)
+        {
+            // Hint : 需要 root 或 CAP_SYS_NICE
+            UTILITY_LOG_WARN << "Set SCHED_FIFO fail, stage is: " << stage << ", error is: " << ret;
+            success = false;
+        }
+    }
+    // 回读校验, 避免 cgroup cpuset 等限制导致设置被静默修改
+    cpu_set_t actual;
+    CPU_ZERO(&actual);
+    std::vector<uint32_t> actualCpus;
+    if (sched_getaffinity(0, sizeof(actual), &actual) == 0)
+    {
+        for (uint32_t cpu=0; cpu<CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &actual))
+            {
+                actualCpus.push_back(cpu);
+            }
+        }
+    }
+    if (actualCpus != policy.cpus)
+    {
+        UTILITY_LOG_WARN << "Thread placement mismatch, stage is: " << stage << ", expect: " << CpusToString(policy.cpus) << ", actual: " << CpusToString(actualCpus);
+        success = false;
+    }
+    std::lock_guard<std::mutex> lock(_mtx);
+    Statistics& statistics = _statistics[stage];
+    statistics.applyNum++;
+    statistics.failNum += success ? 0 : 1;
+    statistics.lastCpus = CpusToString(actualCpus);
+    return success;
+}
+
+bool ThreadPlacement::HasPolicy(const std::string& stage)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _policies.count(stage) != 0;
+}
+
+std::string ThreadPlacement::Report()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::stringstream ss;
+    ss << "ThreadPlacement";
+    for (const auto& policy : _policies)
+    {
+        const Statistics& statistics = _statistics[policy.first];
+        ss << std::endl << "-- " << policy.first << " : cpus " << CpusToString(policy.second.cpus)
+           << (policy.second.priority > 0 ? ", SCHED_FIFO " + std::to_string(policy.second.priority) : std::string())
+           << ", threads : " << statistics.applyNum << ", fail : " << statistics.failNum << ", actual : " << statistics.lastCpus;
+    }
+    return ss.str();
+}
+
+} // namespace Mmp
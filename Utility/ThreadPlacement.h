@@ -0,0 +1,83 @@
+//
+// ThreadPlacement.h
+//
+// Library: Common
+// Package: Utility
+// Module:  ThreadPlacement
+//
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Mmp
+{
+
+/**
+ * @brief  按流水线阶段设置线程的 CPU 亲和性与调度策略
+ * @note   1 - 配置文件每行一个阶段 : [stage] = [cpus] [: priority], # 开头为注释
+ *             cpus 可为 0,2,4-7 形式的列表, 或 big / little (按 cpu_capacity 区分大小核, 如 RK3588 的 A76 / A55)
+ *             priority 为 SCHED_FIFO 优先级 (1-99), 不指定时保持 SCHED_OTHER
+ *         2 - 线程启动时调用 Apply(stage), 对调用线程生效; 未配置的阶段不做任何处理
+ *         3 - 设置后通过 sched_getaffinity 回读校验, 结果计入 Report
+ *         4 - 线程安全
+ */
+class ThreadPlacement
+{
+public:
+    static ThreadPlacement* Instance();
+public:
+    /**
+     * @brief 加载配置文件
+     */
+    bool Load(const std::string& path);
+    /**
+     * @brief 设置单个阶段, spec 格式与配置文件相同 : [cpus] [: priority]
+     */
+    bool SetPolicy(const std::string& stage, const std::string& spec);
+    /**
+     * @brief  将调用线程放置到 stage 对应的 CPU 上
+     * @return 未配置该阶段时返回 true; 设置或校验失败时返回 false
+     */
+    bool Apply(const std::string& stage);
+    /**
+     * @brief 是否配置了 stage
+     */
+    bool HasPolicy(const std::string& stage);
+    std::string Report();
+public:
+    /**
+     * @brief 大核 (cpu_capacity 最大) 列表, 非大小核架构时为全部 CPU
+     */
+    static std::vector<uint32_t> BigCores();
+    /**
+     * @brief 小核列表, 非大小核架构时为全部 CPU
+     */
+    static std::vector<uint32_t> LittleCores();
+private:
+    struct Policy
+    {
+        std::vector<uint32_t> cpus;
+        int priority = 0; // 0 表示不修改调度策略
+    };
+    struct Statistics
+    {
+        uint32_t applyNum = 0;
+        uint32_t failNum = 0;
+        std::string lastCpus; // 最近一次 sched_getaffinity 回读结果
+    };
+private:
+    ThreadPlacement() = default;
+    static bool ParseCpus(const std::string& cpus, std::vector<uint32_t>& result);
+    static std::string CpusToString(const std::vector<uint32_t>& cpus);
+private:
+    std::mutex _mtx;
+    std::map<std::string, Policy> _policies;
+    std::map<std::string, Statistics> _statistics;
+};
+
+} // namespace Mmp
@@ -0,0 +1,47 @@
+//
+// TimedPack.h
+//
+// Library: Common
+// Package: Utility
+// Module:  TimedPack
+//
+
+#pragma once
+
+#include <memory>
+#include <cstdint>
+
+#include "Common/NormalPack.h"
+
+namespace Mmp
+{
+
+/**
+ * @brief 无效时间戳
+ */
+constexpr int64_t kPtsNone = -1;
+
+/**
+ * @brief  携带时间戳的 NAL 单元
+ * @note   1 - 时间戳单位为 us, 以第一个 access unit 为 0
+ *         2 - 字段带单位后缀, 不与 MMP-Core 基类可能定义的同名字段 (如 pts) 冲突
+ */
+class TimedPack : public NormalPack
+{
+public:
+    using ptr = std::shared_ptr<TimedPack>;
+public:
+    TimedPack(size_t size, AbstractAllocateMethod::ptr allocateMethod = nullptr)
+        : NormalPack(size, allocateMethod)
+    {
+        ptsUs = kPtsNone;
+        durationUs = 0;
+        isFirstSlice = false;
+    }
+public:
+    int64_t  ptsUs;        // access unit 的时间戳, 仅一帧的第一个 slice 有效, 其余为 kPtsNone
+    int64_t  durationUs;   // access unit 时长, 同上
+    bool     isFirstSlice; // 是否为一帧图像的第一个 slice
+};
+
+} // namespace Mmp
@@ -0,0 +1,18 @@
+//
+// UtilityCommon.h
+//
+// Library: Common
+// Package: Utility
+// Module:  Utility
+// 
+
+#pragma once
+
+#include "Common/LogMessage.h"
+
+#define  UTILITY_LOG_TRACE      MMP_MLOG_TRACE("Utility")    
+#define  UTILITY_LOG_DEBUG      MMP_MLOG_DEBUG("Utility")    
+#define  UTILITY_LOG_INFO       MMP_MLOG_INFO("Utility")     
+#define  UTILITY_LOG_WARN       MMP_MLOG_WARN("Utility")     
+#define  UTILITY_LOG_ERROR      MMP_MLOG_ERROR("Utility")    
+#define  UTILITY_LOG_FATAL      MMP_MLOG_FATAL("Utility")    
@@ -0,0 +1,283 @@
+#include "WorkStealingExecutor.h"
+
+#include <sstream>
+
+#include "FrameClock.h"
+#include "ThreadPlacement.h"
+
+namespace Mmp
+{
+
+namespace
+{
+
+thread_local WorkStealingExecutor* gCurrentExecutor = nullptr;
+thread_local int32_t gCurrentWorker = -1;
+
+} // namespace
+
+WorkStealingExecutor* WorkStealingExecutor::Instance()
+{
+    uint32_t cpuNum = std::thread::hardware_concurrency();
+    cpuNum = cpuNum == 0 ? 1 : cpuNum;
+    static WorkStealingExecutor gInstance(cpuNum, cpuNum * 2);
+    return &gInstance;
+}
+
+WorkStealingExecutor::WorkStealingExecutor(uint32_t workerNum, uint32_t blockingNum)
+{
+    _nextWorker = 0;
+    _queuedNum = 0;
+    _running = true;
+    _blockingIdleNum = 0;
+    _blockingNum = 0;
+    _blockingWaitNs = 0;
+    _blockingMaxWaitNs = 0;
+    _delayedNum = 0;
+    workerNum = workerNum == 0 ? 1 : workerNum;
+    blockingNum = blockingNum == 0 ? 1 : blockingNum;
+    for (uint32_t i=0; i<workerNum; i++)
+    {
+        _workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (uint32_t i=0; i<workerNum; i++)
+    {
+        _workers[i]->thread = std::thread([this, i]()
+        {
+            WorkerLoop(i);
+        });
+    }
+    {
+        std::lock_guard<std::mutex> lock(_blockingMtx);
+        for (uint32_t i=0; i<blockingNum; i++)
+        {
+            _blockingIdleNum++;
+            _blockingThreads.emplace_back([this]()
+            {
+                BlockingLoop();
+            });
+        }
+    }
+    _timerThread = std::thread([this]()
+    {
+        TimerLoop();
+    });
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+    {
+        std::lock_guard<std::mutex> idleLock(_idleMtx);
+        std::lock_guard<std::mutex> blockingLock(_blockingMtx);
+        std::lock_guard<std::mutex> timerLock(_timerMtx);
+        _running = false;
+        _idleCond.notify_all();
+        _blockingCond.notify_all();
+        _timerCond.notify_all();
+    }
+    for (auto& worker : _workers)
+    {
+        worker->thread.join();
+    }
+    // Hint : _running 为 false 后 SubmitBlocking 不再新增线程
+    for (auto& thread : _blockingThreads)
+    {
+        thread.join();
+    }
+    _timerThread.join();
+}
+
+void WorkStealingExecutor::Submit(const Task& task)
+{
+    uint32_t index = 0;
+    if (gCurrentExecutor == this && gCurrentWorker >= 0)
+    {
+        index = (uint32_t)gCurrentWorker;
+    }
+    else
+    {
+        index = _nextWorker++ % _workers.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_workers[index]->mtx);
+        _workers[index]->tasks.push_back(task);
+        _queuedNum++;
+    }
+    // Hint : 在 _idleMtx 下唤醒, 避免与 worker 检查 _queuedNum 后进入等待之间的竞争
+    std::lock_guard<std::mutex> lock(_idleMtx);
+    _idleCond.notify_one();
+}
+
+void WorkStealingExecutor::SubmitBlocking(const Task& task)
+{
+    std::lock_guard<std::mutex> lock(_blockingMtx);
+    if (!_running)
+    {
+        return;
+    }
+    _blockingTasks.push_back(BlockingTask{task, FrameClock::NowNs()});
+    // Hint : 每个阻塞节点同时最多一个任务, 线程数最终不超过阻塞节点数
+    if (_blockingTasks.size() > _blockingIdleNum)
+    {
+        _blockingIdleNum++;
+        _blockingThreads.emplace_back([this]()
+        {
+            BlockingLoop();
+        });
+    }
+    _blockingCond.notify_one();
+}
+
+void WorkStealingExecutor::SubmitAfter(uint64_t delayUs, const Task& task, bool blocking)
+{
+    if (delayUs == 0)
+    {
+        blocking ? SubmitBlocking(task) : Submit(task);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_timerMtx);
+    _timerTasks.emplace(FrameClock::NowNs() + delayUs * 1000, DelayedTask{task, blocking});
+    _timerCond.notify_one();
+}
+
+uint32_t WorkStealingExecutor::WorkerNum()
+{
+    return (uint32_t)_workers.size();
+}
+
+bool WorkStealingExecutor::TryTake(uint32_t index, Task& task)
+{
+    {
+        Worker& self = *_workers[index];
+        std::lock_guard<std::mutex> lock(self.mtx);
+        if (!self.tasks.empty())
+        {
+            task = std::move(self.tasks.back());
+            self.tasks.pop_back();
+            _queuedNum--;
+            return true;
+        }
+    }
+    for (size_t i=1; i<_workers.size(); i++)
+    {
+        Worker& victim = *_workers[(index + i) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            _queuedNum--;
+            _workers[index]->stolenNum++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingExecutor::WorkerLoop(uint32_t index)
+{
+    ThreadPlacement::Instance()->Apply("worker");
+    gCurrentExecutor = this;
+    gCurrentWorker = (int32_t)index;
+    while (true)
+    {
+        Task task;
+        if (TryTake(index, task))
+        {
+            task();
+            _workers[index]->executedNum++;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_idleMtx);
+        _idleCond.wait(lock, [this]()
+        {
+            return _queuedNum != 0 || !_running;
+        });
+        if (!_running)
+        {
+            break;
+        }
+    }
+}
+
+void WorkStealingExecutor::BlockingLoop()
+{
+    ThreadPlacement::Instance()->Apply("blocking");
+    while (true)
+    {
+        BlockingTask task;
+        {
+            std::unique_lock<std::mutex> lock(_blockingMtx);
+            _blockingCond.wait(lock, [this]()
+            {
+                return !_blockingTasks.empty() || !_running;
+            });
+            if (!_running)
+            {
+                break;
+            }
+            task = std::move(_blockingTasks.front());
+            _blockingTasks.pop_front();
+            _blockingIdleNum--;
+        }
+        uint64_t waitNs = FrameClock::NowNs() - task.submitNs;
+        _blockingWaitNs += waitNs;
+        uint64_t maxWaitNs = _blockingMaxWaitNs;
+        while (waitNs > maxWaitNs && !_blockingMaxWaitNs.compare_exchange_weak(maxWaitNs, waitNs))
+        {
+        }
+        task.task();
+        _blockingNum++;
+        std::lock_guard<std::mutex> lock(_blockingMtx);
+        _blockingIdleNum++;
+    }
+}
+
+void WorkStealingExecutor::TimerLoop()
+{
+    std::unique_lock<std::mutex> lock(_timerMtx);
+    while (_running)
+    {
+        if (_timerTasks.empty())
+        {
+            _timerCond.wait(lock);
+            continue;
+        }
+        uint64_t nowNs = FrameClock::NowNs();
+        auto it = _timerTasks.begin();
+        if (it->first > nowNs)
+        {
+            _timerCond.wait_for(lock, std::chrono::nanoseconds(it->first - nowNs));
+            continue;
+        }
+        DelayedTask delayed = std::move(it->second);
+        _timerTasks.erase(it);
+        _delayedNum++;
+        lock.unlock();
+        delayed.blocking ? SubmitBlocking(delayed.task) : Submit(delayed.task);
+        lock.lock();
+    }
+}
+
+std::string WorkStealingExecutor::Report()
+{
+    std::stringstream ss;
+    uint64_t executedNum = 0, stolenNum = 0;
+    for (auto& worker : _workers)
+    {
+        executedNum += worker->executedNum;
+        stolenNum += worker->stolenNum;
+    }
+    size_t blockingThreadNum = 0;
+    {
+        std::lock_guard<std::mutex> lock(_blockingMtx);
+        blockingThreadNum = _blockingThreads.size();
+    }
+    uint64_t blockingNum = _blockingNum;
+    ss << "WorkStealingExecutor workers : " << _workers.size() << ", blocking threads : " << blockingThreadNum;
+    ss << ", executed : " << executedNum << ", stolen : " << stolenNum << ", blocking executed : " << blockingNum << ", delayed : " << _delayedNum;
+    ss << ", blocking queue wait avg : " << (blockingNum ? _blockingWaitNs / blockingNum / 1000 : 0) << " us, max : " << _blockingMaxWaitNs / 1000 << " us";
+    return ss.str();
+}
+
+} // namespace Mmp
@@ -0,0 +1,119 @@
+//
+// WorkStealingExecutor.h
+//
+// Library: Common
+// Package: Utility
+// Module:  WorkStealingExecutor
+//
+
+#pragma once
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace Mmp
+{
+
+/**
+ * @brief  短任务执行器, 线程数与 CPU 核数相关而与码流路数无关
+ * @note   1 - 每个 worker 一个任务队列: worker 从自己队列的尾部取任务 (LIFO, 缓存友好),
+ *             空闲时从其他 worker 队列的头部窃取 (FIFO)
+ *         2 - Submit 的任务不应阻塞; 可能阻塞的调用 (如编解码器 Push) 通过 SubmitBlocking
+ *             放到独立的阻塞线程池, 避免占满 worker; 阻塞节点随码流与档位数增长, 阻塞线程均在执行任务时
+ *             新增一个线程, 一路的 Push / write 阻塞不会使其他路的任务排队等待, Report 打印任务的排队时间
+ *         3 - SubmitAfter 用于轮询类任务 (如编解码器 Pop), 到期后再投递, 不占用线程等待
+ *         4 - worker 线程以 stage "worker" 应用 ThreadPlacement, 阻塞线程池为 "blocking"
+ *         5 - 线程安全
+ */
+class WorkStealingExecutor
+{
+public:
+    using ptr = std::shared_ptr<WorkStealingExecutor>;
+    using Task = std::function<void()>;
+public:
+    /**
+     * @brief 进程共享的执行器, worker 数为 CPU 核数, 阻塞线程初始为其两倍
+     */
+    static WorkStealingExecutor* Instance();
+public:
+    /**
+     * @param[in] blockingNum : 初始的阻塞线程数, 不足时按需增加
+     */
+    WorkStealingExecutor(uint32_t workerNum, uint32_t blockingNum);
+    ~WorkStealingExecutor();
+public:
+    /**
+     * @brief 投递非阻塞任务; 在 worker 线程上调用时放入本 worker 的队列
+     */
+    void Submit(const Task& task);
+    /**
+     * @brief 投递可能阻塞的任务
+     */
+    void SubmitBlocking(const Task& task);
+    /**
+     * @brief 延迟 delayUs 后投递
+     */
+    void SubmitAfter(uint64_t delayUs, const Task& task, bool blocking = false);
+    uint32_t WorkerNum();
+    std::string Report();
+private:
+    class Worker
+    {
+    public:
+        std::mutex       mtx;
+        std::deque<Task> tasks;
+        std::thread      thread;
+    public: /* statistics */
+        std::atomic<uint64_t> executedNum = {0};
+        std::atomic<uint64_t> stolenNum = {0};
+    };
+private:
+    bool TryTake(uint32_t index, Task& task);
+    void WorkerLoop(uint32_t index);
+    void BlockingLoop();
+    void TimerLoop();
+private:
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<uint32_t>                _nextWorker;
+    std::atomic<uint64_t>                _queuedNum;
+    std::mutex                           _idleMtx;
+    std::condition_variable              _idleCond;
+    bool                                 _running;
+private: /* blocking */
+    struct BlockingTask
+    {
+        Task     task;
+        uint64_t submitNs;
+    };
+    std::mutex                           _blockingMtx;
+    std::condition_variable              _blockingCond;
+    std::deque<BlockingTask>             _blockingTasks;
+    std::vector<std::thread>             _blockingThreads;
+    uint32_t                             _blockingIdleNum; // 未在执行任务的阻塞线程数 (含刚创建的线程)
+private: /* timer */
+    struct DelayedTask
+    {
+        Task task;
+        bool blocking;
+    };
+    std::mutex                           _timerMtx;
+    std::condition_variable              _timerCond;
+    std::multimap<uint64_t, DelayedTask> _timerTasks; // 到期时间 (ns) -> 任务
+    std::thread                          _timerThread;
+private: /* statistics */
+    std::atomic<uint64_t>                _blockingNum;
+    std::atomic<uint64_t>                _blockingWaitNs;    // 阻塞任务的累计排队时间
+    std::atomic<uint64_t>                _blockingMaxWaitNs;
+    std::atomic<uint64_t>                _delayedNum;
+};
+
+} // namespace Mmp
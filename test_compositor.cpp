@@ -1,10 +1,12 @@
 #include <fstream>
 #include <deque>
+#include <sstream>
+#include <vector>
 #include <Poco/Stopwatch.h>
 #include <Poco/Util/Application.h>
 #include <Poco/Util/HelpFormatter.h>
+#include <GLES2/gl2.h>
 
-#include "Common/Promise.h"
 #include "Common/AbstractLogger.h"
 #include "Common/LogMessage.h"
 #include "Common/ThreadPool.h"
@@ -19,168 +21,93 @@
 #include "Codec/StreamFrame.h"
 #include "Codec/CodecConfig.h"
 #include "Codec/CodecFactory.h"
-#include "Common/ImmutableVectorAllocateMethod.h"
 
 #include "Display/AbstractDisplay.h"
+#include "Utility/FrameClock.h"
+#include "Utility/RkCacheFileByteReader.h"
+#include "Utility/TextureImportCache.h"
+#include "Utility/DmaBufFence.h"
+#include "Utility/FrameBufferRing.h"
+#include "Utility/DamageTracker.h"
+#include "Utility/StartupProfiler.h"
+#include "Utility/ThreadPlacement.h"
+#include "Utility/Pipeline.h"
+#include "Utility/PipelineCodec.h"
+#include "Utility/AsyncFileWriter.h"
+#include "Utility/LoadShedder.h"
+#include "Utility/FrameAnalyzer.h"
+#include "Utility/LatencyProbe.h"
 
 using namespace Mmp;
 using namespace Poco::Util;
 
-constexpr uint32_t kBufSize = 1024 * 1024;
+constexpr int32_t kFenceTimeoutMs = 100;
+constexpr int32_t kRingTimeoutMs = 100;
+constexpr int32_t kGpuFlushTimeoutMs = 100;
+constexpr uint32_t kEncodeShedDepth = kEncoderNodeMaxInflight + 1; // 编码队列 (帧) 达到此深度时丢帧
+constexpr uint32_t kEncodeMaxDuplicate = 2;                         // 合成错过周期时单帧最多重复送编码的次数
 
 /**
- * @todo 好像挺烧 CPU, 用 `mmap` 并且优化 NAL UINT 的查找方式可能好一些
+ * @brief 在文件扩展名之前插入后缀, 如 out.h264 -> out_1280x720.h264
  */
-class RkCacheFileByteReader
+static std::string AppendFileSuffix(const std::string& path, const std::string& suffix)
 {
-public:
-    explicit RkCacheFileByteReader(const std::string& path);
-    ~RkCacheFileByteReader();
-public:
-    NormalPack::ptr GetNalUint();
-public:
-    size_t Read(void* data, size_t bytes);
-    bool Seek(size_t offset);
-    size_t Tell();
-    bool eof();
-private:
-    std::ifstream _ifs;
-private:
-    uint8_t* _buf;
-    uint32_t _offset;
-    uint32_t _cur;
-    uint32_t _len;
-};
-
-NormalPack::ptr RkCacheFileByteReader::GetNalUint()
-{
-    std::vector<uint8_t> bufs;
-    bufs.reserve(1024 * 1024);
-    uint32_t next_24_bits = 0;
-    bool isFirst = true;
-    while (!(next_24_bits == 0x000001 && !isFirst))
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
     {
-        if (next_24_bits == 0x000001)
-        {
-            isFirst = false;
-            bufs.push_back(0);
-            bufs.push_back(0);
-            bufs.push_back(0);
-            bufs.push_back(1);
-        }
-        uint8_t byte = 0;
-        if (Read(&byte, 1) != 1 && eof())
-        {
-            return nullptr;
-        }
-        if (!isFirst)
-        {
-            bufs.push_back(byte);
-        }
-        next_24_bits = (next_24_bits << 8) | byte;
-        next_24_bits = next_24_bits & 0xFFFFFF;
-    }
-    Seek(Tell() - 3);
-    if (bufs.size() >= 3)
-    {
-        bufs.resize(bufs.size() - 3);
-        if (!bufs.empty() && bufs[bufs.size()-1] == 0)
-        {
-            bufs.pop_back();
-        }
-    }
-    std::shared_ptr<ImmutableVectorAllocateMethod<uint8_t>> alloc = std::make_shared<ImmutableVectorAllocateMethod<uint8_t>>();
-    alloc->container.swap(bufs);
-    return std::make_shared<NormalPack>(alloc->container.size(), alloc);
-}
-
-RkCacheFileByteReader::RkCacheFileByteReader(const std::string& path)
-{
-    _ifs.open(path, std::ios::in | std::ios::binary);
-    if (!_ifs.is_open())
-    {
-        assert(false);
-        exit(255);
-    }
-    _buf = new uint8_t[kBufSize];
-    _offset = _ifs.tellg();
-    _ifs.read((char*)_buf, kBufSize);
-    _cur = 0;
-    _len = _ifs.gcount();
-}
-
-RkCacheFileByteReader::~RkCacheFileByteReader()
-{
-    delete[] _buf;
-    _ifs.close();
-}
-
-size_t RkCacheFileByteReader::Read(void* data, size_t bytes)
-{
-    if (_cur + bytes <= _len)
-    {
-        memcpy(data, _buf + _cur, bytes);
-        _cur += bytes;
-        return bytes;
-    }
-    else if (_ifs.eof())
-    {
-        memcpy(data, _buf + _cur, _len -  _cur);
-        return _len -  _cur;
+        return path.substr(0, dot) + suffix + path.substr(dot);
     }
     else
     {
-        _offset = _ifs.tellg();
-        _ifs.read((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount();
-        if (_len == 0) /* eof */
-        {
-            return 0;
-        }
-        else
-        {
-            return Read(data, bytes);
-        }
+        return path + suffix;
     }
 }
 
-bool RkCacheFileByteReader::Seek(size_t offset)
-{
-    if (offset < _offset)
-    {
-        _ifs.seekg(offset);
-        _offset = _ifs.tellg();
-        _ifs.readsome((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount(); 
-        return _offset == offset;
-    }
-    else if (offset > _offset + kBufSize)
-    {
-        _ifs.seekg(offset);
-        _offset = _ifs.tellg();
-        _ifs.readsome((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount(); 
-        return _offset == offset;
-    }
-    else
-    {
-        _cur = offset - _offset;
-        return true;
-    }
-}
-
-size_t RkCacheFileByteReader::Tell()
+/**
+ * @brief 一路合成输出, ABR 模式下每档分辨率各一路, 独立编码并写入各自的输出文件
+ */
+class CompositorOutput
 {
-    return _offset + _cur;
-}
+public:
+    using ptr = std::shared_ptr<CompositorOutput>;
+public:
+    uint32_t width;
+    uint32_t height;
+    uint64_t bps;
+    std::string outputFile;
+public:
+    Gpu::AbstractSceneCompositor::ptr compositor;
+    Gpu::AbstractSceneLayer::ptr layer;
+    Gpu::AbstractSceneItem::ptr items[4];
+    FrameBufferRing::ptr ring;
+    DamageTracker::ptr damageTracker; // 每档独立, 本档实际合成后才清空脏标记
+    bool damageUnsent = false;        // 有变化的帧被 EncodeLoadShedder 丢弃, 尚未送入编码
+public:
+    Codec::AbstractEncoder::ptr encoder;
+    CodecNodeStats::ptr encoderStats;
+    EncodeLoadShedder::ptr shedder;
+    BitrateController::ptr bitrateController;
+    FrameAnalyzer::ptr analyzer;
+    uint32_t staticSkipNum = 0; // 连续跳过编码的静止帧数
+public: /* latency probe */
+    LatencyProbe::ptr latencyProbe;
+    Codec::AbstractDecoder::ptr probeDecoder;
+    CodecNodeStats::ptr probeStats;
+    std::weak_ptr<Codec::StreamFrame> lastStampedFrame; // 重复送入的同一帧只写入一次条码
+};
 
-bool RkCacheFileByteReader::eof()
+/**
+ * @brief 合成结果, 消费者访问 buffer 前需等待栅栏
+ */
+class CompositorFrame
 {
-    return _len == 0 || (_ifs.eof() && _cur == _len);
-}
+public:
+    Codec::StreamFrame::ptr frame;
+    DmaBufFence::ptr fence;
+    uint32_t composedUs = 0; // 合成时刻, 见 LatencyStamp::NowUs
+    bool damaged = true;     // 与本档上一次送出的帧相比是否有脏区域 (见 DamageTracker), 重复送入的帧为 false
+};
 
 /**
  * @sa MMP-Core/Extension/poco/Util/samples/SampleApp/src/SampleApp.cpp 
@@ -212,10 +139,37 @@ private:
     void HandleCompositorWidth(const std::string& name, const std::string& value);
     void HandleCompositorHeight(const std::string& name, const std::string& value);
     void HandleUseAFBC(const std::string& name, const std::string& value);
+    void HandlePacing(const std::string& name, const std::string& value);
+    void HandleCompositorBufSize(const std::string& name, const std::string& value);
+    void HandleAbrLadder(const std::string& name, const std::string& value);
+    void HandleFirstFrameDeadline(const std::string& name, const std::string& value);
+    void HandleStartupReport(const std::string& name, const std::string& value);
+    void HandlePlacement(const std::string& name, const std::string& value);
+    void HandleAdaptiveBitrate(const std::string& name, const std::string& value);
+    void HandleTargetBandwidth(const std::string& name, const std::string& value);
+    void HandleFrameAnalysis(const std::string& name, const std::string& value);
+    void HandleLatencyProbe(const std::string& name, const std::string& value);
+    void HandleLatencyLog(const std::string& name, const std::string& value);
     void displayHelp();
+public:
+    /**
+     * @brief      渲染线程已 glFlush 的次数
+     */
+    uint64_t GpuFlushNum();
+    /**
+     * @brief      等待渲染线程在 flushNum 之后再 glFlush 一次
+     * @param[in]  flushNum : Draw() 之前取得的 GpuFlushNum()
+     * @return     是否在超时前完成
+     * @note       GL 命令只在渲染线程执行, 合成线程无法直接 glFlush;
+     *             Draw() 返回时命令已由渲染线程的 ThreadFrame() 执行, 其后的 glFlush 将其提交到驱动
+     */
+    bool WaitGpuFlush(uint64_t flushNum, int32_t timeoutMs);
 public:
     std::string              decoderClassName;
     std::string              encoderClassName;
+    std::string              probeDecoderClassName; // 延迟探测用的解码器
+    H26xCodec                srcCodec;
+    H26xCodec                dstCodec;
     std::string              inputFile;
     std::string              outputFile;
     uint32_t                 gop;
@@ -225,37 +179,43 @@ public:
     uint32_t                 fps;
     uint32_t                 compositorWidth;
     uint32_t                 compositorHeight;
+    uint32_t                 compositorBufSize;
     bool                     useAFBC;
     uint32_t                 flushMode; // 0 -> clear every frame, 1 -> keep
+    FrameClock::Policy       pacing;
+    std::vector<std::pair<uint32_t, uint32_t>> abrLadder; // 额外输出的分辨率档位
+    std::string              startupReportFile;
+    bool                     adaptiveBitrate;
+    uint64_t                 targetBandwidth; // 每路输出的目标带宽, 0 表示不限制
+    bool                     frameAnalysis;
+    bool                     latencyProbe;
+    std::string              latencyLogFile;
 private: /* gpu */
-    std::atomic<bool> _gpuInited;
+    std::mutex _gpuInitedMtx;
+    std::condition_variable _gpuInitedCond;
+    bool _gpuInited;
+    std::mutex _gpuFlushMtx;
+    std::condition_variable _gpuFlushCond;
+    uint64_t _gpuFlushNum;
     std::thread _renderThread;
     AbstractWindows::ptr _window;
     GLDrawContex::ptr    _draw;
 public: /* decoder */
-    std::mutex _decoderMtxs[4];
-    std::condition_variable _decoderConds[4];
-    Codec::StreamFrame::ptr _decoderStreamFrames[4];
     Codec::AbstractDecoder::ptr _decoders[4];
+public: /* encoder, ABR 每档一路 */
+    std::vector<CompositorOutput::ptr> _outputs;
 public:
-    std::mutex _encoderMtx;
-    std::condition_variable _encoderCond;
-    Codec::StreamFrame::ptr _curEncoderFrame;
-    Codec::AbstractEncoder::ptr _encoder;
-public:
-    std::mutex _displayMtx;
-    std::condition_variable _displayCond;
-    AbstractFrame::ptr _curDisplayFrame;
     AbstractDisplay::ptr _display;
 public:
-    Gpu::AbstractSceneCompositor::ptr compositor;
-    Gpu::AbstractSceneLayer::ptr layer;
-    Gpu::AbstractSceneItem::ptr items[4];
+    TextureImportCache::ptr textureCache;
 };
 
 App::App()
 {
     _gpuInited = false;
+    _gpuFlushNum = 0;
+    srcCodec = H26xCodec::H264;
+    dstCodec = H26xCodec::H264;
     bps = 10 * 1024 * 1024;
     gop = 60;
     rcMode = Codec::RateControlMode::CBR;
@@ -263,8 +223,14 @@ App::App()
     fps = 60;
     compositorWidth = 1920;
     compositorHeight = 1080;
+    compositorBufSize = 3;
     useAFBC = true;
     flushMode = 0;
+    pacing = FrameClock::Policy::SKIP;
+    adaptiveBitrate = false;
+    targetBandwidth = 0;
+    frameAnalysis = false;
+    latencyProbe = false;
 }
 
 void App::displayHelp()
@@ -326,6 +292,38 @@ void App::HandleCompositorWidth(const std::string& name, const std::string& valu
     compositorWidth = std::stoi(value);
 }
 
+void App::HandleCompositorBufSize(const std::string& name, const std::string& value)
+{
+    compositorBufSize = std::stoi(value);
+}
+
+void App::HandleFirstFrameDeadline(const std::string& name, const std::string& value)
+{
+    StartupProfiler::Instance()->SetDeadline(kStartupFirstFrame, std::stoull(value));
+}
+
+void App::HandleStartupReport(const std::string& name, const std::string& value)
+{
+    startupReportFile = value;
+}
+
+void App::HandleAbrLadder(const std::string& name, const std::string& value)
+{
+    // 格式 : 1280x720,640x360
+    std::stringstream ss(value);
+    std::string rendition;
+    while (std::getline(ss, rendition, ','))
+    {
+        size_t pos = rendition.find('x');
+        if (pos == std::string::npos)
+        {
+            assert(false);
+            exit(-1);
+        }
+        abrLadder.push_back({std::stoi(rendition.substr(0, pos)), std::stoi(rendition.substr(pos + 1))});
+    }
+}
+
 void App::HandleUseAFBC(const std::string& name, const std::string& value)
 {
     if (value == "true")
@@ -338,6 +336,60 @@ void App::HandleUseAFBC(const std::string& name, const std::string& value)
     }
 }
 
+void App::HandleAdaptiveBitrate(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        adaptiveBitrate = true;
+    }
+}
+
+void App::HandleTargetBandwidth(const std::string& name, const std::string& value)
+{
+    targetBandwidth = std::stoull(value);
+    adaptiveBitrate = true;
+}
+
+void App::HandleFrameAnalysis(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        frameAnalysis = true;
+    }
+}
+
+void App::HandleLatencyProbe(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        latencyProbe = true;
+    }
+}
+
+void App::HandleLatencyLog(const std::string& name, const std::string& value)
+{
+    latencyLogFile = value;
+    latencyProbe = true;
+}
+
+void App::HandlePacing(const std::string& name, const std::string& value)
+{
+    static std::map<std::string, FrameClock::Policy> kLookup = 
+    {
+        {"skip", FrameClock::Policy::SKIP},
+        {"catchup", FrameClock::Policy::CATCH_UP}
+    };
+    if (kLookup.count(value))
+    {
+        pacing = kLookup[value];
+    }
+    else
+    {
+        assert(false);
+        exit(-1);
+    }
+}
+
 void App::HandleCompositorHeight(const std::string& name, const std::string& value)
 {
     compositorHeight = std::stoi(value);
@@ -368,6 +420,7 @@ void App::HandleSrcCodecType(const std::string& name, const std::string& value)
     if (kLookup.count(value))
     {
         decoderClassName = kLookup[value];
+        H26xCodecFromName(value, srcCodec);
     }
     else
     {
@@ -389,6 +442,8 @@ void App::HandleDstCodecType(const std::string& name, const std::string& value)
     if (kLookup.count(value))
     {
         encoderClassName = kLookup[value];
+        H26xCodecFromName(value, dstCodec);
+        probeDecoderClassName = value == "hevc" ? "RKH265Decoder" : (value == "h264" ? "RKH264Decoder" : "");
     }
     else
     {
@@ -397,6 +452,15 @@ void App::HandleDstCodecType(const std::string& name, const std::string& value)
     }
 }
 
+void App::HandlePlacement(const std::string& name, const std::string& value)
+{
+    if (!ThreadPlacement::Instance()->Load(value))
+    {
+        assert(false);
+        exit(-1);
+    }
+}
+
 void App::HandleInput(const std::string& name, const std::string& value)
 {
     inputFile = value;
@@ -411,25 +475,41 @@ void App::initialize(Application& self)
 {
     loadConfiguration(); 
     Application::initialize(self);
+    StartupProfiler::Instance()->Mark("Application::initialize");
     Codec::CodecConfig::Instance()->Init();
+    StartupProfiler::Instance()->Mark("CodecConfig::Init");
     // AbstractLogger::LoggerSingleton()->SetThreshold(AbstractLogger::Level::L_TRACE);
     AbstractLogger::LoggerSingleton()->Enable(AbstractLogger::Direction::CONSLOE);
     {
         _renderThread = std::thread([this]() -> void
         {
+                ThreadPlacement::Instance()->Apply("render");
                 GLDrawContex::SetGPUBackendType(GPUBackend::OPENGL_ES);
                 _window = WindowFactory::DefaultFactory().createWindow("EGLWindowDefault");
                 _window->SetRenderMode(false);
                 _window->Open();
+                StartupProfiler::Instance()->Mark("EGL window open");
                 _window->BindRenderThread(true);
                 _draw = GLDrawContex::Instance();
                 _draw->SetWindows(_window);
-                _gpuInited = true;
+                StartupProfiler::Instance()->Mark("GLDrawContex ready");
+                {
+                    std::lock_guard<std::mutex> lock(_gpuInitedMtx);
+                    _gpuInited = true;
+                    _gpuInitedCond.notify_all();
+                }
                 _draw->ThreadStart();
                 while (true)
                 {
                     GpuTaskStatus status;
                     status = _draw->ThreadFrame();
+                    // Hint : 将本轮执行的渲染提交到驱动, 之后导出的 DMA-BUF 栅栏才覆盖这些渲染
+                    glFlush();
+                    {
+                        std::lock_guard<std::mutex> lock(_gpuFlushMtx);
+                        _gpuFlushNum++;
+                        _gpuFlushCond.notify_all();
+                    }
                     if (status == GpuTaskStatus::EXIT)
                     {
                         break;
@@ -447,10 +527,11 @@ void App::initialize(Application& self)
                 _window->BindRenderThread(false);
                 _window->Close();
         });
-        while (!_gpuInited)
+        std::unique_lock<std::mutex> lock(_gpuInitedMtx);
+        _gpuInitedCond.wait(lock, [this]()
         {
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
-        }
+            return _gpuInited;
+        });
     }
 }
 
@@ -464,6 +545,21 @@ void App::uninitialize()
     }
 }
 
+uint64_t App::GpuFlushNum()
+{
+    std::lock_guard<std::mutex> lock(_gpuFlushMtx);
+    return _gpuFlushNum;
+}
+
+bool App::WaitGpuFlush(uint64_t flushNum, int32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_gpuFlushMtx);
+    return _gpuFlushCond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this, flushNum]()
+    {
+        return _gpuFlushNum > flushNum;
+    });
+}
+
 void App::reinitialize(Application& self)
 {
     Application::reinitialize(self);
@@ -538,6 +634,30 @@ void App::defineOptions(OptionSet& options)
         .argument("[height]")
         .callback(OptionCallback<App>(this, &App::HandleCompositorHeight))
     );
+    options.addOption(Option("compositor_buffers", "compositor_buffers", "合成输出 buffer 数量, 应大于编码器与显示同时持有的帧数, 最少 2 (keep 模式最少 3), default 3")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleCompositorBufSize))
+    );
+    options.addOption(Option("abr_ladder", "abr_ladder", "额外输出的分辨率档位, 例如 1280x720,640x360; 与主输出同一次合成, 各自编码输出到 [output]_[width]x[height]")
+        .required(false)
+        .repeatable(false)
+        .argument("[ladder]")
+        .callback(OptionCallback<App>(this, &App::HandleAbrLadder))
+    );
+    options.addOption(Option("first_frame_deadline", "first_frame_deadline", "首帧 (显示或合成) 距进程启动的最大耗时(ms), 超出时返回非 0")
+        .required(false)
+        .repeatable(false)
+        .argument("[ms]")
+        .callback(OptionCallback<App>(this, &App::HandleFirstFrameDeadline))
+    );
+    options.addOption(Option("startup_report", "startup_report", "启动各阶段耗时导出为 CSV")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleStartupReport))
+    );
     options.addOption(Option("use_AFBC", "afbc", "是否启用 AFBC, 可选 default true")
         .required(false)
         .repeatable(false)
@@ -550,6 +670,48 @@ void App::defineOptions(OptionSet& options)
         .callback(OptionCallback<App>(this, &App::HandleFlushMode))
         .argument("[num]")
     );
+    options.addOption(Option("pacing", "pacing", "合成落后时的处理策略, 可选: skip, catchup; default skip")
+        .required(false)
+        .repeatable(false)
+        .argument("[policy]")
+        .callback(OptionCallback<App>(this, &App::HandlePacing))
+    );
+    options.addOption(Option("adaptive_bitrate", "adaptive_bitrate", "是否按输出码率与写入队列动态调整各档编码码率 (bps 为上限), 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleAdaptiveBitrate))
+    );
+    options.addOption(Option("target_bandwidth", "target_bandwidth", "每档输出的目标带宽 (bit/s), 输出码率超出时下调码率, 指定后启用 -adaptive_bitrate")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleTargetBandwidth))
+    );
+    options.addOption(Option("frame_analysis", "frame_analysis", "是否分析合成输出的帧间差异, 静止画面跳过编码, 统计场景切换 (每秒至少编码一帧), 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleFrameAnalysis))
+    );
+    options.addOption(Option("latency_probe", "latency_probe", "是否在合成输出中写入条码, 解码编码输出后统计合成到解码的延迟与丢帧, 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleLatencyProbe))
+    );
+    options.addOption(Option("latency_log", "latency_log", "逐帧的延迟导出为 CSV (ABR 的每一档附加分辨率后缀), 指定后启用 -latency_probe")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleLatencyLog))
+    );
+    options.addOption(Option("placement", "placement", "线程放置策略配置文件, 每行 : [stage] = [cpus|big|little] [: SCHED_FIFO priority], stage 可选 : render, compositor, display, worker (执行器), blocking (执行器阻塞线程池)")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandlePlacement))
+    );
 }
 
 void App::defineProperty(const std::string& def)
@@ -570,6 +732,7 @@ void App::defineProperty(const std::string& def)
 
 int App::main(const ArgVec& args)
 {
+    StartupProfiler::Instance()->Mark("App::main");
     //
     // Hint : Compositor 涉及的多线程上下文比较复杂, context 统一放到 App number,
     //        跟 test_decoder、test_encoder、test_transcode 有所区别,
@@ -579,6 +742,15 @@ int App::main(const ArgVec& args)
     {
         show = false;
     }
+    {
+        // Hint : 合成线程在发布下一帧之前仍持有上一帧 (Keep 模式还要保留作为重绘底图), 少于此数量会一直等不到可写 buffer
+        uint32_t minBufSize = flushMode == 1 ? 3 : 2;
+        if (compositorBufSize < minBufSize)
+        {
+            MMP_LOG_ERROR << "compositor buffers must be at least " << minBufSize << ", got " << compositorBufSize;
+            return -1;
+        }
+    }
     {
         MMP_LOG_INFO << "Compositor config";
         MMP_LOG_INFO << "-- encoder name : " << encoderClassName;
@@ -591,17 +763,39 @@ int App::main(const ArgVec& args)
         MMP_LOG_INFO << "-- show is: " << show;
         MMP_LOG_INFO << "-- compositor width is: " << compositorWidth;
         MMP_LOG_INFO << "-- compositor height is: " << compositorHeight;
+        MMP_LOG_INFO << "-- compositor buffers is: " << compositorBufSize;
         MMP_LOG_INFO << "-- use AFBC is: " << (useAFBC ? "true" : "false");
         MMP_LOG_INFO << "-- flush mode is: " << (flushMode == 1 ? "keep" : "clear");
+        MMP_LOG_INFO << "-- pacing is: " << (pacing == FrameClock::Policy::SKIP ? "skip" : "catchup");
+        MMP_LOG_INFO << "-- adaptive bitrate is: " << (adaptiveBitrate ? "true" : "false");
+        MMP_LOG_INFO << "-- target bandwidth is: " << targetBandwidth;
+        MMP_LOG_INFO << "-- frame analysis is: " << (frameAnalysis ? "true" : "false") << " (" << FrameAnalyzer::Backend() << ")";
+        MMP_LOG_INFO << "-- latency probe is: " << (latencyProbe ? "true" : "false");
+        for (const auto& rendition : abrLadder)
+        {
+            MMP_LOG_INFO << "-- abr rendition is: " << rendition.first << "x" << rendition.second;
+        }
+    }
+    {
+        CompositorOutput::ptr output = std::make_shared<CompositorOutput>();
+        output->width = compositorWidth;
+        output->height = compositorHeight;
+        output->bps = bps;
+        output->outputFile = outputFile;
+        _outputs.push_back(output);
+    }
+    for (const auto& rendition : abrLadder)
+    {
+        CompositorOutput::ptr output = std::make_shared<CompositorOutput>();
+        output->width = rendition.first;
+        output->height = rendition.second;
+        // Hint : 码率按像素数等比例缩放
+        output->bps = (uint64_t)((double)bps * rendition.first * rendition.second / ((double)compositorWidth * compositorHeight));
+        output->outputFile = AppendFileSuffix(outputFile, "_" + std::to_string(rendition.first) + "x" + std::to_string(rendition.second));
+        _outputs.push_back(output);
     }
-    std::atomic<bool> running(true);
-    std::atomic<uint32_t> _decoderReachFileEndNum(0);
     constexpr uint32_t decoderNum = 4;
 
-    std::vector<std::thread*> _threads;
-
-    uint32_t curSlot = 0;
-
     //
     // 流水线结构
     // Input File Read -> VDEC PUSH (*4)
@@ -611,9 +805,12 @@ int App::main(const ArgVec& args)
     //                                                                 RECEIVE FRAME -> VENC PUSH
     //                                                                                  VENC POP -> Output File Write
     //
-    // 流水线最大长度为 5, 整体使用线程数量 12(4 + 4 + 1 + 1 + 1 + 1)条；
-    // 流控由 COMPOSITOR 控制,按照固定 fps 合成, 其他环节由 mtx 和 cond 形成正向或反向压制
-    // (实际上如果场景更为复杂, 最好是由统一线程池管理调度, 不过单独起线程便于理解逻辑行为)
+    // 节点之间通过有界边连接, 输入结束后 EOS 沿边逐级传递, 各节点取完数据后退出;
+    // 读取、解码、编码、写文件为 step 节点, 在 WorkStealingExecutor 上调度, 线程数随核数而非路数增长,
+    // 合成 (GL 上下文) 与显示各独占一个线程;
+    // 流控由 COMPOSITOR 控制,按照固定 fps 合成: 解码到合成的边容量为 1, 解码侧被反向压制,
+    // 解码器内部的在途帧数与码流的字节数同样有额度, 反压最终传递到读取;
+    // 合成到显示、编码的边只保留最新一帧, 消费者跟不上时丢弃旧帧而不拖慢合成
     // 
     // 其他:
     // 本示例还是挺有意思的,展示了一种通过 DMA BUF 实现无拷贝的画面合成方式,
@@ -621,8 +818,11 @@ int App::main(const ArgVec& args)
     // 而非 VDEC -> CPU -> GPU -> CPU -> VENC
     // 同时依托于 ARM MALI 的 GPU 涉及, 可以全链路使用 NV12 进行传输, 避免 YUV 与 RGB 的互转
     // 
+    Pipeline pipeline("compositor");
 
-    /*********************************** 解码线程(Begin) ******************************/
+    /*********************************** 解码(Begin) ******************************/
+    std::vector<PipelineEdge<AbstractFrame::ptr>::ptr> decodedFrames;
+    std::vector<PipelineEdgeBase::ptr> compositorInputs;
     for (uint32_t i=0; i<decoderNum; i++)
     {
         _decoders[i] =  Codec::DecoderFactory::DefaultFactory().CreateDecoder(decoderClassName);
@@ -630,200 +830,223 @@ int App::main(const ArgVec& args)
         {
             _decoders[i]->SetParameter(true, Codec::kEnableDecoderAFBC);
         }
+        _decoders[i]->Init();
+        _decoders[i]->Start();
     }
-    // Decoder Push
     for (uint32_t i=0; i<decoderNum; i++)
     {
-        std::thread* thread = new std::thread([this, &running, &_decoderReachFileEndNum, slot = i]()
+        PipelineEdge<NormalPack::ptr>::ptr packs = pipeline.CreateEdge<NormalPack::ptr>("nal_" + std::to_string(i), kNalEdgeCapacity, PipelineEdgePolicy::BLOCK, kNalEdgeBytes);
+        // Hint : 容量为 1, 合成取走上一帧之前解码侧阻塞
+        decodedFrames.push_back(pipeline.CreateEdge<AbstractFrame::ptr>("decoded_" + std::to_string(i), 1));
+        compositorInputs.push_back(decodedFrames.back());
+        RkCacheFileByteReader::ptr byteReader = std::make_shared<RkCacheFileByteReader>(inputFile, srcCodec);
+        pipeline.AddSource("reader", packs, [byteReader](NormalPack::ptr& pack) -> bool
         {
-            std::shared_ptr<RkCacheFileByteReader> byteReader = std::make_shared<RkCacheFileByteReader>(inputFile);
-            Codec::AbstractDecoder::ptr decoder = _decoders[slot];
-            decoder->Init();
-            decoder->Start();
-            NormalPack::ptr pack = nullptr;
-            do
-            {
-                pack = byteReader->GetNalUint();
-                if (pack)
-                {
-                    decoder->Push(pack);
-                }
-            } while (pack && running);
-            _decoderReachFileEndNum++;
-            decoder->Stop();
-            decoder->Uninit();
-        });
-        thread->detach();
-        _threads.push_back(thread);
+            pack = byteReader->GetNalUint();
+            return pack != nullptr;
+        }, true);
+        AddDecoderNode(pipeline, _decoders[i], srcCodec, packs, decodedFrames.back());
     }
-    // Decoder Pop
-    for (uint32_t i=0; i<decoderNum; i++)
+    /*********************************** 解码(End) ******************************/
+    /***************************************** 显示(Begin) ****************************************/
+    PipelineEdge<CompositorFrame>::ptr displayFrames;
+    std::vector<PipelineEdgeBase::ptr> compositorOutputs;
+    if (show)
     {
-        std::thread* thread = new std::thread([this, &running, slot = i]()
+        displayFrames = pipeline.CreateEdge<CompositorFrame>("display", 1, PipelineEdgePolicy::DROP_OLDEST);
+        compositorOutputs.push_back(displayFrames);
+        pipeline.AddNode("display", [this, displayFrames]()
         {
-            Codec::AbstractDecoder::ptr decoder = _decoders[slot];
-            std::mutex& decoderMtx = _decoderMtxs[slot];
-            std::condition_variable& decoderCond = _decoderConds[slot];
-            Codec::StreamFrame::ptr& curframe = _decoderStreamFrames[slot]; 
-            while (running)
+            _display = AbstractDisplay::Create();
+            if (!_display)
             {
-                AbstractFrame::ptr frame;
-                if (decoder->Pop(frame))
+                return;
+            }
+            _display->Init();
+            StartupProfiler::Instance()->Mark("Display::Init");
+            bool isFirst = true;
+            bool firstShown = false;
+            CompositorFrame compositorFrame;
+            while (displayFrames->Pop(compositorFrame))
+            {
+                Codec::StreamFrame::ptr frame = compositorFrame.frame;
+                if (isFirst)
                 {
-                    std::unique_lock<std::mutex> lock(decoderMtx);
-                    if (curframe)
-                    {
-                        //
-                        // Hint : 存在两种唤醒条件
-                        //        1 - 数据被消费, 需要再生产数据
-                        //        2 - 线程退出
-                        //
-                        decoderCond.wait(lock);
-                        if (!running)
-                        {
-                            break;
-                        }
-                    }
-                    curframe = std::dynamic_pointer_cast<Codec::StreamFrame>(frame);
+                    _display->Open(frame->info);
+                    StartupProfiler::Instance()->Mark("Display::Open");
+                    isFirst = false;
+                }
+                if (compositorFrame.fence && !compositorFrame.fence->Wait(kFenceTimeoutMs))
+                {
+                    MMP_LOG_WARN << "Wait compositor fence timeout";
                 }
-                else
+                DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(frame->GetAllocateMethod());
+                DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1);
+                _display->UpdateWindow((const uint32_t*)frame->GetData(0));
+                if (!firstShown)
                 {
-                    std::this_thread::sleep_for(std::chrono::microseconds(1));
+                    StartupProfiler::Instance()->Mark(kStartupFirstFrame);
+                    firstShown = true;
                 }
             }
-        });
-        thread->detach();
-        _threads.push_back(thread);
+            _display->Close();
+            _display->UnInit();
+        }, {displayFrames}, {});
     }
-    /*********************************** 解码线程(End) ******************************/
-    /***************************************** 渲染线程(Begin) ****************************************/
-    if (show)
+    /***************************************** 显示(End) ****************************************/
+    /***************************************** 编码(Begin) ****************************************/
+    //
+    // Hint : 每路合成输出 (ABR 的每一档) 各有一个编码器及输出文件
+    //
+    std::vector<PipelineEdge<CompositorFrame>::ptr> encoderFrames;
+    for (size_t index=0; index<_outputs.size(); index++)
     {
-        std::thread* thread = new std::thread([this, &running]()
+        CompositorOutput::ptr output = _outputs[index];
+        output->encoder = Codec::EncoderFactory::DefaultFactory().CreateEncoder(encoderClassName);
         {
-            _display = AbstractDisplay::Create();
-            if (_display)
+            output->encoder->SetParameter(rcMode, Codec::kRateControlMode);
+            output->encoder->SetParameter(gop, Codec::kGop);
+            output->encoder->SetParameter(output->bps, Codec::kBps);
+        }
+        output->encoder->Init();
+        output->encoder->Start();
+        // Hint : 队列深度由 EncodeLoadShedder 控制, DROP_OLDEST 仅作兜底, 合成不会被编码阻塞
+        encoderFrames.push_back(pipeline.CreateEdge<CompositorFrame>("encode_" + std::to_string(index), 1 + kEncodeMaxDuplicate, PipelineEdgePolicy::DROP_OLDEST));
+        compositorOutputs.push_back(encoderFrames.back());
+        output->shedder = std::make_shared<EncodeLoadShedder>(kEncodeShedDepth);
+        output->shedder->SetOutputFrameRate(fps, 1, kEncodeMaxDuplicate);
+        if (adaptiveBitrate)
+        {
+            output->bitrateController = std::make_shared<BitrateController>(output->bps, fps);
+            output->bitrateController->SetTargetBandwidth(targetBandwidth);
+        }
+        PipelineEdge<AbstractPack::ptr>::ptr packs = pipeline.CreateEdge<AbstractPack::ptr>("pack_" + std::to_string(index), kPackEdgeCapacity, PipelineEdgePolicy::BLOCK, kPackEdgeBytes);
+        if (frameAnalysis)
+        {
+            output->analyzer = std::make_shared<FrameAnalyzer>(output->width, output->height, fps / 4);
+        }
+        if (latencyProbe)
+        {
+            output->probeDecoder = Codec::DecoderFactory::DefaultFactory().CreateDecoder(probeDecoderClassName);
+            if (output->probeDecoder)
             {
-                _display->Init();
-                bool isFirst = true;
-                while (running)
-                {
-                    AbstractFrame::ptr frame;
-                    {
-                        std::unique_lock<std::mutex> lock(_displayMtx);
-                        if (!_curDisplayFrame)
-                        {
-                            _displayCond.wait(lock);
-                        }
-                        frame = _curDisplayFrame;
-                        _curDisplayFrame = nullptr;
-                    }
-                    if (isFirst)
-                    {
-                        Codec::StreamFrame::ptr streamFrame = std::dynamic_pointer_cast<Codec::StreamFrame>(frame);
-                        AbstractPicture::ptr pictureFrame = std::dynamic_pointer_cast<AbstractPicture>(frame);
-                        if (streamFrame)
-                        {
-                            _display->Open(streamFrame->info);
-                        }
-                        isFirst = false;
-                    }
-                    if (frame)
-                    {
-                        _display->UpdateWindow((const uint32_t*)frame->GetData(0));
-                    }
-                }
-                _display->Close();
-                _display->UnInit();
+                output->probeDecoder->Init();
+                output->probeDecoder->Start();
+                output->latencyProbe = std::make_shared<LatencyProbe>();
             }
-        });
-        thread->detach();
-        _threads.push_back(thread);
-    }
-    /***************************************** 渲染线程(End) ****************************************/
-    /***************************************** 编码线程(Begin) ****************************************/
-    _encoder = Codec::EncoderFactory::DefaultFactory().CreateEncoder(encoderClassName);
-    // Enoder Push
-    {
-        std::thread* thread = new std::thread([this, &running]()
+            else
+            {
+                MMP_LOG_WARN << "Create " << probeDecoderClassName << " fail, latency probe is disabled";
+            }
+        }
+        uint32_t maxStaticSkipNum = fps - 1;
+        output->encoderStats = AddEncoderNode(pipeline, output->encoder, encoderFrames.back(), packs, [output, packs, maxStaticSkipNum](const CompositorFrame& compositorFrame) -> AbstractFrame::ptr
         {
+            if (output->bitrateController)
             {
-                _encoder->SetParameter(rcMode, Codec::kRateControlMode);
-                _encoder->SetParameter(gop, Codec::kGop);
-                _encoder->SetParameter(bps, Codec::kBps);
+                ApplyBitrateControl(std::to_string(output->width) + "x" + std::to_string(output->height), output->encoder, output->bitrateController, packs);
             }
-            _encoder->Init();
-            _encoder->Start();
-            while (running)
+            // Hint : VENC 不感知隐式栅栏, 送编码前需确认 GPU 已完成渲染
+            if (compositorFrame.fence && !compositorFrame.fence->Wait(kFenceTimeoutMs))
             {
-                Codec::StreamFrame::ptr frame;
+                MMP_LOG_WARN << "Wait compositor fence timeout";
+            }
+            if (output->analyzer)
+            {
+                auto analyze = [&output, &compositorFrame]() -> FrameAnalysis
+                {
+                    DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(compositorFrame.frame->GetAllocateMethod());
+                    DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1);
+                    return output->analyzer->Analyze((const uint8_t*)compositorFrame.frame->GetData(0), FrameLumaStride(compositorFrame.frame));
+                };
+                // Hint : 合成器已知本档没有脏区域时直接视为静止, 不读取画面; 有脏区域时以 SAD 兜底 (如解码出相同的画面)
+                FrameAnalysis analysis;
+                bool analyzed = compositorFrame.damaged;
+                if (analyzed)
+                {
+                    analysis = analyze();
+                }
+                bool isStatic = analyzed ? analysis.isStatic : true;
+                if (isStatic && output->staticSkipNum < maxStaticSkipNum)
                 {
-                    std::unique_lock<std::mutex> lock(_encoderMtx);
-                    if (!_curEncoderFrame)
+                    // Hint : 画面几乎无变化, 跳过编码; 连续跳过 fps - 1 帧后编码一帧, 避免长时间没有输出
+                    if (!analyzed)
                     {
-                        _encoderCond.wait(lock);
+                        // Hint : 未读取的帧同样计入, 场景切换的最小间隔按合成帧数而非分析次数计算
+                        output->analyzer->Skip();
                     }
-                    frame = _curEncoderFrame;
-                    _curEncoderFrame = nullptr;
+                    output->staticSkipNum++;
+                    return nullptr;
                 }
-                if (frame)
+                output->staticSkipNum = 0;
+                if (!analyzed)
                 {
-                    _encoder->Push(frame);
+                    analysis = analyze();
                 }
+                // Hint : 只有送编码的帧作为 SAD 的参考; 编码器没有强制 IDR 的接口, 场景切换只在 Report 中统计
+                output->analyzer->Commit();
             }
-            _encoder->Stop();
-            _encoder->Uninit();
+            if (output->latencyProbe && output->lastStampedFrame.lock() != compositorFrame.frame)
+            {
+                // Hint : 以合成时刻为时间戳, 延迟包含在编码队列中的等待; 重复送入的同一帧沿用已写入的条码
+                DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(compositorFrame.frame->GetAllocateMethod());
+                DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1, true);
+                output->latencyProbe->Stamp((uint8_t*)compositorFrame.frame->GetData(0), FrameLumaStride(compositorFrame.frame), output->width, output->height, compositorFrame.composedUs);
+                output->lastStampedFrame = compositorFrame.frame;
+            }
+            return compositorFrame.frame;
         });
-        thread->detach();
-        _threads.push_back(thread);
-    }
-    // Encoder Pop
-    {
-        std::thread* thread = new std::thread([this, &running]()
+        // Hint : 启用延迟探测时编码输出经 latency_tee 分别送往写文件与探测用的解码器
+        PipelineEdge<AbstractPack::ptr>::ptr writerPacks = packs;
+        if (output->latencyProbe)
+        {
+            writerPacks = pipeline.CreateEdge<AbstractPack::ptr>("write_" + std::to_string(index), kPackEdgeCapacity, PipelineEdgePolicy::BLOCK, kPackEdgeBytes);
+            output->probeStats = AddLatencyProbeNode(pipeline, std::to_string(index), output->probeDecoder, dstCodec, packs, writerPacks, output->latencyProbe);
+        }
+        AsyncFileWriter::ptr writer = std::make_shared<AsyncFileWriter>(output->outputFile);
+        BitrateController::ptr bitrateController = output->bitrateController;
+        pipeline.AddSink("writer", writerPacks, [writer, bitrateController](const AbstractPack::ptr& pack)
         {
-            std::ofstream ofs(outputFile);
-            while (running || _encoder->CanPop())
+            if (bitrateController)
             {
-                AbstractPack::ptr pack;
-                if (_encoder->Pop(pack))
-                {
-                    ofs.write((char*)pack->GetData(0), pack->GetSize());
-                    // MMP_LOG_INFO << "Pop, addresss is: " << pack->GetData(0) << ", size is: " << pack->GetSize();
-                }
-                else
-                {
-                    std::this_thread::sleep_for(std::chrono::microseconds(1));
-                }
+                bitrateController->OnPacket(pack->GetSize());
             }
-            ofs.flush();
-            ofs.close();
-        });
-        thread->detach();
-        _threads.push_back(thread);
+            writer->Write(pack->GetData(0), pack->GetSize());
+            // MMP_LOG_INFO << "Pop, addresss is: " << pack->GetData(0) << ", size is: " << pack->GetSize();
+        }, [writer]()
+        {
+            writer->Close();
+        }, true);
     }
-    /***************************************** 编码线程(End) ****************************************/
-    /***************************************** 合成线程(End) ****************************************/
+    /***************************************** 编码(End) ****************************************/
+    /***************************************** 合成(Begin) ****************************************/
     {
-        std::thread* thread = new std::thread([this, &running]()
+        pipeline.AddNode("compositor", [&]()
         {
             // 
-            // Compositor
+            // Compositor (* ABR 档位数)
             //            -> Layer
             //                     -> Item0
             //                     -> Item1
             //                     -> Item2
             //                     -> Item3
             //
+            // 所有档位共享同一份解码纹理 (只导入一次), 各自渲染到对应分辨率的 framebuffer
+            //
             
             AbstractPicture::ptr frameBuffer;
+            for (auto& output : _outputs)
             {
+                output->damageTracker = std::make_shared<DamageTracker>(output->width, output->height, (uint32_t)decoderNum);
+                Gpu::AbstractSceneCompositor::ptr& compositor = output->compositor;
+                Gpu::AbstractSceneLayer::ptr& layer = output->layer;
                 compositor = Gpu::AbstractSceneCompositor::Create();
                 {
                     {
                         Gpu::SceneCompositorParam param;
-                        param.width = compositorWidth;
-                        param.height = compositorHeight;
-                        param.bufSize = 3;
+                        param.width = output->width;
+                        param.height = output->height;
+                        param.bufSize = compositorBufSize;
                         param.flags = GlTextureFlags::TEXTURE_USE_FOR_RENDER | GlTextureFlags::TEXTURE_EXTERNAL | GlTextureFlags::TEXTURE_YUV;
                         if (useAFBC)
                         {
@@ -840,8 +1063,8 @@ int App::main(const ArgVec& args)
                 {
                     {
                         Gpu::SceneLayerParam param;
-                        param.height = compositorWidth;
-                        param.width = compositorHeight;
+                        param.height = output->width;
+                        param.width = output->height;
                         if (flushMode == 1)
                         {
                             param.strategy = Gpu::SceneRenderStrategy::Keep;
@@ -852,29 +1075,30 @@ int App::main(const ArgVec& args)
                 }
                 for (uint32_t i=0; i<decoderNum; i++)
                 {
-                    items[i] = Gpu::AbstractSceneItem::Create();
+                    output->items[i] = Gpu::AbstractSceneItem::Create();
                     Gpu::SceneItemParam param = {};
+                    float x = 0.0f, y = 0.0f;
                     param.area = NormalizedRect(0.5f, 0.5f);
                     switch (i)
                     {
                         case 0:
                         {
-                            param.location = NormalizedPoint(0.0f, 0.0f);
+                            x = 0.0f, y = 0.0f;
                             break;
                         }
                         case 1:
                         {
-                            param.location = NormalizedPoint(0.0f, 0.5f);
+                            x = 0.0f, y = 0.5f;
                             break;
                         }
                         case 2:
                         {
-                            param.location = NormalizedPoint(0.5f, 0.0f);
+                            x = 0.5f, y = 0.0f;
                             break;
                         }
                         case 3:
                         {
-                            param.location = NormalizedPoint(0.5f, 0.5f);
+                            x = 0.5f, y = 0.5f;
                             break;
                         }
                         default:
@@ -883,127 +1107,256 @@ int App::main(const ArgVec& args)
                             break;
                         }
                     }
-                    items[i]->SetParam(param);
-                    layer->AddSceneItem(std::string() + "item" + "_" + std::to_string(i), items[i]);
+                    param.location = NormalizedPoint(x, y);
+                    output->items[i]->SetParam(param);
+                    layer->AddSceneItem(std::string() + "item" + "_" + std::to_string(i), output->items[i]);
+                    output->damageTracker->SetItemRect(i, x, y, 0.5f, 0.5f);
                 }
+                output->ring = std::make_shared<FrameBufferRing>(compositorBufSize);
             }
+            // Hint : 解码器在固定数量的 DMA-BUF 之间轮转, 每块 DMA-BUF 只导入一次
+            textureCache = std::make_shared<TextureImportCache>(_draw, decoderNum * 16, GlTextureFlags::TEXTURE_EXTERNAL | GlTextureFlags::TEXTURE_YUV);
 
-            while (running || _encoder->CanPop())
+            FrameClock frameClock(fps, 1, pacing);
+            std::vector<Codec::StreamFrame::ptr> lastCompositorFrames(_outputs.size());
+            std::vector<DmaBufFence::ptr> lastCompositorFences(_outputs.size());
+            std::vector<uint32_t> lastComposedUs(_outputs.size(), 0);
+            // Hint : item 纹理直接引用解码帧的 buffer, 未被新帧替换前须一直持有, 否则解码器会复用该 buffer
+            std::vector<Codec::StreamFrame::ptr> heldDecoderFrames(decoderNum);
+            bool firstComposed = false;
+            bool firstDecoded = false;
+            std::vector<bool> inputEos(decoderNum, false);
+            uint32_t eosNum = 0;
+            while (eosNum != decoderNum)
             {
-                Poco::Stopwatch sw;
-                sw.start();
                 Codec::StreamFrame::ptr decodersFrames[4];
-                Codec::StreamFrame::ptr compositorFrame;
                 // 反向压制
                 {
-                    uint32_t curFrame = 0;
-                    while (running && curFrame != decoderNum)
+                    //
+                    // Hint : Keep 模式下不等待所有解码器, 仅取本周期内已就绪的帧,
+                    //        未更新的 item 保持上一帧画面
+                    //
+                    bool waitAll = flushMode != 1;
+                    for (uint32_t i=0; i<decoderNum; i++)
                     {
-                        for (uint32_t i=0; i<decoderNum; i++)
+                        if (inputEos[i])
                         {
-                            if (!decodersFrames[i])
+                            continue;
+                        }
+                        AbstractFrame::ptr frame;
+                        if (waitAll ? decodedFrames[i]->Pop(frame) : decodedFrames[i]->TryPop(frame))
+                        {
+                            decodersFrames[i] = std::dynamic_pointer_cast<Codec::StreamFrame>(frame);
+                            heldDecoderFrames[i] = decodersFrames[i];
+                            for (auto& output : _outputs)
                             {
-                                std::lock_guard<std::mutex> lock(_decoderMtxs[i]);
-                                if (_decoderStreamFrames[i])
-                                {
-                                    decodersFrames[i] = _decoderStreamFrames[i];
-                                    _decoderStreamFrames[i] = nullptr;
-                                    _decoderConds[i].notify_one();
-                                    curFrame++;
-                                }
+                                output->damageTracker->MarkDirty(i);
                             }
+                            if (!firstDecoded)
+                            {
+                                StartupProfiler::Instance()->Mark("first frame decoded");
+                                firstDecoded = true;
+                            }
+                        }
+                        else if (decodedFrames[i]->IsEos())
+                        {
+                            inputEos[i] = true;
+                            eosNum++;
                         }
-                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                    if (eosNum == decoderNum)
+                    {
+                        break;
                     }
                 }
-                // 合成
+                // 导入 (所有档位共享)
+                Texture::ptr textures[4];
+                for (uint32_t i=0; i<decoderNum; i++)
                 {
-                    // MMP_LOG_INFO << "Compositor Begin";
-                    for (uint32_t i=0; i<decoderNum; i++)
+                    if (decodersFrames[i])
                     {
-                        Texture::ptr texture = Gpu::Create2DTextures(_draw, decodersFrames[i]->info, "", GlTextureFlags::TEXTURE_EXTERNAL | GlTextureFlags::TEXTURE_YUV)[0];
-                        {
-                            TextureDesc desc;
-                            AbstractPicture::ptr picFrame = std::make_shared<NormalPicture>(decodersFrames[i]->info, decodersFrames[i]->GetAllocateMethod());
-                            Gpu::Update2DTextures(_draw, {texture}, picFrame);
-                        }
-                        items[i]->UpdateImage(texture);
+                        textures[i] = textureCache->Acquire(decodersFrames[i], decodersFrames[i]->info);
                     }
-                    compositor->Draw();
+                }
+                for (size_t index=0; index<_outputs.size(); index++)
+                {
+                    CompositorOutput::ptr output = _outputs[index];
+                    Codec::StreamFrame::ptr compositorFrame;
+                    DmaBufFence::ptr compositorFence;
+                    uint32_t composedUs = 0;
+                    bool damaged = output->damageTracker->HasDamage() || output->damageUnsent;
+                    // 合成
+                    if (flushMode == 1 && !output->damageTracker->HasDamage())
+                    {
+                        // Hint : 画面无变化, 跳过合成并复用上一帧输出 (尚无输出时本周期不送帧)
+                        compositorFrame = lastCompositorFrames[index];
+                        compositorFence = lastCompositorFences[index];
+                        composedUs = lastComposedUs[index];
+                        output->damageTracker->Commit(false);
+                    }
+                    else if (!output->ring->WaitWritable(kRingTimeoutMs))
+                    {
+                        // Hint : 编码或显示仍持有下一个渲染目标, 放弃本次合成而不是覆盖;
+                        //        脏标记保留到下次实际合成
+                        MMP_LOG_WARN << "Compositor output ring is full, output is: " << output->width << "x" << output->height;
+                    }
+                    else
                     {
+                        // MMP_LOG_INFO << "Compositor Begin";
+                        // Hint : 本档上次放弃合成时留下的脏 item 也需要更新为最新持有的帧
+                        for (uint32_t i=0; i<decoderNum; i++)
+                        {
+                            if (!output->damageTracker->IsDirty(i) || !heldDecoderFrames[i])
+                            {
+                                continue;
+                            }
+                            if (!textures[i])
+                            {
+                                textures[i] = textureCache->Acquire(heldDecoderFrames[i], heldDecoderFrames[i]->info);
+                            }
+                            if (textures[i])
+                            {
+                                output->items[i]->UpdateImage(textures[i]);
+                            }
+                        }
+                        uint64_t flushNum = GpuFlushNum();
+                        output->compositor->Draw();
+                        if (!WaitGpuFlush(flushNum, kGpuFlushTimeoutMs))
+                        {
+                            MMP_LOG_WARN << "Wait gpu flush timeout, output is: " << output->width << "x" << output->height;
+                        }
+                        {
 
-                        DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(compositor->GetFrameBuffer()->GetAllocateMethod());
-                        PixelsInfo info;
-                        info.width = compositorWidth;
-                        info.height = compositorHeight;
-                        info.format = PixelFormat::NV12;
-                        Codec::StreamFrame::ptr frame = std::make_shared<Codec::StreamFrame>(info, alloc);
-                        compositorFrame = frame;
+                            DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(output->compositor->GetFrameBuffer()->GetAllocateMethod());
+                            PixelsInfo info;
+                            info.width = output->width;
+                            info.height = output->height;
+                            info.format = PixelFormat::NV12;
+                            Codec::StreamFrame::ptr frame = output->ring->Publish(alloc, info);
+                            compositorFrame = frame;
+                            // Hint : 已 glFlush 但不调用 glFinish, 由消费者在真正访问 buffer 时等待栅栏
+                            compositorFence = DmaBufFence::Export(alloc ? alloc->GetFd() : -1);
+                            composedUs = LatencyStamp::NowUs();
+                        }
+                        if (!firstComposed)
+                        {
+                            StartupProfiler::Instance()->Mark("first frame composed");
+                            if (!show)
+                            {
+                                StartupProfiler::Instance()->Mark(kStartupFirstFrame);
+                            }
+                            firstComposed = true;
+                        }
+                        output->damageTracker->Commit(true);
+                        lastCompositorFrames[index] = compositorFrame;
+                        lastCompositorFences[index] = compositorFence;
+                        lastComposedUs[index] = composedUs;
+                        // MMP_LOG_INFO << "Compositor End";
                     }
-                    // MMP_LOG_INFO << "Compositor End";
-                }
-                // 正向压制
-                {
+                    // 送显示与编码, 显示只保留最新一帧
                     if (compositorFrame)
                     {
+                        CompositorFrame result;
+                        result.frame = compositorFrame;
+                        result.fence = compositorFence;
+                        result.composedUs = composedUs;
+                        result.damaged = damaged;
+                        if (index == 0 && displayFrames)
                         {
-                            std::lock_guard<std::mutex> lock(_displayMtx);
-                            _curDisplayFrame = compositorFrame;
-                            _displayCond.notify_one();
+                            displayFrames->Push(result);
                         }
+                        // Hint : 以合成周期为时间戳, 错过的周期由重复送入补齐以维持输出帧率; 编码跟不上时丢弃
+                        int64_t pts = (int64_t)(frameClock.FrameIndex() * frameClock.FrameIntervalNs() / 1000);
+                        uint32_t depth = (uint32_t)encoderFrames[index]->Size() + output->encoderStats->Inflight();
+                        uint32_t frameNum = output->shedder->Frames(pts, depth);
+                        output->damageUnsent = damaged && frameNum == 0;
+                        for (uint32_t i=0; i<frameNum; i++)
                         {
-                            std::lock_guard<std::mutex> lock(_encoderMtx);
-                            _curEncoderFrame = compositorFrame;
-                            _encoderCond.notify_one();
-                        }  
+                            encoderFrames[index]->Push(result);
+                            result.damaged = false;
+                        }
                     }
                 }
-                // 简易流控
+                // 流控 (绝对 deadline, 不累计误差)
                 {
-                    uint32_t sleepTime = 1000000 / fps;
-                    if (sw.elapsed() > sleepTime)
+                    if (frameClock.Wait() != 0)
                     {
                         MMP_LOG_WARN << "Compositor process too low";
                     }
-                    else
-                    {
-                        sleepTime -= sw.elapsed();
-                        std::this_thread::sleep_for(std::chrono::microseconds(sleepTime));
-                    }
                 }
             }
-            _displayCond.notify_one();
-            _encoderCond.notify_one();
-            for (uint32_t i=0; i<decoderNum; i++)
+            MMP_LOG_INFO << frameClock.Report();
+            for (auto& output : _outputs)
             {
-                _decoderConds[i].notify_all();
+                MMP_LOG_INFO << output->width << "x" << output->height << " " << output->shedder->Report();
+                if (output->bitrateController)
+                {
+                    MMP_LOG_INFO << output->width << "x" << output->height << " " << output->bitrateController->Report();
+                }
             }
-            for (uint32_t i=0; i<decoderNum; i++)
+            MMP_LOG_INFO << textureCache->Report();
+            lastCompositorFrames.clear();
+            lastCompositorFences.clear();
+            for (auto& output : _outputs)
             {
-                items[i].reset();
+                MMP_LOG_INFO << output->width << "x" << output->height << " " << output->ring->Report();
+                MMP_LOG_INFO << output->width << "x" << output->height << " " << output->damageTracker->Report();
             }
-            layer.reset();
-            compositor.reset();
-        });
-        thread->detach();
-        _threads.push_back(thread);
+            for (auto& output : _outputs)
+            {
+                for (uint32_t i=0; i<decoderNum; i++)
+                {
+                    output->items[i].reset();
+                }
+                output->layer.reset();
+                output->compositor.reset();
+                output->ring.reset();
+            }
+            heldDecoderFrames.clear();
+            textureCache.reset();
+        }, compositorInputs, compositorOutputs);
     }
-    /***************************************** 合成线程(End) ****************************************/
+    /***************************************** 合成(End) ****************************************/
 
-
-    while (_decoderReachFileEndNum != decoderNum)
+    pipeline.Start();
+    pipeline.Wait();
+    for (uint32_t i=0; i<decoderNum; i++)
     {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        _decoders[i]->Stop();
+        _decoders[i]->Uninit();
     }
-    running = true;
-
-    for (auto& thread : _threads)
+    for (auto& output : _outputs)
+    {
+        if (output->analyzer)
+        {
+            MMP_LOG_INFO << output->analyzer->Report();
+        }
+        output->encoder->Stop();
+        output->encoder->Uninit();
+        if (output->latencyProbe)
+        {
+            std::string resolution = std::to_string(output->width) + "x" + std::to_string(output->height);
+            MMP_LOG_INFO << resolution << " probe decoder " << output->probeStats->Report();
+            MMP_LOG_INFO << resolution << " " << output->latencyProbe->Report();
+            std::string latencyLog = output == _outputs.front() ? latencyLogFile : AppendFileSuffix(latencyLogFile, "_" + resolution);
+            if (!latencyLogFile.empty() && !output->latencyProbe->Export(latencyLog))
+            {
+                MMP_LOG_WARN << "Export latency log fail, path is: " << latencyLog;
+            }
+            output->probeDecoder->Stop();
+            output->probeDecoder->Uninit();
+        }
+    }
+    MMP_LOG_INFO << pipeline.Report();
+    MMP_LOG_INFO << WorkStealingExecutor::Instance()->Report();
+    MMP_LOG_INFO << AsyncFileIo::Instance()->Report();
+    MMP_LOG_INFO << StartupProfiler::Instance()->Report();
+    MMP_LOG_INFO << ThreadPlacement::Instance()->Report();
+    if (!startupReportFile.empty() && !StartupProfiler::Instance()->Export(startupReportFile))
     {
-        thread->join();
-        delete thread;
+        MMP_LOG_WARN << "Export startup report fail, path is: " << startupReportFile;
     }
-
-    return 0;
+    return StartupProfiler::Instance()->Check() ? 0 : -1;
 }
 
 /********************************************************* TEST(END) *****************************************************/
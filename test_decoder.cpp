@@ -3,174 +3,25 @@
 #include <Poco/Util/Application.h>
 #include <Poco/Util/HelpFormatter.h>
 
-#include "Common/Promise.h"
 #include "Common/AbstractLogger.h"
 #include "Common/LogMessage.h"
 #include "Common/ThreadPool.h"
 #include "Codec/StreamFrame.h"
 #include "Codec/CodecConfig.h"
 #include "Codec/CodecFactory.h"
-#include "Common/ImmutableVectorAllocateMethod.h"
 #include "Display/AbstractDisplay.h"
+#include "Utility/RkCacheFileByteReader.h"
+#include "Utility/PresentationScheduler.h"
+#include "Utility/CodecWarmPool.h"
+#include "Utility/StartupProfiler.h"
+#include "Utility/ThreadPlacement.h"
+#include "Utility/Pipeline.h"
+#include "Utility/PipelineCodec.h"
 
 using namespace Mmp;
 using namespace Poco::Util;
 
-constexpr uint32_t kBufSize = 1024 * 1024;
-
-/**
- * @todo 好像挺烧 CPU, 用 `mmap` 并且优化 NAL UINT 的查找方式可能好一些
- */
-class RkCacheFileByteReader
-{
-public:
-    explicit RkCacheFileByteReader(const std::string& path);
-    ~RkCacheFileByteReader();
-public:
-    NormalPack::ptr GetNalUint();
-public:
-    size_t Read(void* data, size_t bytes);
-    bool Seek(size_t offset);
-    size_t Tell();
-    bool eof();
-private:
-    std::ifstream _ifs;
-private:
-    uint8_t* _buf;
-    uint32_t _offset;
-    uint32_t _cur;
-    uint32_t _len;
-};
-
-NormalPack::ptr RkCacheFileByteReader::GetNalUint()
-{
-    std::vector<uint8_t> bufs;
-    bufs.reserve(1024 * 1024);
-    uint32_t next_24_bits = 0;
-    bool isFirst = true;
-    while (!(next_24_bits == 0x000001 && !isFirst))
-    {
-        if (next_24_bits == 0x000001)
-        {
-            isFirst = false;
-            bufs.push_back(0);
-            bufs.push_back(0);
-            bufs.push_back(0);
-            bufs.push_back(1);
-        }
-        uint8_t byte = 0;
-        if (Read(&byte, 1) != 1 && eof())
-        {
-            return nullptr;
-        }
-        if (!isFirst)
-        {
-            bufs.push_back(byte);
-        }
-        next_24_bits = (next_24_bits << 8) | byte;
-        next_24_bits = next_24_bits & 0xFFFFFF;
-    }
-    Seek(Tell() - 3);
-    if (bufs.size() >= 3)
-    {
-        bufs.resize(bufs.size() - 3);
-        if (!bufs.empty() && bufs[bufs.size()-1] == 0)
-        {
-            bufs.pop_back();
-        }
-    }
-    std::shared_ptr<ImmutableVectorAllocateMethod<uint8_t>> alloc = std::make_shared<ImmutableVectorAllocateMethod<uint8_t>>();
-    alloc->container.swap(bufs);
-    return std::make_shared<NormalPack>(alloc->container.size(), alloc);
-}
-
-RkCacheFileByteReader::RkCacheFileByteReader(const std::string& path)
-{
-    _ifs.open(path, std::ios::in | std::ios::binary);
-    if (!_ifs.is_open())
-    {
-        assert(false);
-        exit(255);
-    }
-    _buf = new uint8_t[kBufSize];
-    _offset = _ifs.tellg();
-    _ifs.read((char*)_buf, kBufSize);
-    _cur = 0;
-    _len = _ifs.gcount();
-}
-
-RkCacheFileByteReader::~RkCacheFileByteReader()
-{
-    delete[] _buf;
-    _ifs.close();
-}
-
-size_t RkCacheFileByteReader::Read(void* data, size_t bytes)
-{
-    if (_cur + bytes <= _len)
-    {
-        memcpy(data, _buf + _cur, bytes);
-        _cur += bytes;
-        return bytes;
-    }
-    else if (_ifs.eof())
-    {
-        memcpy(data, _buf + _cur, _len -  _cur);
-        return _len -  _cur;
-    }
-    else
-    {
-        _offset = _ifs.tellg();
-        _ifs.read((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount();
-        if (_len == 0) /* eof */
-        {
-            return 0;
-        }
-        else
-        {
-            return Read(data, bytes);
-        }
-    }
-}
-
-bool RkCacheFileByteReader::Seek(size_t offset)
-{
-    if (offset < _offset)
-    {
-        _ifs.seekg(offset);
-        _offset = _ifs.tellg();
-        _ifs.readsome((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount(); 
-        return _offset == offset;
-    }
-    else if (offset > _offset + kBufSize)
-    {
-        _ifs.seekg(offset);
-        _offset = _ifs.tellg();
-        _ifs.readsome((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount(); 
-        return _offset == offset;
-    }
-    else
-    {
-        _cur = offset - _offset;
-        return true;
-    }
-}
-
-size_t RkCacheFileByteReader::Tell()
-{
-    return _offset + _cur;
-}
-
-bool RkCacheFileByteReader::eof()
-{
-    return _len == 0 || (_ifs.eof() && _cur == _len);
-}
+constexpr uint32_t kFrameEdgeCapacity = 2;
 
 /**
  * @sa MMP-Core/Extension/poco/Util/samples/SampleApp/src/SampleApp.cpp 
@@ -193,19 +44,30 @@ private:
     void HandleInput(const std::string& name, const std::string& value);
     void HandleShow(const std::string& name, const std::string& value);
     void HandleFps(const std::string& name, const std::string& value);
+    void HandleTimestamps(const std::string& name, const std::string& value);
+    void HandlePacing(const std::string& name, const std::string& value);
+    void HandleFirstFrameDeadline(const std::string& name, const std::string& value);
+    void HandleStartupReport(const std::string& name, const std::string& value);
+    void HandlePlacement(const std::string& name, const std::string& value);
     void displayHelp();
 public:
     std::string              decoderClassName;
+    H26xCodec                codec;
     std::string              inputFile;
     bool                     show;
     uint64_t                 fps;
+    std::string              timestampsFile;
+    bool                     dropLate;
     size_t                   loopTime;
+    std::string              startupReportFile;
 };
 
 App::App()
 {
     show = true;
     fps = 30;
+    codec = H26xCodec::H264;
+    dropLate = true;
     loopTime = 0;
 }
 
@@ -241,6 +103,7 @@ void App::HandleCodecType(const std::string& name, const std::string& value)
     if (kLookup.count(value))
     {
         decoderClassName = kLookup[value];
+        H26xCodecFromName(value, codec);
     }
     else
     {
@@ -266,6 +129,48 @@ void App::HandleFps(const std::string& name, const std::string& value)
     fps = std::stoi(value);
 }
 
+void App::HandleTimestamps(const std::string& name, const std::string& value)
+{
+    timestampsFile = value;
+}
+
+void App::HandlePacing(const std::string& name, const std::string& value)
+{
+    static std::map<std::string, bool> kLookup = 
+    {
+        {"skip", true},
+        {"catchup", false}
+    };
+    if (kLookup.count(value))
+    {
+        dropLate = kLookup[value];
+    }
+    else
+    {
+        assert(false);
+        exit(-1);
+    }
+}
+
+void App::HandleFirstFrameDeadline(const std::string& name, const std::string& value)
+{
+    StartupProfiler::Instance()->SetDeadline(kStartupFirstFrame, std::stoull(value));
+}
+
+void App::HandleStartupReport(const std::string& name, const std::string& value)
+{
+    startupReportFile = value;
+}
+
+void App::HandlePlacement(const std::string& name, const std::string& value)
+{
+    if (!ThreadPlacement::Instance()->Load(value))
+    {
+        assert(false);
+        exit(-1);
+    }
+}
+
 void App::HandleInput(const std::string& name, const std::string& value)
 {
     inputFile = value;
@@ -276,7 +181,9 @@ void App::initialize(Application& self)
     loadConfiguration(); 
     ThreadPool::ThreadPoolSingleton()->Init();
     Application::initialize(self);
+    StartupProfiler::Instance()->Mark("Application::initialize");
     Codec::CodecConfig::Instance()->Init();
+    StartupProfiler::Instance()->Mark("CodecConfig::Init");
     AbstractLogger::LoggerSingleton()->Enable(AbstractLogger::Direction::CONSLOE);
 }
 
@@ -319,12 +226,42 @@ void App::defineOptions(OptionSet& options)
         .argument("[show]")
         .callback(OptionCallback<App>(this, &App::HandleShow))
     );
-    options.addOption(Option("fps", "fps", "显示帧率, default 30")
+    options.addOption(Option("fps", "fps", "显示帧率, 码流不包含 timing 信息时使用, default 30")
         .required(false)
         .repeatable(false)
         .argument("[num]")
         .callback(OptionCallback<App>(this, &App::HandleFps))
     );
+    options.addOption(Option("timestamps", "timestamps", "逐帧时间戳文件 (变帧率码流), 每行一个 access unit 的 pts (秒, 解码顺序), 见 RkCacheFileByteReader::LoadTimestamps")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleTimestamps))
+    );
+    options.addOption(Option("pacing", "pacing", "显示落后时的处理策略, 可选: skip (丢弃迟到帧), catchup; default skip")
+        .required(false)
+        .repeatable(false)
+        .argument("[policy]")
+        .callback(OptionCallback<App>(this, &App::HandlePacing))
+    );
+    options.addOption(Option("first_frame_deadline", "first_frame_deadline", "首帧 (显示或解码) 距进程启动的最大耗时(ms), 超出时返回非 0")
+        .required(false)
+        .repeatable(false)
+        .argument("[ms]")
+        .callback(OptionCallback<App>(this, &App::HandleFirstFrameDeadline))
+    );
+    options.addOption(Option("startup_report", "startup_report", "启动各阶段耗时导出为 CSV")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleStartupReport))
+    );
+    options.addOption(Option("placement", "placement", "线程放置策略配置文件, 每行 : [stage] = [cpus|big|little] [: SCHED_FIFO priority], stage 可选 : display, worker (执行器), blocking (执行器阻塞线程池)")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandlePlacement))
+    );
 }
 
 void App::defineProperty(const std::string& def)
@@ -345,25 +282,22 @@ void App::defineProperty(const std::string& def)
 
 int App::main(const ArgVec& args)
 {
+    StartupProfiler* profiler = StartupProfiler::Instance();
+    profiler->Mark("App::main");
     AbstractDisplay::ptr display;
-    Codec::AbstractDecoder::ptr decoder = Codec::DecoderFactory::DefaultFactory().CreateDecoder(decoderClassName);
+    // Hint : 解码器的创建与 Init/Start 在后台线程进行, 与显示、文件等初始化并行
+    CodecWarmPool<Codec::AbstractDecoder> decoderPool([this]() -> Codec::AbstractDecoder::ptr
+    {
+        return Codec::DecoderFactory::DefaultFactory().CreateDecoder(decoderClassName);
+    }, 1);
     {
         MMP_LOG_INFO << "Decoder config";
         MMP_LOG_INFO << "-- codec name : " << decoderClassName;
         MMP_LOG_INFO << "-- input :  " << inputFile;
         MMP_LOG_INFO << "-- display : " << (show ? "true" : "false");
         MMP_LOG_INFO << "-- fps : " << fps;
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
-
-
-    if (!decoder)
-    {
-        MMP_LOG_INFO << "Rebuild with -DUSE_ROCKCHIP=ON, see README for detail.";
-        return 0;
+        MMP_LOG_INFO << "-- pacing : " << (dropLate ? "skip" : "catchup");
     }
-    decoder->Init();
-    decoder->Start();
 
     if (show)
     {
@@ -372,69 +306,118 @@ int App::main(const ArgVec& args)
     if (display)
     {
         display->Init();
+        profiler->Mark("Display::Init");
+    }
+    RkCacheFileByteReader::ptr byteReader = std::make_shared<RkCacheFileByteReader>(inputFile, codec);
+    profiler->Mark("input open");
+
+    bool warm = false;
+    Codec::AbstractDecoder::ptr decoder = decoderPool.Lease(&warm);
+    profiler->Mark(warm ? "decoder lease (warm)" : "decoder lease (cold)");
+    // Hint : 单路解码无需保留备用实例
+    decoderPool.SetCapacity(0);
+    if (!decoder)
+    {
+        MMP_LOG_INFO << "Rebuild with -DUSE_ROCKCHIP=ON, see README for detail.";
+        return 0;
     }
-    std::shared_ptr<RkCacheFileByteReader> byteReader = std::make_shared<RkCacheFileByteReader>(inputFile);
-    NormalPack::ptr pack = nullptr;
+    byteReader->SetFrameRate((uint32_t)fps);
+    if (!timestampsFile.empty() && !byteReader->LoadTimestamps(timestampsFile))
+    {
+        MMP_LOG_WARN << "Load timestamps fail, path is: " << timestampsFile;
+    }
+    PtsReorderQueue reorderQueue;
+    PresentationScheduler scheduler(1000000 / fps);
 
     //
     // Input File Read -> VDEC PUSH
     //                    VDEC POP -> Display Show
     //
+    Pipeline pipeline("decoder");
+    PipelineEdge<NormalPack::ptr>::ptr packs = pipeline.CreateEdge<NormalPack::ptr>("nal", kNalEdgeCapacity, PipelineEdgePolicy::BLOCK, kNalEdgeBytes);
+    PipelineEdge<AbstractFrame::ptr>::ptr frames = pipeline.CreateEdge<AbstractFrame::ptr>("frame", kFrameEdgeCapacity);
 
-    /***************************************** 渲染线程(Begin) ****************************************/
-    std::atomic<bool> running(true);
-    std::atomic<bool> sync(false);
-    Promise<void>::ptr displayTask = std::make_shared<Promise<void>>([&]()
+    /*********************************** 读取(Begin) ******************************/
+    size_t currentLoopTime = 0;
+    // loopTime = 120; // for quick exit debug
+    pipeline.AddSource("reader", packs, [&](NormalPack::ptr& pack) -> bool
+    {
+        if (loopTime != 0 && currentLoopTime >= loopTime)
+        {
+            return false;
+        }
+        pack = byteReader->GetNalUint();
+        if (!pack)
+        {
+            return false;
+        }
+        currentLoopTime++;
+        MMP_LOG_INFO << "AbstractDisplay Push";
+        reorderQueue.Push(pack);
+        if (currentLoopTime == 1)
+        {
+            profiler->Mark("first NAL pushed");
+        }
+        return true;
+    }, true);
+    /*********************************** 读取(End) ******************************/
+    CodecNodeStats::ptr decoderStats = AddDecoderNode(pipeline, decoder, codec, packs, frames);
+    /***************************************** 渲染(Begin) ****************************************/
+    bool first = true;
+    bool firstDecoded = false;
+    bool firstShown = false;
+    // Hint : 按时间戳等待呈现, 独占线程
+    pipeline.AddNode("display", [&]()
     {
-        uint64_t intervalMs = 1000 / fps;
-        Poco::Stopwatch sw;
-        sw.start();
-        bool first = true;
-        while (running)
+        AbstractFrame::ptr frame;
+        while (frames->Pop(frame))
         {
-            AbstractFrame::ptr frame;
-            if (decoder->Pop(frame))
+            if (!firstDecoded)
             {
-                MMP_LOG_INFO << "AbstractDisplay Pop";
-                Codec::StreamFrame::ptr streamFrame = std::dynamic_pointer_cast<Codec::StreamFrame>(frame);
-                if (display && first)
+                profiler->Mark("first frame decoded");
+                if (!display)
                 {
-                    display->Open(streamFrame->info);
-                    first = false;
+                    profiler->Mark(kStartupFirstFrame);
                 }
-                if (display)
+                firstDecoded = true;
+            }
+            int64_t pts = reorderQueue.Pop();
+            MMP_LOG_INFO << "AbstractDisplay Pop, pts is: " << pts;
+            Codec::StreamFrame::ptr streamFrame = std::dynamic_pointer_cast<Codec::StreamFrame>(frame);
+            if (display && first)
+            {
+                display->Open(streamFrame->info);
+                profiler->Mark("Display::Open");
+                first = false;
+            }
+            if (display)
+            {
+                // Hint : 按码流时间戳呈现, 而非固定帧率
+                if (scheduler.Wait(pts) || !dropLate)
                 {
                     display->UpdateWindow((const uint32_t*)streamFrame->GetData(0));
-                    if (intervalMs > sw.elapsed() / 1000)
+                    if (!firstShown)
                     {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs - sw.elapsed() / 1000));
+                        profiler->Mark(kStartupFirstFrame);
+                        firstShown = true;
                     }
-                    else
-                    {
-                        MMP_LOG_WARN << "Process too slow!!!";
-                    }                    
-                    sw.restart();
+                }
+                else
+                {
+                    MMP_LOG_WARN << "Process too slow!!!";
                 }
             }
-            sync = true;
-        } 
-    });
-    ThreadPool::ThreadPoolSingleton()->Commit(displayTask);
-    /***************************************** 渲染线程(End) ****************************************/
-    /*********************************** 解码线程(Begin) ******************************/
-    size_t currentLoopTime = 0;
-    // loopTime = 120; // for quick exit debug
-    do
-    {
-        pack = byteReader->GetNalUint();
-        if (pack)
-        {
-            currentLoopTime++;
-            MMP_LOG_INFO << "AbstractDisplay Push";
-            decoder->Push(pack);
         }
-    } while (pack && (loopTime == 0 || currentLoopTime < loopTime));
-    /*********************************** 解码线程(End) ******************************/
+    }, {frames}, {});
+    /***************************************** 渲染(End) ****************************************/
+
+    pipeline.Start();
+    pipeline.Wait();
+    MMP_LOG_INFO << scheduler.Report();
+    MMP_LOG_INFO << reorderQueue.Report();
+    MMP_LOG_INFO << pipeline.Report();
+    MMP_LOG_INFO << "Decoder " << decoderStats->Report();
+    MMP_LOG_INFO << WorkStealingExecutor::Instance()->Report();
 
     if (display)
     {
@@ -442,15 +425,16 @@ int App::main(const ArgVec& args)
         display->UnInit();
     }
 
-    running = false;
-    while (!sync)
-    {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
-
     decoder->Stop();
     decoder->Uninit();
-    return 0;
+
+    MMP_LOG_INFO << profiler->Report();
+    MMP_LOG_INFO << ThreadPlacement::Instance()->Report();
+    if (!startupReportFile.empty() && !profiler->Export(startupReportFile))
+    {
+        MMP_LOG_WARN << "Export startup report fail, path is: " << startupReportFile;
+    }
+    return profiler->Check() ? 0 : -1;
 }
 
 /********************************************************* TEST(END) *****************************************************/
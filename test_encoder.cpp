@@ -8,10 +8,21 @@
 #include "Common/DmaHeapAllocateMethod.h"
 #include "Codec/CodecConfig.h"
 #include "Codec/CodecFactory.h"
+#include "Utility/Pipeline.h"
+#include "Utility/PipelineCodec.h"
+#include "Utility/AsyncFileWriter.h"
+#include "Utility/RawVideoReader.h"
+#include "Utility/DmaBufFence.h"
+#include "Utility/FramePool.h"
+#include "Utility/TestPatternGenerator.h"
+#include "Utility/MockCodec.h"
 
 using namespace Mmp;
 using namespace Poco::Util;
 
+constexpr uint32_t kFrameEdgeCapacity = 2;
+constexpr int32_t  kFramePoolTimeoutMs = 1000;
+
 /**
  * @sa MMP-Core/Extension/poco/Util/samples/SampleApp/src/SampleApp.cpp 
  */
@@ -37,9 +48,24 @@ private:
     void HandleOutput(const std::string& name, const std::string& value);
     void HandleGop(const std::string& name, const std::string& value);
     void HandleMemType(const std::string& name, const std::string& value);
+    void HandleFps(const std::string& name, const std::string& value);
+    void HandleAdaptiveBitrate(const std::string& name, const std::string& value);
+    void HandleTargetBandwidth(const std::string& name, const std::string& value);
+    void HandleInput(const std::string& name, const std::string& value);
+    void HandleInputFormat(const std::string& name, const std::string& value);
+    void HandleInputLoop(const std::string& name, const std::string& value);
+    void HandleBuffers(const std::string& name, const std::string& value);
+    void HandlePrefetch(const std::string& name, const std::string& value);
+    void HandlePattern(const std::string& name, const std::string& value);
+    void HandlePatternThreads(const std::string& name, const std::string& value);
+    void HandleLatencyProbe(const std::string& name, const std::string& value);
+    void HandleLatencyLog(const std::string& name, const std::string& value);
+    void HandleMock(const std::string& name, const std::string& value);
     void displayHelp();
 public:
     std::string              decoderClassName;
+    std::string              probeDecoderClassName; // 延迟探测用的解码器
+    H26xCodec                codec;
     uint32_t                 gop;
     Codec::RateControlMode   rcMode;
     uint64_t                 bps;
@@ -48,11 +74,34 @@ public:
     uint64_t                 loopTime;
     std::string              outputFile;
     uint32_t                 memtype;
+    uint32_t                 fps;
+    bool                     adaptiveBitrate;
+    uint64_t                 targetBandwidth; // 0 表示不限制
+    std::string              inputFile;       // 为空时使用合成的纯色帧
+    std::string              inputFormat;     // 为空时按扩展名推断
+    bool                     inputLoop;       // 输入文件读完后从头循环
+    uint32_t                 bufferNum;       // 0 表示按队列与编码器在途帧数推算
+    uint32_t                 prefetchFrames;
+    std::string              patternName;     // 为空时使用合成的纯色帧
+    uint32_t                 patternThreads;
+    bool                     latencyProbe;
+    std::string              latencyLogFile;
+    bool                     mock;            // 使用软件 mock 编解码器 (CI)
 };
 
 App::App()
 {
     memtype = 0;
+    fps = 30;
+    adaptiveBitrate = false;
+    targetBandwidth = 0;
+    inputLoop = false;
+    bufferNum = 0;
+    prefetchFrames = 4;
+    patternThreads = 1;
+    latencyProbe = false;
+    mock = false;
+    codec = H26xCodec::H264;
     bps = 4 * 1024 * 1024;
     gop = 60;
     rcMode = Codec::RateControlMode::CBR;
@@ -94,6 +143,8 @@ void App::HandleCodecType(const std::string& name, const std::string& value)
     if (kLookup.count(value))
     {
         decoderClassName = kLookup[value];
+        H26xCodecFromName(value, codec);
+        probeDecoderClassName = value == "hevc" ? "RKH265Decoder" : (value == "h264" ? "RKH264Decoder" : "");
     }
     else
     {
@@ -127,6 +178,97 @@ void App::HandleBps(const std::string& name, const std::string& value)
     bps = std::stoi(value);
 }
 
+void App::HandleFps(const std::string& name, const std::string& value)
+{
+    fps = std::stoi(value);
+}
+
+void App::HandleAdaptiveBitrate(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        adaptiveBitrate = true;
+    }
+}
+
+void App::HandleTargetBandwidth(const std::string& name, const std::string& value)
+{
+    targetBandwidth = std::stoull(value);
+    adaptiveBitrate = true;
+}
+
+void App::HandleInput(const std::string& name, const std::string& value)
+{
+    inputFile = value;
+}
+
+void App::HandleInputFormat(const std::string& name, const std::string& value)
+{
+    RawVideoFormat format;
+    if (!RawVideoFormatFromName(value, format))
+    {
+        assert(false);
+        exit(-1);
+    }
+    inputFormat = value;
+}
+
+void App::HandleInputLoop(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        inputLoop = true;
+    }
+}
+
+void App::HandleBuffers(const std::string& name, const std::string& value)
+{
+    bufferNum = std::stoi(value);
+}
+
+void App::HandlePrefetch(const std::string& name, const std::string& value)
+{
+    prefetchFrames = std::stoi(value);
+}
+
+void App::HandlePattern(const std::string& name, const std::string& value)
+{
+    TestPattern pattern;
+    if (!TestPatternFromName(value, pattern))
+    {
+        assert(false);
+        exit(-1);
+    }
+    patternName = value;
+}
+
+void App::HandlePatternThreads(const std::string& name, const std::string& value)
+{
+    patternThreads = std::stoi(value);
+}
+
+void App::HandleLatencyProbe(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        latencyProbe = true;
+    }
+}
+
+void App::HandleMock(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        mock = true;
+    }
+}
+
+void App::HandleLatencyLog(const std::string& name, const std::string& value)
+{
+    latencyLogFile = value;
+    latencyProbe = true;
+}
+
 void App::HandleWidth(const std::string& name, const std::string& value)
 {
     width = std::stol(value);
@@ -229,6 +371,84 @@ void App::defineOptions(OptionSet& options)
         .argument("[type]")
         .callback(OptionCallback<App>(this, &App::HandleMemType))
     );
+    options.addOption(Option("fps", "fps", "帧率, 用于换算输出码率, default 30")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleFps))
+    );
+    options.addOption(Option("adaptive_bitrate", "adaptive_bitrate", "是否按输出码率与写入队列动态调整码率 (-bps 为上限), 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleAdaptiveBitrate))
+    );
+    options.addOption(Option("target_bandwidth", "target_bandwidth", "目标带宽 (bit/s), 输出码率超出时下调码率, 指定后启用 -adaptive_bitrate")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleTargetBandwidth))
+    );
+    options.addOption(Option("input", "i", "输入的原始视频文件 (NV12 / I420 / Y4M), 读到文件结束为止; 不指定时编码合成的纯色帧")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleInput))
+    );
+    options.addOption(Option("input_format", "input_format", "输入文件格式, 可选 : nv12, i420, y4m, default 按扩展名 (.y4m 为 y4m, 其余为 nv12)")
+        .required(false)
+        .repeatable(false)
+        .argument("[format]")
+        .callback(OptionCallback<App>(this, &App::HandleInputFormat))
+    );
+    options.addOption(Option("input_loop", "input_loop", "输入文件读完后从头循环, 送入的帧数与不指定 -input 时相同, 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleInputLoop))
+    );
+    options.addOption(Option("pattern", "pattern", "编码运动测试图案 (不读取文件), 可选 : bars, zoneplate, noise, mix")
+        .required(false)
+        .repeatable(false)
+        .argument("[pattern]")
+        .callback(OptionCallback<App>(this, &App::HandlePattern))
+    );
+    options.addOption(Option("pattern_threads", "pattern_threads", "生成测试图案的线程数, default 1")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandlePatternThreads))
+    );
+    options.addOption(Option("mock", "mock", "是否使用软件 mock 编解码器 (不依赖硬件, 输出可作为 test_transcode -mock 的输入), 用于 CI, 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleMock))
+    );
+    options.addOption(Option("latency_probe", "latency_probe", "是否在送编码的帧中写入条码, 解码编码输出后统计延迟与丢帧, 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleLatencyProbe))
+    );
+    options.addOption(Option("latency_log", "latency_log", "逐帧的延迟导出为 CSV, 指定后启用 -latency_probe")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleLatencyLog))
+    );
+    options.addOption(Option("buffers", "buffers", "输入帧 (-input, -pattern) 的 buffer 数, default 队列容量 + 编码器在途帧数 + 2")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleBuffers))
+    );
+    options.addOption(Option("prefetch", "prefetch", "输入文件预读的帧数, 0 表示不预读, default 4")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandlePrefetch))
+    );
 }
 
 void App::defineProperty(const std::string& def)
@@ -249,12 +469,67 @@ void App::defineProperty(const std::string& def)
 
 int App::main(const ArgVec& args)
 {
+    if (mock)
+    {
+        RegisterMockCodecs();
+        decoderClassName = MockCodecClassName(decoderClassName);
+        probeDecoderClassName = MockCodecClassName(probeDecoderClassName);
+    }
     Codec::AbstractEncoder::ptr encoder = Codec::EncoderFactory::DefaultFactory().CreateEncoder(decoderClassName);
     if (!encoder)
     {
         MMP_LOG_INFO << "Rebuild with -DUSE_ROCKCHIP=ON, see README for detail.";
         return 0;
     }
+    // Hint : 帧队列与编码器内部可同时持有的帧数之外再留出 2 个, 读取或生成不必等待 buffer 归还
+    uint32_t buffers = bufferNum ? bufferNum : kFrameEdgeCapacity + kEncoderNodeMaxInflight + 2;
+    RawVideoReader::ptr reader;
+    if (!inputFile.empty())
+    {
+        RawVideoFormat format = RawVideoFormat::NV12;
+        if (!inputFormat.empty())
+        {
+            RawVideoFormatFromName(inputFormat, format);
+        }
+        else if (inputFile.size() >= 4 && inputFile.compare(inputFile.size() - 4, 4, ".y4m") == 0)
+        {
+            format = RawVideoFormat::Y4M;
+        }
+        reader = std::make_shared<RawVideoReader>(inputFile, format, width, height, buffers, memtype == 1, prefetchFrames);
+        if (!reader->IsOpen())
+        {
+            MMP_LOG_ERROR << "Open input " << inputFile << " fail";
+            return -1;
+        }
+        width = reader->Width();
+        height = reader->Height();
+        uint32_t fpsNum = 0, fpsDen = 0;
+        if (reader->GetFrameRate(fpsNum, fpsDen))
+        {
+            fps = std::max<uint32_t>(1, (fpsNum + fpsDen / 2) / fpsDen);
+        }
+    }
+    Codec::AbstractDecoder::ptr probeDecoder;
+    LatencyProbe::ptr probe;
+    if (latencyProbe)
+    {
+        probeDecoder = Codec::DecoderFactory::DefaultFactory().CreateDecoder(probeDecoderClassName);
+        if (probeDecoder)
+        {
+            probeDecoder->Init();
+            probeDecoder->Start();
+            probe = std::make_shared<LatencyProbe>();
+            if (!reader && patternName.empty())
+            {
+                // Hint : 纯色帧的每一帧为同一个 buffer, 无法逐帧写入条码, 改用测试图案
+                patternName = "mix";
+            }
+        }
+        else
+        {
+            MMP_LOG_WARN << "Create " << probeDecoderClassName << " fail, latency probe is disabled";
+        }
+    }
     {
         MMP_LOG_INFO << "Encoder config";
         MMP_LOG_INFO << "-- codec name : " << decoderClassName;
@@ -265,6 +540,18 @@ int App::main(const ArgVec& args)
         MMP_LOG_INFO << "-- height : " << height;
         MMP_LOG_INFO << "-- output : " << outputFile;
         MMP_LOG_INFO << "-- memtype : " << memtype;
+        MMP_LOG_INFO << "-- fps : " << fps;
+        MMP_LOG_INFO << "-- adaptive bitrate : " << (adaptiveBitrate ? "true" : "false");
+        MMP_LOG_INFO << "-- target bandwidth : " << targetBandwidth;
+        if (reader)
+        {
+            MMP_LOG_INFO << "-- input : " << inputFile << " (" << reader->FrameNum() << " frames)";
+        }
+        else if (!patternName.empty())
+        {
+            MMP_LOG_INFO << "-- pattern : " << patternName << " (" << patternThreads << " threads)";
+        }
+        MMP_LOG_INFO << "-- latency probe : " << (probe ? "true" : "false");
     }
     {
         encoder->SetParameter(rcMode, Codec::kRateControlMode);
@@ -274,86 +561,212 @@ int App::main(const ArgVec& args)
     encoder->Init();
     encoder->Start();
 
-    Codec::StreamFrame::ptr rgbFrame = std::make_shared<Codec::StreamFrame>(PixelsInfo(width, height, 8, PixelFormat::RGB888));
-    AbstractAllocateMethod::ptr alloc;
-    if (memtype == 1)
+    Codec::StreamFrame::ptr yuvFrame;
+    FramePool::ptr patternPool;
+    TestPatternGenerator::ptr patternGenerator;
+    if (!reader && !patternName.empty())
     {
-        //
-        // Hint : DMA-HEAP 是一种特殊的内存分配方式
-        // See also : MMP-Core/Common/DmaHeapAllocateMethod.cpp
-        //
-        alloc = std::make_shared<DmaHeapAllocateMethod>();
+        TestPattern pattern = TestPattern::MIX;
+        TestPatternFromName(patternName, pattern);
+        patternPool = std::make_shared<FramePool>(PixelsInfo(width, height, 8, PixelFormat::NV12), buffers, memtype == 1);
+        patternGenerator = std::make_shared<TestPatternGenerator>(width, height, pattern, patternThreads);
     }
-    Codec::StreamFrame::ptr yuvFrame = std::make_shared<Codec::StreamFrame>(PixelsInfo(width, height, 8, PixelFormat::NV12), alloc);
-    // Init RGB
+    else if (!reader)
     {
-        uint8_t* rgbImage = (uint8_t*)rgbFrame->GetData(0);
-        uint32_t offset = 0;
-        for (uint32_t i=0; i<width*height; i++)
+        Codec::StreamFrame::ptr rgbFrame = std::make_shared<Codec::StreamFrame>(PixelsInfo(width, height, 8, PixelFormat::RGB888));
+        AbstractAllocateMethod::ptr alloc;
+        if (memtype == 1)
         {
-            rgbImage[offset++] = 0x66;
-            rgbImage[offset++] = 0xCC;
-            rgbImage[offset++] = 0xFF;
+            //
+            // Hint : DMA-HEAP 是一种特殊的内存分配方式
+            // See also : MMP-Core/Common/DmaHeapAllocateMethod.cpp
+            //
+            alloc = std::make_shared<DmaHeapAllocateMethod>();
         }
-    }
-    // RGB TO NV12
-    {
-        uint8_t* rgbImage = (uint8_t*)rgbFrame->GetData(0);
-        uint8_t* yuvImage = (uint8_t*)yuvFrame->GetData(0);
-        uint64_t imageSize = width * height;
-        uint64_t rgbIndex = 0;
-        uint64_t yIndex = 0;
-        uint64_t uvIndex = imageSize;
-        for (uint64_t y = 0; y < height; y++) 
+        yuvFrame = std::make_shared<Codec::StreamFrame>(PixelsInfo(width, height, 8, PixelFormat::NV12), alloc);
+        // Init RGB
         {
-            for (uint64_t x = 0; x < width; x++) 
+            uint8_t* rgbImage = (uint8_t*)rgbFrame->GetData(0);
+            uint32_t offset = 0;
+            for (uint32_t i=0; i<width*height; i++)
             {
-                uint8_t R = rgbImage[rgbIndex++];
-                uint8_t G = rgbImage[rgbIndex++];
-                uint8_t B = rgbImage[rgbIndex++];
+                rgbImage[offset++] = 0x66;
+                rgbImage[offset++] = 0xCC;
+                rgbImage[offset++] = 0xFF;
+            }
+        }
+        // RGB TO NV12
+        {
+            uint8_t* rgbImage = (uint8_t*)rgbFrame->GetData(0);
+            uint8_t* yuvImage = (uint8_t*)yuvFrame->GetData(0);
+            uint64_t imageSize = width * height;
+            uint64_t rgbIndex = 0;
+            uint64_t yIndex = 0;
+            uint64_t uvIndex = imageSize;
+            for (uint64_t y = 0; y < height; y++) 
+            {
+                for (uint64_t x = 0; x < width; x++) 
+                {
+                    uint8_t R = rgbImage[rgbIndex++];
+                    uint8_t G = rgbImage[rgbIndex++];
+                    uint8_t B = rgbImage[rgbIndex++];
 #if 1 // BT709
-                uint8_t Y = 0.2126 * R + 0.7152 * G + 0.0722 * B;
-                uint8_t U = -0.1146 * R - 0.3854 * G + 0.5 * B + 128;
-                uint8_t V = 0.5 * R - 0.4542 * G - 0.0458 * B + 128;
+                    uint8_t Y = 0.2126 * R + 0.7152 * G + 0.0722 * B;
+                    uint8_t U = -0.1146 * R - 0.3854 * G + 0.5 * B + 128;
+                    uint8_t V = 0.5 * R - 0.4542 * G - 0.0458 * B + 128;
 #else // BT601
-                uint8_t Y = 0.299 * R + 0.587 * G + 0.114 * B;
-                uint8_t U = -0.169 * R - 0.331 * G + 0.5 * B + 128;
-                uint8_t V = 0.5 * R - 0.419 * G - 0.081 * B + 128;
+                    uint8_t Y = 0.299 * R + 0.587 * G + 0.114 * B;
+                    uint8_t U = -0.169 * R - 0.331 * G + 0.5 * B + 128;
+                    uint8_t V = 0.5 * R - 0.419 * G - 0.081 * B + 128;
 #endif
-                yuvImage[yIndex++] = Y;
-                if (y % 2 == 0 && x % 2 == 0) 
-                {
+                    yuvImage[yIndex++] = Y;
+                    if (y % 2 == 0 && x % 2 == 0) 
+                    {
 
-                    yuvImage[uvIndex++] = U;
-                    yuvImage[uvIndex++] = V;
+                        yuvImage[uvIndex++] = U;
+                        yuvImage[uvIndex++] = V;
+                    }
                 }
             }
         }
-    }
 
-    std::ofstream ofs(outputFile);
-    for (uint64_t i=0; i<loopTime; i++)
+    }
+    //
+    // Frame Source -> VENC PUSH
+    //                 VENC POP -> Output File Write
+    //
+    Pipeline pipeline("encoder");
+    PipelineEdge<AbstractFrame::ptr>::ptr frames = pipeline.CreateEdge<AbstractFrame::ptr>("frame", kFrameEdgeCapacity);
+    PipelineEdge<AbstractPack::ptr>::ptr packs = pipeline.CreateEdge<AbstractPack::ptr>("pack", kPackEdgeCapacity, PipelineEdgePolicy::BLOCK, kPackEdgeBytes);
+    uint64_t frameIndex = 0;
+    pipeline.AddSource("source", frames, [&](AbstractFrame::ptr& frame) -> bool
     {
-        Poco::Stopwatch sw;
-        sw.start();
-        encoder->Push(yuvFrame);
-        // MMP_LOG_INFO << "Push , cur is: " << i << ", cost time is: " << sw.elapsed() / 1000 << " ms";
-        while (encoder->CanPop())
+        if (reader)
         {
-            AbstractPack::ptr pack;
-            if (encoder->Pop(pack))
+            if (inputLoop && frameIndex >= loopTime)
+            {
+                return false;
+            }
+            // Hint : 每次读取使用轮转池中的下一个 buffer, 编码器仍持有时等待其归还
+            frame = reader->Read();
+            if (!frame && inputLoop && frameIndex != 0)
+            {
+                reader->Rewind();
+                frame = reader->Read();
+            }
+            if (frame && probe)
             {
-                ofs.write((char*)pack->GetData(0), pack->GetSize());
-                // MMP_LOG_INFO << "Pop, addresss is: " << pack->GetData(0) << ", size is: " << pack->GetSize();
-            } 
+                DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(frame->GetAllocateMethod());
+                DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1, true);
+                probe->Stamp((uint8_t*)frame->GetData(0), width, width, height);
+            }
+            frameIndex += frame ? 1 : 0;
+            return frame != nullptr;
+        }
+        if (frameIndex >= loopTime)
+        {
+            return false;
+        }
+        if (patternGenerator)
+        {
+            Codec::StreamFrame::ptr patternFrame = patternPool->Acquire(kFramePoolTimeoutMs);
+            DmaHeapAllocateMethod::ptr alloc = std::dynamic_pointer_cast<DmaHeapAllocateMethod>(patternFrame->GetAllocateMethod());
+            DmaBufCpuAccess access(alloc ? alloc->GetFd() : -1, true);
+            patternGenerator->Generate(frameIndex, (uint8_t*)patternFrame->GetData(0), width);
+            if (probe)
+            {
+                probe->Stamp((uint8_t*)patternFrame->GetData(0), width, width, height);
+            }
+            frame = patternFrame;
+        }
+        else
+        {
+            frame = yuvFrame;
+        }
+        frameIndex++;
+        return true;
+    });
+    BitrateController::ptr bitrateController;
+    if (adaptiveBitrate)
+    {
+        bitrateController = std::make_shared<BitrateController>(bps, fps);
+        bitrateController->SetTargetBandwidth(targetBandwidth);
+    }
+    CodecNodeStats::ptr encoderStats = AddEncoderNode<AbstractFrame::ptr>(pipeline, encoder, frames, packs, [&](const AbstractFrame::ptr& frame) -> AbstractFrame::ptr
+    {
+        if (bitrateController)
+        {
+            ApplyBitrateControl("Encoder", encoder, bitrateController, packs);
         }
+        return frame;
+    });
+    // Hint : 启用延迟探测时编码输出经 latency_tee 分别送往写文件与探测用的解码器
+    PipelineEdge<AbstractPack::ptr>::ptr writerPacks = packs;
+    CodecNodeStats::ptr probeStats;
+    if (probe)
+    {
+        writerPacks = pipeline.CreateEdge<AbstractPack::ptr>("write", kPackEdgeCapacity, PipelineEdgePolicy::BLOCK, kPackEdgeBytes);
+        probeStats = AddLatencyProbeNode(pipeline, "encoder", probeDecoder, codec, packs, writerPacks, probe);
+    }
+    AsyncFileWriter writer(outputFile);
+    pipeline.AddSink("writer", writerPacks, [&](const AbstractPack::ptr& pack)
+    {
+        if (bitrateController)
+        {
+            bitrateController->OnPacket(pack->GetSize());
+        }
+        writer.Write(pack->GetData(0), pack->GetSize());
+        // MMP_LOG_INFO << "Pop, addresss is: " << pack->GetData(0) << ", size is: " << pack->GetSize();
+    }, [&writer]()
+    {
+        // Hint : 最后一个包写入后立即落盘, 不必等待其他节点
+        writer.Close();
+    }, true);
+    Poco::Stopwatch sw;
+    sw.start();
+    pipeline.Start();
+    pipeline.Wait();
+    MMP_LOG_INFO << "Encode " << encoderStats->poppedNum << " of " << encoderStats->pushedNum << " frames, cost time is: " << sw.elapsed() / 1000 << " ms";
+    // Hint : 硬件编码器可能将参数集作为单独的包输出, 包数可以多于帧数; mock 编码器每帧恰好一个包
+    bool complete = mock ? encoderStats->poppedNum == encoderStats->pushedNum : encoderStats->poppedNum >= encoderStats->pushedNum;
+    MMP_LOG_INFO << pipeline.Report();
+    MMP_LOG_INFO << "Encoder " << encoderStats->Report();
+    if (reader)
+    {
+        MMP_LOG_INFO << reader->Report();
     }
-    ofs.flush();
-    ofs.close();
+    if (patternGenerator)
+    {
+        MMP_LOG_INFO << patternGenerator->Report();
+        MMP_LOG_INFO << patternPool->Report();
+    }
+    if (probe)
+    {
+        MMP_LOG_INFO << "Probe decoder " << probeStats->Report();
+        MMP_LOG_INFO << probe->Report();
+        // Hint : 写入条码的每一帧都应被解码读到, 用于 CI 检查编码到解码全程不丢帧
+        complete = complete && probe->LostNum() == 0;
+        if (!latencyLogFile.empty() && !probe->Export(latencyLogFile))
+        {
+            MMP_LOG_WARN << "Export latency log fail, path is: " << latencyLogFile;
+        }
+    }
+    if (bitrateController)
+    {
+        MMP_LOG_INFO << bitrateController->Report();
+    }
+    MMP_LOG_INFO << WorkStealingExecutor::Instance()->Report();
+    MMP_LOG_INFO << writer.Report();
+    MMP_LOG_INFO << AsyncFileIo::Instance()->Report();
 
     encoder->Stop();
     encoder->Uninit();
-    return 0;
+    if (probeDecoder)
+    {
+        probeDecoder->Stop();
+        probeDecoder->Uninit();
+    }
+    return complete ? 0 : -1;
 }
 
 /********************************************************* TEST(END) *****************************************************/
@@ -0,0 +1,215 @@
+#include <mutex>
+#include <thread>
+#include <sstream>
+#include <condition_variable>
+#include <Poco/Util/Application.h>
+#include <Poco/Util/HelpFormatter.h>
+
+#include "Common/AbstractLogger.h"
+#include "Common/LogMessage.h"
+#include "Common/DmaHeapAllocateMethod.h"
+#include "GPU/GL/GLDrawContex.h"
+#include "GPU/Windows/AbstractWindows.h"
+#include "GPU/Windows/WindowFactory.h"
+#include "Codec/StreamFrame.h"
+
+#include "Utility/TextureImportCache.h"
+
+using namespace Mmp;
+using namespace Poco::Util;
+
+constexpr int kSkipReturnCode = 77; // 见 CMakeLists.txt SKIP_RETURN_CODE
+
+/**
+ * @brief  TextureImportCache 的检查: 同一块 DMA-BUF 导入两次命中缓存, buffer 释放后对应纹理被淘汰
+ * @note   不依赖 RK 硬件, 可在 Mesa surfaceless llvmpipe 下运行 (EGL_PLATFORM=surfaceless);
+ *         没有可用的 DMA heap 或 EGL 时跳过
+ * @sa     MMP-Core/Extension/poco/Util/samples/SampleApp/src/SampleApp.cpp
+ */
+class App : public Application
+{
+public:
+    App();
+public:
+    void defineOptions(OptionSet& options) override;
+protected:
+    void initialize(Application& self);
+    void uninitialize();
+    void reinitialize(Application& self);
+    int main(const ArgVec& args);
+private:
+    void HandleHelp(const std::string& name, const std::string& value);
+    void HandleWidth(const std::string& name, const std::string& value);
+    void HandleHeight(const std::string& name, const std::string& value);
+    void displayHelp();
+public:
+    uint32_t                 width;
+    uint32_t                 height;
+private:
+    std::thread              _renderThread;
+    std::mutex               _gpuInitedMtx;
+    std::condition_variable  _gpuInitedCond;
+    bool                     _gpuInited;
+    AbstractWindows::ptr     _window;
+    GLDrawContex::ptr        _draw;
+};
+
+App::App()
+{
+    width = 320;
+    height = 240;
+    _gpuInited = false;
+}
+
+void App::displayHelp()
+{
+    AbstractLogger::LoggerSingleton()->Enable(AbstractLogger::Direction::CONSLOE);
+    std::stringstream ss;
+    HelpFormatter helpFormatter(options());
+    helpFormatter.setWidth(1024);
+    helpFormatter.setCommand(commandName());
+    helpFormatter.setUsage("OPTIONS");
+    helpFormatter.setHeader("Simple program to check the DMA-BUF texture import cache using MMP-Core.");
+    helpFormatter.format(ss);
+    MMP_LOG_INFO << ss.str();
+    exit(0);
+}
+
+void App::HandleHelp(const std::string& name, const std::string& value)
+{
+    displayHelp();
+}
+
+void App::HandleWidth(const std::string& name, const std::string& value)
+{
+    width = std::stoi(value);
+}
+
+void App::HandleHeight(const std::string& name, const std::string& value)
+{
+    height = std::stoi(value);
+}
+
+void App::initialize(Application& self)
+{
+    loadConfiguration();
+    Application::initialize(self);
+    AbstractLogger::LoggerSingleton()->Enable(AbstractLogger::Direction::CONSLOE);
+    _renderThread = std::thread([this]() -> void
+    {
+        GLDrawContex::SetGPUBackendType(GPUBackend::OPENGL_ES);
+        _window = WindowFactory::DefaultFactory().createWindow("EGLWindowDefault");
+        if (_window)
+        {
+            _window->SetRenderMode(false);
+            _window->Open();
+            _window->BindRenderThread(true);
+            _draw = GLDrawContex::Instance();
+            _draw->SetWindows(_window);
+        }
+        {
+            std::lock_guard<std::mutex> lock(_gpuInitedMtx);
+            _gpuInited = true;
+            _gpuInitedCond.notify_all();
+        }
+        if (!_draw)
+        {
+            return;
+        }
+        _draw->ThreadStart();
+        while (_draw->ThreadFrame() != GpuTaskStatus::EXIT)
+        {
+        }
+        _draw->ThreadEnd();
+        _window->BindRenderThread(false);
+        _window->Close();
+    });
+    std::unique_lock<std::mutex> lock(_gpuInitedMtx);
+    _gpuInitedCond.wait(lock, [this]()
+    {
+        return _gpuInited;
+    });
+}
+
+void App::uninitialize()
+{
+    Application::uninitialize();
+    if (_draw)
+    {
+        _draw->ThreadStop();
+    }
+    _renderThread.join();
+}
+
+void App::reinitialize(Application& self)
+{
+    Application::reinitialize(self);
+}
+
+void App::defineOptions(OptionSet& options)
+{
+    Application::defineOptions(options);
+
+    options.addOption(Option("help", "help", "帮助")
+        .required(false)
+        .repeatable(false)
+        .callback(OptionCallback<App>(this, &App::HandleHelp))
+    );
+    options.addOption(Option("width", "width", "buffer 宽, default 320")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleWidth))
+    );
+    options.addOption(Option("height", "height", "buffer 高, default 240")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleHeight))
+    );
+}
+
+/********************************************************* TEST(BEGIN) *****************************************************/
+
+int App::main(const ArgVec& args)
+{
+    if (!_draw)
+    {
+        MMP_LOG_WARN << "EGL is not available, skip";
+        return kSkipReturnCode;
+    }
+    PixelsInfo info((int32_t)width, (int32_t)height, 8, PixelFormat::NV12);
+    DmaHeapAllocateMethod::ptr alloc = std::make_shared<DmaHeapAllocateMethod>();
+    Codec::StreamFrame::ptr frame = std::make_shared<Codec::StreamFrame>(info, alloc);
+    if (alloc->GetFd() < 0)
+    {
+        MMP_LOG_WARN << "DMA heap is not available, skip";
+        return kSkipReturnCode;
+    }
+    alloc = nullptr;
+    TextureImportCache cache(_draw, 4, GlTextureFlags::TEXTURE_EXTERNAL | GlTextureFlags::TEXTURE_YUV);
+    bool pass = true;
+    Texture::ptr first = cache.Acquire(frame, info);
+    Texture::ptr second = cache.Acquire(frame, info);
+    if (!first || first != second || cache.HitNum() != 1)
+    {
+        MMP_LOG_ERROR << "Second import of the same DMA-BUF missed the cache";
+        pass = false;
+    }
+    // Hint : 释放 buffer 后, 下一次 Acquire 时其纹理应被淘汰; 另一块 buffer 导入后缓存中只剩一项
+    first = nullptr;
+    second = nullptr;
+    frame = nullptr;
+    Codec::StreamFrame::ptr other = std::make_shared<Codec::StreamFrame>(info, std::make_shared<DmaHeapAllocateMethod>());
+    if (!cache.Acquire(other, info) || cache.Size() != 1 || cache.EvictNum() != 1)
+    {
+        MMP_LOG_ERROR << "Texture of the released DMA-BUF was not evicted";
+        pass = false;
+    }
+    MMP_LOG_INFO << cache.Report();
+    return pass ? 0 : -1;
+}
+
+/********************************************************* TEST(END) *****************************************************/
+
+POCO_APP_MAIN(App)
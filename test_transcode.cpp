@@ -1,174 +1,334 @@
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <functional>
 #include <fstream>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
 #include <Poco/Stopwatch.h>
 #include <Poco/Util/Application.h>
 #include <Poco/Util/HelpFormatter.h>
 
-#include "Common/Promise.h"
 #include "Common/AbstractLogger.h"
 #include "Common/LogMessage.h"
 #include "Common/ThreadPool.h"
 #include "Codec/StreamFrame.h"
 #include "Codec/CodecConfig.h"
 #include "Codec/CodecFactory.h"
-#include "Common/ImmutableVectorAllocateMethod.h"
+#include "Utility/RkCacheFileByteReader.h"
+#include "Utility/PresentationScheduler.h"
+#include "Utility/GopSegmenter.h"
+#include "Utility/CodecScheduler.h"
+#include "Utility/CodecWarmPool.h"
+#include "Utility/ThreadPlacement.h"
+#include "Utility/FrameClock.h"
+#include "Utility/Pipeline.h"
+#include "Utility/PipelineCodec.h"
+#include "Utility/AsyncFileWriter.h"
+#include "Utility/LoadShedder.h"
+#include "Utility/MockCodec.h"
 
 using namespace Mmp;
 using namespace Poco::Util;
 
-constexpr uint32_t kBufSize = 1024 * 1024;
+constexpr uint32_t kRenditionQueueDepth = 4;
+constexpr uint32_t kDecodeShedDepth = 8;                          // 实时模式下解码队列 (帧) 达到此深度时丢弃非参考帧
+constexpr uint32_t kEncodeShedDepth = kEncoderNodeMaxInflight + 1; // 实时模式下编码队列 (帧) 达到此深度时丢帧
 
 /**
- * @todo 好像挺烧 CPU, 用 `mmap` 并且优化 NAL UINT 的查找方式可能好一些
+ * @brief 一路编码输出 (rendition), 多路共享同一份解码结果
  */
-class RkCacheFileByteReader
+class Rendition
 {
 public:
-    explicit RkCacheFileByteReader(const std::string& path);
-    ~RkCacheFileByteReader();
+    using ptr = std::shared_ptr<Rendition>;
 public:
-    NormalPack::ptr GetNalUint();
+    std::string              encoderClassName;
+    std::string              outputFile;
+    uint32_t                 gop;
+    Codec::RateControlMode   rcMode;
+    uint64_t                 bps;
+    uint32_t                 fps = 0; // 目标输出帧率, 0 表示与输入一致
 public:
-    size_t Read(void* data, size_t bytes);
-    bool Seek(size_t offset);
-    size_t Tell();
-    bool eof();
-private:
-    std::ifstream _ifs;
-private:
-    uint8_t* _buf;
-    uint32_t _offset;
-    uint32_t _cur;
-    uint32_t _len;
+    Codec::AbstractEncoder::ptr encoder;
 };
 
-NormalPack::ptr RkCacheFileByteReader::GetNalUint()
+/**
+ * @brief 一个 VPU 处理单元, 每路码流从预热池中租用编解码器实例
+ */
+class CodecSlot
 {
-    std::vector<uint8_t> bufs;
-    bufs.reserve(1024 * 1024);
-    uint32_t next_24_bits = 0;
-    bool isFirst = true;
-    while (!(next_24_bits == 0x000001 && !isFirst))
+public:
+    using ptr = std::shared_ptr<CodecSlot>;
+public:
+    uint32_t                    index;
+public: /* statistics */
+    uint64_t                    jobNum = 0;
+    uint64_t                    busyNs = 0;
+};
+
+/**
+ * @brief 批量转码任务, 对应 manifest 中的一行
+ */
+class TranscodeJob
+{
+public:
+    using ptr = std::shared_ptr<TranscodeJob>;
+public:
+    uint32_t    index;
+    std::string inputFile;
+    std::string outputFile;
+};
+
+/**
+ * @brief  批量转码任务的执行状态
+ * @note   1 - 任务可在 IDR 边界拆分为多个部分 (part), 每个部分处理输入文件的一段字节范围, 在不同的 slot 上并行处理
+ *         2 - 输出按部分在文件中的位置顺序写出: 最靠前的未完成部分直接写文件, 其余部分缓存在内存中
+ */
+class TranscodeJobState
+{
+public:
+    using ptr = std::shared_ptr<TranscodeJobState>;
+public:
+    void AddPart(uint64_t beginOffset);
+    void RemovePart(uint64_t beginOffset);
+    void Write(uint64_t beginOffset, const void* data, size_t bytes);
+    /**
+     * @brief  部分完成
+     * @return 所有部分均已完成时返回 true
+     */
+    bool Finish(uint64_t beginOffset, uint64_t partFrameNum, uint64_t partEncodedNum);
+public:
+    TranscodeJob::ptr           job;
+    AsyncFileWriter::ptr        writer;
+    uint64_t                    beginNs = 0;
+public:
+    struct PartOutput
     {
-        if (next_24_bits == 0x000001)
-        {
-            isFirst = false;
-            bufs.push_back(0);
-            bufs.push_back(0);
-            bufs.push_back(0);
-            bufs.push_back(1);
-        }
-        uint8_t byte = 0;
-        if (Read(&byte, 1) != 1 && eof())
-        {
-            return nullptr;
-        }
-        if (!isFirst)
-        {
-            bufs.push_back(byte);
-        }
-        next_24_bits = (next_24_bits << 8) | byte;
-        next_24_bits = next_24_bits & 0xFFFFFF;
+        bool                 done = false;
+        std::vector<uint8_t> output;
+    };
+    std::mutex                  mtx;
+    std::map<uint64_t, PartOutput> parts; // 按起始偏移排序, 第一项为最靠前的未完成部分
+    uint32_t                    partNum = 0;
+    uint64_t                    frameNum = 0;
+    uint64_t                    encodedNum = 0;
+};
+
+void TranscodeJobState::AddPart(uint64_t beginOffset)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    parts[beginOffset] = PartOutput();
+    partNum++;
+}
+
+void TranscodeJobState::RemovePart(uint64_t beginOffset)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    parts.erase(beginOffset);
+    partNum--;
+}
+
+void TranscodeJobState::Write(uint64_t beginOffset, const void* data, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (beginOffset == parts.begin()->first)
+    {
+        writer->Write(data, bytes);
+    }
+    else
+    {
+        std::vector<uint8_t>& output = parts[beginOffset].output;
+        output.insert(output.end(), (const uint8_t*)data, (const uint8_t*)data + bytes);
     }
-    Seek(Tell() - 3);
-    if (bufs.size() >= 3)
+}
+
+bool TranscodeJobState::Finish(uint64_t beginOffset, uint64_t partFrameNum, uint64_t partEncodedNum)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    frameNum += partFrameNum;
+    encodedNum += partEncodedNum;
+    parts[beginOffset].done = true;
+    while (!parts.empty() && parts.begin()->second.done)
     {
-        bufs.resize(bufs.size() - 3);
-        if (!bufs.empty() && bufs[bufs.size()-1] == 0)
+        parts.erase(parts.begin());
+        // Hint : 成为最靠前部分之前缓存的输出先写出, 之后直接写文件
+        if (!parts.empty())
         {
-            bufs.pop_back();
+            std::vector<uint8_t>& output = parts.begin()->second.output;
+            writer->Write(output.data(), output.size());
+            output.clear();
         }
     }
-    std::shared_ptr<ImmutableVectorAllocateMethod<uint8_t>> alloc = std::make_shared<ImmutableVectorAllocateMethod<uint8_t>>();
-    alloc->container.swap(bufs);
-    return std::make_shared<NormalPack>(alloc->container.size(), alloc);
+    return parts.empty();
 }
 
-RkCacheFileByteReader::RkCacheFileByteReader(const std::string& path)
+/**
+ * @brief  批量转码任务的一个部分, 对应 CodecScheduler 中的一个任务, 处理输入文件 [beginOffset, endOffset) 范围的码流
+ * @note   拆分出的部分以参数集 + IDR 开始, 可独立解码; 其时间戳从 0 开始, 批量模式输出裸码流, 不受影响
+ */
+class TranscodeJobPart
 {
-    _ifs.open(path, std::ios::in | std::ios::binary);
-    if (!_ifs.is_open())
+public:
+    using ptr = std::shared_ptr<TranscodeJobPart>;
+public:
+    TranscodeJobPart(TranscodeJobState::ptr state, H26xCodec codec, uint32_t segmentFrames, uint64_t beginOffset, uint64_t endOffset);
+public:
+    /**
+     * @brief  读取下一个以 IDR 开始的分段
+     * @return 到达 endOffset 或文件尾时返回 nullptr
+     */
+    GopSegment::ptr NextSegment();
+    /**
+     * @brief  在剩余范围的中点之后查找 IDR, 从该 IDR 开始拆分出新的部分
+     * @return 剩余范围不足或找不到 IDR 时返回 nullptr
+     * @note   新的部分带上当前的参数集, 码流仅在开头出现一次参数集时也可独立解码; 本部分的 endOffset 由调用方在拆分成功后更新
+     */
+    TranscodeJobPart::ptr Split(uint64_t minBytes);
+    uint64_t CostKB();
+public:
+    TranscodeJobState::ptr       state;
+    H26xCodec                    codec;
+    uint32_t                     segmentFrames;
+    uint64_t                     beginOffset;
+    uint64_t                     endOffset;
+    RkCacheFileByteReader::ptr   byteReader;
+    GopSegmenter::ptr            segmenter;
+    std::vector<NormalPack::ptr> leadingPacks;  // 拆分时带上的参数集, 在第一个分段之前送入
+    std::map<uint8_t, NormalPack::ptr> parameterSets;
+};
+
+TranscodeJobPart::TranscodeJobPart(TranscodeJobState::ptr state, H26xCodec codec, uint32_t segmentFrames, uint64_t beginOffset, uint64_t endOffset)
+{
+    this->state = state;
+    this->codec = codec;
+    this->segmentFrames = segmentFrames;
+    this->beginOffset = beginOffset;
+    this->endOffset = endOffset;
+    byteReader = std::make_shared<RkCacheFileByteReader>(state->job->inputFile, codec);
+    if (beginOffset != 0)
     {
-        assert(false);
-        exit(255);
+        byteReader->Seek(beginOffset);
     }
-    _buf = new uint8_t[kBufSize];
-    _offset = _ifs.tellg();
-    _ifs.read((char*)_buf, kBufSize);
-    _cur = 0;
-    _len = _ifs.gcount();
+    segmenter = std::make_shared<GopSegmenter>(codec, segmentFrames);
 }
 
-RkCacheFileByteReader::~RkCacheFileByteReader()
+GopSegment::ptr TranscodeJobPart::NextSegment()
 {
-    delete[] _buf;
-    _ifs.close();
+    NormalPack::ptr pack = nullptr;
+    GopSegment::ptr segment = nullptr;
+    while (!segment && byteReader->Tell() < endOffset && (pack = byteReader->GetNalUint()))
+    {
+        const uint8_t* data = (const uint8_t*)pack->GetData(0);
+        if (H26xNal::IsParameterSet(codec, data, pack->GetSize()))
+        {
+            parameterSets[H26xNal::Type(codec, data, pack->GetSize())] = pack;
+        }
+        segment = segmenter->Push(pack);
+    }
+    return segment ? segment : segmenter->Flush();
 }
 
-size_t RkCacheFileByteReader::Read(void* data, size_t bytes)
+TranscodeJobPart::ptr TranscodeJobPart::Split(uint64_t minBytes)
 {
-    if (_cur + bytes <= _len)
+    uint64_t offset = byteReader->Tell();
+    if (endOffset <= offset || endOffset - offset < 2 * minBytes)
     {
-        memcpy(data, _buf + _cur, bytes);
-        _cur += bytes;
-        return bytes;
+        return nullptr;
     }
-    else if (_ifs.eof())
+    // Hint : 第一个 NAL 从中点截断, 从其后的起始码开始查找; IDR 之前紧邻的非 VCL NAL (参数集、SEI 等) 归属于拆分出的部分
+    RkCacheFileByteReader scanner(state->job->inputFile, codec);
+    if (!scanner.Seek(offset + (endOffset - offset) / 2) || !scanner.GetNalUint())
     {
-        memcpy(data, _buf + _cur, _len -  _cur);
-        return _len -  _cur;
+        return nullptr;
     }
-    else
+    uint64_t splitOffset = 0;
+    bool leadingNonVcl = false;
+    while (true)
     {
-        _offset = _ifs.tellg();
-        _ifs.read((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount();
-        if (_len == 0) /* eof */
+        uint64_t nalOffset = scanner.Tell();
+        NormalPack::ptr pack = nalOffset < endOffset ? scanner.GetNalUint() : nullptr;
+        if (!pack)
         {
-            return 0;
+            return nullptr;
         }
-        else
+        const uint8_t* data = (const uint8_t*)pack->GetData(0);
+        size_t size = pack->GetSize();
+        if (!H26xNal::IsVcl(codec, data, size))
         {
-            return Read(data, bytes);
+            splitOffset = leadingNonVcl ? splitOffset : nalOffset;
+            leadingNonVcl = true;
+            continue;
         }
+        if (H26xNal::IsFirstSliceOfPicture(codec, data, size) && H26xNal::IsIdr(codec, data, size))
+        {
+            splitOffset = leadingNonVcl ? splitOffset : nalOffset;
+            break;
+        }
+        leadingNonVcl = false;
+    }
+    TranscodeJobPart::ptr rest = std::make_shared<TranscodeJobPart>(state, codec, segmentFrames, splitOffset, endOffset);
+    for (const auto& parameterSet : parameterSets)
+    {
+        rest->leadingPacks.push_back(parameterSet.second);
     }
+    return rest;
 }
 
-bool RkCacheFileByteReader::Seek(size_t offset)
+uint64_t TranscodeJobPart::CostKB()
 {
-    if (offset < _offset)
+    uint64_t costKB = endOffset > beginOffset ? (endOffset - beginOffset) / 1024 : 0;
+    return costKB == 0 ? 1 : costKB;
+}
+
+static uint64_t FileSize(const std::string& path)
+{
+    std::ifstream ifs(path, std::ios::in | std::ios::binary | std::ios::ate);
+    return ifs.is_open() ? (uint64_t)ifs.tellg() : 0;
+}
+
+static bool EncoderClassNameFromCodec(const std::string& codecType, std::string& encoderClassName)
+{
+    static std::map<std::string, std::string> kLookup = 
     {
-        _ifs.seekg(offset);
-        _offset = _ifs.tellg();
-        _ifs.readsome((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount(); 
-        return _offset == offset;
-    }
-    else if (offset > _offset + kBufSize)
+        {"h264", "RKH264Encoder"},
+        {"hevc", "RKH265Encoder"},
+        {"vp8", ""}, // todo
+        {"vp9", ""}, // todo
+        {"av1", ""} // av1
+    };
+    if (kLookup.count(codecType))
     {
-        _ifs.seekg(offset);
-        _offset = _ifs.tellg();
-        _ifs.readsome((char*)_buf, kBufSize);
-        _cur = 0;
-        _len = _ifs.gcount(); 
-        return _offset == offset;
+        encoderClassName = kLookup[codecType];
+        return true;
     }
     else
     {
-        _cur = offset - _offset;
-        return true;
+        return false;
     }
 }
 
-size_t RkCacheFileByteReader::Tell()
+static bool RateControlModeFromName(const std::string& name, Codec::RateControlMode& rcMode)
 {
-    return _offset + _cur;
-}
-
-bool RkCacheFileByteReader::eof()
-{
-    return _len == 0 || (_ifs.eof() && _cur == _len);
+    static std::map<std::string, Codec::RateControlMode> kLookup = 
+    {
+        {"vbr", Codec::RateControlMode::VBR},
+        {"cbr", Codec::RateControlMode::CBR},
+        {"fixqp", Codec::RateControlMode::FIXQP},
+        {"avbr", Codec::RateControlMode::AVBR}
+    };
+    if (kLookup.count(name))
+    {
+        rcMode = kLookup[name];
+        return true;
+    }
+    else
+    {
+        return false;
+    }
 }
 
 /**
@@ -198,27 +358,84 @@ private:
     void HandleBps(const std::string& name, const std::string& value);
     void HandleGop(const std::string& name, const std::string& value);
     void HandleUseAFBC(const std::string& name, const std::string& value);
+    void HandleRealtime(const std::string& name, const std::string& value);
+    void HandleMock(const std::string& name, const std::string& value);
+    void HandleTimestamps(const std::string& name, const std::string& value);
+    void HandleAdaptiveBitrate(const std::string& name, const std::string& value);
+    void HandleTargetBandwidth(const std::string& name, const std::string& value);
+    void HandleRendition(const std::string& name, const std::string& value);
+    void HandleSegmentParallel(const std::string& name, const std::string& value);
+    void HandleSegmentFrames(const std::string& name, const std::string& value);
     void displayHelp();
+    void printHelp();
+    Rendition::ptr CreateRendition(const std::map<std::string, std::string>& fields);
+    void HandleManifest(const std::string& name, const std::string& value);
+    void HandleJobs(const std::string& name, const std::string& value);
+    void HandlePlacement(const std::string& name, const std::string& value);
+    bool CreateCodecPools(uint32_t slotNum);
+    /**
+     * @brief 输出数与输入数是否满足帧数守恒
+     * @note  mock 编解码器每个输入恰好对应一个输出, 不一致即为 EOS 时丢失了尾部帧; 硬件解码器的输出可以少于输入
+     *        (RASL、损坏的 access unit、两场合成一帧, 见 CodecPopStep), 编码器可能单独输出参数集包, 此时不一致只打印
+     */
+    bool FrameCountMatch(uint64_t inputNum, uint64_t outputNum);
+    /**
+     * @brief      在 slot 上转码一路码流, 编解码器从预热池中租用, 结束后归还
+     * @param[in]  source : 依次返回 NAL 单元, 结束时返回 nullptr
+     * @param[in]  sink   : 编码输出
+     * @param[out] frameNum : 送入解码器的 access unit 数
+     * @return     实际编码输出的帧数
+     */
+    uint32_t TranscodeStream(CodecSlot::ptr slot, const std::function<NormalPack::ptr()>& source, const std::function<void(AbstractPack::ptr)>& sink, uint32_t& frameNum);
+    int SegmentParallelMain();
+    int BatchMain();
 public:
     std::string              decoderClassName;
     std::string              encoderClassName;
+    H26xCodec                srcCodec;
     std::string              inputFile;
     std::string              outputFile;
     uint32_t                 gop;
     Codec::RateControlMode   rcMode;
     uint64_t                 bps;
     bool                     useAFBC;
+    bool                     realtime;
+    bool                     mock;            // 使用软件 mock 编解码器 (CI)
+    std::string              timestampsFile;  // 逐帧时间戳 (变帧率码流)
+    bool                     adaptiveBitrate;
+    uint64_t                 targetBandwidth; // 每路输出的目标带宽, 0 表示不限制
+    std::vector<std::map<std::string, std::string>> renditionSpecs; // 额外的编码输出
+    uint32_t                 segmentParallel; // GOP 并行转码的编解码器实例数, 0 表示不分段
+    uint32_t                 segmentFrames;   // 分段的最少帧数
+    std::string              manifestFile;    // 批量转码任务列表
+    uint32_t                 jobs;            // 批量转码的编解码器实例数
+    CodecWarmPool<Codec::AbstractDecoder>::ptr decoderPool;
+    CodecWarmPool<Codec::AbstractEncoder>::ptr encoderPool;
 };
 
 App::App()
 {
     useAFBC = false;
+    realtime = false;
+    mock = false;
+    adaptiveBitrate = false;
+    targetBandwidth = 0;
+    segmentParallel = 0;
+    segmentFrames = 0;
+    jobs = 2;
+    srcCodec = H26xCodec::H264;
     bps = 4 * 1024 * 1024;
     gop = 60;
     rcMode = Codec::RateControlMode::CBR;
 }
 
 void App::displayHelp()
+{
+    printHelp();
+    exit(0);
+}
+
+void App::printHelp()
 {
     AbstractLogger::LoggerSingleton()->Enable(AbstractLogger::Direction::CONSLOE);
     std::stringstream ss;
@@ -229,7 +446,6 @@ void App::displayHelp()
     helpFormatter.setHeader("Simple program to test rockchip transcode using MMP-Core.");
     helpFormatter.format(ss);
     MMP_LOG_INFO << ss.str();
-    exit(0);
 }
 
 void App::HandleHelp(const std::string& name, const std::string& value)
@@ -239,18 +455,7 @@ void App::HandleHelp(const std::string& name, const std::string& value)
 
 void App::HandleRateControlMode(const std::string& name, const std::string& value)
 {
-    static std::map<std::string, Codec::RateControlMode> kLookup = 
-    {
-        {"vbr", Codec::RateControlMode::VBR},
-        {"cbr", Codec::RateControlMode::CBR},
-        {"fixqp", Codec::RateControlMode::FIXQP},
-        {"avbr", Codec::RateControlMode::AVBR}
-    };
-    if (kLookup.count(value))
-    {
-        rcMode = kLookup[value];
-    }
-    else
+    if (!RateControlModeFromName(value, rcMode))
     {
         assert(false);
         exit(-1);
@@ -280,6 +485,7 @@ void App::HandleSrcCodecType(const std::string& name, const std::string& value)
     if (kLookup.count(value))
     {
         decoderClassName = kLookup[value];
+        H26xCodecFromName(value, srcCodec);
     }
     else
     {
@@ -290,23 +496,36 @@ void App::HandleSrcCodecType(const std::string& name, const std::string& value)
 
 void App::HandleDstCodecType(const std::string& name, const std::string& value)
 {
-    static std::map<std::string, std::string> kLookup = 
+    if (!EncoderClassNameFromCodec(value, encoderClassName))
     {
-        {"h264", "RKH264Encoder"},
-        {"hevc", "RKH265Encoder"},
-        {"vp8", ""}, // todo
-        {"vp9", ""}, // todo
-        {"av1", ""} // av1
-    };
-    if (kLookup.count(value))
+        assert(false);
+        exit(-1);
+    }
+}
+
+void App::HandleRendition(const std::string& name, const std::string& value)
+{
+    // 格式 : codec=hevc,bps=2000000,gop=120,rcmode=vbr,o=out_2m.h265
+    // Hint : 未指定的字段在解析完所有参数后沿用主输出的配置
+    std::stringstream ss(value);
+    std::string field;
+    std::map<std::string, std::string> fields;
+    while (std::getline(ss, field, ','))
     {
-        encoderClassName = kLookup[value];
+        size_t pos = field.find('=');
+        if (pos == std::string::npos)
+        {
+            assert(false);
+            exit(-1);
+        }
+        fields[field.substr(0, pos)] = field.substr(pos + 1);
     }
-    else
+    if (!fields.count("o"))
     {
         assert(false);
         exit(-1);
     }
+    renditionSpecs.push_back(fields);
 }
 
 void App::HandleUseAFBC(const std::string& name, const std::string& value)
@@ -317,6 +536,75 @@ void App::HandleUseAFBC(const std::string& name, const std::string& value)
     }
 }
 
+void App::HandleRealtime(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        realtime = true;
+    }
+}
+
+void App::HandleMock(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        mock = true;
+    }
+}
+
+void App::HandleTimestamps(const std::string& name, const std::string& value)
+{
+    timestampsFile = value;
+}
+
+void App::HandleAdaptiveBitrate(const std::string& name, const std::string& value)
+{
+    if (value == "true")
+    {
+        adaptiveBitrate = true;
+    }
+}
+
+void App::HandleTargetBandwidth(const std::string& name, const std::string& value)
+{
+    targetBandwidth = std::stoull(value);
+    adaptiveBitrate = true;
+}
+
+void App::HandleSegmentParallel(const std::string& name, const std::string& value)
+{
+    segmentParallel = std::stoi(value);
+}
+
+void App::HandleSegmentFrames(const std::string& name, const std::string& value)
+{
+    segmentFrames = std::stoi(value);
+}
+
+void App::HandleManifest(const std::string& name, const std::string& value)
+{
+    manifestFile = value;
+}
+
+void App::HandleJobs(const std::string& name, const std::string& value)
+{
+    jobs = std::stoi(value);
+    if (jobs == 0)
+    {
+        assert(false);
+        exit(-1);
+    }
+}
+
+void App::HandlePlacement(const std::string& name, const std::string& value)
+{
+    if (!ThreadPlacement::Instance()->Load(value))
+    {
+        assert(false);
+        exit(-1);
+    }
+}
+
 void App::HandleInput(const std::string& name, const std::string& value)
 {
     inputFile = value;
@@ -369,14 +657,14 @@ void App::defineOptions(OptionSet& options)
         .argument("[codec_type]")
         .callback(OptionCallback<App>(this, &App::HandleDstCodecType))
     );
-    options.addOption(Option("input", "i", "输入文件")
-        .required(true)
+    options.addOption(Option("input", "i", "输入文件, 未指定 -manifest 时必选")
+        .required(false)
         .repeatable(false)
         .argument("[filepath]")
         .callback(OptionCallback<App>(this, &App::HandleInput))
     );
-    options.addOption(Option("output", "o", "输出文件")
-        .required(true)
+    options.addOption(Option("output", "o", "输出文件, 未指定 -manifest 时必选")
+        .required(false)
         .repeatable(false)
         .argument("[filepath]")
         .callback(OptionCallback<App>(this, &App::HandleOutput))
@@ -405,6 +693,122 @@ void App::defineOptions(OptionSet& options)
         .argument("[flag]")
         .callback(OptionCallback<App>(this, &App::HandleUseAFBC))
     );
+    options.addOption(Option("realtime", "realtime", "是否按码流时间戳实时读取与送编码 (模拟直播), 过载时丢帧而不累积延迟, 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleRealtime))
+    );
+    options.addOption(Option("mock", "mock", "是否使用软件 mock 编解码器 (不依赖硬件, 输入需为 test_encoder -mock 的输出), 用于 CI 检查各模式的帧数守恒, 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleMock))
+    );
+    options.addOption(Option("timestamps", "timestamps", "逐帧时间戳文件 (变帧率码流), 每行一个 access unit 的 pts (秒, 解码顺序), 见 RkCacheFileByteReader::LoadTimestamps")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleTimestamps))
+    );
+    options.addOption(Option("adaptive_bitrate", "adaptive_bitrate", "是否按输出码率与写入队列动态调整各路编码码率 (bps 为上限), 可选 default false")
+        .required(false)
+        .repeatable(false)
+        .argument("[flag]")
+        .callback(OptionCallback<App>(this, &App::HandleAdaptiveBitrate))
+    );
+    options.addOption(Option("target_bandwidth", "target_bandwidth", "每路输出的目标带宽 (bit/s), 输出码率超出时下调码率, 指定后启用 -adaptive_bitrate")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleTargetBandwidth))
+    );
+    options.addOption(Option("rendition", "rendition", "额外的编码输出, 与主输出共享同一次解码, 可重复指定; 例如 codec=hevc,bps=2000000,gop=120,rcmode=vbr,fps=30,o=out.h265")
+        .required(false)
+        .repeatable(true)
+        .argument("[spec]")
+        .callback(OptionCallback<App>(this, &App::HandleRendition))
+    );
+    options.addOption(Option("segment_parallel", "segment_parallel", "按 IDR 切分码流, 由 N 组编解码器并行转码后按序拼接, 适用于离线转码")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleSegmentParallel))
+    );
+    options.addOption(Option("segment_frames", "segment_frames", "分段的最少帧数 (分段并行模式的分段, 批量模式的拆分粒度), default 与 gop 相同")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleSegmentFrames))
+    );
+    options.addOption(Option("manifest", "manifest", "批量转码任务列表, 每行一个任务 : [input] [output], # 开头为注释")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandleManifest))
+    );
+    options.addOption(Option("jobs", "j", "批量转码时同时工作的编解码器实例数, default 2")
+        .required(false)
+        .repeatable(false)
+        .argument("[num]")
+        .callback(OptionCallback<App>(this, &App::HandleJobs))
+    );
+    options.addOption(Option("placement", "placement", "线程放置策略配置文件, 每行 : [stage] = [cpus|big|little] [: SCHED_FIFO priority], stage 可选 : worker (执行器), blocking (执行器阻塞线程池), writer (分段模式)")
+        .required(false)
+        .repeatable(false)
+        .argument("[filepath]")
+        .callback(OptionCallback<App>(this, &App::HandlePlacement))
+    );
+}
+
+Rendition::ptr App::CreateRendition(const std::map<std::string, std::string>& fields)
+{
+    Rendition::ptr rendition = std::make_shared<Rendition>();
+    rendition->encoderClassName = encoderClassName;
+    rendition->outputFile = outputFile;
+    rendition->gop = gop;
+    rendition->rcMode = rcMode;
+    rendition->bps = bps;
+    for (const auto& field : fields)
+    {
+        bool valid = true;
+        if (field.first == "codec")
+        {
+            valid = EncoderClassNameFromCodec(field.second, rendition->encoderClassName);
+            rendition->encoderClassName = mock ? MockCodecClassName(rendition->encoderClassName) : rendition->encoderClassName;
+        }
+        else if (field.first == "bps")
+        {
+            rendition->bps = std::stoull(field.second);
+        }
+        else if (field.first == "gop")
+        {
+            rendition->gop = std::stoi(field.second);
+        }
+        else if (field.first == "rcmode")
+        {
+            valid = RateControlModeFromName(field.second, rendition->rcMode);
+        }
+        else if (field.first == "fps")
+        {
+            rendition->fps = std::stoi(field.second);
+        }
+        else if (field.first == "o")
+        {
+            rendition->outputFile = field.second;
+        }
+        else
+        {
+            valid = false;
+        }
+        if (!valid)
+        {
+            MMP_LOG_ERROR << "Invalid rendition field, " << field.first << "=" << field.second;
+            assert(false);
+            exit(-1);
+        }
+    }
+    return rendition;
 }
 
 void App::defineProperty(const std::string& def)
@@ -423,10 +827,106 @@ void App::defineProperty(const std::string& def)
 
 /********************************************************* TEST(BEGIN) *****************************************************/
 
-int App::main(const ArgVec& args)
+bool App::CreateCodecPools(uint32_t slotNum)
 {
+    //
+    // Hint : 每个 slot 保持一组备用实例, slot 切换码流时直接租用已 Start 的实例,
+    //        归还的实例在后台重置, 不占用下一路码流的启动时间
+    //
+    decoderPool = std::make_shared<CodecWarmPool<Codec::AbstractDecoder>>([this]() -> Codec::AbstractDecoder::ptr
     {
-        MMP_LOG_INFO << "Transcode config";
+        Codec::AbstractDecoder::ptr decoder = Codec::DecoderFactory::DefaultFactory().CreateDecoder(decoderClassName);
+        if (decoder && useAFBC)
+        {
+            decoder->SetParameter(true, Codec::kEnableDecoderAFBC);
+        }
+        return decoder;
+    }, slotNum);
+    encoderPool = std::make_shared<CodecWarmPool<Codec::AbstractEncoder>>([this]() -> Codec::AbstractEncoder::ptr
+    {
+        Codec::AbstractEncoder::ptr encoder = Codec::EncoderFactory::DefaultFactory().CreateEncoder(encoderClassName);
+        if (encoder)
+        {
+            encoder->SetParameter(rcMode, Codec::kRateControlMode);
+            encoder->SetParameter(bps, Codec::kBps);
+            encoder->SetParameter(gop, Codec::kGop);
+        }
+        return encoder;
+    }, slotNum);
+    // Hint : 不支持的编解码器由预热池的首次创建发现, 无需额外创建探测实例
+    bool decoderSupported = decoderPool->WaitWarm();
+    bool encoderSupported = encoderPool->WaitWarm();
+    return decoderSupported && encoderSupported;
+}
+
+bool App::FrameCountMatch(uint64_t inputNum, uint64_t outputNum)
+{
+    return !mock || inputNum == outputNum;
+}
+
+uint32_t App::TranscodeStream(CodecSlot::ptr slot, const std::function<NormalPack::ptr()>& source, const std::function<void(AbstractPack::ptr)>& sink, uint32_t& frameNum)
+{
+    uint64_t beginNs = FrameClock::NowNs();
+    //
+    // Hint : 解码器送入 EOS 后不再接收新码流, 码流之间需要 Uninit/Init 重置, 由预热池在后台完成;
+    //        进程、CodecConfig 以及实例本身在多路码流间复用
+    //        每路码流的编码输出以参数集 + IDR 开头, 可直接拼接
+    //
+    bool decoderWarm = false, encoderWarm = false;
+    Codec::AbstractDecoder::ptr decoder = decoderPool->Lease(&decoderWarm);
+    Codec::AbstractEncoder::ptr encoder = encoderPool->Lease(&encoderWarm);
+    uint64_t leaseNs = FrameClock::NowNs() - beginNs;
+    uint64_t firstPacketNs = 0;
+
+    //
+    // Source -> VDEC PUSH
+    //           VDEC POP -> VENC PUSH
+    //                       VENC POP -> Sink
+    //
+    Pipeline pipeline("stream");
+    PipelineEdge<NormalPack::ptr>::ptr packs = pipeline.CreateEdge<NormalPack::ptr>("nal", kNalEdgeCapacity, PipelineEdgePolicy::BLOCK, kNalEdgeBytes);
+    PipelineEdge<AbstractFrame::ptr>::ptr frames = pipeline.CreateEdge<AbstractFrame::ptr>("frame", kRenditionQueueDepth);
+    PipelineEdge<AbstractPack::ptr>::ptr encodedPacks = pipeline.CreateEdge<AbstractPack::ptr>("pack", kPackEdgeCapacity, PipelineEdgePolicy::BLOCK, kPackEdgeBytes);
+    pipeline.AddSource("reader", packs, [&source](NormalPack::ptr& pack) -> bool
+    {
+        pack = source();
+        return pack != nullptr;
+    }, true);
+    CodecNodeStats::ptr decoderStats = AddDecoderNode(pipeline, decoder, srcCodec, packs, frames);
+    CodecNodeStats::ptr encoderStats = AddEncoderNode(pipeline, encoder, frames, encodedPacks);
+    pipeline.AddSink("writer", encodedPacks, [&](const AbstractPack::ptr& pack)
+    {
+        if (firstPacketNs == 0)
+        {
+            firstPacketNs = FrameClock::NowNs() - beginNs;
+        }
+        sink(pack);
+    }, true);
+    pipeline.Start();
+    pipeline.Wait();
+    uint32_t encodedNum = encoderStats->poppedNum;
+    uint32_t decodedNum = decoderStats->poppedNum;
+    uint32_t pushedNum = decoderStats->pushedNum;
+
+    decoderPool->Return(decoder);
+    encoderPool->Return(encoder);
+    frameNum = pushedNum;
+    MMP_LOG_INFO << "Slot " << slot->index << " time to first packet : " << firstPacketNs / 1000000 << " ms"
+                 << ", codec lease : " << leaseNs / 1000000 << " ms (" << (decoderWarm && encoderWarm ? "warm" : "cold") << ")";
+    MMP_LOG_INFO << "Slot " << slot->index << " decoder " << decoderStats->Report() << ", encoder " << encoderStats->Report();
+    if (decodedNum != pushedNum)
+    {
+        MMP_LOG_WARN << "Slot " << slot->index << " decoded " << decodedNum << " of " << pushedNum << " frames";
+    }
+    slot->jobNum++;
+    slot->busyNs += FrameClock::NowNs() - beginNs;
+    return encodedNum;
+}
+
+int App::SegmentParallelMain()
+{
+    {
+        MMP_LOG_INFO << "Segment parallel transcode config";
         MMP_LOG_INFO << "-- encoder name : " << encoderClassName;
         MMP_LOG_INFO << "-- decoder name : " << decoderClassName;
         MMP_LOG_INFO << "-- input is: " << inputFile;
@@ -435,13 +935,437 @@ int App::main(const ArgVec& args)
         MMP_LOG_INFO << "-- rate control mode : " << rcMode;
         MMP_LOG_INFO << "-- gop is: " << gop;
         MMP_LOG_INFO << "-- use AFBC is: " << (useAFBC ? "true" : "false");
+        MMP_LOG_INFO << "-- parallel is: " << segmentParallel;
+        MMP_LOG_INFO << "-- segment frames is: " << segmentFrames;
+        if (!renditionSpecs.empty() || realtime)
+        {
+            MMP_LOG_WARN << "-rendition and -realtime are ignored in segment parallel mode";
+        }
+    }
+    if (!CreateCodecPools(segmentParallel))
+    {
+        MMP_LOG_INFO << "Rebuild with -DUSE_ROCKCHIP=ON, see README for detail.";
+        return 0;
+    }
+    std::vector<CodecSlot::ptr> slots;
+    for (uint32_t i=0; i<segmentParallel; i++)
+    {
+        CodecSlot::ptr slot = std::make_shared<CodecSlot>();
+        slot->index = i;
+        slots.push_back(slot);
+    }
+
+    //
+    // Input File Read -> GOP Segmenter -> (VDEC -> VENC)[0] -> 
+    //                                  -> (VDEC -> VENC)[1] -> In Order Stitch -> Output File Write
+    //                                  -> ...
+    //
+    // Hint : 已切分但未写出的分段不超过 2 * N 个, 限制内存占用
+    //        分段按预计完成时间分配给各 slot, 负载不均时排队中的分段迁移到空闲的 slot
+    //
+    std::mutex mtx;
+    std::condition_variable cond;
+    CodecScheduler scheduler(segmentParallel, segmentParallel);
+    std::map<uint64_t, GopSegment::ptr> pendingSegments;
+    std::map<uint32_t, std::vector<uint8_t>> doneSegments;
+    uint32_t nextWriteIndex = 0;
+    uint32_t runningWorkerNum = segmentParallel;
+    uint64_t frameNum = 0;
+    uint64_t encodedNum = 0;
+    uint64_t startNs = FrameClock::NowNs();
+
+    std::vector<std::thread> workers;
+    for (uint32_t i=0; i<segmentParallel; i++)
+    {
+        workers.emplace_back([&, i]()
+        {
+            while (true)
+            {
+                uint64_t id = 0, cost = 0;
+                if (!scheduler.Take(i, id, cost))
+                {
+                    break;
+                }
+                GopSegment::ptr segment;
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    segment = pendingSegments[id];
+                    pendingSegments.erase(id);
+                }
+                std::vector<uint8_t> bitstream;
+                uint64_t beginNs = FrameClock::NowNs();
+                uint32_t segmentEncodedNum = 0;
+                {
+                    size_t next = 0;
+                    uint32_t frameNum = 0;
+                    segmentEncodedNum = TranscodeStream(slots[i], [&segment, &next]() -> NormalPack::ptr
+                    {
+                        return next < segment->packs.size() ? segment->packs[next++] : nullptr;
+                    }, [&bitstream](AbstractPack::ptr pack)
+                    {
+                        const uint8_t* data = (const uint8_t*)pack->GetData(0);
+                        bitstream.insert(bitstream.end(), data, data + pack->GetSize());
+                    }, frameNum);
+                }
+                scheduler.Complete(i, cost, FrameClock::NowNs() - beginNs);
+                MMP_LOG_INFO << "Worker " << i << " transcode segment " << segment->index << ", frames : " << segment->frameNum
+                             << ", cost : " << (FrameClock::NowNs() - beginNs) / 1000000 << " ms";
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    encodedNum += segmentEncodedNum;
+                    doneSegments[segment->index].swap(bitstream);
+                    cond.notify_all();
+                }
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            runningWorkerNum--;
+            cond.notify_all();
+        });
+    }
+    std::thread writer([&]()
+    {
+        ThreadPlacement::Instance()->Apply("writer");
+        AsyncFileWriter writer(outputFile);
+        while (true)
+        {
+            std::vector<uint8_t> bitstream;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cond.wait(lock, [&]()
+                {
+                    return doneSegments.count(nextWriteIndex) || runningWorkerNum == 0;
+                });
+                if (!doneSegments.count(nextWriteIndex))
+                {
+                    break;
+                }
+                bitstream.swap(doneSegments[nextWriteIndex]);
+                doneSegments.erase(nextWriteIndex);
+                nextWriteIndex++;
+                cond.notify_all();
+            }
+            writer.Write(bitstream.data(), bitstream.size());
+        }
+        writer.Close();
+    });
+
+    RkCacheFileByteReader::ptr byteReader = std::make_shared<RkCacheFileByteReader>(inputFile, srcCodec);
+    GopSegmenter segmenter(srcCodec, segmentFrames);
+    auto submit = [&](GopSegment::ptr segment)
+    {
+        if (!segment)
+        {
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cond.wait(lock, [&]()
+            {
+                return segment->index < nextWriteIndex + 2 * segmentParallel;
+            });
+            frameNum += segment->frameNum;
+            pendingSegments[segment->index] = segment;
+        }
+        scheduler.Submit(segment->index, segment->frameNum);
+    };
+    NormalPack::ptr pack = nullptr;
+    do
+    {
+        pack = byteReader->GetNalUint();
+        if (pack)
+        {
+            submit(segmenter.Push(pack));
+        }
+    } while (pack);
+    submit(segmenter.Flush());
+    scheduler.Close();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    writer.join();
+    MMP_LOG_INFO << scheduler.Report();
+    MMP_LOG_INFO << ThreadPlacement::Instance()->Report();
+    uint64_t costMs = (FrameClock::NowNs() - startNs) / 1000000;
+    MMP_LOG_INFO << decoderPool->Report();
+    MMP_LOG_INFO << encoderPool->Report();
+    MMP_LOG_INFO << "Segment parallel transcode " << nextWriteIndex << " segments, " << frameNum << " frames, cost : " << costMs << " ms"
+                 << ", fps : " << (costMs ? frameNum * 1000 / costMs : 0);
+    // Hint : 每个分段的尾部帧须在 EOS 时排空, 否则拼接后的输出少于输入
+    if (encodedNum != frameNum)
+    {
+        MMP_LOG_WARN << "Segment parallel transcode encoded " << encodedNum << " of " << frameNum << " frames";
+    }
+    // Hint : 预热实例需在 CodecConfig::Uninit 之前释放
+    decoderPool.reset();
+    encoderPool.reset();
+    return FrameCountMatch(frameNum, encodedNum) ? 0 : -1;
+}
+
+int App::BatchMain()
+{
+    std::vector<TranscodeJob::ptr> pendingJobs;
+    {
+        std::ifstream ifs(manifestFile);
+        if (!ifs.is_open())
+        {
+            MMP_LOG_ERROR << "Open manifest fail, manifest is: " << manifestFile;
+            return -1;
+        }
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            std::stringstream ss(line);
+            TranscodeJob::ptr job = std::make_shared<TranscodeJob>();
+            if (!(ss >> job->inputFile) || job->inputFile[0] == '#')
+            {
+                continue;
+            }
+            if (!(ss >> job->outputFile))
+            {
+                MMP_LOG_ERROR << "Invalid manifest line: " << line;
+                return -1;
+            }
+            job->index = (uint32_t)pendingJobs.size();
+            pendingJobs.push_back(job);
+        }
+    }
+    {
+        MMP_LOG_INFO << "Batch transcode config";
+        MMP_LOG_INFO << "-- encoder name : " << encoderClassName;
+        MMP_LOG_INFO << "-- decoder name : " << decoderClassName;
+        MMP_LOG_INFO << "-- manifest is: " << manifestFile << " (" << pendingJobs.size() << " jobs)";
+        MMP_LOG_INFO << "-- bit per second is: " << bps;
+        MMP_LOG_INFO << "-- rate control mode : " << rcMode;
+        MMP_LOG_INFO << "-- gop is: " << gop;
+        MMP_LOG_INFO << "-- use AFBC is: " << (useAFBC ? "true" : "false");
+        MMP_LOG_INFO << "-- jobs is: " << jobs;
+        MMP_LOG_INFO << "-- segment frames is: " << segmentFrames;
+    }
+    if (!CreateCodecPools(jobs))
+    {
+        MMP_LOG_INFO << "Rebuild with -DUSE_ROCKCHIP=ON, see README for detail.";
+        return 0;
+    }
+    std::vector<CodecSlot::ptr> slots;
+    for (uint32_t i=0; i<jobs; i++)
+    {
+        CodecSlot::ptr slot = std::make_shared<CodecSlot>();
+        slot->index = i;
+        slots.push_back(slot);
     }
-    std::atomic<bool> sync(false);
-    std::atomic<bool> running(true); 
 
+    //
+    // 每个 slot 一个工作线程; 任务按输入文件大小估算工作量, 分配给预计完成最早的 slot,
+    // 负载不均时排队中的任务迁移到空闲的 slot; 有 slot 空闲时, 处理中的任务在 IDR 边界拆分,
+    // 剩余范围的后半部分交给空闲的 slot, 保证所有 VPU 处理单元都处于忙碌状态
+    //
+    CodecScheduler scheduler(jobs);
+    for (const auto& job : pendingJobs)
+    {
+        uint64_t costKB = FileSize(job->inputFile) / 1024;
+        scheduler.Submit(job->index, costKB == 0 ? 1 : costKB);
+    }
+    scheduler.Close();
+    std::mutex mtx;
+    std::map<uint64_t, TranscodeJobPart::ptr> pendingParts; // 拆分出的部分, id 从 pendingJobs.size() 开始
+    uint64_t nextPartId = pendingJobs.size();
+    uint64_t frameNum = 0;
+    uint32_t failNum = 0;
+    uint64_t startNs = FrameClock::NowNs();
+    std::vector<std::thread> workers;
+    for (auto& slot : slots)
+    {
+        workers.emplace_back([&, slot]()
+        {
+            while (true)
+            {
+                uint64_t id = 0, cost = 0;
+                if (!scheduler.Take(slot->index, id, cost))
+                {
+                    break;
+                }
+                uint64_t beginNs = FrameClock::NowNs();
+                TranscodeJobPart::ptr part;
+                if (id < pendingJobs.size())
+                {
+                    TranscodeJob::ptr job = pendingJobs[id];
+                    std::ifstream ifs(job->inputFile);
+                    AsyncFileWriter::ptr writer = std::make_shared<AsyncFileWriter>(job->outputFile);
+                    if (!ifs.is_open() || !writer->IsOpen())
+                    {
+                        MMP_LOG_ERROR << "Job " << job->index << " open file fail, input is: " << job->inputFile << ", output is: " << job->outputFile;
+                        scheduler.Complete(slot->index, cost, 0);
+                        std::lock_guard<std::mutex> lock(mtx);
+                        failNum++;
+                        continue;
+                    }
+                    ifs.close();
+                    TranscodeJobState::ptr state = std::make_shared<TranscodeJobState>();
+                    state->job = job;
+                    state->writer = writer;
+                    state->beginNs = beginNs;
+                    state->AddPart(0);
+                    part = std::make_shared<TranscodeJobPart>(state, srcCodec, segmentFrames, 0, FileSize(job->inputFile));
+                }
+                else
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    part = pendingParts[id];
+                    pendingParts.erase(id);
+                }
+                TranscodeJobState::ptr state = part->state;
+                std::vector<NormalPack::ptr> packs;
+                packs.swap(part->leadingPacks);
+                size_t next = 0;
+                uint64_t partCost = cost;
+                uint32_t partFrameNum = 0;
+                uint32_t encodedNum = TranscodeStream(slot, [&]() -> NormalPack::ptr
+                {
+                    if (next < packs.size())
+                    {
+                        return packs[next++];
+                    }
+                    GopSegment::ptr segment = part->NextSegment();
+                    if (!segment)
+                    {
+                        return nullptr;
+                    }
+                    packs.swap(segment->packs);
+                    next = 0;
+                    //
+                    // Hint : 有空闲的 slot 时在 IDR 边界拆分, 剩余范围的后半部分交给空闲的 slot 并行处理;
+                    //        每个部分至少保留一个分段的数据量, 避免拆分过细时编解码器重置的开销占比过高
+                    //
+                    TranscodeJobPart::ptr rest = scheduler.IdleNum() ? part->Split(segment->size) : nullptr;
+                    if (rest)
+                    {
+                        uint64_t restId = 0;
+                        state->AddPart(rest->beginOffset);
+                        {
+                            std::lock_guard<std::mutex> lock(mtx);
+                            restId = nextPartId++;
+                            pendingParts[restId] = rest;
+                        }
+                        if (scheduler.Split(slot->index, restId, rest->CostKB()))
+                        {
+                            partCost -= std::min(partCost, rest->CostKB());
+                            part->endOffset = rest->beginOffset;
+                            MMP_LOG_INFO << "Job " << state->job->index << " split at offset " << rest->beginOffset << " on slot " << slot->index;
+                        }
+                        else
+                        {
+                            std::lock_guard<std::mutex> lock(mtx);
+                            pendingParts.erase(restId);
+                            state->RemovePart(rest->beginOffset);
+                        }
+                    }
+                    return packs[next++];
+                }, [&state, &part](AbstractPack::ptr pack)
+                {
+                    state->Write(part->beginOffset, pack->GetData(0), pack->GetSize());
+                }, partFrameNum);
+                scheduler.Complete(slot->index, partCost, FrameClock::NowNs() - beginNs);
+                MMP_LOG_INFO << "Job " << state->job->index << " part at offset " << part->beginOffset << " done on slot " << slot->index
+                             << ", frames : " << encodedNum << "/" << partFrameNum << ", cost : " << (FrameClock::NowNs() - beginNs) / 1000000 << " ms";
+                if (!state->Finish(part->beginOffset, partFrameNum, encodedNum))
+                {
+                    continue;
+                }
+                state->writer->Close();
+                uint64_t costMs = (FrameClock::NowNs() - state->beginNs) / 1000000;
+                MMP_LOG_INFO << "Job " << state->job->index << " done, parts : " << state->partNum << ", input is: " << state->job->inputFile
+                             << ", frames : " << state->encodedNum << "/" << state->frameNum << ", cost : " << costMs << " ms"
+                             << ", fps : " << (costMs ? state->encodedNum * 1000 / costMs : 0);
+                std::lock_guard<std::mutex> lock(mtx);
+                frameNum += state->encodedNum;
+                failNum += state->encodedNum == 0 || !FrameCountMatch(state->frameNum, state->encodedNum) ? 1 : 0;
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    uint64_t costNs = FrameClock::NowNs() - startNs;
+    MMP_LOG_INFO << "Batch transcode " << frameNum << " frames, fail jobs : " << failNum << ", cost : " << costNs / 1000000 << " ms"
+                 << ", fps : " << (costNs ? frameNum * 1000000000ull / costNs : 0);
+    MMP_LOG_INFO << scheduler.Report();
+    MMP_LOG_INFO << decoderPool->Report();
+    MMP_LOG_INFO << encoderPool->Report();
+    MMP_LOG_INFO << ThreadPlacement::Instance()->Report();
+    for (auto& slot : slots)
+    {
+        MMP_LOG_INFO << "-- slot " << slot->index << " jobs : " << slot->jobNum << ", utilization : " << (costNs ? slot->busyNs * 100 / costNs : 0) << "%";
+    }
+    decoderPool.reset();
+    encoderPool.reset();
+    return failNum == 0 ? 0 : -1;
+}
+
+int App::main(const ArgVec& args)
+{
+    if (mock)
+    {
+        RegisterMockCodecs();
+        decoderClassName = MockCodecClassName(decoderClassName);
+        encoderClassName = MockCodecClassName(encoderClassName);
+    }
+    if (segmentFrames == 0)
+    {
+        segmentFrames = gop;
+    }
+    if (!manifestFile.empty())
+    {
+        return BatchMain();
+    }
+    if (inputFile.empty() || outputFile.empty())
+    {
+        MMP_LOG_ERROR << "-input and -output are required without -manifest";
+        printHelp();
+        return -1;
+    }
+    if (segmentParallel != 0)
+    {
+        return SegmentParallelMain();
+    }
+    std::vector<Rendition::ptr> renditions;
+    renditions.push_back(CreateRendition({}));
+    for (const auto& spec : renditionSpecs)
+    {
+        renditions.push_back(CreateRendition(spec));
+    }
+    {
+        MMP_LOG_INFO << "Transcode config";
+        MMP_LOG_INFO << "-- decoder name : " << decoderClassName;
+        MMP_LOG_INFO << "-- input is: " << inputFile;
+        MMP_LOG_INFO << "-- use AFBC is: " << (useAFBC ? "true" : "false");
+        MMP_LOG_INFO << "-- realtime is: " << (realtime ? "true" : "false");
+        MMP_LOG_INFO << "-- timestamps is: " << (timestampsFile.empty() ? std::string("stream") : timestampsFile);
+        MMP_LOG_INFO << "-- adaptive bitrate is: " << (adaptiveBitrate ? "true" : "false");
+        MMP_LOG_INFO << "-- target bandwidth is: " << targetBandwidth;
+        for (size_t i=0; i<renditions.size(); i++)
+        {
+            MMP_LOG_INFO << "-- rendition " << i;
+            MMP_LOG_INFO << "---- encoder name : " << renditions[i]->encoderClassName;
+            MMP_LOG_INFO << "---- output is: " << renditions[i]->outputFile;
+            MMP_LOG_INFO << "---- bit per second is: " << renditions[i]->bps;
+            MMP_LOG_INFO << "---- rate control mode : " << renditions[i]->rcMode;
+            MMP_LOG_INFO << "---- gop is: " << renditions[i]->gop;
+            MMP_LOG_INFO << "---- fps is: " << (renditions[i]->fps ? std::to_string(renditions[i]->fps) : std::string("source"));
+        }
+    }
     Codec::AbstractDecoder::ptr decoder = Codec::DecoderFactory::DefaultFactory().CreateDecoder(decoderClassName);
-    Codec::AbstractEncoder::ptr encoder = Codec::EncoderFactory::DefaultFactory().CreateEncoder(encoderClassName);
-    if (!decoder || !encoder)
+    for (auto& rendition : renditions)
+    {
+        rendition->encoder = Codec::EncoderFactory::DefaultFactory().CreateEncoder(rendition->encoderClassName);
+        if (!rendition->encoder)
+        {
+            decoder = nullptr;
+        }
+    }
+    if (!decoder)
     {
         MMP_LOG_INFO << "Rebuild with -DUSE_ROCKCHIP=ON, see README for detail.";
         return 0;
@@ -452,84 +1376,251 @@ int App::main(const ArgVec& args)
     }
     decoder->Init();
     decoder->Start();
-    encoder->SetParameter(rcMode, Codec::kRateControlMode);
-    encoder->SetParameter(bps, Codec::kBps);
-    encoder->SetParameter(gop, Codec::kGop);
-    encoder->Init();
-    encoder->Start();
+    for (auto& rendition : renditions)
+    {
+        Codec::AbstractEncoder::ptr encoder = rendition->encoder;
+        encoder->SetParameter(rendition->rcMode, Codec::kRateControlMode);
+        encoder->SetParameter(rendition->bps, Codec::kBps);
+        encoder->SetParameter(rendition->gop, Codec::kGop);
+        encoder->Init();
+        encoder->Start();
+    }
+
+    PtsReorderQueue reorderQueue;
+    PresentationScheduler scheduler;
+    PresentationScheduler ingestScheduler;
+    // Hint : 仅实时模式下过载丢帧, 离线转码保留每一帧; 目标帧率的转换总是生效
+    DecodeLoadShedder decodeShedder(srcCodec, realtime ? kDecodeShedDepth : 0);
+    std::vector<EncodeLoadShedder::ptr> encodeShedders;
+    for (size_t i=0; i<renditions.size(); i++)
+    {
+        encodeShedders.push_back(std::make_shared<EncodeLoadShedder>(realtime ? kEncodeShedDepth : 0));
+    }
+    std::vector<BitrateController::ptr> bitrateControllers(renditions.size());
+    if (adaptiveBitrate)
+    {
+        for (size_t i=0; i<renditions.size(); i++)
+        {
+            // Hint : 帧率在读取到 SPS 后才能确定, 见 fan_out
+            bitrateControllers[i] = std::make_shared<BitrateController>(renditions[i]->bps, renditions[i]->fps);
+            bitrateControllers[i]->SetTargetBandwidth(targetBandwidth);
+        }
+    }
 
     //
-    // 三级经典流水线:
+    // 三级经典流水线, 解码结果按引用分发给 N 路编码:
     //
     // Input File Read -> VDEC PUSH
-    //                    VDEC POP -> VENC PUSH
-    //                                VENC POP -> Output File Write
+    //                    VDEC POP -> (fan out) -> VENC[0] PUSH -> VENC[0] POP -> Output File[0] Write
+    //                                          -> VENC[1] PUSH -> VENC[1] POP -> Output File[1] Write
+    //                                          -> ...
     //
+    Pipeline pipeline("transcode");
+    PipelineEdge<NormalPack::ptr>::ptr packs = pipeline.CreateEdge<NormalPack::ptr>("nal", kNalEdgeCapacity, PipelineEdgePolicy::BLOCK, kNalEdgeBytes);
+    PipelineEdge<AbstractFrame::ptr>::ptr decodedFrames = pipeline.CreateEdge<AbstractFrame::ptr>("decoded", kRenditionQueueDepth);
 
-    /*********************************** 编码线程(Begin) ******************************/
-    Promise<void>::ptr encoderTask = std::make_shared<Promise<void>>([&]()
+    /*********************************** 读取(Begin) ******************************/
+    RkCacheFileByteReader::ptr byteReader = std::make_shared<RkCacheFileByteReader>(inputFile, srcCodec);
+    if (!timestampsFile.empty() && !byteReader->LoadTimestamps(timestampsFile))
+    {
+        MMP_LOG_WARN << "Load timestamps fail, path is: " << timestampsFile;
+    }
+    CodecNodeStats::ptr decoderStats;
+    uint32_t readPictureNum = 0; // 送往解码的帧数 (首个 slice 数)
+    pipeline.AddSource("reader", packs, [&](NormalPack::ptr& pack) -> bool
     {
-        MMP_LOG_INFO << "Encoder Start";
-        while (running || decoder->CanPop())
+        while ((pack = byteReader->GetNalUint()))
         {
-            AbstractFrame::ptr frame;
-            if (decoder->Pop(frame))
+            if (realtime)
             {
-                encoder->Push(frame);
+                // Hint : 按时间戳读取, 模拟直播输入
+                TimedPack::ptr timedPack = std::dynamic_pointer_cast<TimedPack>(pack);
+                if (timedPack && timedPack->isFirstSlice)
+                {
+                    ingestScheduler.Wait(timedPack->ptsUs);
+                }
+            }
+            // Hint : 解码跟不上输入时丢弃非参考帧, 须在记录时间戳之前决定;
+            //        nal 边中是 NAL 而非帧, 深度按已送出的帧数减去解码输出的帧数计算
+            uint32_t depth = readPictureNum - decoderStats->poppedNum;
+            const uint8_t* data = (const uint8_t*)pack->GetData(0);
+            if (!decodeShedder.Drop(data, pack->GetSize(), depth))
+            {
+                readPictureNum += H26xNal::IsFirstSliceOfPicture(srcCodec, data, pack->GetSize()) ? 1 : 0;
+                reorderQueue.Push(pack);
+                break;
             }
         }
-        MMP_LOG_INFO << "Encoder Stop";
-    });
-    ThreadPool::ThreadPoolSingleton()->Commit(encoderTask);
-    /*********************************** 编码线程(End) ******************************/
-    /*********************************** 文件写入线程(Begin) ******************************/
-    Promise<void>::ptr outFileTask = std::make_shared<Promise<void>>([&]()
+        return pack != nullptr;
+    }, true);
+    /*********************************** 读取(End) ******************************/
+    decoderStats = AddDecoderNode(pipeline, decoder, srcCodec, packs, decodedFrames);
+    /*********************************** 分发(Begin) ******************************/
+    std::vector<PipelineEdgeBase::ptr> fanOutEdges;
+    std::vector<PipelineEdge<AbstractFrame::ptr>::ptr> renditionFrames;
+    for (size_t i=0; i<renditions.size(); i++)
     {
-        MMP_LOG_INFO << "Dump Start"; 
-        std::ofstream ofs(outputFile);
-        while (running || encoder->CanPop())
+        renditionFrames.push_back(pipeline.CreateEdge<AbstractFrame::ptr>("rendition_" + std::to_string(i), kRenditionQueueDepth));
+        fanOutEdges.push_back(renditionFrames.back());
+    }
+    std::vector<CodecNodeStats::ptr> encoderStats;
+    AbstractFrame::ptr fanOutFrame;
+    bool fanOutStarted = false;
+    std::vector<uint32_t> remaining(renditions.size(), 0); // 当前帧在各路尚需送入的次数
+    pipeline.AddStepNode("fan_out", [&]() -> PipelineStep
+    {
+        if (!fanOutFrame)
         {
-            AbstractPack::ptr pack;
-            if (encoder->Pop(pack))
+            if (!decodedFrames->TryPop(fanOutFrame))
+            {
+                return decodedFrames->IsEos() ? PipelineStep::DONE : PipelineStep::IDLE;
+            }
+            int64_t pts = reorderQueue.Pop();
+            if (realtime)
             {
-                ofs.write((char*)pack->GetData(0), pack->GetSize());
-                MMP_LOG_INFO << "Write address is: " << pack->GetData(0) << " , size is: " << pack->GetSize();
+                scheduler.Wait(pts);
+            }
+            if (!fanOutStarted)
+            {
+                // Hint : 解码出第一帧时 SPS 已读取, 此时才能确定输入帧率
+                uint32_t fpsNum = 0, fpsDen = 0;
+                byteReader->GetFrameRate(fpsNum, fpsDen);
+                for (size_t i=0; i<renditions.size(); i++)
+                {
+                    if (renditions[i]->fps != 0)
+                    {
+                        encodeShedders[i]->SetOutputFrameRate(renditions[i]->fps);
+                    }
+                    else if (realtime)
+                    {
+                        encodeShedders[i]->SetOutputFrameRate(fpsNum, fpsDen);
+                    }
+                    if (bitrateControllers[i] && renditions[i]->fps == 0)
+                    {
+                        bitrateControllers[i]->SetFrameRate(fpsNum, fpsDen);
+                    }
+                }
+                fanOutStarted = true;
+            }
+            for (size_t i=0; i<renditions.size(); i++)
+            {
+                uint32_t depth = (uint32_t)renditionFrames[i]->Size() + encoderStats[i]->Inflight();
+                remaining[i] = encodeShedders[i]->Frames(pts, depth);
             }
         }
-        ofs.flush();
-        ofs.close();
-        sync = true;
-        MMP_LOG_INFO << "Dump Stop"; 
-    });
-    ThreadPool::ThreadPoolSingleton()->Commit(outFileTask);
-    /*********************************** 文件写入线程(Begin) ******************************/
-    /*********************************** 解码线程(Begin) ******************************/
-    std::shared_ptr<RkCacheFileByteReader> byteReader = std::make_shared<RkCacheFileByteReader>(inputFile);
-    NormalPack::ptr pack = nullptr;
-    MMP_LOG_INFO << "Decode Start";
-    do
-    {
-        pack = byteReader->GetNalUint();
-        if (pack)
+        // Hint : 解码器输出 buffer 数量有限, 最慢的一路编码决定何时归还, 故按队列深度反压
+        bool allDelivered = true;
+        for (size_t i=0; i<renditionFrames.size(); i++)
         {
-            decoder->Push(pack);
+            while (remaining[i] != 0 && renditionFrames[i]->TryPush(fanOutFrame))
+            {
+                remaining[i]--;
+            }
+            if (renditionFrames[i]->IsAborted())
+            {
+                remaining[i] = 0;
+            }
+            allDelivered = allDelivered && remaining[i] == 0;
         }
-    } while (pack);
-    MMP_LOG_INFO << "Decode End";
-    /*********************************** 解码线程(End) ******************************/
+        if (!allDelivered)
+        {
+            return PipelineStep::IDLE;
+        }
+        fanOutFrame = nullptr;
+        return PipelineStep::PROGRESS;
+    }, {decodedFrames}, fanOutEdges, realtime);
+    /*********************************** 分发(End) ******************************/
+    std::vector<std::shared_future<void>> writerDones;
+    for (size_t i=0; i<renditions.size(); i++)
+    {
+        Rendition::ptr rendition = renditions[i];
+        PipelineEdge<AbstractPack::ptr>::ptr encodedPacks = pipeline.CreateEdge<AbstractPack::ptr>("pack_" + std::to_string(i), kPackEdgeCapacity, PipelineEdgePolicy::BLOCK, kPackEdgeBytes);
+        BitrateController::ptr bitrateController = bitrateControllers[i];
+        encoderStats.push_back(AddEncoderNode<AbstractFrame::ptr>(pipeline, rendition->encoder, renditionFrames[i], encodedPacks, [rendition, bitrateController, encodedPacks, i](const AbstractFrame::ptr& frame) -> AbstractFrame::ptr
+        {
+            if (bitrateController)
+            {
+                ApplyBitrateControl("Encoder " + std::to_string(i), rendition->encoder, bitrateController, encodedPacks);
+            }
+            return frame;
+        }));
+        /*********************************** 文件写入(Begin) ******************************/
+        AsyncFileWriter::ptr writer = std::make_shared<AsyncFileWriter>(rendition->outputFile);
+        writerDones.push_back(pipeline.AddSink("writer", encodedPacks, [writer, bitrateController, i](const AbstractPack::ptr& pack)
+        {
+            if (bitrateController)
+            {
+                bitrateController->OnPacket(pack->GetSize());
+            }
+            writer->Write(pack->GetData(0), pack->GetSize());
+            MMP_LOG_INFO << "Write " << i << " address is: " << pack->GetData(0) << " , size is: " << pack->GetSize();
+        }, [writer]()
+        {
+            writer->Close();
+        }, true));
+        /*********************************** 文件写入(End) ******************************/
+    }
 
-    running = false;
-    while (!sync)
+    MMP_LOG_INFO << "Transcode Start";
+    uint64_t startNs = FrameClock::NowNs();
+    pipeline.Start();
+    for (size_t i=0; i<writerDones.size(); i++)
+    {
+        writerDones[i].wait();
+        MMP_LOG_INFO << "Rendition " << i << " written, cost : " << (FrameClock::NowNs() - startNs) / 1000000 << " ms";
+    }
+    pipeline.Wait();
+    MMP_LOG_INFO << "Transcode End";
+    if (realtime)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        MMP_LOG_INFO << scheduler.Report();
+    }
+    MMP_LOG_INFO << pipeline.Report();
+    MMP_LOG_INFO << "Decoder " << decoderStats->Report();
+    MMP_LOG_INFO << reorderQueue.Report();
+    MMP_LOG_INFO << decodeShedder.Report();
+    for (size_t i=0; i<encoderStats.size(); i++)
+    {
+        MMP_LOG_INFO << "Encoder " << i << " " << encoderStats[i]->Report();
+        MMP_LOG_INFO << "Encoder " << i << " " << encodeShedders[i]->Report();
+        if (bitrateControllers[i])
+        {
+            MMP_LOG_INFO << "Encoder " << i << " " << bitrateControllers[i]->Report();
+        }
+    }
+    // Hint : 边在关闭后仍可取出剩余数据, 各路队列在 EOS 时应已取空, 且编码器的输出全部写出
+    bool drained = FrameCountMatch(decoderStats->pushedNum, decoderStats->poppedNum);
+    if (decoderStats->poppedNum != decoderStats->pushedNum)
+    {
+        MMP_LOG_WARN << "Decoder output " << decoderStats->poppedNum << " of " << decoderStats->pushedNum << " frames";
+    }
+    for (size_t i=0; i<renditionFrames.size(); i++)
+    {
+        uint32_t undelivered = renditionFrames[i]->Size() + encoderStats[i]->Inflight();
+        if (undelivered != 0 && !renditionFrames[i]->IsAborted())
+        {
+            MMP_LOG_WARN << "Encoder " << i << " dropped " << undelivered << " frames at EOS";
+            drained = false;
+        }
+    }
+    MMP_LOG_INFO << WorkStealingExecutor::Instance()->Report();
+    MMP_LOG_INFO << AsyncFileIo::Instance()->Report();
+    MMP_LOG_INFO << ThreadPlacement::Instance()->Report();
+    {
+        uint32_t fpsNum = 0, fpsDen = 0;
+        bool fromStream = byteReader->GetFrameRate(fpsNum, fpsDen);
+        MMP_LOG_INFO << "-- source frame rate is: " << fpsNum << "/" << fpsDen << (fromStream ? " (VUI)" : " (default)");
     }
 
     decoder->Stop();
     decoder->Uninit();
-    encoder->Stop();
-    encoder->Uninit();
+    for (auto& rendition : renditions)
+    {
+        rendition->encoder->Stop();
+        rendition->encoder->Uninit();
+    }
 
-    return 0;
+    return drained ? 0 : -1;
 }
 
 /********************************************************* TEST(END) *****************************************************/